@@ -21,6 +21,55 @@ namespace Color {
 	const std::string VIOLET  = "\033[38;5;129m";
 }
 
+// Inbound flood control defaults (override in config.txt)
+namespace Flood
+{
+	const int BURST                 = 20;   // bucket capacity, in tokens
+	const int RATE                  = 5;    // tokens regained per second
+	const int MAX_STRIKES           = 5;    // throttle episodes before Excess Flood
+	const int COST_DEFAULT          = 1;
+	const int COST_UNKNOWN          = 2;
+	const int THROTTLED_POLL_MS     = 100;  // poll() timeout while someone is throttled
+	const int LINGER_SECONDS        = 2;    // an Excess Flood ERROR's time to be read
+}
+
+// Listener defaults (override in config.txt)
+namespace Net
+{
+	const int LISTEN_BACKLOG        = 4096;  // clamped by the kernel to somaxconn
+	const int ACCEPT_BATCH          = 1024;  // max accepts per POLLIN on the listener
+	const int FD_HEADROOM           = 32;    // fds kept for listener, logs, reserve...
+	const int MAX_FDS               = 1048576;  // cap for an unlimited RLIMIT_NOFILE
+	const int RESUME_GRACE          = 60;    // seconds a lost session waits for RESUME
+}
+
+// Event loop fairness defaults (override in config.txt)
+namespace Sched
+{
+	const int QUANTUM_LINES         = 16;   // lines run per client per loop iteration
+	const int SENDQ_BYTES           = 1048576;  // max queued output per client
+	const int WORKERS               = 1;    // event loop threads (shards)
+	const int FANOUT_THRESHOLD      = 4096; // members from which fan-out goes parallel
+	const int FANOUT_CHUNK          = 1024; // members per fan-out chunk
+	const int BROADCAST_BATCH       = 512;  // clients a shard catches up per iteration
+	const int REPLY_CHUNK           = 4096; // bytes of pooled command output posted at once
+	const int MIGRATE_BATCH         = 512;  // clients a shard checks for migration per iteration
+	const int MIGRATE_VOTES_MAX     = 1 << 20;  // cap on a client's affinity votes
+}
+
+// Channel history defaults (override in config.txt)
+namespace History
+{
+	const int LINES                 = 50;    // lines kept per channel, 0 keeps none
+	const int BYTES                 = 8192;  // arena size per channel
+	const int JOIN_LINES            = 0;     // lines played on JOIN
+	const int LOG_SEGMENT_BYTES     = 16 << 20;  // message log segment size
+	const int LOG_INDEX_BYTES       = 4096;  // segment bytes between index entries
+	const int LOG_QUEUE_BYTES       = 16 << 20;  // lines waiting for the disk, beyond dropped
+	const int SEARCH_BYTES          = 32 << 20;  // search index of the log, 0 for none
+	const int SEARCH_RESULTS        = 20;    // lines a SEARCH returns
+}
+
 namespace IRC
 {
 	// Welcome messages (001-004)
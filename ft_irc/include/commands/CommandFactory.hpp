@@ -4,6 +4,8 @@
 #include <map>
 #include <string>
 
+#include "General.hpp"
+
 // Forward declarations
 class ACommand;
 class Client;
@@ -16,6 +18,8 @@ private:
 	// Map of command names to their corresponding creator functions
 	typedef ACommand* (*CommandCreator)(Server* server);
 	static std::map<std::string, CommandCreator> _commandCreators;
+	// Flood control cost of each command, in tokens
+	static std::map<std::string, int> _commandCosts;
 
 	// Private to prevent instantiation and copy
 	CommandFactory();
@@ -23,18 +27,22 @@ private:
 	CommandFactory& operator=(const CommandFactory& other);
 	~CommandFactory();
 
-	static void initializeCommands();
 	static bool _initialized;
 
 public:
+	// Fill the command tables; done once before any thread looks them up
+	static void initializeCommands();
 	// Create a command based on the message
 	static ACommand* createCommand(const std::string& commandName, Server* server);
 	// Execute the appropriate command based on the message
 	static void executeCommand(Client* client, Server* server, const Message& message);
 	// Register a new command creator
-	static void registerCommand(const std::string& commandName, CommandCreator creator);
+	static void registerCommand(const std::string& commandName, CommandCreator creator,
+								int cost = Flood::COST_DEFAULT);
 	// Check if a command exists
 	static bool commandExists(const std::string& commandName);
+	// Flood control cost of a command (unknown commands cost a bit more)
+	static int getCommandCost(const std::string& commandName);
 };
 
 #endif
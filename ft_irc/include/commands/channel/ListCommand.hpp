@@ -2,6 +2,8 @@
 #define LISTCOMMAND_HPP
 
 #include "ACommand.hpp"
+#include "ChannelDirectory.hpp"
+#include "CommandPool.hpp"
 #include <map>
 
 class Server;
@@ -17,9 +19,10 @@ private:
 	ListCommand& operator=(const ListCommand& other);
 
 	// Helper methods
-	void listAllChannels(Client* client, std::map<std::string, Channel*>& channels);
-	void listSpecificChannels(Client* client, std::map<std::string, Channel*>& channels, const std::string& channelList);
-	void sendChannelInfo(Client* client, Channel* channel);
+	class Task;  // renders the listing, in the command pool if there is one
+	static void listAllChannels(CommandPool::Reply& reply, const ChannelDirectory::Snapshot* channels);
+	static void listSpecificChannels(CommandPool::Reply& reply, const ChannelDirectory::Snapshot* channels, const std::vector<std::string>& requestedChannels);
+	static void sendChannelInfo(CommandPool::Reply& reply, const ChannelDirectory::View* channel);
 
 public:
 	ListCommand(Server* server);
@@ -1,6 +1,8 @@
 #ifndef CAP_COMMAND_HPP
 #define CAP_COMMAND_HPP
 
+#include <string>
+
 #include "ACommand.hpp"
 
 class Client;
@@ -14,6 +16,8 @@ private:
 	CapCommand(const CapCommand& other);
 	CapCommand& operator=(const CapCommand& other);
 
+	bool request(Client* client, const std::string& wanted);
+
 public:
 	CapCommand(Server* server);
 	virtual ~CapCommand();
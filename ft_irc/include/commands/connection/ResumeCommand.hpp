@@ -0,0 +1,28 @@
+#ifndef RESUME_COMMAND_HPP
+#define RESUME_COMMAND_HPP
+
+#include "ACommand.hpp"
+
+class Client;
+class Server;
+class Message;
+
+class ResumeCommand : public ACommand
+{
+private:
+	// Private to prevent copying
+	ResumeCommand(const ResumeCommand& other);
+	ResumeCommand& operator=(const ResumeCommand& other);
+
+public:
+	ResumeCommand(Server* server);
+	virtual ~ResumeCommand();
+
+	// Execute the RESUME command
+	virtual void execute(Client* client, const Message& message);
+
+	// Static creator for factory
+	static ACommand* create(Server* server);
+};
+
+#endif
\ No newline at end of file
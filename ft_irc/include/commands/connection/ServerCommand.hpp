@@ -0,0 +1,29 @@
+#ifndef SERVER_COMMAND_HPP
+#define SERVER_COMMAND_HPP
+
+#include "ACommand.hpp"
+
+class Client;
+class Server;
+class Message;
+
+// SERVER <name> <link password>: another server links in, see Network
+class ServerCommand : public ACommand
+{
+private:
+	// Private to prevent copying
+	ServerCommand(const ServerCommand& other);
+	ServerCommand& operator=(const ServerCommand& other);
+
+public:
+	ServerCommand(Server* server);
+	virtual ~ServerCommand();
+
+	// Execute the SERVER command
+	virtual void execute(Client* client, const Message& message);
+
+	// Static creator for factory
+	static ACommand* create(Server* server);
+};
+
+#endif
\ No newline at end of file
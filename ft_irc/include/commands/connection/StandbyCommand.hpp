@@ -0,0 +1,29 @@
+#ifndef STANDBY_COMMAND_HPP
+#define STANDBY_COMMAND_HPP
+
+#include "ACommand.hpp"
+
+class Client;
+class Server;
+class Message;
+
+// STANDBY <journal password>: a standby follows this server, see Journal
+class StandbyCommand : public ACommand
+{
+private:
+	// Private to prevent copying
+	StandbyCommand(const StandbyCommand& other);
+	StandbyCommand& operator=(const StandbyCommand& other);
+
+public:
+	StandbyCommand(Server* server);
+	virtual ~StandbyCommand();
+
+	// Execute the STANDBY command
+	virtual void execute(Client* client, const Message& message);
+
+	// Static creator for factory
+	static ACommand* create(Server* server);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,45 @@
+#ifndef CHATHISTORY_COMMAND_HPP
+#define CHATHISTORY_COMMAND_HPP
+
+#include <string>
+#include <vector>
+
+#include "ACommand.hpp"
+#include "CommandPool.hpp"
+#include "HistoryRing.hpp"
+
+class Client;
+class Server;
+class Message;
+
+// IRCv3 draft/chathistory over the channel history rings: LATEST, BEFORE,
+// AFTER and BETWEEN, with timestamp= references (no msgid, messages have none).
+// What the ring no longer holds comes from the message log, if there is one.
+class ChathistoryCommand : public ACommand
+{
+private:
+	ChathistoryCommand(const ChathistoryCommand& other);
+	ChathistoryCommand& operator=(const ChathistoryCommand& other);
+
+	class Task;  // reads the message log, in the command pool if there is one
+	void fail(Client* client, const std::string& code, const std::string& context,
+			  const std::string& description) const;
+
+public:
+	ChathistoryCommand(Server* server);
+	virtual ~ChathistoryCommand();
+
+	virtual void execute(Client* client, const Message& message);
+
+	static ACommand* create(Server* server);
+	// Send history lines of a channel, wrapped and tagged as the client's
+	// capabilities allow; also used for the playback on JOIN
+	static void replay(Client* client, const std::string& target,
+					   const std::vector<HistoryRing::Line>& lines);
+	static std::string render(int caps, const std::string& target,
+							  const std::vector<HistoryRing::Line>& lines);
+	static std::string formatTime(unsigned long time);
+	static bool parseTime(const std::string& text, unsigned long& time);
+};
+
+#endif
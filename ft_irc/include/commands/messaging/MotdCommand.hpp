@@ -13,8 +13,6 @@ private:
 	MotdCommand(const MotdCommand& other);
 	MotdCommand& operator=(const MotdCommand& other);
 
-    void    sendLocalMessage(Client* client) const;
-
 public:
 	MotdCommand(Server* server);
 	virtual ~MotdCommand();
@@ -0,0 +1,33 @@
+#ifndef SEARCH_COMMAND_HPP
+#define SEARCH_COMMAND_HPP
+
+#include <string>
+
+#include "ACommand.hpp"
+#include "CommandPool.hpp"
+
+class Client;
+class Server;
+class Message;
+
+// SEARCH <#channel> <words>: the latest lines of a channel holding all the
+// words, from the search index of the message log. Members only; each line
+// comes back as a server NOTICE with its time and author.
+class SearchCommand : public ACommand
+{
+private:
+	SearchCommand(const SearchCommand& other);
+	SearchCommand& operator=(const SearchCommand& other);
+
+	class Task;  // index lookup and reads, in the command pool if there is one
+
+public:
+	SearchCommand(Server* server);
+	virtual ~SearchCommand();
+
+	virtual void execute(Client* client, const Message& message);
+
+	static ACommand* create(Server* server);
+};
+
+#endif
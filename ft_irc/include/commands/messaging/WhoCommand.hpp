@@ -2,6 +2,8 @@
 #define WHO_COMMAND_HPP
 
 #include "ACommand.hpp"
+#include "ChannelDirectory.hpp"
+#include "CommandPool.hpp"
 
 class Client;
 class Server;
@@ -15,9 +17,10 @@ private:
 	WhoCommand(const WhoCommand& other);
 	WhoCommand& operator=(const WhoCommand& other);
 
-	void listChannelUsers(Client* client, const std::string& channelName);
-	void listSpecificUser(Client* client, const std::string& nickname);
-	void sendWhoReply(Client* client, Client* targetClient, const std::string& channel);
+	class Task;  // renders a channel's users, in the command pool if there is one
+	static void listChannelUsers(CommandPool::Reply& reply, const ChannelDirectory::Snapshot* channels, const std::string& channelName);
+	void listSpecificUser(CommandPool::Reply& reply, const std::string& nickname);
+	static void sendWhoReply(CommandPool::Reply& reply, const ChannelDirectory::Member& target, const std::string& channel);
 	
 public:
 	WhoCommand(Server* server);
@@ -5,7 +5,10 @@
 #include <string>
 #include <set>
 
-class Client;
+#include "Client.hpp"
+#include "HistoryRing.hpp"
+
+class ChannelDirectory;
 
 class Channel
 {
@@ -22,9 +25,16 @@ private:
 	bool _hasUserLimit;
 	size_t _userLimit;
 	std::set<std::string> _invitedUsers;
+	ChannelDirectory* _directory;  // told about changes LIST/WHO/WHOIS show
+	int _homeShard;                // shard its members gather on, -1 if they don't
+	std::map<Client*, int> _links; // server links with members behind, and how many
+	bool _held;                    // kept while empty, see Journal::takeOver
+	HistoryRing _history;          // last lines said, for CHATHISTORY
+
+	void touch();
 
 public:
-	Channel(const std::string& name);
+	Channel(const std::string& name, ChannelDirectory* directory = NULL);
 	~Channel();
 
 	// Getters
@@ -64,10 +74,19 @@ public:
 	void removeUserLimit();
 
 	// Broadcasting
-	void broadcast(const std::string& message, int excludeFd = -1);
+	// State changes stay on the control lane, chatter goes on the bulk one
+	void broadcast(const std::string& message, int excludeFd = -1,
+				   Client::Lane lane = Client::LANE_CONTROL);
+	int getHomeShard() const;
+	void setHomeShard(int shard);
+	const std::map<Client*, int>& getLinks() const;
+	void record(const std::string& line);
+	HistoryRing& getHistory();
 
 	// Utility
 	bool isEmpty() const;
+	bool isHeld() const;
+	void setHeld(bool held);
 
 	void addInvitedUser(const std::string& nickname);
 	void removeInvitedUser(const std::string& nickname);
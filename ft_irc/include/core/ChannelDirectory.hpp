@@ -0,0 +1,114 @@
+#ifndef CHANNELDIRECTORY_HPP
+#define CHANNELDIRECTORY_HPP
+
+#include <map>
+#include <set>
+#include <string>
+
+#include "Mutex.hpp"
+
+class Channel;
+
+// Read-copy-update view of the channels for LIST, WHO and WHOIS.
+// Channels mark themselves dirty when their members, operators or topic
+// change, which only costs a set insert. The next reader rebuilds the views
+// of the dirty channels and publishes a new snapshot. The index is cut into
+// buckets by name hash: the new snapshot copies the buckets that hold a
+// changed channel and shares every other bucket, and every other view, with
+// the previous one. A published snapshot never changes: it can
+// be iterated without any lock while JOIN and PART carry on, for as long as
+// the reader stays inside its epoch guard, or past it with acquire().
+// Old snapshots go to Epoch.
+class ChannelDirectory
+{
+public:
+	struct Member
+	{
+		std::string nick;
+		std::string user;
+		bool op;
+	};
+
+	// One channel as it was at publication
+	struct View
+	{
+		std::string name;
+		std::string topic;
+		std::map<unsigned long, Member> members;  // by client id
+		mutable int refs;                         // snapshots sharing it
+	};
+
+	typedef std::map<std::string, const View*> Views;  // by casefolded name
+
+	// One slice of the index
+	struct Bucket
+	{
+		Views channels;
+		mutable int refs;  // snapshots sharing it
+	};
+
+	static const size_t BUCKETS = 256;
+
+	struct Snapshot
+	{
+		const Bucket* buckets[BUCKETS];  // by hash of the casefolded name
+		size_t count;                    // channels in all of them
+		mutable int refs;                // 1 while published, plus acquire() holders
+
+		// Every channel, bucket after bucket
+		class const_iterator
+		{
+		private:
+			const Snapshot* _snapshot;
+			size_t _bucket;
+			Views::const_iterator _it;
+
+			void skipEmpty();
+
+		public:
+			const_iterator(const Snapshot* snapshot, size_t bucket);
+
+			const Views::value_type& operator*() const { return (*_it); }
+			const Views::value_type* operator->() const { return (&*_it); }
+			const_iterator& operator++();
+			bool operator==(const const_iterator& other) const;
+			bool operator!=(const const_iterator& other) const { return (!(*this == other)); }
+		};
+
+		const_iterator begin() const { return (const_iterator(this, 0)); }
+		const_iterator end() const { return (const_iterator(this, BUCKETS)); }
+		size_t size() const { return (count); }
+		const View* find(const std::string& name) const;
+	};
+
+private:
+	Snapshot* _current;
+	Mutex _dirtyLock;
+	std::set<Channel*> _dirty;         // changed since the last snapshot
+	std::set<std::string> _removed;    // casefolded names of deleted channels
+	int _pending;                      // anything in the two sets above
+
+	static size_t bucketOf(const std::string& folded);
+	static View* render(Channel* channel);
+	static void releaseView(const View* view);
+	static void releaseBucket(const Bucket* bucket);
+	static void unpublish(void* snapshot);
+
+	ChannelDirectory(const ChannelDirectory& other);  // private to prevent copies
+	ChannelDirectory& operator=(const ChannelDirectory& other);
+
+public:
+	ChannelDirectory();
+	~ChannelDirectory();
+
+	void markDirty(Channel* channel);
+	void markRemoved(Channel* channel);
+
+	// Latest snapshot, rebuilt first if channels changed. Rebuilding reads
+	// the live channels, so call it where commands run.
+	const Snapshot* snapshot();
+	const Snapshot* acquire();  // same, kept alive until release()
+	static void release(const Snapshot* snapshot);
+};
+
+#endif
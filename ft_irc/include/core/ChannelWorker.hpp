@@ -0,0 +1,60 @@
+#ifndef CHANNELWORKER_HPP
+#define CHANNELWORKER_HPP
+
+#include <pthread.h>
+
+#include "MpscQueue.hpp"
+#include "Mutex.hpp"
+
+class Client;
+class Message;
+class Server;
+
+// Channel actor of the pipelined mode (channel_threads). Channels are split
+// between the workers by name, and PRIVMSG/NOTICE/TOPIC/MODE for a channel
+// run on its owner, in the order the logic thread routed them, so busy
+// channels in different partitions fan out in parallel.
+// A worker holds its partition lock while it runs a task; the logic thread
+// takes every partition lock for the commands it runs itself.
+class ChannelWorker
+{
+private:
+	struct Task
+	{
+		Client* client;
+		Message* message;  // deleted once executed
+	};
+
+	Server* _server;
+	int _id;
+	pthread_t _thread;
+	bool _threaded;
+	volatile bool _stopping;
+
+	MpscQueue<Task> _queue;
+	int _wakePipe[2];
+	int _sleeping;  // set while the worker may block in poll()
+	Mutex _partitionLock;
+
+	void run();
+	void runTasks();
+	void wake();
+	static void* threadMain(void* arg);
+
+	ChannelWorker(const ChannelWorker& other);  // private to prevent copies
+	ChannelWorker& operator=(const ChannelWorker& other);
+
+public:
+	ChannelWorker(Server* server, int id);
+	~ChannelWorker();
+
+	bool start();
+	void stop();  // runs what is still queued, then joins
+
+	// Called by the logic thread
+	void post(Client* client, Message* message);
+	void lock();
+	void unlock();
+};
+
+#endif
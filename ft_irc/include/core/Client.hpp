@@ -1,27 +1,104 @@
 #ifndef CLIENT_HPP
 #define CLIENT_HPP
 
+#include <ctime>
 #include <string>
 
+#include "Socket.hpp"
+#include "TokenBucket.hpp"
 #include "UtilsFun.hpp"
 
 class Print;
+class Shard;
+class ZStream;
 
+// Everything the server keeps per connection lives here, so an idle client
+// costs one Client allocation and one map node. Idle buffers hold no heap.
 class Client
 {
+public:
+	// Outbound lanes: control is always flushed before bulk
+	enum Lane
+	{
+		LANE_CONTROL,  // numerics, PONG, ERROR, direct replies
+		LANE_BULK      // relayed PRIVMSG/NOTICE and channel chatter
+	};
+	static const unsigned long ALL_BROADCASTS = ~0UL;
+	// IRCv3 capabilities taken with CAP REQ
+	enum Cap
+	{
+		CAP_BATCH = 1,
+		CAP_SERVER_TIME = 2,
+		CAP_CHATHISTORY = 4,
+		CAP_RESUME = 8
+	};
+
 private:
 	int _fd;
+	unsigned long _id;         // unique for the process lifetime, unlike fds
+	Shard* _shard;             // event loop that owns the connection
+	Socket _socket;            // owns the fd, closed on disconnect or deletion
+	std::string _inputBuffer;  // partial lines received but not yet run
 	std::string _nickname;
 	std::string _username;
 	bool _authenticated;
 	bool _isBot;
+	int _caps;          // Cap bits
+	// Server links, see Network
+	bool _isLink;       // the connection is another server
+	bool _isJournalStream;  // a link to a standby or its primary, see Journal
+	Client* _route;     // user of another server: the link it is behind
+	bool _announced;    // local user the other servers know about
+	time_t _nickTs;     // when the nick was taken, settles nick collisions
+	int _disconnect;    // set by the state side, the shard drops the client
+	int _detached;      // connection lost, session kept, see SessionStore
+	// Link transport, owned by the shard: once the link is up, whatever a
+	// flush finds queued goes out as one deflated frame
+	int _compressLevel;  // set by the state side, 0 keeps sending lines
+	ZStream* _deflater;
+	ZStream* _inflater;     // made on the first frame received
+	std::string _linkIn;    // link input not decoded yet
+	std::string _frameOut;  // frames waiting for the socket
+	size_t _frameOffset;
+	int _channelTasks;  // commands queued on channel workers, see ChannelWorker
+	int _channelWaiter; // set while the logic thread waits for the last one
+	bool _offloaded;    // a CommandPool or log read is answering, input waits
+	// Channel affinity: majority vote over the home shards of the channel
+	// traffic the client takes part in, see Shard::rebalanceClients
+	int _affinityShard;
+	int _affinityVotes;
+	unsigned long _broadcastSeq;  // last server-wide broadcast queued here
+
+	// Inbound flood control
+	TokenBucket _floodBucket;
+	bool _throttled;
+	int _floodStrikes;
+
+	// Outbound queue, one string of complete lines per lane
+	std::string _controlOut;
+	std::string _bulkOut;
+	size_t _controlOffset;  // bytes of _controlOut already written
+	size_t _bulkOffset;     // bytes of _bulkOut already written
+	bool _writeError;
+
+	static void compactLane(std::string& lane, size_t& offset);
+	void packFrame();
+
+	// Not implemented: a client owns its socket
+	Client(const Client& other);
+	Client& operator=(const Client& other);
 
 public:
-	Client(int fd);
+	Client(int fd, double floodBurst, double floodRate);
 	~Client();
 
 	int getFd() const;
+	unsigned long getId() const;
 	std::string getFdString() const;
+	Shard* getShard() const;
+	void setShard(Shard* shard);
+	std::string& getInputBuffer();
+	void releaseInputBuffer();
 
 	const std::string& getNickname() const;
 	void setNickname(const std::string& nickname);
@@ -30,9 +107,63 @@ public:
 	bool isAuthenticated() const;
 	bool isBot();
 	void setAuthenticated(bool auth);
+	bool hasCap(Cap cap) const;
+	int getCaps() const;
+	void setCaps(int caps);
+
+	bool isLink() const;
+	void setLink(bool link);
+	bool isJournalStream() const;
+	void setJournalStream(bool stream);
+	bool isRemote() const;
+	Client* getRoute() const;
+	void setRoute(Client* link);
+	bool isAnnounced() const;
+	void setAnnounced(bool announced);
+	time_t getNickTs() const;
+	void setNickTs(time_t ts);
+	void requestDisconnect();
+	bool isDisconnectRequested() const;
+	bool isDetached() const;
+	void setDetached(bool detached);
+	bool reattach(int fd, Shard* shard);
+	void setCompression(int level);
+	bool receiveLink(const char* data, size_t length);
 
-	bool sendMessage(const std::string& message);
+	bool sendMessage(const std::string& message, Lane lane = LANE_CONTROL);
+	// broadcasts: server-wide broadcasts issued before the message, they are
+	// queued ahead of it. The default means all of them so far.
+	bool queueOutput(const std::string& message, Lane lane,
+					 unsigned long broadcasts = ALL_BROADCASTS);
+	bool appendOutput(const std::string& message, Lane lane,
+					  unsigned long broadcasts = ALL_BROADCASTS);
+	bool scheduleFlush();
+	unsigned long getBroadcastSeq() const;
+	void setBroadcastSeq(unsigned long seq);
+	bool flush();
+	void closeSocket();
+	bool hasPendingOutput() const;
+	size_t getQueuedBytes() const;
+	bool hasWriteError() const;
+	std::string takePendingOutput(bool wholeLines = false);
 	void setBot(bool status);
+
+	void beginChannelTask();
+	bool endChannelTask();
+	bool hasChannelTasks() const;
+	bool waitChannelTasks();
+	bool isOffloaded() const;
+	void setOffloaded(bool offloaded);
+	void noteChannelTraffic(int homeShard);
+	int getAffinityShard() const;
+	int getAffinityVotes() const;
+	void resetAffinity();
+
+	TokenBucket& getFloodBucket();
+	bool isThrottled() const;
+	void setThrottled(bool throttled);
+	int addFloodStrike();
+	void resetFloodStrikes();
 };
 
 #endif
@@ -0,0 +1,103 @@
+#ifndef COMMANDPOOL_HPP
+#define COMMANDPOOL_HPP
+
+#include <pthread.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "Mutex.hpp"
+
+class Client;
+class Shard;
+
+// Work-stealing pool for expensive read-only commands (command_threads):
+// LIST and WHO on a channel. The command checks its arguments on the event loop and hands a Task
+// that renders the replies to the pool. Tasks only read immutable data
+// (directory snapshots, files on disk), never live clients or channels.
+// Each pool thread has its own deque: it takes its oldest task first and,
+// once out of work, steals the newest task of another thread.
+// Replies reach the client through its shard's mailbox, a chunk at a time.
+// The client runs no further command until the last chunk is queued, so
+// its replies keep their order.
+// Without a pool (or in pipelined mode) tasks run inline.
+class CommandPool
+{
+public:
+	// Where a task writes its replies
+	class Reply
+	{
+	private:
+		Client* _client;  // set when running inline
+		Shard* _shard;
+		int _fd;
+		unsigned long _clientId;
+		std::string _nick;
+		std::string _pending;
+
+		void flush(bool last);
+
+	public:
+		Reply(Client* client, bool streamed);
+
+		void numeric(int code, const std::string& message);
+		void line(const std::string& text);  // complete lines, sent as they are
+		void finish();  // last chunk; a streamed client runs commands again
+	};
+
+	class Task
+	{
+	public:
+		virtual ~Task();
+		virtual void run(Reply& reply) = 0;
+	};
+
+private:
+	struct Queued
+	{
+		Task* task;
+		Reply reply;
+
+		Queued(Task* task, const Reply& reply);
+	};
+
+	struct Worker
+	{
+		CommandPool* pool;
+		size_t id;
+		pthread_t thread;
+		Mutex lock;
+		std::deque<Queued*> tasks;
+	};
+
+	std::vector<Worker*> _workers;
+	Mutex _idleLock;
+	Condition _wakeup;
+	size_t _queued;  // tasks waiting in any deque
+	unsigned long _next;
+	bool _stopping;
+
+	static CommandPool* s_installed;
+
+	void submit(Queued* queued);
+	Queued* take(Worker& self);
+	void work(Worker& self);
+	static void* threadMain(void* arg);
+
+	CommandPool(const CommandPool& other);  // private to prevent copies
+	CommandPool& operator=(const CommandPool& other);
+
+public:
+	CommandPool();
+	~CommandPool();
+
+	bool start(int threads);
+	void stop();
+	static void install(CommandPool* pool);  // pool used by run(), or NULL
+
+	// Run a task for a client, in the pool if there is one. Takes ownership.
+	static void run(Client* client, Task* task);
+};
+
+#endif
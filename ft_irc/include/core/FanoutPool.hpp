@@ -0,0 +1,74 @@
+#ifndef FANOUTPOOL_HPP
+#define FANOUTPOOL_HPP
+
+#include <pthread.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Client.hpp"
+#include "Mutex.hpp"
+#include "SharedBuffer.hpp"
+
+class Shard;
+
+// Parallel fan-out for large channels (fanout_threads). The members are cut
+// into chunks that the pool threads and the calling thread take in turn,
+// and the caller only returns once every chunk is queued: fan-outs never
+// overlap, so each recipient still gets messages in order.
+// Clients of the caller's own shard get the message appended directly,
+// since their shard is the thread waiting. The others get one mailbox
+// batch per shard and chunk, all sharing the same rendered buffer.
+// Below the threshold, or without a pool, the fan-out stays inline.
+class FanoutPool
+{
+private:
+	struct Job
+	{
+		std::vector<Client*> recipients;
+		SharedBuffer message;
+		Client::Lane lane;
+		Shard* owner;  // shard of the calling thread, or NULL
+		int homeShard; // voted for by every recipient, -1 for no vote
+		size_t chunkSize;
+		size_t chunks;
+		size_t nextChunk;   // claimed with an atomic add
+		size_t doneChunks;
+		int helpers;        // pool threads still holding the job
+		std::vector<std::vector<Client*> > woken;  // per chunk, see runChunk
+	};
+
+	std::vector<pthread_t> _threads;
+	size_t _threshold;
+	size_t _chunkSize;
+	Mutex _lock;
+	Condition _wakeup;
+	Job* _job;  // job on offer, NULL while the pool is idle
+	unsigned long _generation;
+	bool _stopping;
+
+	static FanoutPool* s_installed;
+
+	void work();
+	void runParallel(Job& job);
+	static void runChunks(Job& job);
+	static void runChunk(Job& job, size_t chunk);
+	static void* threadMain(void* arg);
+
+	FanoutPool(const FanoutPool& other);  // private to prevent copies
+	FanoutPool& operator=(const FanoutPool& other);
+
+public:
+	FanoutPool(size_t threshold, size_t chunkSize);
+	~FanoutPool();
+
+	bool start(int threads);
+	void stop();
+	static void install(FanoutPool* pool);  // pool used by deliver(), or NULL
+
+	static void deliver(const std::map<int, Client*>& members, const std::string& message,
+						int excludeFd, Client::Lane lane, int homeShard = -1);
+};
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+#include <set>
+#include <string>
+
+#include "Mutex.hpp"
+
+class Channel;
+class Client;
+class Message;
+class Server;
+
+// Hot standby (journal_password, standby_of). A standby ircserv connects
+// to its primary with STANDBY. It gets a snapshot of the state, then every
+// change as an ordered, numbered record:
+//   <seq> USER|NICK|QUIT ...           users of the primary
+//   <seq> CHANNEL|TOPIC|HOLD ...       a channel's modes, topic, holding
+//   <seq> JOIN|PART|KICK|MODE|INVITE   what happens in it
+// The standby applies the records to its own Server state, with socketless
+// Clients (negative fds) standing in for the primary's users. It doesn't
+// listen. Once the primary can't be reached, it drops the stand-ins and
+// opens the listener, keeping the channels with their topics and modes.
+// Those channels are held while empty, and the first to join gets op.
+// Only the primary's own users are journaled. For a channel shared with
+// other servers, its modes and topic are, but not the remote members.
+class Journal
+{
+private:
+	Server* _server;
+	std::string _password;  // journal_password, asked of a standby
+	std::string _primary;   // standby_of, empty once serving
+	Mutex _lock;            // record order, channel workers record too
+	unsigned long _seq;     // last record sent, or applied on a standby
+	bool _syncing;          // standby: between RESET and SYNC
+	std::set<Client*> _standbys;            // primary: connections to feed
+	Client* _upstream;                      // standby: connection to the primary
+	std::set<Client*> _users;               // standby: the stand-ins
+	int _nextFd;                            // pseudo fds of the stand-ins, below
+	                                        // the ones Network gives remote users
+
+	static bool isJournaled(Client* client);
+	static bool isKnown(Channel* channel, Client* except);
+	static std::string modeLine(Channel* channel);
+	static std::string member(Channel* channel, Client* client);
+	bool isRecording() const;
+	void record(const std::string& line);
+	void recordChannel(Channel* channel);
+	void sendSnapshot(Client* standby);
+
+	// Standby side
+	bool connect();
+	void apply(const Message& body);
+	void applyChannel(const Message& body);
+	Client* standIn(const std::string& nick);
+	void dropUser(Client* user);
+	void reset();
+	void takeOver();
+
+	Journal(const Journal& other);  // private to prevent copies
+	Journal& operator=(const Journal& other);
+
+public:
+	Journal(Server* server);
+	~Journal();
+
+	void setup();  // reads the config, a standby dials its primary
+	bool isStandby() const;
+
+	// The stream, from either side
+	void acceptStandby(Client* client, const std::string& password);
+	void handleLine(Client* client, const Message& message);
+	void dropStream(Client* client);
+
+	// Primary side: state changes, where they happen
+	void userRegistered(Client* client);
+	void userNick(Client* client, const std::string& oldNick);
+	void userQuit(Client* client);
+	void channelJoin(Channel* channel, Client* client);
+	void channelPart(Channel* channel, Client* client, bool kicked);
+	void channelModes(Channel* channel, const std::string& modes);
+	void channelTopic(Channel* channel);
+	void channelInvite(Channel* channel, const std::string& nick);
+
+	// Upgrade: the numbering and the standbys go to the next process
+	unsigned long getSeq() const;
+	void resumeSeq(unsigned long seq);
+	void resumeStandby(Client* client);
+};
+
+#endif
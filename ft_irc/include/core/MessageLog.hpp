@@ -0,0 +1,130 @@
+#ifndef MESSAGELOG_HPP
+#define MESSAGELOG_HPP
+
+#include <pthread.h>
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "CommandPool.hpp"
+#include "HistoryRing.hpp"
+#include "Mutex.hpp"
+
+class Client;
+class SearchIndex;
+
+// Channel traffic kept on disk beyond the history rings (log_dir). Every
+// line said in a channel is queued here, and a write-behind thread appends
+// it to the channel's current segment: the loops never wait for the disk,
+// and when the disk falls too far behind lines are dropped, not waited for.
+//   <log_dir>/<channel>/<first time, 16 digits>.log  "<time> <line>\r\n"...
+//   <log_dir>/<channel>/<first time, 16 digits>.idx  <time u64> <offset u64>...
+// A segment is closed past log_segment_bytes and the next line starts a
+// new one. The index gets an entry every log_index_bytes of its segment,
+// so a range query maps the segment and starts reading near its first line.
+// With search_index_bytes, the writer also indexes the words of every line
+// it writes (SearchIndex), after rebuilding the index from the files.
+// CHATHISTORY and SEARCH read the files on a reader thread of their own,
+// with or without a command pool, and answer like a CommandPool task.
+// Times are milliseconds since the epoch.
+class MessageLog
+{
+private:
+	struct Record
+	{
+		std::string channel;
+		unsigned long time;
+		std::string line;
+	};
+
+	struct Segment
+	{
+		int fd;
+		int indexFd;
+		std::string dir;
+		std::string name;    // file name without the extension
+		size_t size;         // bytes in the file, pending ones included
+		size_t indexed;      // size at the last index entry
+		std::string pending;
+		std::string pendingIndex;
+		unsigned long used;  // batch that last wrote to it
+	};
+
+	struct Read
+	{
+		CommandPool::Task* task;
+		CommandPool::Reply reply;
+
+		Read(CommandPool::Task* task, const CommandPool::Reply& reply);
+	};
+
+	std::string _dir;
+	size_t _segmentBytes;
+	size_t _indexBytes;
+	SearchIndex* _search;  // NULL without search_index_bytes
+	pthread_t _thread;
+	pthread_t _reader;
+	bool _started;
+
+	// Shared with the threads recording lines
+	Mutex _lock;
+	Condition _wakeup;
+	std::vector<Record> _queue;
+	size_t _queuedBytes;
+	unsigned long _dropped;
+	bool _stopping;
+	Condition _readWakeup;
+	std::deque<Read*> _reads;
+
+	// Writer thread only
+	std::map<std::string, Segment> _open;
+	unsigned long _batches;
+
+	static MessageLog* s_installed;
+
+	void work();
+	void serveReads();
+	void append(const Record& record);
+	Segment& segmentFor(const std::string& channel, unsigned long time);
+	void flush(Segment& segment);
+	void close(const std::string& channel);
+	void rebuild();
+	void index(const std::string& dir, const std::string& name, size_t offset,
+			   const char* data, size_t size);
+	static void* threadMain(void* arg);
+	static void* readerMain(void* arg);
+	static std::string channelDir(const std::string& dir, const std::string& channel);
+	static void scan(const std::string& path, unsigned long after, unsigned long before,
+					 size_t limit, bool newest, std::vector<HistoryRing::Line>& out);
+
+	MessageLog(const MessageLog& other);  // private to prevent copies
+	MessageLog& operator=(const MessageLog& other);
+
+public:
+	MessageLog(const std::string& dir, size_t segmentBytes, size_t indexBytes,
+			   size_t searchBytes);
+	~MessageLog();
+
+	bool start();
+	void stop();  // writes what is still queued, drops the reads
+	static void install(MessageLog* log);  // log used by write() and find(), or NULL
+	static bool isEnabled();
+	static bool isSearchable();
+
+	static void write(const std::string& channel, unsigned long time, const std::string& line);
+	// Run a task calling find() or search() on the reader thread, as
+	// CommandPool::run would. Takes ownership.
+	static void read(Client* client, CommandPool::Task* task);
+	// Same as HistoryRing::find, from the files; reads the disk, call it
+	// from a task given to read()
+	static void find(const std::string& channel, unsigned long after, unsigned long before,
+					 size_t limit, bool newest, std::vector<HistoryRing::Line>& out);
+	// Latest lines of the channel holding all the words, newest first,
+	// looked up in the index and read from their segments
+	static void search(const std::string& channel, const std::vector<std::string>& words,
+					   size_t limit, std::vector<HistoryRing::Line>& out);
+};
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef NETWORK_HPP
+#define NETWORK_HPP
+
+#include <ctime>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+class Channel;
+class Client;
+class Message;
+class Server;
+
+// Server-to-server links (server_name, link_password, link_connect).
+// The servers form a spanning tree: a link is a connection that sent
+// SERVER, and a server already on the network is never linked twice.
+// A new link first gets a burst of everything this side knows (servers,
+// users, channels with their modes, members and topics), then every change
+// as it happens.
+// Users of other servers are Clients without a socket (negative fds), found
+// by nick and in channels like everyone else, reached through their link.
+// Channel messages only go down the links with members behind them, state
+// changes go to every link but the one they came from: a line crosses each
+// link at most once.
+// A nick taken on both sides stays with the older holder, the younger is
+// killed (both on a tie). A lost link takes every user behind it along.
+// Lines for a link are not written one by one: its shard writes whatever
+// queued up during a loop iteration at once, and with link_compress that
+// batch goes out as one deflated frame (see Client::packFrame).
+// Everything here runs where commands run, with the state lock held.
+class Network
+{
+private:
+	struct Node
+	{
+		Client* route;  // link the server is behind
+		std::set<Client*> users;
+	};
+
+	Server* _server;
+	std::string _name;      // this server on the network
+	std::string _password;  // shared by every link, links are refused without it
+	int _compress;          // zlib level of what we send, 0 for plain lines
+	std::map<Client*, std::string> _links;    // link -> peer, empty until SERVER
+	std::map<std::string, Node> _nodes;       // every other server
+	std::map<Client*, std::string> _origins;  // remote user -> its server
+	int _nextFd;                              // pseudo fds of remote users
+
+	void connect(const std::string& peer);
+	void refuse(Client* client, const std::string& reason);
+	void sendBurst(Client* link);
+	std::string sjoinLine(Channel* channel, Client* except);
+	void forward(Client* except, const std::string& line);
+	void relayChannel(Channel* channel, const std::string& line, Client* except);
+
+	// Link lines, by verb
+	void addNode(Client* link, const Message& body, const std::string& line);
+	void removeNode(Client* link, const Message& body, const std::string& line);
+	void introduceUser(Client* link, const Message& body, const std::string& line);
+	void renameUser(Client* link, Client* user, const Message& body,
+					const std::string& line);
+	void killUser(Client* link, const Message& body);
+	void syncChannel(Client* link, const Message& body, const std::string& line);
+	void channelEvent(Client* link, Client* user, const std::string& verb,
+					  const Message& body, const std::string& line);
+	void routeMessage(Client* link, const Message& body, const std::string& line);
+
+	Client* remoteUser(Client* link, const std::string& prefix);
+	bool settleCollision(Client* link, Client* holder, const std::string& nick, time_t ts);
+	void kill(Client* user, const std::string& reason, Client* except);
+	void dropUser(Client* user, const std::string& quit);
+	void splitServer(const std::string& name, const std::string& reason);
+
+	Network(const Network& other);  // private to prevent copies
+	Network& operator=(const Network& other);
+
+public:
+	Network(Server* server);
+	~Network();
+
+	void setup(bool dial = true);  // reads the config and dials link_connect
+	bool isEnabled() const;
+	const std::string& getName() const;
+
+	// Link side: SERVER from a connection, then every line it sends
+	void acceptLink(Client* client, const std::string& name, const std::string& password);
+	void handleLine(Client* link, const Message& message);
+	void dropLink(Client* link);
+
+	// Local side: what this server's users do, for the other servers
+	void announceUser(Client* client);
+	void userNick(Client* client, const std::string& oldNick);
+	void userQuit(Client* client, const std::string& reason);
+	void channelCreated(Channel* channel);
+	void userEvent(Client* client, const std::string& line);
+	void channelMessage(Client* client, Channel* channel, const std::string& line);
+
+	// Also how a standby applies the modes of its journal
+	void applyModes(Channel* channel, const std::vector<std::string>& params, size_t first,
+					size_t last);
+};
+
+#endif
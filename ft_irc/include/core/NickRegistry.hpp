@@ -0,0 +1,62 @@
+#ifndef NICKREGISTRY_HPP
+#define NICKREGISTRY_HPP
+
+#include <cstddef>
+#include <string>
+
+class Client;
+
+// Nick namespace shared by every thread: an open-addressing hash table
+// keyed by the casefolded nick.
+// - find() is wait-free: a bounded probe over the published table.
+// - claim() takes a nick with a compare-and-swap on its entry, so of two
+//   simultaneous claims of the same nick exactly one wins.
+// Each nick has a single entry, created on first claim and reused by later
+// claims; release() only clears the owner. When the table gets crowded a
+// writer compacts it into a new one: live entries move, dead ones are
+// dropped. Writers wait for that (rare) step, readers never do.
+// The old table and the dropped entries are retired to Epoch, since a
+// find() may still be probing them.
+class NickRegistry
+{
+private:
+	struct Entry
+	{
+		std::string nick;  // casefolded, never changes
+		Client* owner;     // NULL while the nick is free
+	};
+
+	struct Table
+	{
+		size_t mask;     // capacity - 1, capacity is a power of two
+		Entry** slots;
+		size_t used;     // slots holding an entry
+	};
+
+	Table* _table;
+	int _gate;   // writers inside, -1 while compacting
+	long _live;  // nicks with an owner
+
+	static Table* newTable(size_t capacity);
+	static void destroyTable(void* table);
+	static size_t hash(const std::string& nick);
+	void enterWriter();
+	void leaveWriter();
+	void compact();
+
+	NickRegistry(const NickRegistry& other);  // private to prevent copies
+	NickRegistry& operator=(const NickRegistry& other);
+
+public:
+	NickRegistry();
+	~NickRegistry();
+
+	static std::string fold(const std::string& nick);
+
+	Client* find(const std::string& nick);
+	bool claim(const std::string& nick, Client* client);
+	void release(const std::string& nick, Client* client);
+	size_t size() const;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef SEARCHINDEX_HPP
+#define SEARCHINDEX_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Mutex.hpp"
+
+// Inverted index of the message log, fed by its writer as lines reach the
+// disk and rebuilt from the segment files at startup. Words are lowercased
+// runs of letters and digits; each segment file has its own word -> lines
+// table, the line numbers delta and varint encoded. Past the byte budget the
+// oldest segment's table goes, so old enough lines are not found anymore.
+class SearchIndex
+{
+public:
+	// A line found: where it sits in the log, not its text
+	struct Hit
+	{
+		std::string segment;  // path without the extension
+		size_t offset;
+		unsigned long time;
+	};
+
+private:
+	struct Posting
+	{
+		std::string deltas;  // varints, each line number minus the previous
+		unsigned int last;
+		unsigned int count;
+	};
+
+	// One segment file
+	struct Part
+	{
+		std::vector<unsigned long> times;   // by line number
+		std::vector<unsigned int> offsets;
+		std::map<std::string, Posting> words;
+		size_t bytes;
+	};
+
+	typedef std::map<std::string, Part> Parts;  // by segment name, oldest first
+
+	std::map<std::string, Parts> _channels;  // by channel directory
+	size_t _maxBytes;
+	size_t _bytes;
+	Mutex _lock;
+
+	void evict(const std::string& keep);
+	static void decode(const Posting& posting, std::vector<unsigned int>& out);
+
+	SearchIndex(const SearchIndex& other);  // private to prevent copies
+	SearchIndex& operator=(const SearchIndex& other);
+
+public:
+	SearchIndex(size_t maxBytes);
+	~SearchIndex();
+
+	// Writer thread: a line of `segment` (file name without the extension)
+	// in the channel directory `dir`, at `offset`
+	void add(const std::string& dir, const std::string& segment, size_t offset,
+			 unsigned long time, const std::string& text);
+	// Lines of `dir` holding every word of `words`, newest first
+	void search(const std::string& dir, const std::vector<std::string>& words, size_t limit,
+				std::vector<Hit>& out);
+	size_t bytes();
+
+	static void tokenize(const std::string& text, std::vector<std::string>& out);
+};
+
+#endif
@@ -3,39 +3,155 @@
 
 #include <poll.h>
 
+#include <deque>
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 #include <ctime>
 #include <iomanip>
 
 #include "Bot.hpp"
+#include "ChannelDirectory.hpp"
+#include "Client.hpp"
+#include "Journal.hpp"
+#include "MpscQueue.hpp"
+#include "Mutex.hpp"
+#include "Network.hpp"
+#include "NickRegistry.hpp"
+#include "SharedBuffer.hpp"
+#include "Snapshot.hpp"
 #include "Socket.hpp"
+#include "Upgrade.hpp"
+#include "Welcome.hpp"
 
 // Forward declarations
-class Client;
 class Channel;
+class ChannelWorker;
+class CommandPool;
+class FanoutPool;
+class MessageLog;
+class SessionStore;
 class Command;
 class Message;
+class Shard;
 
+// Shards run the event loops and own the connections; the Server holds the
+// state they share. Everything below is guarded by _stateLock once several
+// shards run, and commands always execute with it held.
 class Server
 {
+	friend class Shard;
+	friend class Network;
+	friend class Journal;
+	friend class Upgrade;
+	friend class Snapshot;
+	friend class ChannelWorker;
+
 private:
-	Socket _serverSocket;  // main server socket
-	std::map<int, Socket*> _clientSockets;
-	std::vector<pollfd> _pollFds;               // Array of pollfd structures for poll()
+	std::vector<Shard*> _shards;                // event loops, one per worker
 	std::map<int, Client*> _clients;            // Map of fds to client objects
 	std::map<std::string, Channel*> _channels;  // Map of name to Channel objects
+	NickRegistry _nicks;                        // nick -> client, lock-free
+	ChannelDirectory _directory;                // snapshots for LIST/WHO/WHOIS
 	std::string _password;                      // Server password
-	bool _running;
-	bool _botConnected;
+	volatile bool _running;
+	volatile bool _listening;  // false while a standby follows its primary
+	volatile bool _botConnected;
+	Mutex _stateLock;                           // recursive, see above
+	int _workers;
+
+	// Pipelined mode (io_threads): the shards do I/O and parsing, and one
+	// logic thread owns the state and runs every command
+	struct LogicEvent
+	{
+		enum Type
+		{
+			CONNECT,
+			LINE,
+			RESUMED,       // the client's log read is answered
+			CHANNEL_DONE,  // the client's channel commands are all run
+			DISCONNECT     // the logic thread deletes the client
+		};
+		Type type;
+		Client* client;
+		Message* message;  // LINE only, deleted once executed
+	};
+	bool _pipelined;
+	MpscQueue<LogicEvent> _logicQueue;
+	// Waiting for a log read, or for the client's channel commands
+	std::map<Client*, std::deque<LogicEvent> > _heldEvents;
+	int _logicWake[2];   // pipe waking the logic thread
+	int _logicSleeping;  // set while the logic thread may block in poll()
+	std::vector<ChannelWorker*> _channelWorkers;  // channel actors, may be empty
+	FanoutPool* _fanoutPool;                      // NULL unless fanout_threads
+	CommandPool* _commandPool;                    // NULL unless command_threads
+	MessageLog* _messageLog;                      // NULL unless log_dir
+	SessionStore* _sessions;                      // NULL when resume_grace is 0
+
+	// Connection scaling: fd limit and a spare fd to answer EMFILE with
+	size_t _maxConnections;
+	long _connectionCount;
+	int _reserveFd;
+
+	// Inbound flood control (token bucket per client)
+	int _floodBurst;
+	int _floodRate;
+	int _floodMaxStrikes;
+
+	// Fair scheduling: lines run per client per loop iteration
+	int _quantumLines;
+	size_t _maxSendq;  // bytes a client may have queued for output
 
-	std::map<int, std::string> _clientBuffers;  // Buffer to store partial messagens by fd
+	// Server-wide broadcasts, kept until every shard has caught all of its
+	// clients up on them (see Shard::advanceBroadcasts)
+	struct Broadcast
+	{
+		unsigned long seq;
+		SharedBuffer message;
+		unsigned long excludedId;  // client left out, 0 for none
+	};
+	Mutex _broadcastLock;
+	std::deque<Broadcast> _broadcasts;
+	unsigned long _broadcastSeq;  // seq of the latest broadcast
+	int _broadcastBatch;          // clients caught up per shard iteration
+
+	// Channel affinity: clients move to the shard their channels live on
+	int _migrateVotes;      // votes a shard needs to get a client, 0 to never move
+	int _clientsInTransit;  // handed over, not adopted yet; the log is kept meanwhile
+
+	Network _network;  // links to other servers and their users
+	Journal _journal;  // state replicated to standbys, or followed as one
+	Upgrade _upgrade;  // restart without disconnects
+	Snapshot _snapshot;  // channels kept on disk across restarts
+	Welcome _welcome;    // registration burst and MOTD, rendered ahead
+	int _historyJoin;    // lines of channel history played on JOIN, 0 for none
 
 	bool setupServer(int port, const std::string& password);
-	void processNewConnection();
-	void processClientMessage(int clientFd);
-	void removeClient(int clientFd);
+	bool setupConnectionLimits();
+	bool openListener(Socket& listener, int port, bool reusePort);
+
+	void runLogic();
+	void waitLogicEvents();
+	void processLogicEvents();
+	void dispatchLogicEvent(const LogicEvent& event);
+	bool runLogicEvent(const LogicEvent& event);
+	ChannelWorker* channelOwner(const Message& message);
+	int channelHome(const std::string& name) const;
+	void lockChannelWorkers();
+	void unlockChannelWorkers();
+
+	// Called by the shards
+	void submit(LogicEvent::Type type, Client* client, Message* message);
+	Client* addClient(int clientFd, Shard* shard);
+	unsigned long getBroadcastSeq() const;
+	bool catchUpBroadcasts(Client* client, unsigned long upTo);
+	void trimBroadcasts();
+	void removeClient(Client* client);
+	void expireSessions(bool all = false);
+	void rejectConnection(int clientFd, const std::string& reason);
+	bool rejectWithReserveFd(Socket& listener);
+
 	std::string formatStr(const std::string& str);
     bool caseInsensitiveCompare(const std::string& str1, const std::string& str2);
 
@@ -55,20 +171,27 @@ public:
 	// Client management
 	Client* getClient(int fd);
 	Client* getClientByNick(const std::string& nickname);
+	bool changeNick(Client* client, const std::string& nickname);
 	void    removeClientFromChannels(Client* client);
 	void broadcast(const std::string& message, int excludeFd = -1);
+	Client* resumeSession(Client* client, const std::string& token, std::string& held);
 	void broadcastChannel(const std::string& message, const std::string& channel,
-						  int excludeFd = -1);
+						  int excludeFd = -1, Client::Lane lane = Client::LANE_CONTROL);
 
 	// Channel management
 	Channel* getChannel(const std::string& name);
 	Channel* createChannel(const std::string& name, Client* creator);
 	void removeChannel(const std::string& name);
 	std::map<std::string, Channel*>& getChannels();
+	const ChannelDirectory::Snapshot* getDirectory();
+	const ChannelDirectory::Snapshot* acquireDirectory();
 	void cleanupEmptyChannels();
 
 	// Other helper methods
 	const std::string& getPassword() const;
+	Network& getNetwork();
+	Journal& getJournal();
+	int getHistoryJoin() const;
 
 	// utils for print data structures - only for understand what's in
 	void print_clients(bool command = 0);
@@ -79,6 +202,7 @@ public:
 	Client* getBot() const;
 	bool hasBot() const;
 	const std::string& getStartupTime() const;
+	Welcome& getWelcome();
 };
 
 #endif
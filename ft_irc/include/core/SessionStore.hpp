@@ -0,0 +1,71 @@
+#ifndef SESSIONSTORE_HPP
+#define SESSIONSTORE_HPP
+
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Mutex.hpp"
+
+class Client;
+class Shard;
+
+// Sessions a user can take back from a new connection (IRCv3
+// draft/resume-0.5). A client with the capability gets a token at
+// registration; when its connection is lost rather than closed, the Client
+// stays, detached: still in its channels, its nick still held, its socket
+// left open so the fd it is known by is not reused. What is sent to it
+// meanwhile is held here. RESUME <token> on a new connection moves that
+// socket in and plays the held lines; after resume_grace seconds, or past
+// the sendq limit, the session ends like any lost connection.
+class SessionStore
+{
+private:
+	struct Session
+	{
+		Client* client;
+		time_t detachedAt;  // 0 while connected
+		std::string held;   // lines sent to it since
+		unsigned long seq;  // last server-wide broadcast in them
+	};
+
+	int _grace;
+	size_t _maxHeld;
+	Mutex _lock;
+	std::map<std::string, Session> _sessions;  // by token
+	std::map<Client*, std::string> _tokens;
+	size_t _detached;
+
+	static SessionStore* s_installed;
+
+	static std::string newToken();
+
+	SessionStore(const SessionStore& other);  // private to prevent copies
+	SessionStore& operator=(const SessionStore& other);
+
+public:
+	SessionStore(int grace, size_t maxHeld);
+	~SessionStore();
+
+	static void install(SessionStore* store);  // store used by the calls below, or NULL
+	static bool isEnabled();
+
+	static std::string issue(Client* client);  // a new token, the previous one is void
+	// Owning shard, the connection is gone: keep the client and what it had
+	// queued. False when it has no session to keep.
+	static bool detach(Client* client);
+	static bool hold(Client* client, const std::string& message);
+	static void holdBroadcast(const std::string& message, unsigned long excludedId,
+							  unsigned long seq);
+	// The detached client of a token, out of the store and handed over to
+	// `shard` on its socket `fd`, with its held lines; NULL for a token of
+	// nobody detached
+	static Client* resume(const std::string& token, int fd, Shard* shard, std::string& held);
+	static void forget(Client* client);
+	// Detached clients whose grace ran out, or that were sent too much, or
+	// all of them
+	static void expire(std::vector<Client*>& out, bool all = false);
+};
+
+#endif
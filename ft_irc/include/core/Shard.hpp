@@ -0,0 +1,143 @@
+#ifndef SHARD_HPP
+#define SHARD_HPP
+
+#include <poll.h>
+#include <pthread.h>
+
+#include <ctime>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Client.hpp"
+#include "Mutex.hpp"
+#include "SharedBuffer.hpp"
+#include "Socket.hpp"
+
+class Server;
+
+// One event loop of the server. A shard owns its listener (SO_REUSEPORT when
+// there are several shards), its poll set and the connections it accepted:
+// only the shard's thread reads, writes or closes those sockets.
+// Shared state (clients by nick, channels) lives in Server behind the state
+// lock. Output for a client of another shard is posted to that shard's
+// mailbox and the owner queues it when its wake pipe fires.
+// In pipelined mode a shard only does I/O and parsing, and hands the parsed
+// commands to the server's logic thread.
+// With migrate_votes, a client whose channel traffic mostly belongs to
+// another shard is handed over to it, buffers and queued output included.
+class Shard
+{
+public:
+	struct Recipient
+	{
+		int fd;
+		unsigned long clientId;  // guards against fd reuse
+	};
+
+private:
+	struct Delivery
+	{
+		Recipient to;
+		SharedBuffer message;
+		Client::Lane lane;
+		unsigned long broadcasts;  // broadcasts issued before it was posted
+		bool resumes;              // last reply of a CommandPool task
+		Client* adopted;           // client handed over by another shard
+	};
+
+	Server* _server;
+	int _id;
+	int _cpu;  // pinned CPU, -1 if not pinned
+	pthread_t _thread;
+	bool _threaded;
+	Socket _listener;  // not open while the server is a standby
+	int _port;
+	bool _reusePort;
+
+	std::vector<pollfd> _pollFds;     // Array of pollfd structures for poll()
+	std::vector<int> _pollIndex;      // fd -> position in _pollFds, -1 if absent
+	std::map<int, Client*> _clients;  // connections owned by this shard
+	std::set<int> _throttledFds;      // clients whose input is left in the kernel
+	std::set<int> _backloggedFds;     // clients with complete lines still queued
+	std::map<int, time_t> _closingFds;  // flooders sent ERROR, input discarded until then
+	std::vector<int> _dirtyFds;       // clients that got output this iteration
+
+	// Server-wide broadcasts reach the clients in passes of bounded size
+	bool _broadcastPass;
+	int _broadcastCursor;              // last fd caught up by the pass
+	unsigned long _broadcastTarget;    // broadcast the pass catches up to
+	unsigned long _broadcastDone;      // every client has seen up to this one
+
+	// Clients are checked for migration in passes too, one per second at most
+	bool _rebalancePass;
+	int _rebalanceCursor;
+	time_t _nextRebalance;
+
+	// Cross-shard mailbox
+	Mutex _mailboxLock;
+	std::vector<Delivery> _mailbox;
+	int _wakePipe[2];
+
+	bool startListening();
+	void processNewConnection();
+	void processClientMessage(int clientFd);
+	bool processClientBuffer(Client* client);
+	void runLine(Client* client, const std::string& rawMessage);
+	bool throttleClient(Client* client);
+	void servicePendingClients(const std::vector<int>& fds);
+	void lingerClose(int fd);
+	void drainClosingFds(bool all);
+	void advanceBroadcasts();
+	void rebalanceClients();
+	bool canMigrate(Client* client) const;
+	void migrateClient(Client* client, Shard* target);
+	void adoptClient(Client* client);
+	void drainMailbox();
+	void flushDirtyClients();
+	void syncClientOutput();
+	void removeClient(int clientFd, bool lost = false);  // lost: not closed by anyone
+	Client* getClient(int fd);
+
+	void setReadInterest(int fd, bool enabled);
+	void addPollFd(int fd, short events);
+	void removePollFd(int fd);
+	pollfd* findPollFd(int fd);
+
+	static void* threadMain(void* arg);
+	void pinToCpu();
+
+	Shard(const Shard& other);  // private to prevent copies
+	Shard& operator=(const Shard& other);
+
+public:
+	Shard(Server* server, int id);
+	~Shard();
+
+	bool setup(int port, bool reusePort);
+	void setCpu(int cpu);
+	void run();
+	bool startThread();
+	void join();
+	void wake();
+
+	int getId() const;
+	size_t getClientCount() const;
+	static Shard* current();  // shard running on the calling thread, or NULL
+
+	void post(int fd, unsigned long clientId, const std::string& message,
+			  Client::Lane lane, bool resumes = false);
+	void post(const std::vector<Recipient>& recipients, const SharedBuffer& message,
+			  Client::Lane lane);
+	Client* attachConnection(int fd);
+	void handOver(Client* client);
+	void markDirty(int fd);
+	void markBacklogged(int fd);
+	void settle();
+	int getListenerFd() const;
+	bool catchUpBroadcasts(Client* client, unsigned long upTo);
+	unsigned long getBroadcastsDone() const;
+};
+
+#endif
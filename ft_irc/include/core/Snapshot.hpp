@@ -0,0 +1,51 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <sys/types.h>
+
+#include <ctime>
+#include <string>
+
+class Server;
+
+// Channels kept on disk across restarts (snapshot_file). Every
+// snapshot_interval seconds the thread owning the state forks, and the
+// child writes the channels to a binary file and exits: the loop never
+// waits for the disk. The file is written aside, synced and renamed over
+// the previous one, so a crash leaves one snapshot or the other, whole.
+// At startup the file is mapped and the channels come back with their
+// topic, modes, key, limit and invites, held until someone joins.
+//   "IRCSNAP" <version u8> <channels u32> <saved at u64>
+//   per channel: <name> <topic> <key> <modes u8> <limit u32>
+//                <invited u16> <nick>...
+//   <crc32 u32> of everything before it
+// Integers are little endian, strings a u16 length and the bytes.
+class Snapshot
+{
+private:
+	Server* _server;
+	std::string _path;   // snapshot_file, empty when disabled
+	int _interval;       // seconds between snapshots
+	time_t _nextSave;
+	pid_t _writer;       // child writing a snapshot, 0 if none
+
+	bool setAside(const std::string& reason) const;
+	std::string encode() const;
+	bool writeFile(const std::string& data) const;
+	void reap(bool wait);
+
+	Snapshot(const Snapshot& other);  // private to prevent copies
+	Snapshot& operator=(const Snapshot& other);
+
+public:
+	Snapshot(Server* server);
+	~Snapshot();
+
+	void setup();
+	bool load();
+	bool isDue();     // reaps the last writer, then checks the clock
+	void save();      // state owner only: forks a writer
+	void saveNow();   // at shutdown, written by the calling thread
+};
+
+#endif
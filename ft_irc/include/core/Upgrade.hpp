@@ -0,0 +1,60 @@
+#ifndef UPGRADE_HPP
+#define UPGRADE_HPP
+
+#include <string>
+#include <vector>
+
+#include "Socket.hpp"
+
+class Client;
+class Server;
+
+// Restart without disconnects (upgrade_socket). A server listens on a Unix
+// socket; a new ircserv started with the same upgrade_socket connects to it
+// before it opens anything. The running server stops its loops, writes its
+// clients and channels down with the output they still have queued, passes
+// its listeners and client sockets over SCM_RIGHTS, and exits. The new one
+// rebuilds the same state around the same sockets and carries on.
+// Standby journal streams go along; server links don't, the peers see a
+// split and link_connect is dialed again.
+class Upgrade
+{
+private:
+	static const size_t FDS_PER_MESSAGE = 250;  // below the kernel's SCM_MAX_FD
+
+	Server* _server;
+	std::string _path;        // upgrade_socket, empty when disabled
+	Socket _listener;         // where the next process asks for the state
+	Socket _next;             // the next process, once it asked
+	std::string _state;       // received: the previous process's state
+	std::vector<int> _fds;    // received: its listeners, then its clients
+	size_t _listeners;        // how many of _fds are listeners
+	bool _handedOver;
+
+	bool receive();
+	bool listen();
+	std::string writeState(std::vector<int>& fds);
+	bool sendFds(const std::vector<int>& fds);
+
+	Upgrade(const Upgrade& other);  // private to prevent copies
+	Upgrade& operator=(const Upgrade& other);
+
+public:
+	Upgrade(Server* server);
+	~Upgrade();
+
+	// New process: take the state of a running server if there is one, then
+	// listen for the next upgrade
+	bool setup();
+	bool isResuming() const;
+	int takeListener(size_t shard);  // inherited listener of a shard, or -1
+	bool restore();
+
+	// Running process
+	int getFd() const;
+	void accept();     // the next process connected: stop the loops
+	bool isRequested() const;
+	void handOver();   // loops stopped: send everything
+};
+
+#endif
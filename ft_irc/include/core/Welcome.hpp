@@ -0,0 +1,71 @@
+#ifndef WELCOME_HPP
+#define WELCOME_HPP
+
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include <csignal>
+#include <ctime>
+#include <string>
+
+#include "Mutex.hpp"
+#include "SharedBuffer.hpp"
+
+// What a client is sent when it registers: 001 to 005 and the MOTD, rendered
+// once into templates with a marker where each client's nick (and user)
+// goes, and sent as one string. The MOTD file is read at startup, then by a
+// watcher thread when it changes or on SIGHUP, never by an event loop or a
+// command: the new text is rendered aside and swapped in.
+class Welcome
+{
+private:
+	struct Stamp
+	{
+		time_t seconds;  // 0 for the built-in text
+		long nanos;
+		off_t size;
+	};
+
+	std::string _motdFile;
+	std::string _header;  // 001 to 005, constant once set up
+	SharedBuffer _motd;   // 375 to 376, swapped by a reload
+	Mutex _lock;
+
+	// Watcher thread
+	Stamp _motdStamp;     // of the file loaded
+	pthread_t _thread;
+	bool _started;
+	Mutex _watchLock;
+	Condition _wakeup;
+	bool _stopping;
+
+	static volatile sig_atomic_t s_reloadRequested;
+
+	static std::string numeric(int code, const std::string& message);
+	static void splice(const std::string& text, const std::string& nick,
+					   const std::string& user, std::string& out);
+	static std::string defaultMotd();
+	static Stamp stampOf(const std::string& path);
+	void load(const Stamp& stamp);
+	void watch();
+	static void* threadMain(void* arg);
+
+	Welcome(const Welcome& other);  // private to prevent copies
+	Welcome& operator=(const Welcome& other);
+
+public:
+	Welcome(const std::string& motdFile);
+	~Welcome();
+
+	void setup(const std::string& created, const std::string& isupport);
+	bool start();  // watcher thread: a stat() a second, a read when it changed
+	void stop();
+	static void requestReload();  // from a signal handler
+
+	// The registration burst, with `extra` between 005 and the MOTD
+	std::string burst(const std::string& nick, const std::string& user,
+					  const std::string& extra);
+	std::string motd(const std::string& nick);
+};
+
+#endif
@@ -16,6 +16,7 @@ private:
 public:
 	static bool hasConfig(const std::string& wanted);
 	static std::string  getConfig(const std::string& wanted);
+	static int  getConfigInt(const std::string& wanted, int fallback);
 
 };
 
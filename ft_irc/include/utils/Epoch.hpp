@@ -0,0 +1,84 @@
+#ifndef EPOCH_HPP
+#define EPOCH_HPP
+
+#include <pthread.h>
+
+// Epoch-based reclamation for objects read without a lock.
+// A thread that may hold a pointer to a shared Client, Channel or registry
+// table does so inside a Guard. Whoever unlinks such an object hands it to
+// retire() instead of deleting it; it is freed once every thread that was
+// inside a guard at that moment has left it.
+// The global epoch only moves on when every thread inside a guard has seen
+// the current one, so an object retired two epochs ago is out of reach.
+// Guards nest and cost two atomic stores. Retiring never waits; a thread
+// staying inside a guard only delays the frees.
+class Epoch
+{
+private:
+	struct Retired
+	{
+		void* object;
+		void (*destroy)(void*);
+		unsigned long epoch;  // global epoch when it was retired
+		Retired* next;
+	};
+
+	// One per thread, recycled when the thread exits
+	struct Participant
+	{
+		unsigned long state;  // (epoch << 1) | 1 inside a guard, 0 outside
+		int depth;            // nested guards
+		int inUse;
+		Retired* limbo;       // retired by this thread, not freed yet
+		int limboCount;
+		Participant* next;
+	};
+
+	static unsigned long s_epoch;
+	static Participant* s_participants;  // grows only
+	static Retired* s_orphans;           // left behind by exited threads
+	static __thread Participant* s_self;
+	static pthread_key_t s_exitKey;
+	static pthread_once_t s_keyOnce;
+
+	static Participant* self();
+	static void createKey();
+	static void threadExit(void* participant);
+	static void tryAdvance();
+	static void destroyAll(Retired* list);
+
+	template <typename T>
+	static void destroy(void* object)
+	{
+		delete static_cast<T*>(object);
+	}
+
+	Epoch();  // static only
+
+public:
+	class Guard
+	{
+	private:
+		Guard(const Guard& other);
+		Guard& operator=(const Guard& other);
+
+	public:
+		Guard();
+		~Guard();
+	};
+
+	static void enter();
+	static void leave();
+
+	template <typename T>
+	static void retire(T* object)
+	{
+		retire(object, &destroy<T>);
+	}
+	static void retire(void* object, void (*destroy)(void*));
+
+	static void collect();  // free what this thread retired and is safe now
+	static void drain();    // free everything, once no other thread is left
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef HISTORYRING_HPP
+#define HISTORYRING_HPP
+
+#include <string>
+#include <vector>
+
+// Last lines said in a channel, bounded by a line count and a byte size.
+// The lines sit back to back in one arena per channel, allocated on the
+// first line and grown up to the byte size; once full, writing wraps to the
+// start and evicts the oldest lines it lands on. Their places are a ring of
+// slots, so a channel that never speaks costs no allocation. Times are
+// milliseconds since the epoch.
+class HistoryRing
+{
+public:
+	struct Line
+	{
+		unsigned long time;
+		std::string text;
+	};
+
+private:
+	struct Slot
+	{
+		size_t offset;
+		size_t length;
+		unsigned long time;
+	};
+
+	std::vector<char> _arena;
+	std::vector<Slot> _slots;  // ring of history_lines slots
+	size_t _first;             // oldest slot
+	size_t _count;
+	size_t _head;              // where the next line goes in the arena
+
+	const Slot& slot(size_t i) const;  // i-th oldest
+	void evictFront();
+
+	static size_t s_maxLines;
+	static size_t s_maxBytes;
+
+public:
+	HistoryRing();
+	HistoryRing(const HistoryRing& other);
+	HistoryRing& operator=(const HistoryRing& other);
+	~HistoryRing();
+
+	void push(const std::string& text, unsigned long time);
+	// Lines after `after` and before `before` (0: no bound), at most
+	// `limit` of them from the newest end or the oldest, oldest first
+	void find(unsigned long after, unsigned long before, size_t limit, bool newest,
+			  std::vector<Line>& out) const;
+	size_t size() const;
+	unsigned long oldest() const;  // time of the oldest line, 0 when empty
+	size_t bytes() const;
+
+	static void setLimits(size_t lines, size_t bytes);
+	static size_t maxLines();
+	static bool isEnabled();
+	static unsigned long now();
+};
+
+#endif
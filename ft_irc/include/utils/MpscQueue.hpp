@@ -0,0 +1,72 @@
+#ifndef MPSCQUEUE_HPP
+#define MPSCQUEUE_HPP
+
+#include <cstddef>
+
+// Unbounded lock-free queue for many producers and a single consumer
+// (Vyukov's intrusive MPSC list). push() is one atomic exchange and never
+// blocks; pop() must only be called from the consumer thread. Items come
+// out in the order each producer pushed them.
+// T must be default constructible and cheap to copy.
+template <typename T>
+class MpscQueue
+{
+private:
+	struct Node
+	{
+		Node* next;
+		T value;
+	};
+
+	Node* _head;  // last pushed node, swapped by producers
+	Node* _tail;  // consumer side: node before the next item
+
+	// Not implemented: nodes are owned by the queue
+	MpscQueue(const MpscQueue& other);
+	MpscQueue& operator=(const MpscQueue& other);
+
+public:
+	MpscQueue()
+	{
+		Node* stub = new Node();
+		stub->next = NULL;
+		_head = stub;
+		_tail = stub;
+	}
+
+	~MpscQueue()
+	{
+		T ignored;
+		while (pop(ignored))
+		{
+		}
+		delete _tail;
+	}
+
+	void push(const T& value)
+	{
+		Node* node = new Node();
+		node->next = NULL;
+		node->value = value;
+		Node* previous = __atomic_exchange_n(&_head, node, __ATOMIC_ACQ_REL);
+		// Until this store the consumer sees the queue end at `previous`
+		__atomic_store_n(&previous->next, node, __ATOMIC_RELEASE);
+	}
+
+	bool pop(T& value)
+	{
+		Node* next = __atomic_load_n(&_tail->next, __ATOMIC_ACQUIRE);
+		if (!next)
+		{
+			return (false);
+		}
+		value = next->value;
+		delete _tail;
+		_tail = next;
+		return (true);
+	}
+
+	bool empty() const { return (__atomic_load_n(&_tail->next, __ATOMIC_ACQUIRE) == NULL); }
+};
+
+#endif
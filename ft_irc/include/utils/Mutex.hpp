@@ -0,0 +1,60 @@
+#ifndef MUTEX_HPP
+#define MUTEX_HPP
+
+#include <pthread.h>
+
+// Thin wrapper over a pthread mutex. A recursive one can be taken again by
+// the thread already holding it, which the server state lock relies on.
+class Mutex
+{
+	friend class Condition;
+
+private:
+	pthread_mutex_t _mutex;
+
+	// Not implemented: a mutex cannot be copied
+	Mutex(const Mutex& other);
+	Mutex& operator=(const Mutex& other);
+
+public:
+	explicit Mutex(bool recursive = false);
+	~Mutex();
+
+	void lock();
+	void unlock();
+};
+
+// Holds a Mutex until the end of the scope
+class ScopedLock
+{
+private:
+	Mutex& _mutex;
+
+	ScopedLock(const ScopedLock& other);
+	ScopedLock& operator=(const ScopedLock& other);
+
+public:
+	explicit ScopedLock(Mutex& mutex);
+	~ScopedLock();
+};
+
+// Condition variable used together with a (non-recursive) Mutex
+class Condition
+{
+private:
+	pthread_cond_t _cond;
+
+	Condition(const Condition& other);
+	Condition& operator=(const Condition& other);
+
+public:
+	Condition();
+	~Condition();
+
+	void wait(Mutex& mutex);  // mutex must be held
+	void wait(Mutex& mutex, int ms);  // same, gives up after ms
+	void signal();
+	void broadcast();
+};
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef SHAREDBUFFER_HPP
+#define SHAREDBUFFER_HPP
+
+#include <string>
+
+// Immutable string shared between threads by reference count. A message
+// rendered once for a fan-out is handed to every shard mailbox without
+// being copied per recipient.
+class SharedBuffer
+{
+private:
+	struct Block
+	{
+		int refs;
+		std::string data;
+	};
+
+	Block* _block;
+
+	void release();
+
+public:
+	SharedBuffer();
+	explicit SharedBuffer(const std::string& data);
+	SharedBuffer(const SharedBuffer& other);
+	SharedBuffer& operator=(const SharedBuffer& other);
+	~SharedBuffer();
+
+	const std::string& str() const;
+};
+
+#endif
@@ -15,6 +15,9 @@
 #include <string>
 #include <vector>  // STL container
 
+// A Socket owns its file descriptor and closes it on destruction. It cannot
+// be copied; ownership moves explicitly with release(), adopt() or
+// Socket(fd, ...).
 class Socket
 {
 private:
@@ -23,11 +26,14 @@ private:
 	bool _blocking;
 	struct sockaddr_in _addr;
 
+	// Not implemented: two objects must never own the same fd
+	Socket(const Socket& other);
+	Socket& operator=(const Socket& other);
+
 public:
 	Socket();
 	Socket(int domain, int type, int protocol);
-	Socket(const Socket& other);
-	Socket& operator=(const Socket& other);
+	Socket(int fd, bool blocking);  // takes ownership of an existing fd
 	~Socket();
 
 	bool create(int domain, int type, int protocol);
@@ -36,14 +42,17 @@ public:
 	bool bind(int port, const std::string& address = "");
 	bool listen(int backlog);
 	bool connect(const std::string& host, int port);
-	Socket accept();
+	int accept();  // returns an owned fd, or -1 (see getLastErrno())
 	ssize_t send(const std::string& data, int flags = 0);
 	ssize_t recv(char* buffer, size_t buffersize, int flags = 0);
 
 	int getFd() const;
 	bool isValid() const;
 	void close();
+	int release();  // gives up ownership of the fd without closing it
+	void adopt(int fd);  // closes the current fd and owns this one instead
 	std::string getLastError() const;
+	int getLastErrno() const;
 };
 
 #endif
@@ -0,0 +1,32 @@
+#ifndef TOKENBUCKET_HPP
+#define TOKENBUCKET_HPP
+
+// Classic token bucket: holds up to _capacity tokens and refills at
+// _refillRate tokens per second. Used for per-client inbound flood control.
+class TokenBucket
+{
+private:
+	double _capacity;
+	double _refillRate;  // tokens per second
+	double _tokens;
+	double _lastRefill;  // monotonic seconds
+
+public:
+	TokenBucket(double capacity, double refillRate);
+	TokenBucket(const TokenBucket& other);
+	TokenBucket& operator=(const TokenBucket& other);
+	~TokenBucket();
+
+	void refill();
+	bool consume(double cost);
+
+	double getTokens() const;
+	double getCapacity() const;
+	bool isFull() const;
+	// Seconds until at least `wanted` tokens are available (0 if already there)
+	double secondsUntil(double wanted) const;
+
+	static double now();
+};
+
+#endif
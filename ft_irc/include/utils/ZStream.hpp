@@ -0,0 +1,36 @@
+#ifndef ZSTREAM_HPP
+#define ZSTREAM_HPP
+
+#include <zlib.h>
+
+#include <string>
+
+// One direction of a zlib stream. Each call ends on a sync flush, so what
+// it produced can be decoded on its own by the other side, while the
+// dictionary carries over from call to call.
+class ZStream
+{
+public:
+	enum Mode
+	{
+		DEFLATE,
+		INFLATE
+	};
+
+private:
+	Mode _mode;
+	z_stream _stream;
+	bool _ok;
+
+	ZStream(const ZStream& other);  // private to prevent copies
+	ZStream& operator=(const ZStream& other);
+
+public:
+	explicit ZStream(Mode mode, int level = Z_DEFAULT_COMPRESSION);
+	~ZStream();
+
+	// Appends the (de)compressed data to out, false on a corrupt stream
+	bool process(const char* data, size_t length, std::string& out);
+};
+
+#endif
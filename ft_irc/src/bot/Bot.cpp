@@ -23,7 +23,6 @@ Bot::Bot(std::string host, int port, std::string password)
 	  _connected(false),
 	  _authenticated(false)
 {
-	_socket = Socket();
 	_messageBuffer.clear();
 	Print::Log("[BOT] Bot initialized - Target: " + host + " : " + toString(port));
 }
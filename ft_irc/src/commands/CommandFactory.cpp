@@ -17,6 +17,8 @@
 #include "PassCommand.hpp"
 #include "PingCommand.hpp"
 #include "PongCommand.hpp"
+#include "ServerCommand.hpp"
+#include "StandbyCommand.hpp"
 #include "UserCommand.hpp"
 #include "QuitCommand.hpp"
 #include "NoticeCommand.hpp"
@@ -24,10 +26,14 @@
 #include "WhoIsCommand.hpp"
 #include "TopicCommand.hpp"
 #include "MotdCommand.hpp"
+#include "ChathistoryCommand.hpp"
+#include "ResumeCommand.hpp"
+#include "SearchCommand.hpp"
 #include "PrintdataCommand.hpp"
 
 // Initialize static members
 std::map<std::string, CommandFactory::CommandCreator> CommandFactory::_commandCreators;
+std::map<std::string, int> CommandFactory::_commandCosts;
 bool CommandFactory::_initialized = false;
 
 // Registers all available commands
@@ -38,31 +44,36 @@ void CommandFactory::initializeCommands()
 		return;
 	}
 
-	// Channel commands
-	registerCommand("INVITE", &InviteCommand::create);
-	registerCommand("JOIN", &JoinCommand::create);
-	registerCommand("KICK", &KickCommand::create);
-	registerCommand("LIST", &ListCommand::create);
-	registerCommand("MODE", &ModeCommand::create);
-	registerCommand("PART", &PartCommand::create);
-	registerCommand("TOPIC", &TopicCommand::create);
+	// Channel commands (cost: tokens charged by flood control)
+	registerCommand("INVITE", &InviteCommand::create, 2);
+	registerCommand("JOIN", &JoinCommand::create, 2);
+	registerCommand("KICK", &KickCommand::create, 2);
+	registerCommand("LIST", &ListCommand::create, 10);
+	registerCommand("MODE", &ModeCommand::create, 2);
+	registerCommand("PART", &PartCommand::create, 2);
+	registerCommand("TOPIC", &TopicCommand::create, 2);
 
 	// Connection commands
 	registerCommand("CAP", &CapCommand::create);
-	registerCommand("NICK", &NickCommand::create);
+	registerCommand("NICK", &NickCommand::create, 2);
 	registerCommand("PASS", &PassCommand::create);
 	registerCommand("QUIT", &QuitCommand::create);
 	registerCommand("USER", &UserCommand::create);
 	registerCommand("PING", &PingCommand::create);
 	registerCommand("PONG", &PongCommand::create);
+	registerCommand("SERVER", &ServerCommand::create);
+	registerCommand("STANDBY", &StandbyCommand::create);
+	registerCommand("RESUME", &ResumeCommand::create);
 
 	// Messaging commands
 	registerCommand("NOTICE", &NoticeCommand::create);
 	registerCommand("PRIVMSG", &PrivmsgCommand::create);
-	registerCommand("WHO", &WhoCommand::create);
-	registerCommand("WHOIS", &WhoIsCommand::create);
-	registerCommand("MOTD", &MotdCommand::create);
-	registerCommand("PRINT_DATA", &PrintdataCommand::create);
+	registerCommand("WHO", &WhoCommand::create, 5);
+	registerCommand("WHOIS", &WhoIsCommand::create, 3);
+	registerCommand("MOTD", &MotdCommand::create, 5);
+	registerCommand("CHATHISTORY", &ChathistoryCommand::create, 3);
+	registerCommand("SEARCH", &SearchCommand::create, 5);
+	registerCommand("PRINT_DATA", &PrintdataCommand::create, 10);
 
 	_initialized = true;
 }
@@ -101,6 +112,19 @@ ACommand *CommandFactory::createCommand(const std::string &commandName, Server *
 void CommandFactory::executeCommand(Client *client, Server *server,
 									const Message &message)
 {
+	// A standby or its primary speaks the journal, another server speaks the
+	// link protocol, neither sends client commands
+	if (client && client->isJournalStream())
+	{
+		server->getJournal().handleLine(client, message);
+		return;
+	}
+	if (client && client->isLink())
+	{
+		server->getNetwork().handleLine(client, message);
+		return;
+	}
+
 	std::string commandName = message.getCommand();
 	Print::Debug("Attempting to execute command: " + commandName);
 
@@ -136,7 +160,7 @@ void CommandFactory::executeCommand(Client *client, Server *server,
 
 // Register a new command creator
 void CommandFactory::registerCommand(const std::string &commandName,
-									 CommandCreator creator)
+									 CommandCreator creator, int cost)
 {
 	std::string upperCommandName = commandName;
 	for (size_t i = 0; i < upperCommandName.size(); ++i)
@@ -144,6 +168,7 @@ void CommandFactory::registerCommand(const std::string &commandName,
 		upperCommandName[i] = toupper(upperCommandName[i]);
 	}
 	_commandCreators[upperCommandName] = creator;
+	_commandCosts[upperCommandName] = cost;
 }
 
 // Check if a command exists
@@ -161,3 +186,24 @@ bool CommandFactory::commandExists(const std::string &commandName)
 
 	return (_commandCreators.find(upperCommandName) != _commandCreators.end());
 }
+
+// Get the flood control cost of a command
+int CommandFactory::getCommandCost(const std::string &commandName)
+{
+	if (!_initialized)
+	{
+		initializeCommands();
+	}
+	std::string upperCommandName = commandName;
+	for (size_t i = 0; i < upperCommandName.size(); ++i)
+	{
+		upperCommandName[i] = toupper(upperCommandName[i]);
+	}
+
+	std::map<std::string, int>::iterator it = _commandCosts.find(upperCommandName);
+	if (it == _commandCosts.end())
+	{
+		return (Flood::COST_UNKNOWN);
+	}
+	return (it->second);
+}
@@ -118,6 +118,7 @@ void InviteCommand::executeInvite(Client* inviter, Client* target, Channel* chan
 	Print::Debug("Executing invite: " + inviterNick + " invites " + targetNick + " to " + channelName);
 
 	channel->addInvitedUser(targetNick);
+	_server->getJournal().channelInvite(channel, targetNick);
 	// Send RPL_INVITING (341) to the inviter
 	sendNumericReply(inviter, IRC::RPL_INVITING, targetNick + " " + channelName);
 
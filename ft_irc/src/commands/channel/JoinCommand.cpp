@@ -1,6 +1,7 @@
 #include <new>
 
 #include "Channel.hpp"
+#include "ChathistoryCommand.hpp"
 #include "Client.hpp"
 #include "JoinCommand.hpp"
 #include "General.hpp"
@@ -84,6 +85,8 @@ void    JoinCommand::joinChannel(Client* client, const std::string& channelName,
 		}
 		_server->getChannels()[channelName] = channel;
 		client->sendMessage(joinMessage);
+		_server->getNetwork().channelCreated(channel);
+		_server->getJournal().channelJoin(channel, client);
 	}
 	else
 	{
@@ -123,8 +126,16 @@ void    JoinCommand::joinChannel(Client* client, const std::string& channelName,
 			}
 			channel->addClient(client);
 			channel->removeInvitedUser(client->getNickname());
+			// A channel kept from a primary or a snapshot: the first one in runs it
+			if (channel->isHeld())
+			{
+				channel->setHeld(false);
+				channel->addOperator(client);
+			}
 			client->sendMessage(joinMessage);
 			_server->broadcastChannel(joinMessage, channel->getName(), client->getFd());
+			_server->getNetwork().userEvent(client, joinMessage);
+			_server->getJournal().channelJoin(channel, client);
 		}
 		if (!channel->getTopic().empty())
 		{
@@ -138,6 +149,17 @@ void    JoinCommand::joinChannel(Client* client, const std::string& channelName,
 
 	sendList(client, channel);
 
+	// Catch the newcomer up on the conversation; the bot would take it as new
+	if (_server->getHistoryJoin() > 0 && !client->isBot())
+	{
+		std::vector<HistoryRing::Line> lines;
+		channel->getHistory().find(0, 0, _server->getHistoryJoin(), true, lines);
+		if (!lines.empty())
+		{
+			ChathistoryCommand::replay(client, channel->getName(), lines);
+		}
+	}
+
 	Print::Ok("Join " + Color::YELLOW +  client->getNickname() 
 			  + Color::RESET + " to " 
 			  + Color::YELLOW + channelName + Color::RESET);
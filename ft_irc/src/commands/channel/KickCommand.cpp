@@ -147,6 +147,8 @@ void KickCommand::executeKickFromChannel(Client* kicker, Client* target, Channel
 	Print::Debug("Broadcasting KICK message: " + broadcastMsg);
 
 	_server->broadcastChannel(broadcastMsg, channelName, -1);
+	_server->getNetwork().userEvent(kicker, broadcastMsg);
+	_server->getJournal().channelPart(channel, target, true);
 
 	channel->removeClient(target);
 	
@@ -5,6 +5,34 @@
 #include "Channel.hpp"
 #include "UtilsFun.hpp"
 
+class ListCommand::Task : public CommandPool::Task
+{
+private:
+	const ChannelDirectory::Snapshot* _channels;
+	std::vector<std::string> _requested;  // empty for every channel
+
+public:
+	Task(const ChannelDirectory::Snapshot* channels, const std::vector<std::string>& requested)
+		: _channels(channels), _requested(requested) {}
+
+	virtual ~Task() { ChannelDirectory::release(_channels); }
+
+	virtual void run(CommandPool::Reply& reply)
+	{
+		reply.numeric(321, "Channel :Users  Name");
+		if (_requested.empty())
+		{
+			Print::Debug("Listing all channels");
+			ListCommand::listAllChannels(reply, _channels);
+		}
+		else
+		{
+			ListCommand::listSpecificChannels(reply, _channels, _requested);
+		}
+		reply.numeric(323, ":End of /LIST");
+	}
+};
+
 ListCommand::ListCommand(Server* server) : ACommand(server) {}
 
 ListCommand::~ListCommand() {}
@@ -45,48 +73,35 @@ Print::Do("execute LIST command");
 		return;
 	}
 
-	sendNumericReply(client, 321, "Channel :Users  Name");
-
-	std::map<std::string, Channel*>& channels = _server->getChannels();
-	
-
 	std::string channelParam = message.getParams(0);
-	
-	if (channelParam.empty())
-	{
-		Print::Debug("Listing all channels");
-		listAllChannels(client, channels);
-	}
-	else
+	std::vector<std::string> requestedChannels;
+	if (!channelParam.empty())
 	{
 		Print::Debug("Listing specific channels: " + channelParam);
-		listSpecificChannels(client, channels, channelParam);
+		requestedChannels = splitArguments(channelParam, ',');
 	}
 
-	sendNumericReply(client, 323, ":End of /LIST");
+	// A snapshot: JOIN and PART don't disturb the listing, which may well
+	// be rendered on a pool thread
+	CommandPool::run(client, new Task(_server->acquireDirectory(), requestedChannels));
 	Print::Ok("LIST command completed");
 }
 
-void ListCommand::listAllChannels(Client* client, std::map<std::string, Channel*>& channels)
+void ListCommand::listAllChannels(CommandPool::Reply& reply, const ChannelDirectory::Snapshot* channels)
 {
-	std::map<std::string, Channel*>::iterator it = channels.begin();
-	std::map<std::string, Channel*>::iterator ite = channels.end();
+	ChannelDirectory::Snapshot::const_iterator it = channels->begin();
+	ChannelDirectory::Snapshot::const_iterator ite = channels->end();
 
 	for (; it != ite; ++it)
 	{
-		Channel* channel = it->second;
-		if (channel)
-		{
-			sendChannelInfo(client, channel);
-		}
+		sendChannelInfo(reply, it->second);
 	}
 	
-	Print::Debug("Listed " + toString(channels.size()) + " channels");
+	Print::Debug("Listed " + toString(channels->size()) + " channels");
 }
 
-void ListCommand::listSpecificChannels(Client* client, std::map<std::string, Channel*>& channels, const std::string& channelList)
+void ListCommand::listSpecificChannels(CommandPool::Reply& reply, const ChannelDirectory::Snapshot* channels, const std::vector<std::string>& requestedChannels)
 {
-	std::vector<std::string> requestedChannels = splitArguments(channelList, ',');
 	int listedCount = 0;
 
 	for (size_t i = 0; i < requestedChannels.size(); ++i)
@@ -101,10 +116,10 @@ void ListCommand::listSpecificChannels(Client* client, std::map<std::string, Cha
 			channelName = channelName.substr(start, end - start + 1);
 		}
 		
-		std::map<std::string, Channel*>::iterator it = channels.find(channelName);
-		if (it != channels.end() && it->second)
+		const ChannelDirectory::View* channel = channels->find(channelName);
+		if (channel)
 		{
-			sendChannelInfo(client, it->second);
+			sendChannelInfo(reply, channel);
 			listedCount++;
 		}
 	}
@@ -112,7 +127,7 @@ void ListCommand::listSpecificChannels(Client* client, std::map<std::string, Cha
 	Print::Debug("Listed " + toString(listedCount) + " specific channels");
 }
 
-void ListCommand::sendChannelInfo(Client* client, Channel* channel)
+void ListCommand::sendChannelInfo(CommandPool::Reply& reply, const ChannelDirectory::View* channel)
 {
 	if (!channel)
 	{
@@ -120,18 +135,17 @@ void ListCommand::sendChannelInfo(Client* client, Channel* channel)
 	}
 
 	// Count users in channel
-	const std::map<int, Client*>& clients = channel->getClients();
-	int userCount = static_cast<int>(clients.size());
+	int userCount = static_cast<int>(channel->members.size());
 	
-	std::string topic = channel->getTopic();
+	std::string topic = channel->topic;
 	if (topic.empty())
 	{
 		topic = "No topic set";
 	}
 
 	// Format: 322 <nick> <channel> <# visible> :<topic>
-	std::string listReply = channel->getName() + " " + toString(userCount) + " :" + topic;
-	sendNumericReply(client, 322, listReply);
+	std::string listReply = channel->name + " " + toString(userCount) + " :" + topic;
+	reply.numeric(322, listReply);
 	
-	Print::Debug("Sent info for channel: " + channel->getName() + " (" + toString(userCount) + " users)");
+	Print::Debug("Sent info for channel: " + channel->name + " (" + toString(userCount) + " users)");
 }
\ No newline at end of file
@@ -152,7 +152,9 @@ void ModeCommand::processModeChanges(Client* client, Channel* channel,
 	bool adding = true;
 	std::string addedModes = "";
 	std::string removedModes = "";
-	std::string appliedParams = "";
+	// Arguments in the order of the +... then -... modes they go with
+	std::string addedParams = "";
+	std::string removedParams = "";
 	size_t paramIndex = 2;
 
 	Print::Debug("Starting mode processing: " + modeString);
@@ -200,7 +202,8 @@ void ModeCommand::processModeChanges(Client* client, Channel* channel,
 				break;
 
 			case 'k': // Channel key
-				modeChanged = processChannelKeyMode(client, channel, adding, message, paramIndex, appliedParams);
+				modeChanged = processChannelKeyMode(client, channel, adding, message, paramIndex,
+					(adding ? addedParams : removedParams));
 				if (modeChanged)
 				{
 					if (adding)
@@ -211,7 +214,8 @@ void ModeCommand::processModeChanges(Client* client, Channel* channel,
 				break;
 
 			case 'o': // Operator privilege
-				modeChanged = processOperatorMode(client, channel, adding, message, paramIndex, appliedParams);
+				modeChanged = processOperatorMode(client, channel, adding, message, paramIndex,
+					(adding ? addedParams : removedParams));
 				if (modeChanged)
 				{
 					if (adding)
@@ -222,7 +226,8 @@ void ModeCommand::processModeChanges(Client* client, Channel* channel,
 				break;
 
 			case 'l': // User limit
-				modeChanged = processUserLimitMode(client, channel, adding, message, paramIndex, appliedParams);
+				modeChanged = processUserLimitMode(client, channel, adding, message, paramIndex,
+					(adding ? addedParams : removedParams));
 				if (modeChanged)
 				{
 					if (adding)
@@ -250,6 +255,13 @@ void ModeCommand::processModeChanges(Client* client, Channel* channel,
 		finalModes += "-" + removedModes;
 	}
 
+	std::string appliedParams = addedParams;
+	if (!appliedParams.empty() && !removedParams.empty())
+	{
+		appliedParams += " ";
+	}
+	appliedParams += removedParams;
+
 	// Send mode change notification to all channel members
 	if (!finalModes.empty())
 	{
@@ -459,5 +471,8 @@ void ModeCommand::broadcastModeChange(Client* client, Channel* channel,
 
 	Print::Debug("Broadcasting mode change: " + modeChange);
 	channel->broadcast(modeChange, -1);
+	_server->getNetwork().userEvent(client, modeChange);
+	_server->getJournal().channelModes(
+		channel, appliedParams.empty() ? appliedModes : appliedModes + " " + appliedParams);
 	Print::Ok("Mode change broadcasted");
 }
@@ -130,6 +130,8 @@ void PartCommand::executePartFromChannel(Client* client, Channel* channel, const
 	broadcastMsg += "\r\n";
 
 	_server->broadcastChannel(broadcastMsg, channelName, -1);
+	_server->getNetwork().userEvent(client, broadcastMsg);
+	_server->getJournal().channelPart(channel, client, false);
 
 	channel->removeClient(client);
 	
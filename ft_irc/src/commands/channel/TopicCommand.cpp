@@ -83,5 +83,7 @@ void TopicCommand::execute(Client* client, const Message& message)
 
     topicMsg += " TOPIC " + channelName + " :" + newTopic + "\r\n";
     _server->broadcastChannel(topicMsg, channelName, -1);
+    _server->getNetwork().userEvent(client, topicMsg);
+    _server->getJournal().channelTopic(channel);
     Print::Ok("");
 }
@@ -1,7 +1,11 @@
+#include <sstream>
+
 #include "CapCommand.hpp"
 #include "Client.hpp"
+#include "HistoryRing.hpp"
 #include "Message.hpp"
 #include "Server.hpp"
+#include "SessionStore.hpp"
 #include "UtilsFun.hpp"
 
 CapCommand::CapCommand(Server* server) : ACommand(server) {}
@@ -23,6 +27,79 @@ CapCommand& CapCommand::operator=(const CapCommand& other)
 // Static creator for factory
 ACommand* CapCommand::create(Server* server) { return (new CapCommand(server)); }
 
+// Capabilities offered: the ones channel history playback uses, when
+// history is kept at all, and session resumption when sessions are kept
+static const struct
+{
+	const char* name;
+	Client::Cap bit;
+} CAPS[] = {
+	{"batch", Client::CAP_BATCH},
+	{"server-time", Client::CAP_SERVER_TIME},
+	{"draft/chathistory", Client::CAP_CHATHISTORY},
+	{"draft/resume-0.5", Client::CAP_RESUME},
+};
+static const size_t CAP_COUNT = sizeof(CAPS) / sizeof(CAPS[0]);
+
+static int offeredCaps()
+{
+	int caps = 0;
+	if (HistoryRing::isEnabled())
+	{
+		caps |= Client::CAP_BATCH | Client::CAP_SERVER_TIME | Client::CAP_CHATHISTORY;
+	}
+	if (SessionStore::isEnabled())
+	{
+		caps |= Client::CAP_RESUME;
+	}
+	return (caps);
+}
+
+static int findCap(const std::string& name)
+{
+	for (size_t i = 0; i < CAP_COUNT; i++)
+	{
+		if (name == CAPS[i].name)
+		{
+			return (CAPS[i].bit & offeredCaps());
+		}
+	}
+	return (0);
+}
+
+static std::string listCaps(int caps)
+{
+	std::string list;
+	for (size_t i = 0; i < CAP_COUNT; i++)
+	{
+		if (caps & CAPS[i].bit)
+		{
+			list += (list.empty() ? "" : " ") + std::string(CAPS[i].name);
+		}
+	}
+	return (list);
+}
+
+// All of a REQ is taken or none of it; a name with a '-' in front drops it
+bool CapCommand::request(Client* client, const std::string& wanted)
+{
+	int caps = client->getCaps();
+	std::istringstream names(wanted);
+	std::string name;
+	while (names >> name)
+	{
+		bool drop = (name[0] == '-');
+		int bit = findCap(drop ? name.substr(1) : name);
+		if (!bit)
+		{
+			return (false);
+		}
+		caps = drop ? (caps & ~bit) : (caps | bit);
+	}
+	client->setCaps(caps);
+	return (true);
+}
+
 void CapCommand::execute(Client* client, const Message& message)
 {
 	Print::Do("execute CAP command");
@@ -52,10 +129,9 @@ void CapCommand::execute(Client* client, const Message& message)
 	if (subcommand == "LS")
 	{
 		Print::Debug("Listing capabilities");
-		// we don't support any capabilities
-		std::string reply = ":server CAP * LS :\r\n";
+		std::string reply = ":server CAP * LS :" + listCaps(offeredCaps()) + "\r\n";
 		client->sendMessage(reply);
-		Print::Ok("sent empty capability list");
+		Print::Ok("sent capability list");
 	}
 	else if (subcommand == "END")
 	{
@@ -65,25 +141,31 @@ void CapCommand::execute(Client* client, const Message& message)
 	else if (subcommand == "REQ")
 	{
 		Print::Debug("Client requesting capabilities");
-		// Client requesting capabilities - we don't support any
-		std::string reply = ":server CAP * NAK :";
+		std::string wanted;
 		
 		for (size_t i = 1; i < message.getSize(); ++i)
 		{
-			if (i > 1) reply += " ";
-			reply += message.getParams(i);
+			if (i > 1) wanted += " ";
+			wanted += message.getParams(i);
+		}
+		bool taken = request(client, wanted);
+		client->sendMessage(":server CAP * " + std::string(taken ? "ACK" : "NAK") + " :" +
+							wanted + "\r\n");
+		if (taken)
+		{
+			Print::Ok("capabilities now: " + listCaps(client->getCaps()));
+		}
+		else
+		{
+			Print::Warn("rejected capability request: " + wanted);
 		}
-		reply += "\r\n";
-		
-		client->sendMessage(reply);
-		Print::Warn("rejected all capability requests");
 	}
 	else if (subcommand == "LIST")
 	{
 		Print::Debug("Listing active capabilities");
-		std::string reply = ":server CAP * LIST :\r\n";
+		std::string reply = ":server CAP * LIST :" + listCaps(client->getCaps()) + "\r\n";
 		client->sendMessage(reply);
-		Print::Ok("sent empty active capability list");
+		Print::Ok("sent active capability list");
 	}
 	else
 	{
@@ -4,6 +4,7 @@
 #include "Message.hpp"
 #include "NickCommand.hpp"
 #include "Server.hpp"
+#include "SessionStore.hpp"
 
 NickCommand::NickCommand(Server* server) : ACommand(server) {}
 
@@ -59,13 +60,6 @@ void NickCommand::execute(Client* client, const Message& message)
 		sendErrorReply(client, 432, nickname + " :Erroneous nickname");
 		return;
 	}
-	// Check if the nickname is already in use
-	Client* existingClient = _server->getClientByNick(nickname);
-	if ((existingClient && existingClient != client))
-	{
-		sendErrorReply(client, 433, nickname + " :Nickname is already in use");
-		return;
-	}
 	if ((nickname.find("IRCBot") != std::string::npos && client->isBot() == false))
 	{
 		sendErrorReply(client, 433, nickname + " :Nickname is already in use");
@@ -75,9 +69,15 @@ void NickCommand::execute(Client* client, const Message& message)
 	// Previous nickname (if any)
 	std::string oldNick = client->getNickname();
 	Print::Debug("Old nickname: '" + oldNick + "'");
-	// Set the new nickname
-	client->setNickname(nickname);
+	// Take the new nickname, unless someone else holds it
+	if (!_server->changeNick(client, nickname))
+	{
+		sendErrorReply(client, 433, nickname + " :Nickname is already in use");
+		return;
+	}
 	Print::Debug("Nickname updated to: '" + client->getNickname() + "'");
+	_server->getNetwork().userNick(client, oldNick);
+	_server->getJournal().userNick(client, oldNick);
 	// If the client was already registered, inform others about the nick
 	// change
 	if (client->isAuthenticated())
@@ -98,21 +98,11 @@ void NickCommand::execute(Client* client, const Message& message)
 	}
 	if (!client->getNickname().empty() && !client->getUsername().empty())
 	{
-		sendNumericReply(client, IRC::RPL_WELCOME,
-						 ":Welcome to the IRC Network " + client->getNickname() + "!" +
-							 client->getUsername() + "@localhost");
-		sendNumericReply(client, IRC::RPL_YOURHOST, ":Host is server, running version 1.0");
-		sendNumericReply(client, IRC::RPL_CREATED,
-		   ":This server was created " + _server->getStartupTime());
-		sendNumericReply(client, IRC::RPL_MYINFO,
-		   "server ft_irc-1.0 o itkol");
-		sendNumericReply(client, IRC::RPL_ISUPPORT,
-		   "CHANTYPES=#& CHANMODES=itkol PREFIX=(o)@ :are supported by this server");
-		{
-			Message motdMessage("MOTD");
-			MotdCommand motdCmd(_server);
-			motdCmd.execute(client, motdMessage);
-		}
+		// 001 to 005 and the MOTD in one write, see Welcome
+		std::string token = client->hasCap(Client::CAP_RESUME) ? SessionStore::issue(client) : "";
+		client->sendMessage(_server->getWelcome().burst(
+			client->getNickname(), client->getUsername(),
+			token.empty() ? "" : ":server RESUME TOKEN " + token + "\r\n"));
 
 		Print::Ok("Client registration done!");
 	}
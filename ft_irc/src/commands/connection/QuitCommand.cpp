@@ -2,6 +2,7 @@
 #include "Client.hpp"
 #include "Message.hpp"
 #include "Server.hpp"
+#include "SessionStore.hpp"
 #include "UtilsFun.hpp"
 
 QuitCommand::QuitCommand(Server* server) : ACommand(server) {}
@@ -56,10 +57,15 @@ void QuitCommand::execute(Client* client, const Message& message)
 
 	// Broadcast quit message
 	_server->broadcast(quitNotification, client->getFd());
+	_server->getNetwork().userQuit(client, quitMessage);
 
 	std::string quitConfirmation = "ERROR :Closing Link: localhost (Quit: " + 
 		quitMessage + ")\r\n";
 	client->sendMessage(quitConfirmation);
 
+	// The session ends here: the socket the client closes next is no lost
+	// connection to keep for RESUME
+	SessionStore::forget(client);
+
 	Print::Ok("Client quit processed");
 }
\ No newline at end of file
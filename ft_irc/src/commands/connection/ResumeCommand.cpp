@@ -0,0 +1,80 @@
+#include "ResumeCommand.hpp"
+#include "Client.hpp"
+#include "Message.hpp"
+#include "Server.hpp"
+#include "SessionStore.hpp"
+#include "UtilsFun.hpp"
+
+ResumeCommand::ResumeCommand(Server* server) : ACommand(server) {}
+
+ResumeCommand::~ResumeCommand() {}
+
+// Private copy constructor
+ResumeCommand::ResumeCommand(const ResumeCommand& other) : ACommand(other._server) {}
+
+ResumeCommand& ResumeCommand::operator=(const ResumeCommand& other)
+{
+	if (this != &other)
+	{
+		_server = other._server;
+	}
+	return (*this);
+}
+
+// Static creator for factory
+ACommand* ResumeCommand::create(Server* server) { return (new ResumeCommand(server)); }
+
+// Execute the RESUME command: a connection not registered yet takes over the
+// lost session of a token instead of registering itself
+void ResumeCommand::execute(Client* client, const Message& message)
+{
+	Print::Do("execute RESUME command");
+
+	if (!client || !client->isAuthenticated())
+	{
+		Print::Fail("Client NULL or not auth");
+		return;
+	}
+
+	if (!SessionStore::isEnabled())
+	{
+		Print::Fail("sessions are not kept");
+		sendErrorReply(client, 421, "RESUME :Unknown command");
+		return;
+	}
+
+	if (!client->getNickname().empty() && !client->getUsername().empty())
+	{
+		Print::Warn("Already registered");
+		client->sendMessage(":server FAIL RESUME REGISTRATION_IS_COMPLETED :Cannot resume after "
+							"registration\r\n");
+		return;
+	}
+
+	if (message.getSize() == 0 || message.getParams(0).empty())
+	{
+		Print::Fail("no token");
+		sendErrorReply(client, 461, "RESUME :Not enough parameters");
+		return;
+	}
+
+	std::string held;
+	Client* resumed = _server->resumeSession(client, message.getParams(0), held);
+	if (!resumed)
+	{
+		Print::Fail("no session for that token");
+		client->sendMessage(":server FAIL RESUME INVALID_TOKEN :Cannot resume connection, token "
+							"is invalid\r\n");
+		return;
+	}
+
+	// Lines were held from the moment the old connection was lost
+	resumed->sendMessage(":server RESUME SUCCESS " + resumed->getNickname() + "\r\n" + held);
+	std::string token = SessionStore::issue(resumed);
+	if (!token.empty())
+	{
+		resumed->sendMessage(":server RESUME TOKEN " + token + "\r\n");
+	}
+	Print::Ok("Session of " + resumed->getNickname() + " resumed, " + toString(held.size()) +
+			  " bytes held");
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+#include "ServerCommand.hpp"
+#include "Client.hpp"
+#include "Message.hpp"
+#include "Network.hpp"
+#include "Server.hpp"
+#include "UtilsFun.hpp"
+
+ServerCommand::ServerCommand(Server* server) : ACommand(server) {}
+
+ServerCommand::~ServerCommand() {}
+
+// Private copy constructor
+ServerCommand::ServerCommand(const ServerCommand& other) : ACommand(other._server) {}
+
+ServerCommand& ServerCommand::operator=(const ServerCommand& other)
+{
+	if (this != &other)
+	{
+		_server = other._server;
+	}
+	return (*this);
+}
+
+// Static creator for factory
+ACommand* ServerCommand::create(Server* server)
+{
+	return (new ServerCommand(server));
+}
+
+// Execute the SERVER command
+void ServerCommand::execute(Client* client, const Message& message)
+{
+	Print::Do("execute SERVER command");
+
+	if (!client)
+	{
+		Print::Fail("Client NULL");
+		return;
+	}
+
+	// Only a fresh connection can turn into a link
+	if (client->isAuthenticated() || !client->getNickname().empty())
+	{
+		sendErrorReply(client, 462, ":You may not reregister");
+		return;
+	}
+	if (message.getSize() < 2)
+	{
+		sendErrorReply(client, 461, "SERVER :Not enough parameters");
+		return;
+	}
+
+	_server->getNetwork().acceptLink(client, message.getParams(0), message.getParams(1));
+}
@@ -0,0 +1,54 @@
+#include "StandbyCommand.hpp"
+#include "Client.hpp"
+#include "Message.hpp"
+#include "Journal.hpp"
+#include "Server.hpp"
+#include "UtilsFun.hpp"
+
+StandbyCommand::StandbyCommand(Server* server) : ACommand(server) {}
+
+StandbyCommand::~StandbyCommand() {}
+
+// Private copy constructor
+StandbyCommand::StandbyCommand(const StandbyCommand& other) : ACommand(other._server) {}
+
+StandbyCommand& StandbyCommand::operator=(const StandbyCommand& other)
+{
+	if (this != &other)
+	{
+		_server = other._server;
+	}
+	return (*this);
+}
+
+// Static creator for factory
+ACommand* StandbyCommand::create(Server* server)
+{
+	return (new StandbyCommand(server));
+}
+
+// Execute the STANDBY command
+void StandbyCommand::execute(Client* client, const Message& message)
+{
+	Print::Do("execute STANDBY command");
+
+	if (!client)
+	{
+		Print::Fail("Client NULL");
+		return;
+	}
+
+	// Only a fresh connection can turn into a journal stream
+	if (client->isAuthenticated() || !client->getNickname().empty())
+	{
+		sendErrorReply(client, 462, ":You may not reregister");
+		return;
+	}
+	if (message.getSize() < 1)
+	{
+		sendErrorReply(client, 461, "STANDBY :Not enough parameters");
+		return;
+	}
+
+	_server->getJournal().acceptStandby(client, message.getParams(0));
+}
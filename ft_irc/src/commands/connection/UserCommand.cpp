@@ -3,6 +3,7 @@
 #include "Client.hpp"
 #include "Message.hpp"
 #include "Server.hpp"
+#include "SessionStore.hpp"
 #include "UserCommand.hpp"
 #include "UtilsFun.hpp"
 
@@ -55,21 +56,13 @@ void UserCommand::execute(Client* client, const Message& message)
 
 	if (!client->getNickname().empty() && !client->getUsername().empty())
 	{
-		sendNumericReply(client, IRC::RPL_WELCOME,
-						 ":Welcome to the IRC Network " + client->getNickname() + "!" +
-							 client->getUsername() + "@localhost");
-		sendNumericReply(client, IRC::RPL_YOURHOST, ":Host is server, running version 1.0");
-		sendNumericReply(client, IRC::RPL_CREATED,
-		   ":This server was created " + _server->getStartupTime());
-		sendNumericReply(client, IRC::RPL_MYINFO,
-		   "server ft_irc-1.0 o itkol");
-		sendNumericReply(client, IRC::RPL_ISUPPORT,
-		   "CHANTYPES=#& CHANMODES=itkol PREFIX=(o)@ :are supported by this server");
-		{
-			Message motdMessage("MOTD");
-			MotdCommand motdCmd(_server);
-			motdCmd.execute(client, motdMessage);
-		}
+		_server->getNetwork().announceUser(client);
+		_server->getJournal().userRegistered(client);
+		// 001 to 005 and the MOTD in one write, see Welcome
+		std::string token = client->hasCap(Client::CAP_RESUME) ? SessionStore::issue(client) : "";
+		client->sendMessage(_server->getWelcome().burst(
+			client->getNickname(), client->getUsername(),
+			token.empty() ? "" : ":server RESUME TOKEN " + token + "\r\n"));
 		Print::Ok("Client registration done!");
 	}
 	else
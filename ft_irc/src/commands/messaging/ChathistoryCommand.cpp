@@ -0,0 +1,266 @@
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+#include "ChathistoryCommand.hpp"
+#include "Channel.hpp"
+#include "Client.hpp"
+#include "Message.hpp"
+#include "MessageLog.hpp"
+#include "Server.hpp"
+#include "UtilsFun.hpp"
+
+// Lines older than the ring, read from the message log, then the ring's
+class ChathistoryCommand::Task : public CommandPool::Task
+{
+private:
+	std::string _target;
+	int _caps;
+	unsigned long _after;
+	unsigned long _before;
+	size_t _limit;
+	bool _newest;
+	std::vector<HistoryRing::Line> _recent;
+
+public:
+	Task(const std::string& target, int caps, unsigned long after, unsigned long before,
+		 size_t limit, bool newest, const std::vector<HistoryRing::Line>& recent)
+		: _target(target),
+		  _caps(caps),
+		  _after(after),
+		  _before(before),
+		  _limit(limit),
+		  _newest(newest),
+		  _recent(recent)
+	{
+	}
+
+	virtual void run(CommandPool::Reply& reply)
+	{
+		std::vector<HistoryRing::Line> lines;
+		MessageLog::find(_target, _after, _before,
+						 _newest ? _limit - _recent.size() : _limit, _newest, lines);
+		size_t room = _limit - lines.size();
+		lines.insert(lines.end(), _recent.begin(),
+					 _recent.begin() + (room < _recent.size() ? room : _recent.size()));
+		reply.line(ChathistoryCommand::render(_caps, _target, lines));
+		Print::Ok("CHATHISTORY sent " + toString(lines.size()) + " line(s) of " + _target +
+				  ", from the message log");
+	}
+};
+
+ChathistoryCommand::ChathistoryCommand(Server* server) : ACommand(server) {}
+
+ChathistoryCommand::~ChathistoryCommand() {}
+
+// Private copy constructor
+ChathistoryCommand::ChathistoryCommand(const ChathistoryCommand& other) : ACommand(other._server) {}
+
+ChathistoryCommand& ChathistoryCommand::operator=(const ChathistoryCommand& other)
+{
+	if (this != &other)
+	{
+		_server = other._server;
+	}
+	return (*this);
+}
+
+// Static creator for factory
+ACommand* ChathistoryCommand::create(Server* server) { return (new ChathistoryCommand(server)); }
+
+// A reference is `timestamp=<ISO 8601>`, or `*` (no bound) where allowed
+static bool parseReference(const std::string& text, bool allowAny, unsigned long& time)
+{
+	static const std::string prefix = "timestamp=";
+	if (allowAny && text == "*")
+	{
+		time = 0;
+		return (true);
+	}
+	return (text.compare(0, prefix.size(), prefix) == 0 &&
+			ChathistoryCommand::parseTime(text.substr(prefix.size()), time));
+}
+
+void ChathistoryCommand::execute(Client* client, const Message& message)
+{
+	Print::Do("execute CHATHISTORY command");
+
+	if (!validateClientRegist(client))
+	{
+		return;
+	}
+	if (!HistoryRing::isEnabled())
+	{
+		sendErrorReply(client, IRC::ERR_UNKNOWNCOMMAND, "CHATHISTORY :Unknown command");
+		return;
+	}
+
+	std::string subcommand = message.getParams(0);
+	for (size_t i = 0; i < subcommand.size(); ++i)
+	{
+		subcommand[i] = toupper(subcommand[i]);
+	}
+	if (subcommand != "LATEST" && subcommand != "BEFORE" && subcommand != "AFTER" &&
+		subcommand != "BETWEEN")
+	{
+		fail(client, "UNKNOWN_COMMAND", message.getParams(0), "Unknown subcommand");
+		return;
+	}
+	size_t needed = (subcommand == "BETWEEN" ? 5 : 4);
+	if (message.getSize() < needed)
+	{
+		fail(client, "INVALID_PARAMS", subcommand, "Not enough parameters");
+		return;
+	}
+
+	std::string target = message.getParams(1);
+	Channel* channel = isValidChannelName(target) ? _server->getChannel(target) : NULL;
+	if (!channel || !channel->hasClient(client))
+	{
+		fail(client, "INVALID_TARGET", subcommand + " " + target,
+			 "Messages could not be retrieved");
+		return;
+	}
+
+	int limit = std::atoi(message.getParams(needed - 1).c_str());
+	unsigned long first = 0;
+	unsigned long second = 0;
+	if (limit <= 0 ||
+		!parseReference(message.getParams(2), subcommand == "LATEST", first) ||
+		(needed == 5 && !parseReference(message.getParams(3), false, second)))
+	{
+		fail(client, "INVALID_PARAMS", subcommand, "Invalid reference or limit");
+		return;
+	}
+	if (static_cast<size_t>(limit) > HistoryRing::maxLines())
+	{
+		limit = HistoryRing::maxLines();
+	}
+
+	// LATEST and BEFORE count back from the newest line, AFTER forward from
+	// the reference; BETWEEN counts from its first reference
+	unsigned long after = first;
+	unsigned long before = 0;
+	bool newest = (subcommand == "LATEST");
+	if (subcommand == "BEFORE")
+	{
+		after = 0;
+		before = first;
+		newest = true;
+	}
+	else if (subcommand == "BETWEEN")
+	{
+		after = (first <= second ? first : second);
+		before = (first <= second ? second : first);
+		newest = (first > second);
+	}
+	std::vector<HistoryRing::Line> lines;
+	const HistoryRing& history = channel->getHistory();
+	history.find(after, before, limit, newest, lines);
+
+	// The ring holds the latest lines: whatever is older than its oldest one
+	// is only in the message log, read by its reader thread
+	unsigned long oldest = history.oldest();
+	if (MessageLog::isEnabled() && (oldest == 0 || after < oldest) &&
+		(!newest || lines.size() < static_cast<size_t>(limit)))
+	{
+		unsigned long cut = (oldest != 0 && (before == 0 || oldest < before)) ? oldest : before;
+		MessageLog::read(client, new Task(channel->getName(), client->getCaps(), after, cut,
+										  limit, newest, lines));
+		return;
+	}
+	replay(client, channel->getName(), lines);
+	Print::Ok("CHATHISTORY " + subcommand + " sent " + toString(lines.size()) +
+			  " line(s) of " + channel->getName());
+}
+
+void ChathistoryCommand::fail(Client* client, const std::string& code,
+							  const std::string& context, const std::string& description) const
+{
+	Print::Warn("CHATHISTORY " + code + ": " + context);
+	sendReply(client, ":server FAIL CHATHISTORY " + code + " " + context + " :" + description +
+						  "\r\n");
+}
+
+// Lines go out in one piece, inside a batch for the clients that take them
+void ChathistoryCommand::replay(Client* client, const std::string& target,
+								const std::vector<HistoryRing::Line>& lines)
+{
+	std::string out = render(client->getCaps(), target, lines);
+	if (!out.empty())
+	{
+		client->sendMessage(out);
+	}
+}
+
+std::string ChathistoryCommand::render(int caps, const std::string& target,
+									   const std::vector<HistoryRing::Line>& lines)
+{
+	static unsigned long batches = 0;  // command threads render too
+	bool batch = (caps & Client::CAP_BATCH) != 0;
+	bool serverTime = (caps & Client::CAP_SERVER_TIME) != 0;
+	std::string id = "h" + toString(__sync_add_and_fetch(&batches, 1));
+	std::string out;
+
+	if (batch)
+	{
+		out += ":server BATCH +" + id + " chathistory " + target + "\r\n";
+	}
+	for (size_t i = 0; i < lines.size(); i++)
+	{
+		std::string tags;
+		if (batch)
+		{
+			tags = "batch=" + id;
+		}
+		if (serverTime)
+		{
+			tags += (tags.empty() ? "" : ";") + std::string("time=") + formatTime(lines[i].time);
+		}
+		if (!tags.empty())
+		{
+			out += "@" + tags + " ";
+		}
+		out += lines[i].text;
+	}
+	if (batch)
+	{
+		out += ":server BATCH -" + id + "\r\n";
+	}
+	return (out);
+}
+
+// 2026-10-19T08:30:00.250Z
+std::string ChathistoryCommand::formatTime(unsigned long time)
+{
+	time_t seconds = time / 1000;
+	struct tm parts;
+	char text[32];
+	gmtime_r(&seconds, &parts);
+	size_t length = strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%S", &parts);
+	snprintf(text + length, sizeof(text) - length, ".%03luZ", time % 1000);
+	return (text);
+}
+
+// The same, milliseconds optional
+bool ChathistoryCommand::parseTime(const std::string& text, unsigned long& time)
+{
+	struct tm parts = tm();
+	int millis = 0;
+	int fields = sscanf(text.c_str(), "%4d-%2d-%2dT%2d:%2d:%2d.%3d", &parts.tm_year,
+						&parts.tm_mon, &parts.tm_mday, &parts.tm_hour, &parts.tm_min,
+						&parts.tm_sec, &millis);
+	if (fields < 6)
+	{
+		return (false);
+	}
+	parts.tm_year -= 1900;
+	parts.tm_mon -= 1;
+	time_t seconds = timegm(&parts);
+	if (seconds < 0)
+	{
+		return (false);
+	}
+	time = static_cast<unsigned long>(seconds) * 1000 + (fields >= 7 ? millis : 0);
+	return (true);
+}
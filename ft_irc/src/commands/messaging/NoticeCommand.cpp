@@ -100,6 +100,8 @@ void NoticeCommand::sendNoticeToChannel(Client* sender, const std::string& chann
 
 	// Send to all channel members except the sender
 	broadcastToChannel(channel, noticeMsg, sender->getFd());
+	_server->getNetwork().channelMessage(sender, channel, noticeMsg);
+	channel->record(noticeMsg);
 	
 	Print::Debug("Channel NOTICE formatted: " + noticeMsg);
 	Print::Ok("NOTICE sent to channel: " + channelName);
@@ -122,7 +124,7 @@ void NoticeCommand::sendNoticeToUser(Client* sender, const std::string& targetNi
 						  + "@localhost NOTICE " + targetNick + " :" + notice + "\r\n";
 
 	// Send the notice to the target user
-	bool sent = targetClient->sendMessage(noticeMsg);
+	bool sent = targetClient->sendMessage(noticeMsg, Client::LANE_BULK);
 	
 	if (sent)
 	{
@@ -149,9 +151,9 @@ void NoticeCommand::broadcastToChannel(Channel* channel, const std::string& mess
 	for (std::map<int, Client*>::iterator it = clients.begin();
 		 it != clients.end(); ++it)
 	{
-		if (it->first != excludeFd && it->second)
+		if (it->first != excludeFd && it->second && !it->second->isRemote())
 		{
-			it->second->sendMessage(message);
+			it->second->sendMessage(message, Client::LANE_BULK);
 		}
 	}
 }
\ No newline at end of file
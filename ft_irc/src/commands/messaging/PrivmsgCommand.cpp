@@ -126,7 +126,9 @@ void PrivmsgCommand::handleChannelMessage(Client* sender, const std::string& cha
 
 	Print::Debug("Broadcasting to channel " + channelName + ": " + broadcastMsg);
 
-	_server->broadcastChannel(broadcastMsg, channelName, sender->getFd());
+	_server->broadcastChannel(broadcastMsg, channelName, sender->getFd(), Client::LANE_BULK);
+	_server->getNetwork().channelMessage(sender, channel, broadcastMsg);
+	channel->record(broadcastMsg);
 
 	Print::Ok("Message sent to channel " + Color::YELLOW + channelName + Color::RESET +
 			  " by " + Color::YELLOW + sender->getNickname() + Color::RESET);
@@ -163,7 +165,7 @@ void PrivmsgCommand::handlePrivateMessage(Client* sender, const std::string& tar
 
 	Print::Debug("Sending private message: " + privateMsg);
 
-	if (targetClient->sendMessage(privateMsg))
+	if (targetClient->sendMessage(privateMsg, Client::LANE_BULK))
 	{
 		Print::Ok("Private message sent to " + Color::YELLOW + targetNick + Color::RESET +
 				  " from " + Color::YELLOW + sender->getNickname() + Color::RESET);
@@ -216,7 +218,7 @@ void PrivmsgCommand::sendDccNotify(Client* sender, const std::string& target,
 									   sender->getNickname() +
 									   " wants to send you: \002" + parts[2] + "\002\r\n";
 
-			targetClient->sendMessage(notification);
+			targetClient->sendMessage(notification, Client::LANE_BULK);
 		}
 	}
 }
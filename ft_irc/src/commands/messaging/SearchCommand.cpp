@@ -0,0 +1,121 @@
+#include "SearchCommand.hpp"
+#include "Channel.hpp"
+#include "ChathistoryCommand.hpp"
+#include "Client.hpp"
+#include "General.hpp"
+#include "Message.hpp"
+#include "MessageLog.hpp"
+#include "SearchIndex.hpp"
+#include "Server.hpp"
+#include "UtilsFun.hpp"
+
+class SearchCommand::Task : public CommandPool::Task
+{
+private:
+	std::string _nick;
+	std::string _target;
+	std::vector<std::string> _words;
+
+public:
+	Task(const std::string& nick, const std::string& target, const std::vector<std::string>& words)
+		: _nick(nick), _target(target), _words(words)
+	{
+	}
+
+	// ":alice!u@h PRIVMSG #chan :text" shown as "<alice> text", notices as
+	// "-alice- text"
+	virtual void run(CommandPool::Reply& reply)
+	{
+		std::vector<HistoryRing::Line> lines;
+		MessageLog::search(_target, _words, History::SEARCH_RESULTS, lines);
+		for (size_t i = 0; i < lines.size(); i++)
+		{
+			const std::string& raw = lines[i].text;
+			size_t nickEnd = raw.find_first_of("! ");
+			size_t command = raw.find(' ');
+			size_t trailing = raw.find(" :", 1);
+			size_t end = raw.find_last_not_of("\r\n");
+			if (nickEnd == std::string::npos || command == std::string::npos ||
+				trailing == std::string::npos || end == std::string::npos || end < trailing + 2)
+			{
+				continue;
+			}
+			bool notice = raw.compare(command + 1, 6, "NOTICE") == 0;
+			std::string author = raw.substr(1, nickEnd - 1);
+			reply.line(":server NOTICE " + _nick + " :" + _target + " " +
+					   ChathistoryCommand::formatTime(lines[i].time) + " " +
+					   (notice ? "-" + author + "-" : "<" + author + ">") + " " +
+					   raw.substr(trailing + 2, end - trailing - 1) + "\r\n");
+		}
+		reply.line(":server NOTICE " + _nick + " :End of SEARCH " + _target + ", " +
+				   toString(lines.size()) + " line(s)\r\n");
+		Print::Ok("SEARCH found " + toString(lines.size()) + " line(s) of " + _target);
+	}
+};
+
+SearchCommand::SearchCommand(Server* server) : ACommand(server) {}
+
+SearchCommand::~SearchCommand() {}
+
+// Private copy constructor
+SearchCommand::SearchCommand(const SearchCommand& other) : ACommand(other._server) {}
+
+SearchCommand& SearchCommand::operator=(const SearchCommand& other)
+{
+	if (this != &other)
+	{
+		_server = other._server;
+	}
+	return (*this);
+}
+
+// Static creator for factory
+ACommand* SearchCommand::create(Server* server) { return (new SearchCommand(server)); }
+
+void SearchCommand::execute(Client* client, const Message& message)
+{
+	Print::Do("execute SEARCH command");
+
+	if (!validateClientRegist(client))
+	{
+		return;
+	}
+	if (!MessageLog::isSearchable())
+	{
+		sendErrorReply(client, IRC::ERR_UNKNOWNCOMMAND, "SEARCH :Unknown command");
+		return;
+	}
+	if (!validateParameterCount(client, message, 2, "SEARCH"))
+	{
+		return;
+	}
+
+	std::string target = message.getParams(0);
+	Channel* channel = isValidChannelName(target) ? _server->getChannel(target) : NULL;
+	if (!channel)
+	{
+		sendErrorReply(client, IRC::ERR_NOSUCHCHANNEL, target + " :No such channel");
+		return;
+	}
+	if (!channel->hasClient(client))
+	{
+		sendErrorReply(client, IRC::ERR_NOTONCHANNEL, target + " :You're not on that channel");
+		return;
+	}
+
+	// Words may come as one trailing parameter or several
+	std::vector<std::string> words;
+	for (size_t i = 1; i < message.getSize(); i++)
+	{
+		SearchIndex::tokenize(message.getParams(i), words);
+	}
+	if (words.empty())
+	{
+		sendErrorReply(client, IRC::ERR_NEEDMOREPARAMS, "SEARCH :No word to search for");
+		return;
+	}
+
+	// The index lookup is quick, reading the lines back is disk work for the
+	// log's reader thread
+	MessageLog::read(client, new Task(client->getNickname(), channel->getName(), words));
+}
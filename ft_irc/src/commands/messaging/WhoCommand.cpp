@@ -5,6 +5,25 @@
 #include "Channel.hpp"
 #include "UtilsFun.hpp"
 
+class WhoCommand::Task : public CommandPool::Task
+{
+private:
+	const ChannelDirectory::Snapshot* _channels;
+	std::string _target;
+
+public:
+	Task(const ChannelDirectory::Snapshot* channels, const std::string& target)
+		: _channels(channels), _target(target) {}
+
+	virtual ~Task() { ChannelDirectory::release(_channels); }
+
+	virtual void run(CommandPool::Reply& reply)
+	{
+		WhoCommand::listChannelUsers(reply, _channels, _target);
+		reply.numeric(315, _target + " :End of WHO list");
+	}
+};
+
 WhoCommand::WhoCommand(Server* server) : ACommand(server) {}
 
 WhoCommand::~WhoCommand() {}
@@ -55,47 +74,51 @@ void WhoCommand::execute(Client* client, const Message& message)
 	std::string target = message.getParams(0);
 	Print::Debug("WHO target: '" + target + "'");
 
-	if (target.empty())
+	if (!target.empty() && (target[0] == '#' || target[0] == '&'))
 	{
-		Print::Debug("WHO without parameters - no action");
+		// A big channel is rendered from a snapshot, off the event loop
+		Print::Debug("WHO for channel: " + target);
+		CommandPool::run(client, new Task(_server->acquireDirectory(), target));
+		Print::Ok("WHO command completed");
+		return;
 	}
-	else if (target[0] == '#' || target[0] == '&')
+
+	CommandPool::Reply reply(client, false);
+	if (target.empty())
 	{
-		Print::Debug("WHO for channel: " + target);
-		listChannelUsers(client, target);
+		Print::Debug("WHO without parameters - no action");
 	}
 	else
 	{
 		Print::Debug("WHO for user: " + target);
-		listSpecificUser(client, target);
+		listSpecificUser(reply, target);
 	}
 
 	// Send end of WHO list
-	sendNumericReply(client, 315, target + " :End of WHO list");
+	reply.numeric(315, target + " :End of WHO list");
+	reply.finish();
 	Print::Ok("WHO command completed");
 }
 
-void WhoCommand::listChannelUsers(Client* client, const std::string& channelName)
+void WhoCommand::listChannelUsers(CommandPool::Reply& reply, const ChannelDirectory::Snapshot* channels, const std::string& channelName)
 {
 	Print::Debug("Listing users in channel: " + channelName);
 	
-	Channel* channel = _server->getChannel(channelName);
+	const ChannelDirectory::View* channel = channels->find(channelName);
 	if (!channel)
 	{
 		Print::Warn("Channel not found: " + channelName);
 		return;
 	}
 	
-	std::map<int, Client*> channelClients = channel->getClients();
 	int userCount = 0;
 	
-	for (std::map<int, Client*>::iterator it = channelClients.begin();
-		 it != channelClients.end(); ++it)
+	for (std::map<unsigned long, ChannelDirectory::Member>::const_iterator it = channel->members.begin();
+		 it != channel->members.end(); ++it)
 	{
-		Client* targetClient = it->second;
-		if (targetClient && !targetClient->getNickname().empty())
+		if (!it->second.nick.empty())
 		{
-			sendWhoReply(client, targetClient, channelName);
+			sendWhoReply(reply, it->second, channel->name);
 			userCount++;
 		}
 	}
@@ -103,14 +126,18 @@ void WhoCommand::listChannelUsers(Client* client, const std::string& channelName
 	Print::Debug("Listed " + toString(userCount) + " users in channel");
 }
 
-void WhoCommand::listSpecificUser(Client* client, const std::string& nickname)
+void WhoCommand::listSpecificUser(CommandPool::Reply& reply, const std::string& nickname)
 {
 	Print::Debug("Looking for specific user: " + nickname);
 	
 	Client* targetClient = _server->getClientByNick(nickname);
 	if (targetClient && !targetClient->getNickname().empty())
 	{
-		sendWhoReply(client, targetClient, "*");
+		ChannelDirectory::Member target;
+		target.nick = targetClient->getNickname();
+		target.user = targetClient->getUsername();
+		target.op = false;
+		sendWhoReply(reply, target, "*");
 		Print::Debug("Found user: " + nickname);
 	}
 	else
@@ -119,22 +146,18 @@ void WhoCommand::listSpecificUser(Client* client, const std::string& nickname)
 	}
 }
 
-void WhoCommand::sendWhoReply(Client* client, Client* targetClient, const std::string& channel)
+void WhoCommand::sendWhoReply(CommandPool::Reply& reply, const ChannelDirectory::Member& target, const std::string& channel)
 {
 	// Format: 352 <client> <channel> <user> <host> <server> <nick> <flags> :<hopcount> <realname>
 	std::string flags = "H"; // H = Here
 	
-	if (channel != "*")
+	if (target.op)
 	{
-		Channel* chan = _server->getChannel(channel);
-		if (chan && chan->isOperator(targetClient))
-		{
-			flags += "@";
-		}
+		flags += "@";
 	}
 	
-	std::string response = channel + " " + targetClient->getUsername() + " localhost server " 
-						 + targetClient->getNickname() + " " + flags + " :0 " + targetClient->getNickname();
+	std::string response = channel + " " + target.user + " localhost server " 
+						 + target.nick + " " + flags + " :0 " + target.nick;
 	
-	sendNumericReply(client, 352, response);
+	reply.numeric(352, response);
 }
\ No newline at end of file
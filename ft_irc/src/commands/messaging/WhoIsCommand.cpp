@@ -106,16 +106,18 @@ void WhoIsCommand::sendWhoIsInfo(Client* client, Client* targetClient)
 std::string WhoIsCommand::getClientChannels(Client* targetClient)
 {
 	std::string channelList = "";
-	std::map<std::string, Channel*>& channels = _server->getChannels();
+	const ChannelDirectory::Snapshot* channels = _server->getDirectory();
 	
 	Print::Debug("Getting channels for user: " + targetClient->getNickname());
 	
 	int channelCount = 0;
-	for (std::map<std::string, Channel*>::iterator it = channels.begin(); 
-		 it != channels.end(); ++it)
+	for (ChannelDirectory::Snapshot::const_iterator it = channels->begin(); 
+		 it != channels->end(); ++it)
 	{
-		Channel* channel = it->second;
-		if (channel && channel->hasClient(targetClient))
+		const ChannelDirectory::View* channel = it->second;
+		std::map<unsigned long, ChannelDirectory::Member>::const_iterator member =
+			channel->members.find(targetClient->getId());
+		if (member != channel->members.end())
 		{
 			if (!channelList.empty())
 			{
@@ -123,12 +125,12 @@ std::string WhoIsCommand::getClientChannels(Client* targetClient)
 			}
 			
 			// Add @ if user is operator in this channel
-			if (channel->isOperator(targetClient))
+			if (member->second.op)
 			{
 				channelList += "@";
 			}
 			
-			channelList += channel->getName();
+			channelList += channel->name;
 			channelCount++;
 		}
 	}
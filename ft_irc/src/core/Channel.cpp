@@ -1,7 +1,10 @@
 #include "Channel.hpp"
+#include "ChannelDirectory.hpp"
 #include "Client.hpp"
+#include "FanoutPool.hpp"
+#include "MessageLog.hpp"
 
-Channel::Channel(const std::string& name)
+Channel::Channel(const std::string& name, ChannelDirectory* directory)
 	: _name(name),
 	_topic(""),
 	_inviteOnly(false),
@@ -9,7 +12,13 @@ Channel::Channel(const std::string& name)
 	_hasKey(false),
 	_key(""),
 	_hasUserLimit(false),
-	_userLimit(0) {}
+	_userLimit(0),
+	_directory(directory),
+	_homeShard(-1),
+	_held(false)
+{
+	touch();
+}
 
 Channel::~Channel() {}
 
@@ -21,13 +30,31 @@ const std::map<int, Client*>& Channel::getClients() { return _clients; };
 
 const std::map<int, Client*>& Channel::getOperators() { return _operators; };
 
-void Channel::setTopic(const std::string& topic) { _topic = topic; }
+// Let the directory render this channel again
+void Channel::touch()
+{
+	if (_directory)
+	{
+		_directory->markDirty(this);
+	}
+}
+
+void Channel::setTopic(const std::string& topic)
+{
+	_topic = topic;
+	touch();
+}
 
 void Channel::addClient(Client* client)
 {
 	if (client)
 	{
+		if (client->isRemote() && !_clients.count(client->getFd()))
+		{
+			_links[client->getRoute()]++;
+		}
 		_clients[client->getFd()] = client;
+		touch();
 	}
 }
 
@@ -36,6 +63,7 @@ void Channel::addOperator(Client* _operator)
 	if (_operator)
 	{
 		_operators[_operator->getFd()] = _operator;
+		touch();
 	}
 }
 
@@ -43,7 +71,12 @@ void Channel::removeClient(Client* client)
 {
 	if (client)
 	{
-		_clients.erase(client->getFd());
+		if (_clients.erase(client->getFd()) && client->isRemote()
+			&& --_links[client->getRoute()] == 0)
+		{
+			_links.erase(client->getRoute());
+		}
+		touch();
 	}
 }
 
@@ -52,6 +85,7 @@ void Channel::removeOperator(Client* client)
 	if (client)
 	{
 		_operators.erase(client->getFd());
+		touch();
 	}
 }
 
@@ -77,6 +111,10 @@ bool Channel::hasClient(Client* client) const
 
 bool Channel::isEmpty() const
 {
+	if (_held)
+	{
+		return false;
+	}
 	if (_clients.empty())
 	{
 		return true;
@@ -89,6 +127,16 @@ bool Channel::isEmpty() const
 	return false;
 }
 
+bool Channel::isHeld() const
+{
+	return _held;
+}
+
+void Channel::setHeld(bool held)
+{
+	_held = held;
+}
+
 // Mode management methods
 bool Channel::isInviteOnly() const
 {
@@ -154,18 +202,37 @@ void Channel::removeUserLimit()
 	_hasUserLimit = false;
 }
 
-void Channel::broadcast(const std::string& message, int excludeFd)
+// Large channels are fanned out in parallel, see FanoutPool. Sender and
+// recipients each vote for the channel's home shard.
+void Channel::broadcast(const std::string& message, int excludeFd, Client::Lane lane)
 {
-	for (std::map<int, Client*>::iterator it = _clients.begin(); 
-		 it != _clients.end(); ++it)
+	if (_homeShard >= 0)
 	{
-		if (it->first != excludeFd && it->second)
+		std::map<int, Client*>::iterator sender = _clients.find(excludeFd);
+		if (sender != _clients.end())
 		{
-			it->second->sendMessage(message);
+			sender->second->noteChannelTraffic(_homeShard);
 		}
 	}
+	FanoutPool::deliver(_clients, message, excludeFd, lane, _homeShard);
 }
 
+int Channel::getHomeShard() const { return _homeShard; }
+
+void Channel::setHomeShard(int shard) { _homeShard = shard; }
+
+const std::map<Client*, int>& Channel::getLinks() const { return _links; }
+
+// A PRIVMSG or NOTICE said in the channel, kept for CHATHISTORY
+void Channel::record(const std::string& line)
+{
+	unsigned long time = HistoryRing::now();
+	_history.push(line, time);
+	MessageLog::write(_name, time, line);
+}
+
+HistoryRing& Channel::getHistory() { return _history; }
+
 void Channel::addInvitedUser(const std::string& nickname)
 {
     _invitedUsers.insert(nickname);
@@ -0,0 +1,238 @@
+#include "Channel.hpp"
+#include "ChannelDirectory.hpp"
+#include "Client.hpp"
+#include "Epoch.hpp"
+#include "NickRegistry.hpp"
+
+#include <vector>
+
+ChannelDirectory::ChannelDirectory() : _current(new Snapshot()), _pending(0)
+{
+	_current->count = 0;
+	_current->refs = 1;
+	for (size_t i = 0; i < BUCKETS; ++i)
+	{
+		Bucket* bucket = new Bucket();
+		bucket->refs = 1;
+		_current->buckets[i] = bucket;
+	}
+}
+
+ChannelDirectory::~ChannelDirectory() { release(_current); }
+
+// Channel names compare case-insensitively, like nicks
+const ChannelDirectory::View* ChannelDirectory::Snapshot::find(const std::string& name) const
+{
+	std::string folded = NickRegistry::fold(name);
+	const Views& channels = buckets[bucketOf(folded)]->channels;
+	Views::const_iterator it = channels.find(folded);
+	if (it != channels.end())
+	{
+		return (it->second);
+	}
+	return (NULL);
+}
+
+ChannelDirectory::Snapshot::const_iterator::const_iterator(const Snapshot* snapshot, size_t bucket)
+	: _snapshot(snapshot), _bucket(bucket)
+{
+	if (_bucket < BUCKETS)
+	{
+		_it = _snapshot->buckets[_bucket]->channels.begin();
+		skipEmpty();
+	}
+}
+
+// Moves on to the next bucket with channels once this one is done
+void ChannelDirectory::Snapshot::const_iterator::skipEmpty()
+{
+	while (_it == _snapshot->buckets[_bucket]->channels.end())
+	{
+		if (++_bucket == BUCKETS)
+		{
+			return;
+		}
+		_it = _snapshot->buckets[_bucket]->channels.begin();
+	}
+}
+
+ChannelDirectory::Snapshot::const_iterator& ChannelDirectory::Snapshot::const_iterator::operator++()
+{
+	++_it;
+	skipEmpty();
+	return (*this);
+}
+
+bool ChannelDirectory::Snapshot::const_iterator::operator==(const const_iterator& other) const
+{
+	if (_bucket != other._bucket)
+	{
+		return (false);
+	}
+	return (_bucket == BUCKETS || _it == other._it);
+}
+
+// FNV-1a, the nick table hashes the same way
+size_t ChannelDirectory::bucketOf(const std::string& folded)
+{
+	unsigned int hash = 2166136261u;
+	for (size_t i = 0; i < folded.size(); ++i)
+	{
+		hash = (hash ^ static_cast<unsigned char>(folded[i])) * 16777619u;
+	}
+	return (hash % BUCKETS);
+}
+
+void ChannelDirectory::markDirty(Channel* channel)
+{
+	ScopedLock lock(_dirtyLock);
+	_dirty.insert(channel);
+	__atomic_store_n(&_pending, 1, __ATOMIC_RELEASE);
+}
+
+// The channel is about to go away: forget it rather than render it
+void ChannelDirectory::markRemoved(Channel* channel)
+{
+	ScopedLock lock(_dirtyLock);
+	_dirty.erase(channel);
+	_removed.insert(NickRegistry::fold(channel->getName()));
+	__atomic_store_n(&_pending, 1, __ATOMIC_RELEASE);
+}
+
+const ChannelDirectory::Snapshot* ChannelDirectory::snapshot()
+{
+	// Nothing changed: no lock at all
+	if (!__atomic_load_n(&_pending, __ATOMIC_ACQUIRE))
+	{
+		return (__atomic_load_n(&_current, __ATOMIC_ACQUIRE));
+	}
+
+	ScopedLock lock(_dirtyLock);
+	if (!_pending)
+	{
+		return (_current);
+	}
+
+	// Share the previous buckets, then copy the ones that change
+	Snapshot* next = new Snapshot(*_current);
+	next->refs = 1;
+	for (size_t i = 0; i < BUCKETS; ++i)
+	{
+		__atomic_add_fetch(&next->buckets[i]->refs, 1, __ATOMIC_RELAXED);
+	}
+	std::map<size_t, Bucket*> copied;
+	std::vector<std::pair<std::string, const View*> > changes;
+	for (std::set<std::string>::iterator it = _removed.begin(); it != _removed.end(); ++it)
+	{
+		changes.push_back(std::make_pair(*it, static_cast<const View*>(NULL)));
+	}
+	for (std::set<Channel*>::iterator it = _dirty.begin(); it != _dirty.end(); ++it)
+	{
+		View* view = render(*it);
+		changes.push_back(std::make_pair(NickRegistry::fold(view->name), view));
+	}
+	for (size_t i = 0; i < changes.size(); ++i)
+	{
+		size_t index = bucketOf(changes[i].first);
+		Bucket*& bucket = copied[index];
+		if (!bucket)
+		{
+			bucket = new Bucket(*next->buckets[index]);
+			bucket->refs = 1;
+			for (Views::iterator it = bucket->channels.begin(); it != bucket->channels.end(); ++it)
+			{
+				__atomic_add_fetch(&it->second->refs, 1, __ATOMIC_RELAXED);
+			}
+			releaseBucket(next->buckets[index]);
+			next->buckets[index] = bucket;
+		}
+		Views::iterator slot = bucket->channels.find(changes[i].first);
+		if (slot != bucket->channels.end())
+		{
+			releaseView(slot->second);
+			bucket->channels.erase(slot);
+			--next->count;
+		}
+		if (changes[i].second)
+		{
+			bucket->channels[changes[i].first] = changes[i].second;
+			++next->count;
+		}
+	}
+	_dirty.clear();
+	_removed.clear();
+
+	Snapshot* previous = _current;
+	__atomic_store_n(&_current, next, __ATOMIC_RELEASE);
+	__atomic_store_n(&_pending, 0, __ATOMIC_RELEASE);
+	Epoch::retire(previous, &ChannelDirectory::unpublish);
+	return (next);
+}
+
+// Only safe inside an epoch guard, where the snapshot cannot be freed yet
+const ChannelDirectory::Snapshot* ChannelDirectory::acquire()
+{
+	const Snapshot* current = snapshot();
+	__atomic_add_fetch(&current->refs, 1, __ATOMIC_RELAXED);
+	return (current);
+}
+
+ChannelDirectory::View* ChannelDirectory::render(Channel* channel)
+{
+	View* view = new View();
+	view->name = channel->getName();
+	view->topic = channel->getTopic();
+	view->refs = 1;
+
+	const std::map<int, Client*>& clients = channel->getClients();
+	for (std::map<int, Client*>::const_iterator it = clients.begin(); it != clients.end(); ++it)
+	{
+		Client* client = it->second;
+		if (!client)
+		{
+			continue;
+		}
+		Member& member = view->members[client->getId()];
+		member.nick = client->getNickname();
+		member.user = client->getUsername();
+		member.op = channel->isOperator(client);
+	}
+	return (view);
+}
+
+void ChannelDirectory::releaseView(const View* view)
+{
+	if (__atomic_sub_fetch(&view->refs, 1, __ATOMIC_ACQ_REL) == 0)
+	{
+		delete view;
+	}
+}
+
+void ChannelDirectory::release(const Snapshot* snapshot)
+{
+	if (__atomic_sub_fetch(&snapshot->refs, 1, __ATOMIC_ACQ_REL) > 0)
+	{
+		return;
+	}
+	for (size_t i = 0; i < BUCKETS; ++i)
+	{
+		releaseBucket(snapshot->buckets[i]);
+	}
+	delete snapshot;
+}
+
+void ChannelDirectory::releaseBucket(const Bucket* bucket)
+{
+	if (__atomic_sub_fetch(&bucket->refs, 1, __ATOMIC_ACQ_REL) > 0)
+	{
+		return;
+	}
+	for (Views::const_iterator it = bucket->channels.begin(); it != bucket->channels.end(); ++it)
+	{
+		releaseView(it->second);
+	}
+	delete bucket;
+}
+
+// Called by Epoch once no guard can still see the snapshot
+void ChannelDirectory::unpublish(void* snapshot) { release(static_cast<Snapshot*>(snapshot)); }
@@ -0,0 +1,160 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "ChannelWorker.hpp"
+#include "Client.hpp"
+#include "CommandFactory.hpp"
+#include "Epoch.hpp"
+#include "Message.hpp"
+#include "Server.hpp"
+#include "UtilsFun.hpp"
+
+ChannelWorker::ChannelWorker(Server* server, int id)
+	: _server(server),
+	  _id(id),
+	  _threaded(false),
+	  _stopping(false),
+	  _sleeping(0)
+{
+	_wakePipe[0] = -1;
+	_wakePipe[1] = -1;
+}
+
+ChannelWorker::~ChannelWorker()
+{
+	stop();
+	if (_wakePipe[0] >= 0)
+	{
+		::close(_wakePipe[0]);
+		::close(_wakePipe[1]);
+	}
+}
+
+// Start the worker thread. Shutdown signals stay with the main thread.
+bool ChannelWorker::start()
+{
+	if (pipe2(_wakePipe, O_NONBLOCK | O_CLOEXEC) != 0)
+	{
+		Print::Fail("Error creating wake pipe: " + toString(strerror(errno)));
+		return (false);
+	}
+
+	sigset_t blocked;
+	sigset_t previous;
+	sigemptyset(&blocked);
+	sigaddset(&blocked, SIGINT);
+	sigaddset(&blocked, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+	int error = pthread_create(&_thread, NULL, &ChannelWorker::threadMain, this);
+	pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+	if (error != 0)
+	{
+		Print::Fail("Error starting channel worker " + toString(_id) + ": " +
+					toString(strerror(error)));
+		return (false);
+	}
+	_threaded = true;
+	return (true);
+}
+
+void ChannelWorker::stop()
+{
+	if (!_threaded)
+	{
+		return;
+	}
+	_stopping = true;
+	wake();
+	pthread_join(_thread, NULL);
+	_threaded = false;
+}
+
+void* ChannelWorker::threadMain(void* arg)
+{
+	static_cast<ChannelWorker*>(arg)->run();
+	return (NULL);
+}
+
+void ChannelWorker::run()
+{
+	pollfd wake;
+	wake.fd = _wakePipe[0];
+	wake.events = POLLIN;
+
+	Print::Debug("Channel worker " + toString(_id) + " started");
+	while (!_stopping || !_queue.empty())
+	{
+		// Same handshake as the logic thread: flag the nap, then look once more
+		__atomic_store_n(&_sleeping, 1, __ATOMIC_SEQ_CST);
+		if (_queue.empty() && !_stopping)
+		{
+			poll(&wake, 1, 1000);
+		}
+		__atomic_store_n(&_sleeping, 0, __ATOMIC_SEQ_CST);
+
+		char buffer[256];
+		while (read(_wakePipe[0], buffer, sizeof(buffer)) > 0)
+		{
+		}
+		runTasks();
+		Epoch::collect();
+	}
+	Print::Debug("Channel worker " + toString(_id) + " stopped");
+}
+
+// Run everything queued so far, holding the partition lock per task so the
+// logic thread can slip in between
+void ChannelWorker::runTasks()
+{
+	Task task;
+	Epoch::Guard guard;
+
+	while (_queue.pop(task))
+	{
+		{
+			ScopedLock partition(_partitionLock);
+			Print::Debug("Processing command: " + task.message->getCommand());
+			CommandFactory::executeCommand(task.client, _server, *task.message);
+		}
+		delete task.message;
+		if (task.client->endChannelTask())
+		{
+			_server->submit(Server::LogicEvent::CHANNEL_DONE, task.client, NULL);
+		}
+	}
+}
+
+void ChannelWorker::wake()
+{
+	char byte = 0;
+	if (write(_wakePipe[1], &byte, 1) < 0 && errno != EAGAIN)
+	{
+		Print::Debug("Could not wake channel worker " + toString(_id));
+	}
+}
+
+// Queue a command for a channel this worker owns. The client stays alive
+// until the worker is done with it (see Client::endChannelTask).
+void ChannelWorker::post(Client* client, Message* message)
+{
+	Task task;
+	task.client = client;
+	task.message = message;
+	client->beginChannelTask();
+	_queue.push(task);
+
+	if (__atomic_exchange_n(&_sleeping, 0, __ATOMIC_SEQ_CST))
+	{
+		wake();
+	}
+}
+
+void ChannelWorker::lock() { _partitionLock.lock(); }
+
+void ChannelWorker::unlock() { _partitionLock.unlock(); }
@@ -1,20 +1,71 @@
+#include <fcntl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include <cerrno>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <sstream>
 #include <string>
 
 #include "Client.hpp"
+#include "General.hpp"
+#include "SessionStore.hpp"
+#include "Shard.hpp"
+#include "ZStream.hpp"
 
-Client::Client(int fd) : _fd(fd), _authenticated(false), _isBot(false) {}
+static unsigned long g_nextClientId = 0;
 
-Client::~Client() {}
+Client::Client(int fd, double floodBurst, double floodRate)
+	: _fd(fd),
+	  _id(__sync_add_and_fetch(&g_nextClientId, 1)),
+	  _shard(NULL),
+	  _socket(fd, false),
+	  _authenticated(false),
+	  _isBot(false),
+	  _caps(0),
+	  _isLink(false),
+	  _isJournalStream(false),
+	  _route(NULL),
+	  _announced(false),
+	  _nickTs(0),
+	  _disconnect(0),
+	  _detached(0),
+	  _compressLevel(0),
+	  _deflater(NULL),
+	  _inflater(NULL),
+	  _frameOffset(0),
+	  _channelTasks(0),
+	  _channelWaiter(0),
+	  _offloaded(false),
+	  _affinityShard(-1),
+	  _affinityVotes(0),
+	  _broadcastSeq(0),
+	  _floodBucket(floodBurst, floodRate),
+	  _throttled(false),
+	  _floodStrikes(0),
+	  _controlOffset(0),
+	  _bulkOffset(0),
+	  _writeError(false)
+{
+}
+
+Client::~Client()
+{
+	delete _deflater;
+	delete _inflater;
+}
 
 int Client::getFd() const { return _fd; }
 
+unsigned long Client::getId() const { return _id; }
+
+Shard* Client::getShard() const { return _shard; }
+
+void Client::setShard(Shard* shard) { _shard = shard; }
+
 std::string Client::getFdString() const
 {
 	std::stringstream ss;
@@ -22,6 +73,17 @@ std::string Client::getFdString() const
 	return ss.str();
 }
 
+std::string& Client::getInputBuffer() { return _inputBuffer; }
+
+// Give the buffer memory back once it is drained, idle clients keep nothing
+void Client::releaseInputBuffer()
+{
+	if (_inputBuffer.empty())
+	{
+		std::string().swap(_inputBuffer);
+	}
+}
+
 const std::string& Client::getNickname() const { return _nickname; }
 
 void Client::setNickname(const std::string& nickname) { _nickname = nickname; }
@@ -36,28 +98,484 @@ void Client::setAuthenticated(bool auth) { _authenticated = auth; }
 
 bool Client::isBot() { return _isBot; }
 void Client::setBot(bool status) { _isBot = status; }
-bool Client::sendMessage(const std::string& message)
+
+bool Client::isLink() const { return _isLink; }
+
+void Client::setLink(bool link) { _isLink = link; }
+
+bool Client::isJournalStream() const { return _isJournalStream; }
+
+void Client::setJournalStream(bool stream) { _isJournalStream = stream; }
+
+bool Client::isRemote() const { return (_route != NULL); }
+
+Client* Client::getRoute() const { return _route; }
+
+void Client::setRoute(Client* link) { _route = link; }
+
+bool Client::hasCap(Cap cap) const { return (_caps & cap) != 0; }
+
+int Client::getCaps() const { return _caps; }
+
+void Client::setCaps(int caps) { _caps = caps; }
+
+bool Client::isAnnounced() const { return _announced; }
+
+void Client::setAnnounced(bool announced) { _announced = announced; }
+
+time_t Client::getNickTs() const { return _nickTs; }
+
+void Client::setNickTs(time_t ts) { _nickTs = ts; }
+
+// Asked from wherever the state lives; read by the owning shard, which
+// flushes the pending output and closes the connection
+void Client::requestDisconnect() { __atomic_store_n(&_disconnect, 1, __ATOMIC_RELEASE); }
+
+bool Client::isDisconnectRequested() const
+{
+	return (__atomic_load_n(&_disconnect, __ATOMIC_ACQUIRE) != 0);
+}
+
+bool Client::isDetached() const { return (__atomic_load_n(&_detached, __ATOMIC_ACQUIRE) != 0); }
+
+void Client::setDetached(bool detached)
+{
+	__atomic_store_n(&_detached, detached ? 1 : 0, __ATOMIC_RELEASE);
+}
+
+// A detached client takes over another connection's socket, under its own
+// fd: the one its channels and shard know it by. Whatever the lost
+// connection left half done starts over; the other connection still closes
+// its own fd.
+bool Client::reattach(int fd, Shard* shard)
+{
+	if (dup3(fd, _fd, O_CLOEXEC) < 0)
+	{
+		return (false);
+	}
+	std::string().swap(_inputBuffer);
+	std::string().swap(_controlOut);
+	std::string().swap(_bulkOut);
+	_controlOffset = 0;
+	_bulkOffset = 0;
+	_writeError = false;
+	_throttled = false;
+	_offloaded = false;
+	_shard = shard;
+	return (true);
+}
+
+// From the state side once the link is up; the shard picks it up at its
+// next flush, everything queued from then on is compressed
+void Client::setCompression(int level)
+{
+	__atomic_store_n(&_compressLevel, level, __ATOMIC_RELEASE);
+}
+
+// Input of a server link: plain lines, and "Z <length>" frames of deflated
+// lines from a peer that compresses. The lines end up in the input buffer,
+// anything incomplete waits for more. False on a corrupt stream.
+bool Client::receiveLink(const char* data, size_t length)
+{
+	size_t pos = 0;
+	size_t eol;
+
+	_linkIn.append(data, length);
+	while ((eol = _linkIn.find("\r\n", pos)) != std::string::npos)
+	{
+		if (_linkIn.compare(pos, 2, "Z ") != 0)
+		{
+			_inputBuffer.append(_linkIn, pos, eol + 2 - pos);
+			pos = eol + 2;
+			continue;
+		}
+		size_t frameLength = std::strtoul(_linkIn.c_str() + pos + 2, NULL, 10);
+		if (_linkIn.length() - (eol + 2) < frameLength)
+		{
+			break;
+		}
+		if (!_inflater)
+		{
+			_inflater = new ZStream(ZStream::INFLATE);
+		}
+		if (!_inflater->process(_linkIn.data() + eol + 2, frameLength, _inputBuffer))
+		{
+			return (false);
+		}
+		pos = eol + 2 + frameLength;
+	}
+	_linkIn.erase(0, pos);
+	if (_linkIn.empty())
+	{
+		std::string().swap(_linkIn);
+	}
+	return (true);
+}
+
+// Counted by the logic thread, released by the channel worker that ran it
+void Client::beginChannelTask() { __atomic_add_fetch(&_channelTasks, 1, __ATOMIC_RELAXED); }
+
+// True for the last task when the logic thread waits for it: the worker
+// then tells it with a CHANNEL_DONE event
+bool Client::endChannelTask()
+{
+	if (__atomic_sub_fetch(&_channelTasks, 1, __ATOMIC_SEQ_CST) > 0)
+	{
+		return (false);
+	}
+	return (__atomic_exchange_n(&_channelWaiter, 0, __ATOMIC_SEQ_CST) != 0);
+}
+
+unsigned long Client::getBroadcastSeq() const { return _broadcastSeq; }
+
+void Client::setBroadcastSeq(unsigned long seq) { _broadcastSeq = seq; }
+
+bool Client::hasChannelTasks() const
+{
+	return (__atomic_load_n(&_channelTasks, __ATOMIC_ACQUIRE) > 0);
+}
+
+// Logic thread: false if no channel task is left, else the last one to end
+// sends CHANNEL_DONE. The flag is raised before the last look at the count,
+// so either this look sees the worker's decrement or the worker sees the flag.
+bool Client::waitChannelTasks()
+{
+	if (!hasChannelTasks())
+	{
+		return (false);
+	}
+	__atomic_store_n(&_channelWaiter, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&_channelTasks, __ATOMIC_SEQ_CST) > 0)
+	{
+		return (true);
+	}
+	__atomic_store_n(&_channelWaiter, 0, __ATOMIC_SEQ_CST);
+	return (false);
+}
+
+TokenBucket& Client::getFloodBucket() { return _floodBucket; }
+
+// Set by the thread running its commands, cleared by its shard: the same
+// thread but in pipelined mode
+bool Client::isOffloaded() const { return (__atomic_load_n(&_offloaded, __ATOMIC_ACQUIRE)); }
+
+void Client::setOffloaded(bool offloaded)
+{
+	__atomic_store_n(&_offloaded, offloaded, __ATOMIC_RELEASE);
+}
+
+// One channel message sent or received, under the state lock. Boyer-Moore
+// majority vote: a shard carrying most of the traffic ends up as the
+// candidate, with a lead of votes.
+void Client::noteChannelTraffic(int homeShard)
+{
+	if (homeShard == _affinityShard)
+	{
+		if (_affinityVotes < Sched::MIGRATE_VOTES_MAX)
+		{
+			_affinityVotes++;
+		}
+	}
+	else if (_affinityVotes == 0)
+	{
+		_affinityShard = homeShard;
+		_affinityVotes = 1;
+	}
+	else
+	{
+		_affinityVotes--;
+	}
+}
+
+int Client::getAffinityShard() const { return _affinityShard; }
+
+int Client::getAffinityVotes() const { return _affinityVotes; }
+
+void Client::resetAffinity()
+{
+	_affinityShard = -1;
+	_affinityVotes = 0;
+}
+
+bool Client::isThrottled() const { return _throttled; }
+
+void Client::setThrottled(bool throttled) { _throttled = throttled; }
+
+int Client::addFloodStrike() { return ++_floodStrikes; }
+
+void Client::resetFloodStrikes() { _floodStrikes = 0; }
+
+// Send a message to this client. On the thread of the shard owning the
+// client it is queued directly; from any other thread (another shard, the
+// logic thread) it is posted to the owner, which is the only thread
+// touching the socket and the queues.
+bool Client::sendMessage(const std::string& message, Lane lane)
 {
 	Print::Debug("Attempting to send to client FD: " + getFdString());
 	Print::Debug(message);
 
-	ssize_t sentBytes = send(_fd, message.c_str(), message.length(), MSG_NOSIGNAL);
+	if (message.empty())
+	{
+		return true;
+	}
+	// Its connection is gone: kept for when it comes back
+	if (isDetached() && SessionStore::hold(this, message))
+	{
+		return true;
+	}
+	// A user of another server: the line goes down its link, in order
+	if (_route)
+	{
+		return _route->sendMessage(message);
+	}
+	if (_shard && Shard::current() != _shard)
+	{
+		_shard->post(_fd, _id, message, lane);
+		return true;
+	}
+	return queueOutput(message, lane);
+}
 
-	if (sentBytes < 0)
+// Queue a message on a lane. An idle client is flushed by its shard at the
+// end of the loop iteration (right away outside of the event loop); one
+// that already has output queued waits for POLLOUT.
+bool Client::queueOutput(const std::string& message, Lane lane, unsigned long broadcasts)
+{
+	if (_writeError)
 	{
-		Print::StdErr("sending message: " + toString(strerror(errno)) +
-					  " (errno: " + toString(errno));
 		return false;
 	}
-	else if (sentBytes < (ssize_t)message.length())
+	if (!appendOutput(message, lane, broadcasts))
+	{
+		Print::Debug("Output queued, " + toString(getQueuedBytes()) + " bytes pending");
+		return true;
+	}
+	return scheduleFlush();
+}
+
+// Append to a lane without scheduling anything. Returns true when the
+// client just went from idle to having output, the caller then owes it a
+// scheduleFlush(). Used directly by the fan-out pool.
+bool Client::appendOutput(const std::string& message, Lane lane, unsigned long broadcasts)
+{
+	if (_writeError)
 	{
-		Print::Log("WARNING: Partial send - only " + toString(sentBytes) + " of " +
-				   toString(message.length()) + " bytes sent");
 		return false;
 	}
+
+	bool wasIdle = !hasPendingOutput();
+	if (_shard)
+	{
+		_shard->catchUpBroadcasts(this, broadcasts);
+	}
+	if (lane == LANE_BULK)
+	{
+		_bulkOut += message;
+	}
 	else
 	{
-		Print::Debug("Successfully sent " + toString(sentBytes) + " bytes");
+		_controlOut += message;
+	}
+	return (wasIdle);
+}
+
+// Have the owning shard write the client's output at the end of its loop
+// iteration, or write it right away outside of the event loop
+bool Client::scheduleFlush()
+{
+	if (_shard && Shard::current() == _shard)
+	{
+		_shard->markDirty(_fd);
 		return true;
 	}
+	return flush();
+}
+
+// Hang up now; the object itself may outlive the connection (see Epoch)
+void Client::closeSocket() { _socket.close(); }
+
+// Both lanes of a compressing link, deflated into one frame behind the
+// ones still being written. The peer tells frames from lines by the header.
+void Client::packFrame()
+{
+	int level = __atomic_load_n(&_compressLevel, __ATOMIC_ACQUIRE);
+	std::string frame;
+
+	if (_controlOut.empty() && _bulkOut.empty())
+	{
+		return;
+	}
+	if (!_deflater)
+	{
+		_deflater = new ZStream(ZStream::DEFLATE, level);
+	}
+	_controlOut += _bulkOut;
+	if (!_deflater->process(_controlOut.data(), _controlOut.length(), frame))
+	{
+		Print::StdErr("compressing link output for FD: " + getFdString());
+		_writeError = true;
+		return;
+	}
+	_frameOut += "Z " + toString(frame.length()) + "\r\n" + frame;
+	std::string().swap(_controlOut);
+	std::string().swap(_bulkOut);
+}
+
+// Write as much queued output as the socket takes, control lane first.
+// A bulk line that was partially written is always finished before the
+// control lane goes out, so lines from both lanes never interleave.
+bool Client::flush()
+{
+	// A compressing link packs what is queued, once no line is half written
+	if (__atomic_load_n(&_compressLevel, __ATOMIC_ACQUIRE) > 0 && _controlOffset == 0 &&
+		_bulkOffset == 0)
+	{
+		packFrame();
+	}
+	while (hasPendingOutput() && !_writeError)
+	{
+		struct iovec iov[4];
+		size_t* offsets[4];
+		int count = 0;
+		size_t total = 0;
+		size_t bulkResume = _bulkOffset;
+
+		if (_frameOffset < _frameOut.length())
+		{
+			iov[count].iov_base = (void*)(_frameOut.data() + _frameOffset);
+			iov[count].iov_len = _frameOut.length() - _frameOffset;
+			offsets[count++] = &_frameOffset;
+		}
+		// Rest of a bulk line cut by a previous partial write
+		if (_bulkOffset > 0 && _bulkOffset < _bulkOut.length()
+			&& _bulkOut[_bulkOffset - 1] != '\n')
+		{
+			size_t lineEnd = _bulkOut.find('\n', _bulkOffset);
+			bulkResume = (lineEnd == std::string::npos ? _bulkOut.length() : lineEnd + 1);
+			iov[count].iov_base = (void*)(_bulkOut.data() + _bulkOffset);
+			iov[count].iov_len = bulkResume - _bulkOffset;
+			offsets[count++] = &_bulkOffset;
+		}
+		if (_controlOffset < _controlOut.length())
+		{
+			iov[count].iov_base = (void*)(_controlOut.data() + _controlOffset);
+			iov[count].iov_len = _controlOut.length() - _controlOffset;
+			offsets[count++] = &_controlOffset;
+		}
+		if (bulkResume < _bulkOut.length())
+		{
+			iov[count].iov_base = (void*)(_bulkOut.data() + bulkResume);
+			iov[count].iov_len = _bulkOut.length() - bulkResume;
+			offsets[count++] = &_bulkOffset;
+		}
+		for (int i = 0; i < count; i++)
+		{
+			total += iov[i].iov_len;
+		}
+
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = count;
+		ssize_t sentBytes = sendmsg(_fd, &msg, MSG_NOSIGNAL);
+
+		if (sentBytes < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				Print::Debug("Socket full, " + toString(getQueuedBytes()) +
+							 " bytes pending");
+				return true;
+			}
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			Print::StdErr("sending message: " + toString(strerror(errno)) +
+						  " (errno: " + toString(errno));
+			_writeError = true;
+			return false;
+		}
+
+		// Advance each lane by what went out, in the order it was gathered
+		size_t sent = sentBytes;
+		for (int i = 0; i < count && sent > 0; i++)
+		{
+			size_t taken = (sent < iov[i].iov_len ? sent : iov[i].iov_len);
+			*offsets[i] += taken;
+			sent -= taken;
+		}
+		compactLane(_frameOut, _frameOffset);
+		compactLane(_controlOut, _controlOffset);
+		compactLane(_bulkOut, _bulkOffset);
+		Print::Debug("Successfully sent " + toString(sentBytes) + " bytes");
+		if ((size_t)sentBytes < total)
+		{
+			return true;
+		}
+	}
+	return !_writeError;
+}
+
+// Free a drained lane, and drop the written prefix of a big one so appends
+// while draining do not grow it forever. Only cut at a line boundary, flush()
+// relies on that to spot a partially written line.
+void Client::compactLane(std::string& lane, size_t& offset)
+{
+	if (offset >= lane.length())
+	{
+		std::string().swap(lane);
+		offset = 0;
+	}
+	else if (offset > 65536 && offset > lane.length() / 2 && lane[offset - 1] == '\n')
+	{
+		lane.erase(0, offset);
+		offset = 0;
+	}
+}
+
+bool Client::hasPendingOutput() const
+{
+	return (_frameOffset < _frameOut.length() || _controlOffset < _controlOut.length() ||
+			_bulkOffset < _bulkOut.length());
+}
+
+size_t Client::getQueuedBytes() const
+{
+	return (_frameOut.length() - _frameOffset) + (_controlOut.length() - _controlOffset) +
+		   (_bulkOut.length() - _bulkOffset);
+}
+
+bool Client::hasWriteError() const { return _writeError; }
+
+// Everything still queued, in the order flush() would have written it, and
+// the queues emptied. Used when the socket moves to another process. With
+// wholeLines the rest of a line half written is left out, for output that
+// goes to a new connection instead.
+std::string Client::takePendingOutput(bool wholeLines)
+{
+	std::string pending = wholeLines ? "" : _frameOut.substr(_frameOffset);
+	size_t bulkResume = _bulkOffset;
+	if (_bulkOffset > 0 && _bulkOffset < _bulkOut.length() && _bulkOut[_bulkOffset - 1] != '\n')
+	{
+		size_t lineEnd = _bulkOut.find('\n', _bulkOffset);
+		bulkResume = (lineEnd == std::string::npos ? _bulkOut.length() : lineEnd + 1);
+		pending += wholeLines ? "" : _bulkOut.substr(_bulkOffset, bulkResume - _bulkOffset);
+	}
+	size_t controlResume = _controlOffset;
+	if (wholeLines && _controlOffset > 0 && _controlOffset < _controlOut.length() &&
+		_controlOut[_controlOffset - 1] != '\n')
+	{
+		size_t lineEnd = _controlOut.find('\n', _controlOffset);
+		controlResume = (lineEnd == std::string::npos ? _controlOut.length() : lineEnd + 1);
+	}
+	pending += _controlOut.substr(controlResume);
+	pending += _bulkOut.substr(bulkResume);
+	_frameOut.clear();
+	_controlOut.clear();
+	_bulkOut.clear();
+	_frameOffset = 0;
+	_controlOffset = 0;
+	_bulkOffset = 0;
+	return (pending);
 }
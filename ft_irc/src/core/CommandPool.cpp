@@ -0,0 +1,231 @@
+#include <signal.h>
+
+#include <cstring>
+#include <sstream>
+
+#include "Client.hpp"
+#include "CommandPool.hpp"
+#include "General.hpp"
+#include "Shard.hpp"
+#include "UtilsFun.hpp"
+
+CommandPool* CommandPool::s_installed = NULL;
+
+CommandPool::Reply::Reply(Client* client, bool streamed)
+	: _client(streamed ? NULL : client),
+	  _shard(client->getShard()),
+	  _fd(client->getFd()),
+	  _clientId(client->getId()),
+	  _nick(client->getNickname().empty() ? "*" : client->getNickname())
+{
+}
+
+// Same format as ACommand::sendNumericReply
+void CommandPool::Reply::numeric(int code, const std::string& message)
+{
+	std::ostringstream oss;
+	oss << ":server " << code << " " << _nick << " " << message << "\r\n";
+	_pending += oss.str();
+	if (_pending.size() >= static_cast<size_t>(Sched::REPLY_CHUNK))
+	{
+		flush(false);
+	}
+}
+
+void CommandPool::Reply::line(const std::string& text)
+{
+	_pending += text;
+	if (_pending.size() >= static_cast<size_t>(Sched::REPLY_CHUNK))
+	{
+		flush(false);
+	}
+}
+
+void CommandPool::Reply::finish() { flush(true); }
+
+void CommandPool::Reply::flush(bool last)
+{
+	if (_client)
+	{
+		if (!_pending.empty())
+		{
+			_client->sendMessage(_pending);
+		}
+	}
+	else if (!_pending.empty() || last)
+	{
+		_shard->post(_fd, _clientId, _pending, Client::LANE_CONTROL, last);
+	}
+	_pending.clear();
+}
+
+CommandPool::Task::~Task() {}
+
+CommandPool::Queued::Queued(Task* task, const Reply& reply) : task(task), reply(reply) {}
+
+CommandPool::CommandPool() : _queued(0), _next(0), _stopping(false) {}
+
+CommandPool::~CommandPool()
+{
+	stop();
+	for (size_t i = 0; i < _workers.size(); i++)
+	{
+		for (size_t j = 0; j < _workers[i]->tasks.size(); j++)
+		{
+			delete _workers[i]->tasks[j]->task;
+			delete _workers[i]->tasks[j];
+		}
+		delete _workers[i];
+	}
+}
+
+// Start the pool threads. Shutdown signals stay with the main thread.
+bool CommandPool::start(int threads)
+{
+	sigset_t blocked;
+	sigset_t previous;
+	sigemptyset(&blocked);
+	sigaddset(&blocked, SIGINT);
+	sigaddset(&blocked, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+
+	// Every deque exists before any thread may steal from it
+	for (int i = 0; i < threads; i++)
+	{
+		Worker* worker = new Worker();
+		worker->pool = this;
+		worker->id = i;
+		_workers.push_back(worker);
+	}
+	int error = 0;
+	size_t started = 0;
+	for (; started < _workers.size() && error == 0; started++)
+	{
+		error = pthread_create(&_workers[started]->thread, NULL, &CommandPool::threadMain,
+							   _workers[started]);
+	}
+	pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+	if (error != 0)
+	{
+		// Let the threads that did start go; the failed one was counted too
+		_idleLock.lock();
+		_stopping = true;
+		_wakeup.broadcast();
+		_idleLock.unlock();
+		for (size_t i = 0; i + 1 < started; i++)
+		{
+			pthread_join(_workers[i]->thread, NULL);
+		}
+		Print::Fail("Error starting command thread: " + toString(strerror(error)));
+		return (false);
+	}
+	return (true);
+}
+
+void CommandPool::stop()
+{
+	_idleLock.lock();
+	bool running = !_stopping;
+	_stopping = true;
+	_wakeup.broadcast();
+	_idleLock.unlock();
+
+	for (size_t i = 0; running && i < _workers.size(); i++)
+	{
+		pthread_join(_workers[i]->thread, NULL);
+	}
+}
+
+void CommandPool::install(CommandPool* pool) { s_installed = pool; }
+
+void* CommandPool::threadMain(void* arg)
+{
+	Worker* worker = static_cast<Worker*>(arg);
+	worker->pool->work(*worker);
+	return (NULL);
+}
+
+void CommandPool::run(Client* client, Task* task)
+{
+	CommandPool* pool = s_installed;
+	if (!pool || !client->getShard())
+	{
+		Reply reply(client, false);
+		task->run(reply);
+		reply.finish();
+		delete task;
+		return;
+	}
+	client->setOffloaded(true);
+	pool->submit(new Queued(task, Reply(client, true)));
+}
+
+// Deal tasks round-robin, stealing evens the load out
+void CommandPool::submit(Queued* queued)
+{
+	Worker* worker = _workers[__atomic_fetch_add(&_next, 1, __ATOMIC_RELAXED) % _workers.size()];
+	{
+		ScopedLock lock(worker->lock);
+		worker->tasks.push_back(queued);
+	}
+	ScopedLock idle(_idleLock);
+	_queued++;
+	_wakeup.signal();
+}
+
+// Own oldest task first, then the newest one of the other threads
+CommandPool::Queued* CommandPool::take(Worker& self)
+{
+	Queued* taken = NULL;
+	{
+		ScopedLock lock(self.lock);
+		if (!self.tasks.empty())
+		{
+			taken = self.tasks.front();
+			self.tasks.pop_front();
+		}
+	}
+	for (size_t i = 1; !taken && i < _workers.size(); i++)
+	{
+		Worker& victim = *_workers[(self.id + i) % _workers.size()];
+		ScopedLock lock(victim.lock);
+		if (!victim.tasks.empty())
+		{
+			taken = victim.tasks.back();
+			victim.tasks.pop_back();
+		}
+	}
+	if (taken)
+	{
+		ScopedLock idle(_idleLock);
+		_queued--;
+	}
+	return (taken);
+}
+
+void CommandPool::work(Worker& self)
+{
+	while (true)
+	{
+		Queued* queued = take(self);
+		if (queued)
+		{
+			queued->task->run(queued->reply);
+			queued->reply.finish();
+			delete queued->task;
+			delete queued;
+			continue;
+		}
+
+		ScopedLock idle(_idleLock);
+		while (_queued == 0 && !_stopping)
+		{
+			_wakeup.wait(_idleLock);
+		}
+		if (_stopping)
+		{
+			break;
+		}
+	}
+}
@@ -0,0 +1,245 @@
+#include <sched.h>
+#include <signal.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "Epoch.hpp"
+#include "FanoutPool.hpp"
+#include "Shard.hpp"
+#include "UtilsFun.hpp"
+
+FanoutPool* FanoutPool::s_installed = NULL;
+
+FanoutPool::FanoutPool(size_t threshold, size_t chunkSize)
+	: _threshold(threshold),
+	  _chunkSize(chunkSize),
+	  _job(NULL),
+	  _generation(0),
+	  _stopping(false)
+{
+}
+
+FanoutPool::~FanoutPool() { stop(); }
+
+// Start the pool threads. Shutdown signals stay with the main thread.
+bool FanoutPool::start(int threads)
+{
+	sigset_t blocked;
+	sigset_t previous;
+	sigemptyset(&blocked);
+	sigaddset(&blocked, SIGINT);
+	sigaddset(&blocked, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+
+	int error = 0;
+	for (int i = 0; i < threads && error == 0; i++)
+	{
+		pthread_t thread;
+		error = pthread_create(&thread, NULL, &FanoutPool::threadMain, this);
+		if (error == 0)
+		{
+			_threads.push_back(thread);
+		}
+	}
+	pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+	if (error != 0)
+	{
+		Print::Fail("Error starting fan-out thread: " + toString(strerror(error)));
+		return (false);
+	}
+	return (true);
+}
+
+void FanoutPool::stop()
+{
+	_lock.lock();
+	_stopping = true;
+	_wakeup.broadcast();
+	_lock.unlock();
+
+	for (size_t i = 0; i < _threads.size(); i++)
+	{
+		pthread_join(_threads[i], NULL);
+	}
+	_threads.clear();
+}
+
+void FanoutPool::install(FanoutPool* pool) { s_installed = pool; }
+
+void* FanoutPool::threadMain(void* arg)
+{
+	static_cast<FanoutPool*>(arg)->work();
+	return (NULL);
+}
+
+// Pool thread: help with every job offered, once
+void FanoutPool::work()
+{
+	unsigned long seen = 0;
+
+	_lock.lock();
+	while (true)
+	{
+		while (!_stopping && (!_job || _generation == seen))
+		{
+			_wakeup.wait(_lock);
+		}
+		if (_stopping)
+		{
+			break;
+		}
+		Job* job = _job;
+		seen = _generation;
+		__atomic_add_fetch(&job->helpers, 1, __ATOMIC_RELAXED);
+		_lock.unlock();
+
+		Epoch::enter();
+		runChunks(*job);
+		Epoch::leave();
+		// Last access to the job, the caller may return right after
+		__atomic_sub_fetch(&job->helpers, 1, __ATOMIC_RELEASE);
+		_lock.lock();
+	}
+	_lock.unlock();
+}
+
+// Send a message to the members of a channel, except excludeFd. With a
+// home shard, each recipient votes for it (see Client::noteChannelTraffic).
+void FanoutPool::deliver(const std::map<int, Client*>& members, const std::string& message,
+						 int excludeFd, Client::Lane lane, int homeShard)
+{
+	FanoutPool* pool = s_installed;
+	if (!pool || members.size() < pool->_threshold)
+	{
+		for (std::map<int, Client*>::const_iterator it = members.begin();
+			 it != members.end(); ++it)
+		{
+			// Users of other servers get it through their link, see Network
+			if (it->first != excludeFd && it->second && !it->second->isRemote())
+			{
+				if (homeShard >= 0)
+				{
+					it->second->noteChannelTraffic(homeShard);
+				}
+				it->second->sendMessage(message, lane);
+			}
+		}
+		return;
+	}
+
+	Job job;
+	job.recipients.reserve(members.size());
+	for (std::map<int, Client*>::const_iterator it = members.begin(); it != members.end();
+		 ++it)
+	{
+		if (it->first != excludeFd && it->second && !it->second->isRemote())
+		{
+			job.recipients.push_back(it->second);
+		}
+	}
+	job.message = SharedBuffer(message);
+	job.lane = lane;
+	job.owner = Shard::current();
+	job.homeShard = homeShard;
+	job.chunkSize = pool->_chunkSize;
+	job.chunks = (job.recipients.size() + job.chunkSize - 1) / job.chunkSize;
+	job.nextChunk = 0;
+	job.doneChunks = 0;
+	job.helpers = 0;
+	job.woken.resize(job.chunks);
+	pool->runParallel(job);
+
+	// The waiting shard flushes its own clients like after any reply
+	for (size_t i = 0; i < job.woken.size(); i++)
+	{
+		for (size_t j = 0; j < job.woken[i].size(); j++)
+		{
+			job.woken[i][j]->scheduleFlush();
+		}
+	}
+}
+
+// Offer the job to the pool and work on it too. A pool busy with another
+// caller's job is not waited for: the chunks then all run here.
+void FanoutPool::runParallel(Job& job)
+{
+	bool offered = false;
+	_lock.lock();
+	if (!_job && !_stopping)
+	{
+		_job = &job;
+		_generation++;
+		offered = true;
+		_wakeup.broadcast();
+	}
+	_lock.unlock();
+
+	runChunks(job);
+	if (!offered)
+	{
+		return;
+	}
+
+	// Withdraw the offer, then wait for the helpers already on it
+	_lock.lock();
+	_job = NULL;
+	_lock.unlock();
+	while (__atomic_load_n(&job.doneChunks, __ATOMIC_ACQUIRE) < job.chunks ||
+		   __atomic_load_n(&job.helpers, __ATOMIC_ACQUIRE) > 0)
+	{
+		sched_yield();
+	}
+}
+
+void FanoutPool::runChunks(Job& job)
+{
+	size_t chunk;
+	while ((chunk = __atomic_fetch_add(&job.nextChunk, 1, __ATOMIC_RELAXED)) < job.chunks)
+	{
+		runChunk(job, chunk);
+		__atomic_add_fetch(&job.doneChunks, 1, __ATOMIC_RELEASE);
+	}
+}
+
+// Clients of the waiting shard are appended to directly and the ones that
+// went idle to busy are remembered for the caller; the rest is batched per
+// owning shard
+void FanoutPool::runChunk(Job& job, size_t chunk)
+{
+	size_t begin = chunk * job.chunkSize;
+	size_t end = std::min(begin + job.chunkSize, job.recipients.size());
+	std::map<Shard*, std::vector<Shard::Recipient> > remote;
+
+	for (size_t i = begin; i < end; i++)
+	{
+		Client* client = job.recipients[i];
+		if (job.homeShard >= 0)
+		{
+			client->noteChannelTraffic(job.homeShard);
+		}
+		if (client->isDetached())
+		{
+			client->sendMessage(job.message.str(), job.lane);  // held for RESUME
+			continue;
+		}
+		if (client->getShard() == job.owner)
+		{
+			if (client->appendOutput(job.message.str(), job.lane))
+			{
+				job.woken[chunk].push_back(client);
+			}
+			continue;
+		}
+		Shard::Recipient recipient;
+		recipient.fd = client->getFd();
+		recipient.clientId = client->getId();
+		remote[client->getShard()].push_back(recipient);
+	}
+	for (std::map<Shard*, std::vector<Shard::Recipient> >::iterator it = remote.begin();
+		 it != remote.end(); ++it)
+	{
+		it->first->post(it->second, job.message, job.lane);
+	}
+}
@@ -0,0 +1,605 @@
+#include "Journal.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <vector>
+
+#include "Channel.hpp"
+#include "Client.hpp"
+#include "Config.hpp"
+#include "Epoch.hpp"
+#include "Message.hpp"
+#include "Server.hpp"
+#include "Shard.hpp"
+#include "Socket.hpp"
+#include "UtilsFun.hpp"
+
+Journal::Journal(Server* server)
+	: _server(server), _seq(0), _syncing(false), _upstream(NULL), _nextFd(-1000000)
+{
+}
+
+Journal::~Journal() {}
+
+// A primary needs journal_password to take standbys. A standby dials its
+// primary once, before the event loops start; if it can't, it serves.
+void Journal::setup()
+{
+	_password = Config::getConfig("journal_password");
+	_primary = Config::getConfig("standby_of");
+	if (!_password.empty())
+	{
+		Print::Ok("Standbys can follow this server");
+	}
+	if (!_primary.empty() && !connect())
+	{
+		_primary.clear();
+		_server->_listening = true;
+	}
+}
+
+bool Journal::isStandby() const { return (!_primary.empty()); }
+
+// Dial the primary and ask for the journal, like Network::connect does for
+// a link. Without a primary to follow, the server serves right away.
+bool Journal::connect()
+{
+	size_t colon = _primary.rfind(':');
+	if (colon == std::string::npos || _password.empty())
+	{
+		Print::Warn("standby_of: expected host:port and a journal_password, serving");
+		return (false);
+	}
+	std::string host = _primary.substr(0, colon);
+	int port = std::atoi(_primary.c_str() + colon + 1);
+
+	Socket socket;
+	if (!socket.create(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0) ||
+		!socket.connect(host, port) || !socket.setNonBlocking())
+	{
+		Print::Warn("Can't follow " + _primary + ", serving: " + socket.getLastError());
+		return (false);
+	}
+	int fd = socket.release();
+	Client* upstream = _server->_shards[0]->attachConnection(fd);
+	if (!upstream)
+	{
+		::close(fd);
+		Print::Warn("Can't follow " + _primary + ", serving: server full");
+		return (false);
+	}
+	upstream->setLink(true);
+	upstream->setJournalStream(true);
+	_upstream = upstream;
+	upstream->sendMessage("STANDBY " + _password + "\r\n");
+	Print::Ok("Standing by for " + _primary);
+	return (true);
+}
+
+// A user the standby knows about: registered here, not the bot
+bool Journal::isJournaled(Client* client)
+{
+	return (client && !client->isLink() && !client->isRemote() && !client->isBot() &&
+			!client->getNickname().empty() && !client->getUsername().empty());
+}
+
+// The standby has the channel already: it has a journaled member other
+// than `except`, or it is held
+bool Journal::isKnown(Channel* channel, Client* except)
+{
+	if (channel->isHeld())
+	{
+		return (true);
+	}
+	const std::map<int, Client*>& clients = channel->getClients();
+	for (std::map<int, Client*>::const_iterator it = clients.begin(); it != clients.end();
+		 ++it)
+	{
+		if (it->second != except && isJournaled(it->second))
+		{
+			return (true);
+		}
+	}
+	return (false);
+}
+
+// Every mode of the channel, set or not, so applying it gives the same
+// channel whatever it was before
+std::string Journal::modeLine(Channel* channel)
+{
+	std::string set = "+";
+	std::string unset = "-";
+	std::string params;
+	(channel->isInviteOnly() ? set : unset) += "i";
+	(channel->isTopicRestricted() ? set : unset) += "t";
+	if (channel->hasKey())
+	{
+		set += "k";
+		params += " " + channel->getKey();
+	}
+	else
+	{
+		unset += "k";
+	}
+	if (channel->hasUserLimit())
+	{
+		set += "l";
+		params += " " + toString(channel->getUserLimit());
+	}
+	else
+	{
+		unset += "l";
+	}
+	return ((set.size() > 1 ? set : "") + (unset.size() > 1 ? unset : "") + params);
+}
+
+// A member as JOIN records carry it
+std::string Journal::member(Channel* channel, Client* client)
+{
+	return ((channel->isOperator(client) ? "@" : "") + client->getNickname());
+}
+
+bool Journal::isRecording() const { return (!_standbys.empty()); }
+
+// Number the record and queue it for every standby. Records go through
+// the shard mailbox even from the owning shard, so they leave in order.
+void Journal::record(const std::string& line)
+{
+	ScopedLock lock(_lock);
+	std::string numbered = toString(++_seq) + " " + line + "\r\n";
+	for (std::set<Client*>::iterator it = _standbys.begin(); it != _standbys.end(); ++it)
+	{
+		(*it)->getShard()->post((*it)->getFd(), (*it)->getId(), numbered,
+								Client::LANE_CONTROL);
+	}
+}
+
+// What the standby needs before a channel's first journaled member joins
+void Journal::recordChannel(Channel* channel)
+{
+	record("CHANNEL " + channel->getName() + " " + modeLine(channel));
+	if (!channel->getTopic().empty())
+	{
+		record("TOPIC " + channel->getName() + " :" + channel->getTopic());
+	}
+	const std::set<std::string>& invited = channel->getInvitedUsers();
+	for (std::set<std::string>::const_iterator it = invited.begin(); it != invited.end(); ++it)
+	{
+		record("INVITE " + channel->getName() + " " + *it);
+	}
+}
+
+// STANDBY <password>: a standby wants the journal. It gets the whole state
+// numbered with the last record sent, then every record after it.
+void Journal::acceptStandby(Client* client, const std::string& password)
+{
+	if (_password.empty() || password != _password)
+	{
+		Print::Warn("Refusing standby: bad journal password");
+		client->sendMessage("ERROR :Closing Link: Bad journal password\r\n");
+		client->requestDisconnect();
+		return;
+	}
+	client->setLink(true);  // no flood control, no registration
+	client->setJournalStream(true);
+	sendSnapshot(client);
+	Print::Ok("Standby following, journal at " + toString(_seq));
+}
+
+void Journal::sendSnapshot(Client* standby)
+{
+	ScopedLock lock(_lock);
+	std::string seq = toString(_seq) + " ";
+	std::string snapshot = seq + "RESET\r\n";
+	size_t users = 0;
+	for (std::map<int, Client*>::iterator it = _server->_clients.begin();
+		 it != _server->_clients.end(); ++it)
+	{
+		if (isJournaled(it->second))
+		{
+			snapshot += seq + "USER " + it->second->getNickname() + " " +
+						it->second->getUsername() + "\r\n";
+			users++;
+		}
+	}
+	for (std::map<std::string, Channel*>::iterator it = _server->_channels.begin();
+		 it != _server->_channels.end(); ++it)
+	{
+		Channel* channel = it->second;
+		if (!isKnown(channel, NULL))
+		{
+			continue;
+		}
+		snapshot += seq + "CHANNEL " + it->first + " " + modeLine(channel) + "\r\n";
+		if (!channel->getTopic().empty())
+		{
+			snapshot += seq + "TOPIC " + it->first + " :" + channel->getTopic() + "\r\n";
+		}
+		if (channel->isHeld())
+		{
+			snapshot += seq + "HOLD " + it->first + "\r\n";
+		}
+		const std::set<std::string>& invited = channel->getInvitedUsers();
+		for (std::set<std::string>::const_iterator name = invited.begin();
+			 name != invited.end(); ++name)
+		{
+			snapshot += seq + "INVITE " + it->first + " " + *name + "\r\n";
+		}
+		const std::map<int, Client*>& clients = channel->getClients();
+		for (std::map<int, Client*>::const_iterator client = clients.begin();
+			 client != clients.end(); ++client)
+		{
+			if (isJournaled(client->second))
+			{
+				snapshot += seq + "JOIN " + it->first + " " + member(channel, client->second) +
+							"\r\n";
+			}
+		}
+	}
+	snapshot += seq + "SYNC\r\n";
+	standby->getShard()->post(standby->getFd(), standby->getId(), snapshot,
+							  Client::LANE_CONTROL);
+	_standbys.insert(standby);
+	Print::Ok("Snapshot to standby: " + toString(users) + " user(s)");
+}
+
+// A line on a journal stream. The primary expects nothing from its
+// standbys; a standby applies what its primary sends, in order.
+void Journal::handleLine(Client* client, const Message& message)
+{
+	if (client != _upstream)
+	{
+		return;
+	}
+	if (message.getCommand() == "ERROR")
+	{
+		// Taking over would only fight the primary for its port
+		Print::Fail("Primary refused the standby: " + message.getParams(0));
+		_upstream = NULL;
+		_server->_running = false;
+		return;
+	}
+	Message body(message.getRemainder());
+	unsigned long seq = std::strtoul(message.getCommand().c_str(), NULL, 10);
+	if (body.getCommand() == "RESET")
+	{
+		reset();
+		_syncing = true;
+		return;
+	}
+	if (body.getCommand() == "SYNC")
+	{
+		_syncing = false;
+		_seq = seq;
+		Print::Ok("Standby in sync with " + _primary + " at " + toString(_seq) + ", " +
+				  toString(_users.size()) + " user(s)");
+		return;
+	}
+	if (!_syncing)
+	{
+		if (seq != _seq + 1)
+		{
+			Print::Warn("Journal skipped from " + toString(_seq) + " to " + toString(seq));
+		}
+		_seq = seq;
+	}
+	apply(body);
+}
+
+void Journal::apply(const Message& body)
+{
+	const std::string& verb = body.getCommand();
+	if (verb == "USER")
+	{
+		Client* user = standIn(body.getParams(0));
+		if (user)
+		{
+			user->setUsername(body.getParams(1));
+		}
+	}
+	else if (verb == "NICK")
+	{
+		Client* user = _server->getClientByNick(body.getParams(0));
+		if (user && _users.count(user))
+		{
+			_server->changeNick(user, body.getParams(1));
+		}
+	}
+	else if (verb == "QUIT")
+	{
+		Client* user = _server->getClientByNick(body.getParams(0));
+		if (user && _users.count(user))
+		{
+			dropUser(user);
+		}
+	}
+	else
+	{
+		applyChannel(body);
+	}
+}
+
+// CHANNEL, HOLD, TOPIC, INVITE, JOIN, PART, KICK and MODE: the standby's
+// copy of the channel, nobody is told
+void Journal::applyChannel(const Message& body)
+{
+	const std::string& verb = body.getCommand();
+	std::vector<std::string> params = body.getParams();
+	if (params.size() < 2 && verb != "HOLD")
+	{
+		return;
+	}
+	Channel* channel = _server->getChannel(body.getParams(0));
+	if (verb == "CHANNEL")
+	{
+		if (!channel)
+		{
+			channel = _server->createChannel(params[0], NULL);
+		}
+		_server->_network.applyModes(channel, params, 1, params.size());
+		return;
+	}
+	if (!channel)
+	{
+		return;
+	}
+	if (verb == "HOLD")
+	{
+		channel->setHeld(true);
+	}
+	else if (verb == "TOPIC")
+	{
+		channel->setTopic(params[1]);
+	}
+	else if (verb == "INVITE")
+	{
+		channel->addInvitedUser(params[1]);
+	}
+	else if (verb == "MODE")
+	{
+		_server->_network.applyModes(channel, params, 1, params.size());
+	}
+	else if (verb == "JOIN")
+	{
+		bool op = params[1][0] == '@';
+		Client* user = _server->getClientByNick(op ? params[1].substr(1) : params[1]);
+		if (!user || !_users.count(user))
+		{
+			return;
+		}
+		channel->setHeld(false);
+		channel->addClient(user);
+		channel->removeInvitedUser(user->getNickname());
+		if (op)
+		{
+			channel->addOperator(user);
+		}
+	}
+	else if (verb == "PART" || verb == "KICK")
+	{
+		Client* user = _server->getClientByNick(params[1]);
+		if (!user || !_users.count(user))
+		{
+			return;
+		}
+		channel->removeOperator(user);
+		channel->removeClient(user);
+		if (channel->isEmpty())
+		{
+			_server->removeChannel(params[0]);
+		}
+	}
+}
+
+// A socketless Client for a user of the primary
+Client* Journal::standIn(const std::string& nick)
+{
+	if (nick.empty() || _server->getClientByNick(nick))
+	{
+		return (NULL);
+	}
+	Client* user = new Client(_nextFd--, 0, 0);
+	user->setAuthenticated(true);
+	_server->_clients[user->getFd()] = user;
+	_server->changeNick(user, nick);
+	_users.insert(user);
+	return (user);
+}
+
+// A stand-in leaves every channel and the server
+void Journal::dropUser(Client* user)
+{
+	std::vector<std::string> emptied;
+	for (std::map<std::string, Channel*>::iterator it = _server->_channels.begin();
+		 it != _server->_channels.end(); ++it)
+	{
+		if (!it->second->hasClient(user))
+		{
+			continue;
+		}
+		it->second->removeOperator(user);
+		it->second->removeClient(user);
+		if (it->second->isEmpty())
+		{
+			emptied.push_back(it->first);
+		}
+	}
+	for (size_t i = 0; i < emptied.size(); i++)
+	{
+		_server->removeChannel(emptied[i]);
+	}
+	_server->_nicks.release(user->getNickname(), user);
+	_server->_clients.erase(user->getFd());
+	_users.erase(user);
+	Epoch::retire(user);  // commands on other threads may still hold it
+}
+
+// RESET: a new snapshot follows, forget the last one
+void Journal::reset()
+{
+	std::vector<Client*> users(_users.begin(), _users.end());
+	for (size_t i = 0; i < users.size(); i++)
+	{
+		dropUser(users[i]);
+	}
+	std::vector<std::string> names;
+	for (std::map<std::string, Channel*>::iterator it = _server->_channels.begin();
+		 it != _server->_channels.end(); ++it)
+	{
+		names.push_back(it->first);
+	}
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		_server->removeChannel(names[i]);
+	}
+}
+
+// A journal stream closed. Losing a standby stops feeding it; losing the
+// primary means this server takes over.
+void Journal::dropStream(Client* client)
+{
+	{
+		ScopedLock lock(_lock);
+		if (_standbys.erase(client))
+		{
+			Print::Warn("Standby left, journal at " + toString(_seq));
+			return;
+		}
+	}
+	if (client != _upstream)
+	{
+		return;
+	}
+	_upstream = NULL;
+	if (_server->_running)
+	{
+		Print::Warn("Lost the primary " + _primary + " at journal " + toString(_seq));
+		takeOver();
+	}
+}
+
+unsigned long Journal::getSeq() const { return (_seq); }
+
+void Journal::resumeSeq(unsigned long seq) { _seq = seq; }
+
+// A standby that followed the previous process goes on from the same record
+void Journal::resumeStandby(Client* client)
+{
+	ScopedLock lock(_lock);
+	_standbys.insert(client);
+}
+
+// Serve: the primary's users are gone, its channels stay, held until
+// someone joins. The shards open their listeners, links come up.
+void Journal::takeOver()
+{
+	for (std::map<std::string, Channel*>::iterator it = _server->_channels.begin();
+		 it != _server->_channels.end(); ++it)
+	{
+		it->second->setHeld(true);
+	}
+	std::vector<Client*> users(_users.begin(), _users.end());
+	for (size_t i = 0; i < users.size(); i++)
+	{
+		dropUser(users[i]);
+	}
+	_primary.clear();
+	_server->_listening = true;
+	for (size_t i = 0; i < _server->_shards.size(); i++)
+	{
+		_server->_shards[i]->wake();
+	}
+	Print::Ok("Taking over with " + toString(_server->_channels.size()) + " channel(s)");
+	// Outgoing links go on the first shard, only its own thread may add them
+	bool dial = Shard::current() == _server->_shards[0];
+	if (!dial && !Config::getConfig("link_connect").empty())
+	{
+		Print::Warn("link_connect is not dialed after a takeover, peers have to dial in");
+	}
+	_server->_network.setup(dial);
+}
+
+// A local user completed registration
+void Journal::userRegistered(Client* client)
+{
+	if (isRecording() && isJournaled(client))
+	{
+		record("USER " + client->getNickname() + " " + client->getUsername());
+	}
+}
+
+// A local user took a new nick, or got one to complete its registration
+void Journal::userNick(Client* client, const std::string& oldNick)
+{
+	if (!isRecording() || !isJournaled(client))
+	{
+		return;
+	}
+	if (oldNick.empty())
+	{
+		userRegistered(client);
+	}
+	else if (oldNick != client->getNickname())
+	{
+		record("NICK " + oldNick + " " + client->getNickname());
+	}
+}
+
+// A local user is leaving, before it loses its nick
+void Journal::userQuit(Client* client)
+{
+	if (isRecording() && isJournaled(client))
+	{
+		record("QUIT " + client->getNickname());
+	}
+}
+
+// A local user joined, or created, the channel
+void Journal::channelJoin(Channel* channel, Client* client)
+{
+	if (!isRecording() || !isJournaled(client))
+	{
+		return;
+	}
+	if (!isKnown(channel, client))
+	{
+		recordChannel(channel);
+	}
+	record("JOIN " + channel->getName() + " " + member(channel, client));
+}
+
+// A local user parted or was kicked, still a member when this is called
+void Journal::channelPart(Channel* channel, Client* client, bool kicked)
+{
+	if (isRecording() && isJournaled(client))
+	{
+		record((kicked ? "KICK " : "PART ") + channel->getName() + " " + client->getNickname());
+	}
+}
+
+// Modes as applied, with their arguments: "+kl key 10"
+void Journal::channelModes(Channel* channel, const std::string& modes)
+{
+	if (isRecording() && isKnown(channel, NULL))
+	{
+		record("MODE " + channel->getName() + " " + modes);
+	}
+}
+
+void Journal::channelTopic(Channel* channel)
+{
+	if (isRecording() && isKnown(channel, NULL))
+	{
+		record("TOPIC " + channel->getName() + " :" + channel->getTopic());
+	}
+}
+
+void Journal::channelInvite(Channel* channel, const std::string& nick)
+{
+	if (isRecording() && isKnown(channel, NULL))
+	{
+		record("INVITE " + channel->getName() + " " + nick);
+	}
+}
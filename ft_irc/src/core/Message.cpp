@@ -45,15 +45,26 @@ std::vector<std::string> Message::parseParams(const std::string& rawMessage)
 	std::vector<std::string> result;
 	std::istringstream iss(rawMessage);
 	std::string temp;
-	if (rawMessage.find(":") == rawMessage.npos)
+	// The trailing parameter starts with a ':' that starts a parameter, a
+	// colon inside one (a timestamp, an address) is part of it
+	size_t trailing = rawMessage.find(" :");
+	if (rawMessage.compare(0, 1, ":") == 0)
+	{
+		trailing = 0;
+	}
+	else if (trailing != rawMessage.npos)
+	{
+		trailing++;
+	}
+	if (trailing == rawMessage.npos)
 	{
 		while (iss >> temp) result.push_back(temp);
 	}
 	else
 	{
-		std::istringstream before(rawMessage.substr(0, rawMessage.find(':')));
+		std::istringstream before(rawMessage.substr(0, trailing));
 		std::istringstream after(
-			rawMessage.substr(rawMessage.find(':') + 1, rawMessage.length()));
+			rawMessage.substr(trailing + 1, rawMessage.length()));
 		while (before >> temp) result.push_back(temp);
 		std::getline(after, temp);
 		if (temp.length() > 0) result.push_back(temp);
@@ -0,0 +1,729 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "Client.hpp"
+#include "General.hpp"
+#include "MessageLog.hpp"
+#include "SearchIndex.hpp"
+#include "UtilsFun.hpp"
+
+static const size_t UNINDEXED = static_cast<size_t>(-1);
+static const size_t INDEX_ENTRY = 16;        // time u64, offset u64
+static const size_t MAX_OPEN_SEGMENTS = 256; // least recently written go first
+static const size_t MAX_RECORD = 4096;       // longest line a search reads back
+
+MessageLog* MessageLog::s_installed = NULL;
+
+static void putInt(std::string& out, unsigned long value, int bytes)
+{
+	for (int i = 0; i < bytes; i++)
+	{
+		out += static_cast<char>((value >> (8 * i)) & 0xff);
+	}
+}
+
+static unsigned long getInt(const unsigned char* pos, int bytes)
+{
+	unsigned long value = 0;
+	for (int i = 0; i < bytes; i++)
+	{
+		value |= static_cast<unsigned long>(pos[i]) << (8 * i);
+	}
+	return (value);
+}
+
+static bool writeAll(int fd, const std::string& data)
+{
+	size_t written = 0;
+	while (written < data.length())
+	{
+		ssize_t n = ::write(fd, data.data() + written, data.length() - written);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n <= 0)
+		{
+			return (false);
+		}
+		written += n;
+	}
+	return (true);
+}
+
+// Segment names of a channel directory, without the extension, oldest first
+static std::vector<std::string> listSegments(const std::string& dir)
+{
+	std::vector<std::string> names;
+	DIR* handle = opendir(dir.c_str());
+	if (!handle)
+	{
+		return (names);
+	}
+	while (struct dirent* entry = readdir(handle))
+	{
+		std::string name = entry->d_name;
+		if (name.size() > 4 && name.compare(name.size() - 4, 4, ".log") == 0)
+		{
+			names.push_back(name.substr(0, name.size() - 4));
+		}
+	}
+	closedir(handle);
+	std::sort(names.begin(), names.end());
+	return (names);
+}
+
+MessageLog::MessageLog(const std::string& dir, size_t segmentBytes, size_t indexBytes,
+					   size_t searchBytes)
+	: _dir(dir),
+	  _segmentBytes(segmentBytes),
+	  _indexBytes(indexBytes),
+	  _search(searchBytes > 0 ? new SearchIndex(searchBytes) : NULL),
+	  _started(false),
+	  _queuedBytes(0),
+	  _dropped(0),
+	  _stopping(false),
+	  _batches(0)
+{
+}
+
+MessageLog::~MessageLog()
+{
+	stop();
+	for (size_t i = 0; i < _reads.size(); i++)
+	{
+		delete _reads[i]->task;
+		delete _reads[i];
+	}
+	delete _search;
+}
+
+MessageLog::Read::Read(CommandPool::Task* task, const CommandPool::Reply& reply)
+	: task(task), reply(reply)
+{
+}
+
+// Start the writer and reader threads. Shutdown signals stay with the main
+// thread.
+bool MessageLog::start()
+{
+	if (mkdir(_dir.c_str(), 0700) != 0 && errno != EEXIST)
+	{
+		Print::Fail("Message log " + _dir + ": " + toString(strerror(errno)));
+		return (false);
+	}
+	sigset_t blocked;
+	sigset_t previous;
+	sigemptyset(&blocked);
+	sigaddset(&blocked, SIGINT);
+	sigaddset(&blocked, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+	int error = pthread_create(&_thread, NULL, &MessageLog::threadMain, this);
+	if (error == 0)
+	{
+		error = pthread_create(&_reader, NULL, &MessageLog::readerMain, this);
+		if (error != 0)
+		{
+			stop();
+			pthread_join(_thread, NULL);
+		}
+	}
+	pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+	if (error != 0)
+	{
+		Print::Fail("Error starting message log thread: " + toString(strerror(error)));
+		return (false);
+	}
+	_started = true;
+	return (true);
+}
+
+void MessageLog::stop()
+{
+	_lock.lock();
+	_stopping = true;
+	_wakeup.signal();
+	_readWakeup.signal();
+	_lock.unlock();
+
+	if (_started)
+	{
+		pthread_join(_thread, NULL);
+		pthread_join(_reader, NULL);
+		_started = false;
+	}
+}
+
+void MessageLog::install(MessageLog* log) { s_installed = log; }
+
+bool MessageLog::isEnabled() { return (s_installed != NULL); }
+
+bool MessageLog::isSearchable() { return (s_installed != NULL && s_installed->_search != NULL); }
+
+void* MessageLog::threadMain(void* arg)
+{
+	static_cast<MessageLog*>(arg)->work();
+	return (NULL);
+}
+
+void* MessageLog::readerMain(void* arg)
+{
+	static_cast<MessageLog*>(arg)->serveReads();
+	return (NULL);
+}
+
+// The client reads no further line until the task's last reply is queued,
+// as for a pooled command
+void MessageLog::read(Client* client, CommandPool::Task* task)
+{
+	MessageLog* log = s_installed;
+	if (!log || !client->getShard())
+	{
+		CommandPool::Reply reply(client, false);
+		task->run(reply);
+		reply.finish();
+		delete task;
+		return;
+	}
+	client->setOffloaded(true);
+	ScopedLock lock(log->_lock);
+	log->_reads.push_back(new Read(task, CommandPool::Reply(client, true)));
+	log->_readWakeup.signal();
+}
+
+// Reader thread: one task at a time, in the order they came
+void MessageLog::serveReads()
+{
+	for (;;)
+	{
+		_lock.lock();
+		while (!_stopping && _reads.empty())
+		{
+			_readWakeup.wait(_lock);
+		}
+		if (_stopping)
+		{
+			_lock.unlock();
+			break;
+		}
+		Read* read = _reads.front();
+		_reads.pop_front();
+		_lock.unlock();
+
+		read->task->run(read->reply);
+		read->reply.finish();
+		delete read->task;
+		delete read;
+	}
+}
+
+// Any thread owning a channel: queue the line for the writer, or drop it
+// when the writer is that far behind
+void MessageLog::write(const std::string& channel, unsigned long time, const std::string& line)
+{
+	MessageLog* log = s_installed;
+	if (!log)
+	{
+		return;
+	}
+	ScopedLock lock(log->_lock);
+	if (log->_stopping ||
+		log->_queuedBytes + line.size() > static_cast<size_t>(History::LOG_QUEUE_BYTES))
+	{
+		log->_dropped++;
+		return;
+	}
+	log->_queue.push_back(Record());
+	Record& record = log->_queue.back();
+	record.channel = channel;
+	record.time = time;
+	record.line = line;
+	log->_queuedBytes += channel.size() + line.size();
+	if (log->_queue.size() == 1)
+	{
+		log->_wakeup.signal();
+	}
+}
+
+// Writer thread: take everything queued, append it, one write per segment
+// touched. Whatever is queued when the log stops is still written.
+void MessageLog::work()
+{
+	if (_search)
+	{
+		rebuild();
+	}
+	for (;;)
+	{
+		std::vector<Record> batch;
+		_lock.lock();
+		while (!_stopping && _queue.empty())
+		{
+			_wakeup.wait(_lock);
+		}
+		batch.swap(_queue);
+		_queuedBytes = 0;
+		unsigned long dropped = _dropped;
+		_dropped = 0;
+		bool stopping = _stopping;
+		_lock.unlock();
+
+		if (dropped > 0)
+		{
+			Print::Warn("Message log: disk behind, " + toString(dropped) + " line(s) dropped");
+		}
+		if (batch.empty() && stopping)
+		{
+			break;
+		}
+		_batches++;
+		for (size_t i = 0; i < batch.size(); i++)
+		{
+			append(batch[i]);
+		}
+		for (std::map<std::string, Segment>::iterator it = _open.begin(); it != _open.end();
+			 ++it)
+		{
+			flush(it->second);
+		}
+	}
+	while (!_open.empty())
+	{
+		close(_open.begin()->first);
+	}
+}
+
+void MessageLog::append(const Record& record)
+{
+	Segment& segment = segmentFor(record.channel, record.time);
+	segment.used = _batches;
+	if (segment.indexed == UNINDEXED || segment.size - segment.indexed >= _indexBytes)
+	{
+		putInt(segment.pendingIndex, record.time, 8);
+		putInt(segment.pendingIndex, segment.size, 8);
+		segment.indexed = segment.size;
+	}
+	size_t before = segment.pending.size();
+	segment.pending += toString(record.time) + " " + record.line;
+	if (record.line.empty() || record.line[record.line.size() - 1] != '\n')
+	{
+		segment.pending += "\r\n";
+	}
+	segment.size += segment.pending.size() - before;
+	if (segment.size >= _segmentBytes)
+	{
+		close(record.channel);
+	}
+}
+
+// The channel's open segment, else its last one if there is room left, else
+// a new one named after the line starting it
+MessageLog::Segment& MessageLog::segmentFor(const std::string& channel, unsigned long time)
+{
+	std::map<std::string, Segment>::iterator found = _open.find(channel);
+	if (found != _open.end())
+	{
+		return (found->second);
+	}
+	if (_open.size() >= MAX_OPEN_SEGMENTS)
+	{
+		std::map<std::string, Segment>::iterator oldest = _open.begin();
+		for (std::map<std::string, Segment>::iterator it = _open.begin(); it != _open.end();
+			 ++it)
+		{
+			oldest = (it->second.used < oldest->second.used) ? it : oldest;
+		}
+		close(oldest->first);
+	}
+
+	std::string dir = channelDir(_dir, channel);
+	mkdir(dir.c_str(), 0700);
+	std::vector<std::string> names = listSegments(dir);
+	std::string name;
+	struct stat info;
+	if (!names.empty() && stat((dir + "/" + names.back() + ".log").c_str(), &info) == 0 &&
+		static_cast<size_t>(info.st_size) < _segmentBytes)
+	{
+		name = names.back();
+	}
+	else
+	{
+		char first[32];
+		snprintf(first, sizeof(first), "%016lu", time);
+		name = first;
+	}
+	std::string base = dir + "/" + name;
+
+	Segment& segment = _open[channel];
+	segment.dir = dir;
+	segment.name = name;
+	segment.fd = open((base + ".log").c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+	segment.indexFd =
+		open((base + ".idx").c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+	segment.size = (segment.fd >= 0 && fstat(segment.fd, &info) == 0) ? info.st_size : 0;
+	segment.indexed = UNINDEXED;  // first line written by this process is indexed
+	segment.used = _batches;
+	if (segment.fd < 0 || segment.indexFd < 0)
+	{
+		Print::Warn("Message log " + base + ": " + toString(strerror(errno)) +
+					", lines dropped until the next segment");
+	}
+	return (segment);
+}
+
+void MessageLog::flush(Segment& segment)
+{
+	if (!segment.pending.empty() && segment.fd >= 0 && segment.indexFd >= 0)
+	{
+		// Index entries after the lines they point to: a reader never finds
+		// an entry past the end of its segment
+		if (!writeAll(segment.fd, segment.pending) ||
+			!writeAll(segment.indexFd, segment.pendingIndex))
+		{
+			Print::Warn("Message log: write failed: " + toString(strerror(errno)));
+		}
+		else if (_search)
+		{
+			index(segment.dir, segment.name, segment.size - segment.pending.size(),
+				  segment.pending.data(), segment.pending.size());
+		}
+	}
+	segment.pending.clear();
+	segment.pendingIndex.clear();
+}
+
+void MessageLog::close(const std::string& channel)
+{
+	std::map<std::string, Segment>::iterator it = _open.find(channel);
+	flush(it->second);
+	if (it->second.fd >= 0)
+	{
+		::close(it->second.fd);
+	}
+	if (it->second.indexFd >= 0)
+	{
+		::close(it->second.indexFd);
+	}
+	_open.erase(it);
+}
+
+// Writer thread, before the first line: index every segment already there
+void MessageLog::rebuild()
+{
+	DIR* handle = opendir(_dir.c_str());
+	if (!handle)
+	{
+		return;
+	}
+	size_t segments = 0;
+	while (struct dirent* entry = readdir(handle))
+	{
+		if (entry->d_name[0] == '.')
+		{
+			continue;
+		}
+		std::string dir = _dir + "/" + entry->d_name;
+		std::vector<std::string> names = listSegments(dir);
+		for (size_t i = 0; i < names.size(); i++)
+		{
+			int fd = open((dir + "/" + names[i] + ".log").c_str(), O_RDONLY | O_CLOEXEC);
+			if (fd < 0)
+			{
+				continue;
+			}
+			struct stat info;
+			void* map = MAP_FAILED;
+			if (fstat(fd, &info) == 0 && info.st_size > 0)
+			{
+				map = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+			}
+			::close(fd);
+			if (map == MAP_FAILED)
+			{
+				continue;
+			}
+			madvise(map, info.st_size, MADV_SEQUENTIAL);
+			index(dir, names[i], 0, static_cast<const char*>(map), info.st_size);
+			munmap(map, info.st_size);
+			segments++;
+		}
+	}
+	closedir(handle);
+	if (segments > 0)
+	{
+		Print::Ok("Search index rebuilt from " + toString(segments) + " log segment(s), " +
+				  toString(_search->bytes() / 1024) + " KB");
+	}
+}
+
+// Hand the words of complete lines to the index: those of the message,
+// after the prefix, command and target
+void MessageLog::index(const std::string& dir, const std::string& name, size_t offset,
+					   const char* data, size_t size)
+{
+	size_t pos = 0;
+	while (pos < size)
+	{
+		const char* newline = static_cast<const char*>(std::memchr(data + pos, '\n', size - pos));
+		if (!newline)
+		{
+			break;
+		}
+		size_t end = newline - data;
+		unsigned long time = 0;
+		size_t text = pos;
+		while (text < end && data[text] >= '0' && data[text] <= '9')
+		{
+			time = time * 10 + (data[text++] - '0');
+		}
+		std::string line(data + text, end - text);
+		size_t trailing = line.find(" :", 1);
+		_search->add(dir, name, offset + pos, time,
+					 trailing == std::string::npos ? line : line.substr(trailing + 2));
+		pos = end + 1;
+	}
+}
+
+// Channel names compare case-insensitively; anything that has no place in
+// a file name is escaped
+std::string MessageLog::channelDir(const std::string& dir, const std::string& channel)
+{
+	static const char hex[] = "0123456789abcdef";
+	std::string name;
+	for (size_t i = 0; i < channel.size(); i++)
+	{
+		unsigned char c = tolower(channel[i]);
+		if (isalnum(c) || c == '-' || c == '_')
+		{
+			name += c;
+		}
+		else
+		{
+			name += '%';
+			name += hex[c >> 4];
+			name += hex[c & 0xf];
+		}
+	}
+	return (dir + "/" + name);
+}
+
+// Segments are time ordered: a line of one is never older than the start
+// of the next one, so whole segments outside the range are skipped
+void MessageLog::find(const std::string& channel, unsigned long after, unsigned long before,
+					  size_t limit, bool newest, std::vector<HistoryRing::Line>& out)
+{
+	MessageLog* log = s_installed;
+	if (!log || limit == 0)
+	{
+		return;
+	}
+	std::string dir = channelDir(log->_dir, channel);
+	std::vector<std::string> names = listSegments(dir);
+	std::vector<unsigned long> starts;
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		starts.push_back(std::strtoul(names[i].c_str(), NULL, 10));
+	}
+
+	if (newest)
+	{
+		std::vector<HistoryRing::Line> found;
+		for (size_t i = names.size(); i > 0 && found.size() < limit; i--)
+		{
+			if (before != 0 && starts[i - 1] >= before)
+			{
+				continue;
+			}
+			std::vector<HistoryRing::Line> part;
+			scan(dir + "/" + names[i - 1], after, before, limit - found.size(), true, part);
+			found.insert(found.begin(), part.begin(), part.end());
+			if (starts[i - 1] <= after)
+			{
+				break;
+			}
+		}
+		out.insert(out.end(), found.begin(), found.end());
+		return;
+	}
+	size_t wanted = out.size() + limit;
+	for (size_t i = 0; i < names.size() && out.size() < wanted; i++)
+	{
+		if (i + 1 < names.size() && starts[i + 1] <= after)
+		{
+			continue;
+		}
+		if (before != 0 && starts[i] >= before)
+		{
+			break;
+		}
+		scan(dir + "/" + names[i], after, before, wanted - out.size(), false, out);
+	}
+}
+
+// Map one segment and read the lines in range, starting from the last
+// index entry at or before `after`. A line still being written (no end of
+// line yet) is not there.
+void MessageLog::scan(const std::string& path, unsigned long after, unsigned long before,
+					  size_t limit, bool newest, std::vector<HistoryRing::Line>& out)
+{
+	int fd = open((path + ".log").c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		return;
+	}
+	struct stat info;
+	void* map = MAP_FAILED;
+	if (fstat(fd, &info) == 0 && info.st_size > 0)
+	{
+		map = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	::close(fd);
+	if (map == MAP_FAILED)
+	{
+		return;
+	}
+	const char* data = static_cast<const char*>(map);
+	size_t size = info.st_size;
+	madvise(map, size, MADV_SEQUENTIAL);
+
+	size_t pos = 0;
+	int indexFd = after > 0 ? open((path + ".idx").c_str(), O_RDONLY | O_CLOEXEC) : -1;
+	if (indexFd >= 0)
+	{
+		struct stat indexInfo;
+		void* index = MAP_FAILED;
+		if (fstat(indexFd, &indexInfo) == 0 &&
+			static_cast<size_t>(indexInfo.st_size) >= INDEX_ENTRY)
+		{
+			index = mmap(NULL, indexInfo.st_size, PROT_READ, MAP_SHARED, indexFd, 0);
+		}
+		::close(indexFd);
+		if (index != MAP_FAILED)
+		{
+			const unsigned char* entries = static_cast<const unsigned char*>(index);
+			size_t low = 0;
+			size_t high = indexInfo.st_size / INDEX_ENTRY;
+			while (low < high)
+			{
+				size_t middle = (low + high) / 2;
+				if (getInt(entries + middle * INDEX_ENTRY, 8) <= after)
+				{
+					low = middle + 1;
+				}
+				else
+				{
+					high = middle;
+				}
+			}
+			if (low > 0)
+			{
+				size_t offset = getInt(entries + (low - 1) * INDEX_ENTRY + 8, 8);
+				pos = offset < size ? offset : size;
+			}
+			munmap(index, indexInfo.st_size);
+		}
+	}
+
+	// Lines in range, as spans of the mapping: only the ones kept are copied
+	std::vector<size_t> starts;
+	std::vector<size_t> ends;
+	std::vector<unsigned long> times;
+	while (pos < size)
+	{
+		const char* newline = static_cast<const char*>(std::memchr(data + pos, '\n', size - pos));
+		if (!newline)
+		{
+			break;
+		}
+		size_t end = newline - data + 1;
+		unsigned long time = 0;
+		size_t text = pos;
+		while (text < end && data[text] >= '0' && data[text] <= '9')
+		{
+			time = time * 10 + (data[text++] - '0');
+		}
+		pos = end;
+		if (time <= after)
+		{
+			continue;
+		}
+		if (before != 0 && time >= before)
+		{
+			break;
+		}
+		starts.push_back(text + 1);
+		ends.push_back(end);
+		times.push_back(time);
+		if (!newest && times.size() >= limit)
+		{
+			break;
+		}
+	}
+	size_t first = (newest && times.size() > limit) ? times.size() - limit : 0;
+	for (size_t i = first; i < times.size(); i++)
+	{
+		HistoryRing::Line line;
+		line.time = times[i];
+		line.text.assign(data + starts[i], ends[i] - starts[i]);
+		out.push_back(line);
+	}
+	munmap(map, size);
+}
+
+// Hits of one segment come together; each line is read on its own, the
+// rest of the segment is not
+void MessageLog::search(const std::string& channel, const std::vector<std::string>& words,
+						size_t limit, std::vector<HistoryRing::Line>& out)
+{
+	MessageLog* log = s_installed;
+	if (!log || !log->_search || limit == 0)
+	{
+		return;
+	}
+	std::vector<SearchIndex::Hit> hits;
+	log->_search->search(channelDir(log->_dir, channel), words, limit, hits);
+
+	std::string segment;
+	int fd = -1;
+	char buffer[MAX_RECORD];
+	for (size_t i = 0; i < hits.size(); i++)
+	{
+		if (hits[i].segment != segment)
+		{
+			if (fd >= 0)
+			{
+				::close(fd);
+			}
+			segment = hits[i].segment;
+			fd = open((segment + ".log").c_str(), O_RDONLY | O_CLOEXEC);
+		}
+		ssize_t n = fd >= 0 ? pread(fd, buffer, sizeof(buffer), hits[i].offset) : -1;
+		const char* space = n > 0 ? static_cast<const char*>(std::memchr(buffer, ' ', n)) : NULL;
+		const char* newline =
+			space ? static_cast<const char*>(std::memchr(space, '\n', buffer + n - space)) : NULL;
+		if (!newline)
+		{
+			continue;  // segment removed since, or line too long
+		}
+		HistoryRing::Line line;
+		line.time = hits[i].time;
+		line.text.assign(space + 1, newline + 1);
+		out.push_back(line);
+	}
+	if (fd >= 0)
+	{
+		::close(fd);
+	}
+}
@@ -0,0 +1,856 @@
+#include "Network.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <sstream>
+
+#include "Channel.hpp"
+#include "Client.hpp"
+#include "Config.hpp"
+#include "Epoch.hpp"
+#include "Message.hpp"
+#include "Server.hpp"
+#include "Shard.hpp"
+#include "Socket.hpp"
+#include "UtilsFun.hpp"
+
+// The QUIT a user's channels and the whole server see when it leaves
+static std::string quitLine(Client* user, const std::string& reason)
+{
+	return (":" + user->getNickname() + "!" + user->getUsername() + "@localhost QUIT :" +
+			reason + "\r\n");
+}
+
+// params[first] up to params[last] as one string, how the journal takes modes
+static std::string modeArgs(const std::vector<std::string>& params, size_t first, size_t last)
+{
+	std::string modes = params[first];
+	for (size_t i = first + 1; i < last; i++)
+	{
+		modes += " " + params[i];
+	}
+	return (modes);
+}
+
+Network::Network(Server* server) : _server(server), _compress(0), _nextFd(-2) {}
+
+Network::~Network() {}
+
+// Links need a name for this server and the shared password. The peers in
+// link_connect are dialed once, at startup or when a standby takes over,
+// unless dial is false; they can also dial in later.
+void Network::setup(bool dial)
+{
+	_password = Config::getConfig("link_password");
+	_name = Config::getConfig("server_name");
+	if (_password.empty())
+	{
+		return;
+	}
+	if (_name.empty() || _name.find(' ') != std::string::npos)
+	{
+		Print::Warn("link_password needs a server_name, server links disabled");
+		_password.clear();
+		return;
+	}
+	_compress = Config::getConfigInt("link_compress", 0);
+	if (_compress < 0 || _compress > 9)
+	{
+		Print::Warn("link_compress: expected a zlib level from 0 to 9, links stay plain");
+		_compress = 0;
+	}
+	Print::Ok("Server links enabled as " + _name +
+			  (_compress ? " (compression level " + toString(_compress) + ")" : ""));
+
+	std::istringstream peers(dial ? Config::getConfig("link_connect") : "");
+	std::string peer;
+	while (std::getline(peers, peer, ','))
+	{
+		if (!peer.empty())
+		{
+			connect(peer);
+		}
+	}
+}
+
+bool Network::isEnabled() const { return (!_password.empty()); }
+
+const std::string& Network::getName() const { return (_name); }
+
+// Dial host:port and introduce ourselves, the handshake goes on in the
+// event loop like any other input
+void Network::connect(const std::string& peer)
+{
+	size_t colon = peer.rfind(':');
+	if (colon == std::string::npos)
+	{
+		Print::Warn("link_connect: expected host:port, got " + peer);
+		return;
+	}
+	std::string host = peer.substr(0, colon);
+	int port = std::atoi(peer.c_str() + colon + 1);
+
+	Socket socket;
+	if (!socket.create(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0) ||
+		!socket.connect(host, port) || !socket.setNonBlocking())
+	{
+		Print::Warn("Can't link to " + peer + ": " + socket.getLastError());
+		return;
+	}
+	int fd = socket.release();
+	Client* link = _server->_shards[0]->attachConnection(fd);
+	if (!link)
+	{
+		::close(fd);
+		Print::Warn("Can't link to " + peer + ": server full");
+		return;
+	}
+	link->setLink(true);
+	_links[link] = "";
+	link->sendMessage("SERVER " + _name + " " + _password + "\r\n");
+	Print::Ok("Linking to " + peer);
+}
+
+void Network::refuse(Client* client, const std::string& reason)
+{
+	Print::Warn("Refusing server link: " + reason);
+	client->sendMessage("ERROR :Closing Link: " + reason + "\r\n");
+	client->requestDisconnect();
+}
+
+// SERVER, from a connection that dialed in or as the answer of one we
+// dialed. Either way the peer gets our burst once the link is up.
+void Network::acceptLink(Client* client, const std::string& name, const std::string& password)
+{
+	if (_password.empty())
+	{
+		refuse(client, "Server links are disabled");
+		return;
+	}
+	if (password != _password)
+	{
+		refuse(client, "Bad link password");
+		return;
+	}
+	if (name.empty() || name == _name || _nodes.count(name))
+	{
+		refuse(client, "Server " + name + " already linked");
+		return;
+	}
+
+	bool dialed = _links.count(client);
+	client->setLink(true);
+	if (_compress)
+	{
+		client->setCompression(_compress);
+	}
+	_links[client] = name;
+	_nodes[name].route = client;
+	if (!dialed)
+	{
+		client->sendMessage("SERVER " + _name + " " + _password + "\r\n");
+	}
+	sendBurst(client);
+	forward(client, "NODE " + name + "\r\n");
+	Print::Ok("Linked to server " + name);
+}
+
+// Everything the network behind a new link has to learn about this side
+void Network::sendBurst(Client* link)
+{
+	std::string burst;
+	for (std::map<std::string, Node>::iterator it = _nodes.begin(); it != _nodes.end(); ++it)
+	{
+		if (it->second.route != link)
+		{
+			burst += "NODE " + it->first + "\r\n";
+		}
+	}
+
+	size_t users = 0;
+	for (std::map<int, Client*>::iterator it = _server->_clients.begin();
+		 it != _server->_clients.end(); ++it)
+	{
+		Client* user = it->second;
+		std::string origin;
+		if (user->isAnnounced())
+		{
+			origin = _name;
+		}
+		else if (user->isRemote() && user->getRoute() != link)
+		{
+			origin = _origins[user];
+		}
+		else
+		{
+			continue;
+		}
+		burst += "UNICK " + user->getNickname() + " " + user->getUsername() + " " + origin +
+				 " " + toString(user->getNickTs()) + "\r\n";
+		users++;
+	}
+
+	for (std::map<std::string, Channel*>::iterator it = _server->_channels.begin();
+		 it != _server->_channels.end(); ++it)
+	{
+		std::string sjoin = sjoinLine(it->second, link);
+		if (sjoin.empty())
+		{
+			continue;
+		}
+		burst += sjoin;
+		if (!it->second->getTopic().empty())
+		{
+			burst += "STOPIC " + it->first + " :" + it->second->getTopic() + "\r\n";
+		}
+	}
+	link->sendMessage(burst);
+	Print::Ok("Burst to " + _links[link] + ": " + toString(users) + " user(s)");
+}
+
+// A channel with its modes and the members the link's side doesn't own,
+// empty if there are none
+std::string Network::sjoinLine(Channel* channel, Client* except)
+{
+	std::string members;
+	const std::map<int, Client*>& clients = channel->getClients();
+	for (std::map<int, Client*>::const_iterator it = clients.begin(); it != clients.end();
+		 ++it)
+	{
+		Client* member = it->second;
+		if (!member->isAnnounced() && (!member->isRemote() || member->getRoute() == except))
+		{
+			continue;
+		}
+		if (!members.empty())
+		{
+			members += " ";
+		}
+		if (channel->isOperator(member))
+		{
+			members += "@";
+		}
+		members += member->getNickname();
+	}
+	if (members.empty())
+	{
+		return ("");
+	}
+
+	std::string modes = "+";
+	std::string params;
+	if (channel->isInviteOnly())
+	{
+		modes += "i";
+	}
+	if (channel->isTopicRestricted())
+	{
+		modes += "t";
+	}
+	if (channel->hasKey())
+	{
+		modes += "k";
+		params += " " + channel->getKey();
+	}
+	if (channel->hasUserLimit())
+	{
+		modes += "l";
+		params += " " + toString(channel->getUserLimit());
+	}
+	return ("SJOIN " + channel->getName() + " " + modes + params + " :" + members + "\r\n");
+}
+
+// Send a line to every link but the one it came from
+void Network::forward(Client* except, const std::string& line)
+{
+	for (std::map<Client*, std::string>::iterator it = _links.begin(); it != _links.end();
+		 ++it)
+	{
+		if (it->first != except && !it->second.empty())
+		{
+			it->first->sendMessage(line);
+		}
+	}
+}
+
+// Send a channel message only down the links with members behind them
+void Network::relayChannel(Channel* channel, const std::string& line, Client* except)
+{
+	const std::map<Client*, int>& links = channel->getLinks();
+	for (std::map<Client*, int>::const_iterator it = links.begin(); it != links.end(); ++it)
+	{
+		if (it->first != except)
+		{
+			it->first->sendMessage(line);
+		}
+	}
+}
+
+// A line from a linked server. State changes are applied, shown to the
+// local users concerned like the originating server did, and passed on.
+void Network::handleLine(Client* link, const Message& message)
+{
+	std::string line = message.getCommand() + message.getRemainder() + "\r\n";
+	std::string prefix;
+	Message body = message;
+	if (!message.getCommand().empty() && message.getCommand()[0] == ':')
+	{
+		prefix = message.getCommand().substr(1);
+		body = Message(message.getRemainder());
+	}
+	const std::string& verb = body.getCommand();
+
+	if (verb == "SERVER")
+	{
+		acceptLink(link, body.getParams(0), body.getParams(1));
+		return;
+	}
+	if (verb == "ERROR")
+	{
+		Print::Warn("Server link error: " + body.getParams(0));
+		return;
+	}
+	std::map<Client*, std::string>::iterator it = _links.find(link);
+	if (it == _links.end() || it->second.empty())
+	{
+		Print::Warn("Server link sent " + verb + " before SERVER");
+		return;
+	}
+
+	if (verb == "NODE")
+	{
+		addNode(link, body, line);
+	}
+	else if (verb == "SQUIT")
+	{
+		removeNode(link, body, line);
+	}
+	else if (verb == "UNICK")
+	{
+		introduceUser(link, body, line);
+	}
+	else if (verb == "KILL")
+	{
+		killUser(link, body);
+	}
+	else if (verb == "SJOIN")
+	{
+		syncChannel(link, body, line);
+	}
+	else if (verb == "STOPIC")
+	{
+		Channel* channel = _server->getChannel(body.getParams(0));
+		if (channel && channel->getTopic().empty())
+		{
+			channel->setTopic(body.getParams(1));
+			_server->_journal.channelTopic(channel);
+		}
+		forward(link, line);
+	}
+	else if (verb == "PRIVMSG" || verb == "NOTICE" || verb == "INVITE")
+	{
+		routeMessage(link, body, line);
+	}
+	else if (Client* user = remoteUser(link, prefix))
+	{
+		if (verb == "NICK")
+		{
+			renameUser(link, user, body, line);
+		}
+		else if (verb == "QUIT")
+		{
+			forward(link, line);
+			dropUser(user, line);
+		}
+		else
+		{
+			channelEvent(link, user, verb, body, line);
+		}
+	}
+}
+
+// The user a line is from, if it is one of the link's side
+Client* Network::remoteUser(Client* link, const std::string& prefix)
+{
+	Client* user = _server->getClientByNick(prefix.substr(0, prefix.find('!')));
+	if (!user || user->getRoute() != link)
+	{
+		return (NULL);
+	}
+	return (user);
+}
+
+// NODE <name>: a server joined the network behind the link. Knowing it
+// already means the link closes a cycle.
+void Network::addNode(Client* link, const Message& body, const std::string& line)
+{
+	std::string name = body.getParams(0);
+	if (name.empty())
+	{
+		return;
+	}
+	if (name == _name || _nodes.count(name))
+	{
+		refuse(link, "Server " + name + " already linked");
+		return;
+	}
+	_nodes[name].route = link;
+	forward(link, line);
+}
+
+// SQUIT <name>: a server behind the link split off
+void Network::removeNode(Client* link, const Message& body, const std::string& line)
+{
+	std::string name = body.getParams(0);
+	std::map<std::string, Node>::iterator it = _nodes.find(name);
+	if (it == _nodes.end() || it->second.route != link)
+	{
+		return;
+	}
+	splitServer(name, _links[link] + " " + name);
+	forward(link, line);
+}
+
+// UNICK <nick> <user> <server> <ts>: a user of the link's side
+void Network::introduceUser(Client* link, const Message& body, const std::string& line)
+{
+	if (body.getSize() < 4)
+	{
+		return;
+	}
+	std::string nick = body.getParams(0);
+	std::string server = body.getParams(2);
+	time_t ts = std::atol(body.getParams(3).c_str());
+	std::map<std::string, Node>::iterator node = _nodes.find(server);
+	if (node == _nodes.end() || node->second.route != link)
+	{
+		Print::Warn("UNICK " + nick + " from unknown server " + server);
+		return;
+	}
+	Client* holder = _server->getClientByNick(nick);
+	if (holder && !settleCollision(link, holder, nick, ts))
+	{
+		return;
+	}
+
+	Client* user = new Client(_nextFd--, 0, 0);
+	user->setRoute(link);
+	user->setUsername(body.getParams(1));
+	user->setAuthenticated(true);
+	_server->_clients[user->getFd()] = user;
+	_server->changeNick(user, nick);
+	user->setNickTs(ts);
+	node->second.users.insert(user);
+	_origins[user] = server;
+	forward(link, line);
+}
+
+// :<nick> NICK <new> <ts>
+void Network::renameUser(Client* link, Client* user, const Message& body,
+						 const std::string& line)
+{
+	std::string nick = body.getParams(0);
+	time_t ts = std::atol(body.getParams(1).c_str());
+	Client* holder = _server->getClientByNick(nick);
+	if (holder && holder != user && !settleCollision(link, holder, nick, ts))
+	{
+		// It lost the new nick: gone here and past this server
+		std::string quit = quitLine(user, "Nick collision");
+		forward(link, quit);
+		dropUser(user, quit);
+		return;
+	}
+	_server->changeNick(user, nick);
+	user->setNickTs(ts);
+	forward(link, line);
+}
+
+// KILL <nick> <ts> :<reason>, only for the holder the sender meant
+void Network::killUser(Client* link, const Message& body)
+{
+	Client* holder = _server->getClientByNick(body.getParams(0));
+	if (!holder || holder->getNickTs() != std::atol(body.getParams(1).c_str()))
+	{
+		return;
+	}
+	kill(holder, body.getParams(2), link);
+}
+
+// A nick the link's side introduces is held here already. The older one
+// stays, a tie kills both. Returns true if the newcomer keeps the nick.
+bool Network::settleCollision(Client* link, Client* holder, const std::string& nick,
+							  time_t ts)
+{
+	time_t held = holder->getNickTs();
+	Print::Warn("Nick collision on " + nick);
+	if (ts >= held)
+	{
+		link->sendMessage("KILL " + nick + " " + toString(ts) + " :Nick collision\r\n");
+	}
+	if (ts <= held)
+	{
+		kill(holder, "Nick collision", link);
+	}
+	return (ts < held);
+}
+
+// Remove a user here and on every link but `except`. A local user gets
+// ERROR and is disconnected, without a QUIT for the links.
+void Network::kill(Client* user, const std::string& reason, Client* except)
+{
+	forward(except, "KILL " + user->getNickname() + " " + toString(user->getNickTs()) +
+						" :" + reason + "\r\n");
+	std::string quit = quitLine(user, "Killed (" + reason + ")");
+	if (user->isRemote())
+	{
+		dropUser(user, quit);
+		return;
+	}
+	user->sendMessage("ERROR :Closing Link: localhost (Killed: " + reason + ")\r\n");
+	user->setAnnounced(false);
+	_server->broadcast(quit, user->getFd());
+	_server->removeClientFromChannels(user);
+	_server->_journal.userQuit(user);
+	_server->_nicks.release(user->getNickname(), user);
+	user->setNickname("");
+	user->requestDisconnect();
+}
+
+// A user of another server is gone: the local users see it quit
+void Network::dropUser(Client* user, const std::string& quit)
+{
+	_server->broadcast(quit, user->getFd());
+	_server->removeClientFromChannels(user);
+	if (!user->getNickname().empty())
+	{
+		_server->_nicks.release(user->getNickname(), user);
+	}
+	_server->_clients.erase(user->getFd());
+	std::map<Client*, std::string>::iterator origin = _origins.find(user);
+	if (origin != _origins.end())
+	{
+		std::map<std::string, Node>::iterator node = _nodes.find(origin->second);
+		if (node != _nodes.end())
+		{
+			node->second.users.erase(user);
+		}
+		_origins.erase(origin);
+	}
+	Epoch::retire(user);  // commands on other threads may still hold it
+}
+
+// A server left the network, and its users with it
+void Network::splitServer(const std::string& name, const std::string& reason)
+{
+	std::map<std::string, Node>::iterator it = _nodes.find(name);
+	if (it == _nodes.end())
+	{
+		return;
+	}
+	std::vector<Client*> users(it->second.users.begin(), it->second.users.end());
+	for (size_t i = 0; i < users.size(); i++)
+	{
+		dropUser(users[i], quitLine(users[i], reason));
+	}
+	_nodes.erase(name);
+	Print::Warn("Server " + name + " split, " + toString(users.size()) + " user(s) lost");
+}
+
+// The link's connection closed: every server behind it splits off
+void Network::dropLink(Client* link)
+{
+	std::map<Client*, std::string>::iterator it = _links.find(link);
+	if (it == _links.end())
+	{
+		return;
+	}
+	std::string peer = it->second;
+	_links.erase(it);
+	if (peer.empty())
+	{
+		Print::Warn("Server link closed before SERVER");
+		return;
+	}
+
+	std::vector<std::string> lost;
+	for (std::map<std::string, Node>::iterator node = _nodes.begin(); node != _nodes.end();
+		 ++node)
+	{
+		if (node->second.route == link)
+		{
+			lost.push_back(node->first);
+		}
+	}
+	for (size_t i = 0; i < lost.size(); i++)
+	{
+		splitServer(lost[i], _name + " " + peer);
+		forward(link, "SQUIT " + lost[i] + "\r\n");
+	}
+	Print::Warn("Lost link to " + peer);
+}
+
+// SJOIN <channel> <modes> [mode params] :<[@]nick ...>: a channel with
+// members on the link's side. Modes add up with the ones known here.
+void Network::syncChannel(Client* link, const Message& body, const std::string& line)
+{
+	std::vector<std::string> params = body.getParams();
+	if (params.size() < 3)
+	{
+		return;
+	}
+	std::string name = params[0];
+	Channel* channel = _server->getChannel(name);
+	if (!channel)
+	{
+		channel = _server->createChannel(name, NULL);
+		channel->setTopicRestricted(false);  // the modes say
+	}
+	applyModes(channel, params, 1, params.size() - 1);
+	_server->_journal.channelModes(channel, modeArgs(params, 1, params.size() - 1));
+
+	std::istringstream members(params.back());
+	std::string member;
+	while (members >> member)
+	{
+		bool op = member[0] == '@';
+		Client* user = _server->getClientByNick(op ? member.substr(1) : member);
+		if (!user || user->getRoute() != link)
+		{
+			continue;
+		}
+		if (!channel->hasClient(user))
+		{
+			channel->addClient(user);
+			channel->broadcast(":" + user->getNickname() + " JOIN :" + name + "\r\n",
+							   user->getFd());
+		}
+		if (op)
+		{
+			channel->addOperator(user);
+		}
+	}
+	forward(link, line);
+}
+
+// Channel modes as the MODE and SJOIN lines carry them: params[first] is
+// the mode string, its arguments follow up to params[last]
+void Network::applyModes(Channel* channel, const std::vector<std::string>& params,
+						 size_t first, size_t last)
+{
+	const std::string& modes = params[first];
+	size_t next = first + 1;
+	bool adding = true;
+	for (size_t i = 0; i < modes.size(); i++)
+	{
+		char mode = modes[i];
+		if (mode == '+' || mode == '-')
+		{
+			adding = mode == '+';
+		}
+		else if (mode == 'i')
+		{
+			channel->setInviteOnly(adding);
+		}
+		else if (mode == 't')
+		{
+			channel->setTopicRestricted(adding);
+		}
+		else if (mode == 'k' && !adding)
+		{
+			channel->removeKey();
+		}
+		else if (mode == 'l' && !adding)
+		{
+			channel->removeUserLimit();
+		}
+		else if (next < last && mode == 'k')
+		{
+			channel->setKey(params[next++]);
+		}
+		else if (next < last && mode == 'l')
+		{
+			channel->setUserLimit(std::atoi(params[next++].c_str()));
+		}
+		else if (next < last && mode == 'o')
+		{
+			Client* member = _server->getClientByNick(params[next++]);
+			if (member && channel->hasClient(member))
+			{
+				if (adding)
+				{
+					channel->addOperator(member);
+				}
+				else
+				{
+					channel->removeOperator(member);
+				}
+			}
+		}
+	}
+}
+
+// JOIN, PART, TOPIC, MODE and KICK of a user of the link's side
+void Network::channelEvent(Client* link, Client* user, const std::string& verb,
+						   const Message& body, const std::string& line)
+{
+	std::string name = body.getParams(0);
+	Channel* channel = _server->getChannel(name);
+	if (verb == "JOIN")
+	{
+		if (!channel)
+		{
+			channel = _server->createChannel(name, NULL);
+		}
+		if (channel->hasClient(user))
+		{
+			return;
+		}
+		channel->addClient(user);
+		channel->removeInvitedUser(user->getNickname());
+		channel->broadcast(line, user->getFd());
+	}
+	else if (!channel)
+	{
+		return;
+	}
+	else if (verb == "PART" || verb == "KICK")
+	{
+		Client* leaving = verb == "PART" ? user : _server->getClientByNick(body.getParams(1));
+		if (!leaving || !channel->hasClient(leaving))
+		{
+			return;
+		}
+		channel->broadcast(line);
+		channel->removeOperator(leaving);
+		channel->removeClient(leaving);
+		if (channel->isEmpty())
+		{
+			_server->removeChannel(name);
+		}
+	}
+	else if (verb == "TOPIC")
+	{
+		channel->setTopic(body.getParams(1));
+		channel->broadcast(line);
+		_server->_journal.channelTopic(channel);
+	}
+	else if (verb == "MODE" && body.getSize() > 1)
+	{
+		std::vector<std::string> params = body.getParams();
+		applyModes(channel, params, 1, params.size());
+		channel->broadcast(line);
+		_server->_journal.channelModes(channel, modeArgs(params, 1, params.size()));
+	}
+	else
+	{
+		return;
+	}
+	forward(link, line);
+}
+
+// PRIVMSG, NOTICE and INVITE. A channel gets it here and down the other
+// links with members; a user here gets it, one further away gets it on
+// the way to its server.
+void Network::routeMessage(Client* link, const Message& body, const std::string& line)
+{
+	std::string target = body.getParams(0);
+	if (target.empty())
+	{
+		return;
+	}
+	if (body.getCommand() != "INVITE" && (target[0] == '#' || target[0] == '&'))
+	{
+		Channel* channel = _server->getChannel(target);
+		if (channel)
+		{
+			channel->broadcast(line, -1, Client::LANE_BULK);
+			relayChannel(channel, line, link);
+			channel->record(line);
+		}
+		return;
+	}
+
+	if (body.getCommand() == "INVITE")
+	{
+		Channel* channel = _server->getChannel(body.getParams(1));
+		if (channel)
+		{
+			channel->addInvitedUser(target);
+			_server->_journal.channelInvite(channel, target);
+		}
+	}
+	Client* recipient = _server->getClientByNick(target);
+	if (recipient && recipient->getRoute() != link)
+	{
+		recipient->sendMessage(line, Client::LANE_BULK);
+	}
+}
+
+// A local user completed registration, the network learns about it
+void Network::announceUser(Client* client)
+{
+	if (client->isAnnounced() || client->isBot() || client->isLink() ||
+		client->isRemote() || client->getNickname().empty() || client->getUsername().empty())
+	{
+		return;
+	}
+	client->setAnnounced(true);
+	forward(NULL, "UNICK " + client->getNickname() + " " + client->getUsername() + " " +
+					  _name + " " + toString(client->getNickTs()) + "\r\n");
+}
+
+// A local user took a new nick, or got one to complete its registration
+void Network::userNick(Client* client, const std::string& oldNick)
+{
+	if (!client->isAnnounced())
+	{
+		announceUser(client);
+		return;
+	}
+	if (oldNick != client->getNickname())
+	{
+		forward(NULL, ":" + oldNick + " NICK " + client->getNickname() + " " +
+						  toString(client->getNickTs()) + "\r\n");
+	}
+}
+
+// A local user quit or disconnected; later lines from it stay local
+void Network::userQuit(Client* client, const std::string& reason)
+{
+	if (!client->isAnnounced())
+	{
+		return;
+	}
+	client->setAnnounced(false);
+	forward(NULL, quitLine(client, reason));
+}
+
+// A local user created a channel
+void Network::channelCreated(Channel* channel)
+{
+	std::string sjoin = sjoinLine(channel, NULL);
+	if (!sjoin.empty())
+	{
+		forward(NULL, sjoin);
+	}
+}
+
+// JOIN, PART, TOPIC, MODE or KICK by a local user, as its channel saw it
+void Network::userEvent(Client* client, const std::string& line)
+{
+	if (client->isAnnounced())
+	{
+		forward(NULL, line);
+	}
+}
+
+// PRIVMSG or NOTICE of a local user to a channel
+void Network::channelMessage(Client* client, Channel* channel, const std::string& line)
+{
+	if (client->isAnnounced())
+	{
+		relayChannel(channel, line, NULL);
+	}
+}
@@ -0,0 +1,273 @@
+#include <sched.h>
+
+#include <cctype>
+#include <vector>
+
+#include "Epoch.hpp"
+#include "NickRegistry.hpp"
+
+static const size_t MIN_CAPACITY = 64;
+
+NickRegistry::NickRegistry()
+	: _table(newTable(MIN_CAPACITY)),
+	  _gate(0),
+	  _live(0)
+{
+}
+
+NickRegistry::~NickRegistry()
+{
+	for (size_t i = 0; i <= _table->mask; i++)
+	{
+		delete _table->slots[i];
+	}
+	destroyTable(_table);
+}
+
+NickRegistry::Table* NickRegistry::newTable(size_t capacity)
+{
+	Table* table = new Table();
+	table->mask = capacity - 1;
+	table->slots = new Entry*[capacity]();
+	table->used = 0;
+	return (table);
+}
+
+// Frees the slot array only, the entries are retired on their own
+void NickRegistry::destroyTable(void* table)
+{
+	delete[] static_cast<Table*>(table)->slots;
+	delete static_cast<Table*>(table);
+}
+
+// Nicks compare case-insensitively, like Server::caseInsensitiveCompare
+std::string NickRegistry::fold(const std::string& nick)
+{
+	std::string folded = nick;
+	for (size_t i = 0; i < folded.size(); i++)
+	{
+		folded[i] = std::toupper(folded[i]);
+	}
+	return (folded);
+}
+
+// FNV-1a
+size_t NickRegistry::hash(const std::string& nick)
+{
+	size_t hash = 2166136261u;
+	for (size_t i = 0; i < nick.size(); i++)
+	{
+		hash = (hash ^ static_cast<unsigned char>(nick[i])) * 16777619u;
+	}
+	return (hash);
+}
+
+// Owner of a nick, or NULL. Never blocks and never retries.
+Client* NickRegistry::find(const std::string& nick)
+{
+	std::string key = fold(nick);
+	Client* owner = NULL;
+
+	Epoch::Guard guard;
+	Table* table = __atomic_load_n(&_table, __ATOMIC_ACQUIRE);
+	size_t i = hash(key);
+	for (size_t n = 0; n <= table->mask; n++, i++)
+	{
+		Entry* entry = __atomic_load_n(&table->slots[i & table->mask], __ATOMIC_ACQUIRE);
+		if (!entry)
+		{
+			break;
+		}
+		if (entry->nick == key)
+		{
+			owner = __atomic_load_n(&entry->owner, __ATOMIC_ACQUIRE);
+			break;
+		}
+	}
+	return (owner);
+}
+
+// Take a nick for a client. Fails if someone else holds it; a nick the
+// client already holds counts as claimed.
+bool NickRegistry::claim(const std::string& nick, Client* client)
+{
+	std::string key = fold(nick);
+	Table* table;
+
+	while (true)
+	{
+		enterWriter();
+		table = __atomic_load_n(&_table, __ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&table->used, __ATOMIC_RELAXED) * 2 <= table->mask)
+		{
+			break;
+		}
+		leaveWriter();
+		compact();
+	}
+
+	// The first empty slot of the probe is where the nick goes, so two
+	// claimers of a new nick race for the same slot
+	bool claimed = false;
+	bool owned = false;
+	Entry* fresh = NULL;
+	size_t i = hash(key);
+	for (size_t n = 0; n <= table->mask; n++, i++)
+	{
+		Entry** slot = &table->slots[i & table->mask];
+		Entry* entry = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+		if (!entry)
+		{
+			if (!fresh)
+			{
+				fresh = new Entry();
+				fresh->nick = key;
+				fresh->owner = client;
+			}
+			if (__atomic_compare_exchange_n(slot, &entry, fresh, false, __ATOMIC_ACQ_REL,
+											__ATOMIC_ACQUIRE))
+			{
+				__atomic_add_fetch(&table->used, 1, __ATOMIC_RELAXED);
+				fresh = NULL;
+				claimed = true;
+				break;
+			}
+			// Lost the slot, entry is the winner: look at it below
+		}
+		if (entry->nick == key)
+		{
+			Client* expected = NULL;
+			claimed = __atomic_compare_exchange_n(&entry->owner, &expected, client, false,
+												  __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+			owned = (expected == client);
+			break;
+		}
+	}
+	leaveWriter();
+
+	delete fresh;
+	if (claimed)
+	{
+		__atomic_add_fetch(&_live, 1, __ATOMIC_RELAXED);
+	}
+	return (claimed || owned);
+}
+
+// Free a nick, if the client still holds it
+void NickRegistry::release(const std::string& nick, Client* client)
+{
+	std::string key = fold(nick);
+
+	enterWriter();
+	Table* table = __atomic_load_n(&_table, __ATOMIC_ACQUIRE);
+	size_t i = hash(key);
+	for (size_t n = 0; n <= table->mask; n++, i++)
+	{
+		Entry* entry = __atomic_load_n(&table->slots[i & table->mask], __ATOMIC_ACQUIRE);
+		if (!entry)
+		{
+			break;
+		}
+		if (entry->nick == key)
+		{
+			Client* expected = client;
+			if (__atomic_compare_exchange_n(&entry->owner, &expected, (Client*)NULL, false,
+											__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			{
+				__atomic_sub_fetch(&_live, 1, __ATOMIC_RELAXED);
+			}
+			break;
+		}
+	}
+	leaveWriter();
+}
+
+size_t NickRegistry::size() const { return (__atomic_load_n(&_live, __ATOMIC_RELAXED)); }
+
+void NickRegistry::enterWriter()
+{
+	while (true)
+	{
+		int gate = __atomic_load_n(&_gate, __ATOMIC_ACQUIRE);
+		if (gate < 0)
+		{
+			sched_yield();
+			continue;
+		}
+		if (__atomic_compare_exchange_n(&_gate, &gate, gate + 1, false, __ATOMIC_ACQUIRE,
+										__ATOMIC_RELAXED))
+		{
+			return;
+		}
+	}
+}
+
+void NickRegistry::leaveWriter() { __atomic_sub_fetch(&_gate, 1, __ATOMIC_RELEASE); }
+
+// Rebuild the table with room for four times the live nicks, dropping the
+// free ones. Runs with every other writer held off; readers keep using the
+// old table until the new one is published.
+void NickRegistry::compact()
+{
+	int open = 0;
+	while (!__atomic_compare_exchange_n(&_gate, &open, -1, false, __ATOMIC_ACQUIRE,
+										__ATOMIC_RELAXED))
+	{
+		open = 0;
+		sched_yield();
+	}
+
+	Table* old = _table;
+	if (old->used * 2 <= old->mask)
+	{
+		// Somebody else got here first
+		__atomic_store_n(&_gate, 0, __ATOMIC_RELEASE);
+		return;
+	}
+
+	size_t live = 0;
+	for (size_t i = 0; i <= old->mask; i++)
+	{
+		if (old->slots[i] && old->slots[i]->owner)
+		{
+			live++;
+		}
+	}
+	size_t capacity = MIN_CAPACITY;
+	while (capacity < live * 4)
+	{
+		capacity *= 2;
+	}
+
+	Table* table = newTable(capacity);
+	std::vector<Entry*> dropped;
+	for (size_t i = 0; i <= old->mask; i++)
+	{
+		Entry* entry = old->slots[i];
+		if (!entry)
+		{
+			continue;
+		}
+		if (!entry->owner)
+		{
+			dropped.push_back(entry);
+			continue;
+		}
+		size_t j = hash(entry->nick);
+		while (table->slots[j & table->mask])
+		{
+			j++;
+		}
+		table->slots[j & table->mask] = entry;
+		table->used++;
+	}
+	__atomic_store_n(&_table, table, __ATOMIC_RELEASE);
+	__atomic_store_n(&_gate, 0, __ATOMIC_RELEASE);
+
+	// Out of reach of new readers only now
+	Epoch::retire(old, &NickRegistry::destroyTable);
+	for (size_t i = 0; i < dropped.size(); i++)
+	{
+		Epoch::retire(dropped[i]);
+	}
+}
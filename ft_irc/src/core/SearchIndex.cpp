@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+
+#include "SearchIndex.hpp"
+
+static const size_t MAX_WORD = 32;       // longer words are cut there
+static const size_t WORD_OVERHEAD = 64;  // map node and posting of a new word
+
+SearchIndex::SearchIndex(size_t maxBytes) : _maxBytes(maxBytes), _bytes(0) {}
+
+SearchIndex::~SearchIndex() {}
+
+void SearchIndex::add(const std::string& dir, const std::string& segment, size_t offset,
+					  unsigned long time, const std::string& text)
+{
+	std::vector<std::string> words;
+	tokenize(text, words);
+
+	ScopedLock lock(_lock);
+	Part& part = _channels[dir][segment];
+	unsigned int line = part.times.size();
+	part.times.push_back(time);
+	part.offsets.push_back(offset);
+	size_t added = sizeof(unsigned long) + sizeof(unsigned int);
+
+	for (size_t i = 0; i < words.size(); i++)
+	{
+		std::map<std::string, Posting>::iterator found = part.words.find(words[i]);
+		if (found == part.words.end())
+		{
+			found = part.words.insert(std::make_pair(words[i], Posting())).first;
+			added += words[i].size() + WORD_OVERHEAD;
+		}
+		Posting& posting = found->second;
+		if (posting.count > 0 && posting.last == line)
+		{
+			continue;  // said twice in the line
+		}
+		unsigned int delta = posting.count > 0 ? line - posting.last : line;
+		size_t before = posting.deltas.size();
+		while (delta >= 0x80)
+		{
+			posting.deltas += static_cast<char>((delta & 0x7f) | 0x80);
+			delta >>= 7;
+		}
+		posting.deltas += static_cast<char>(delta);
+		posting.last = line;
+		posting.count++;
+		added += posting.deltas.size() - before;
+	}
+	part.bytes += added;
+	_bytes += added;
+	if (_bytes > _maxBytes)
+	{
+		evict(dir + "/" + segment);
+	}
+}
+
+// Drop the oldest segments of all channels until the index fits, except
+// the one being written to
+void SearchIndex::evict(const std::string& keep)
+{
+	while (_bytes > _maxBytes)
+	{
+		std::map<std::string, Parts>::iterator oldest = _channels.end();
+		for (std::map<std::string, Parts>::iterator it = _channels.begin();
+			 it != _channels.end(); ++it)
+		{
+			if (it->first + "/" + it->second.begin()->first == keep)
+			{
+				continue;
+			}
+			if (oldest == _channels.end() ||
+				it->second.begin()->first < oldest->second.begin()->first)
+			{
+				oldest = it;
+			}
+		}
+		if (oldest == _channels.end())
+		{
+			return;
+		}
+		_bytes -= oldest->second.begin()->second.bytes;
+		oldest->second.erase(oldest->second.begin());
+		if (oldest->second.empty())
+		{
+			_channels.erase(oldest);
+		}
+	}
+}
+
+void SearchIndex::decode(const Posting& posting, std::vector<unsigned int>& out)
+{
+	unsigned int line = 0;
+	size_t pos = 0;
+	for (unsigned int i = 0; i < posting.count; i++)
+	{
+		unsigned int delta = 0;
+		int shift = 0;
+		unsigned char byte;
+		do
+		{
+			byte = posting.deltas[pos++];
+			delta |= (byte & 0x7f) << shift;
+			shift += 7;
+		} while (byte & 0x80);
+		line = (i == 0) ? delta : line + delta;
+		out.push_back(line);
+	}
+}
+
+// Segments newest first; in each, the shortest list is decoded first and
+// the others only narrow it down
+void SearchIndex::search(const std::string& dir, const std::vector<std::string>& words,
+						 size_t limit, std::vector<Hit>& out)
+{
+	ScopedLock lock(_lock);
+	std::map<std::string, Parts>::iterator channel = _channels.find(dir);
+	if (channel == _channels.end() || words.empty())
+	{
+		return;
+	}
+	for (Parts::reverse_iterator it = channel->second.rbegin();
+		 it != channel->second.rend() && out.size() < limit; ++it)
+	{
+		const Part& part = it->second;
+		std::vector<const Posting*> postings;
+		for (size_t i = 0; i < words.size(); i++)
+		{
+			std::map<std::string, Posting>::const_iterator found = part.words.find(words[i]);
+			if (found == part.words.end())
+			{
+				break;
+			}
+			postings.push_back(&found->second);
+		}
+		if (postings.size() < words.size())
+		{
+			continue;
+		}
+		size_t shortest = 0;
+		for (size_t i = 1; i < postings.size(); i++)
+		{
+			shortest = postings[i]->count < postings[shortest]->count ? i : shortest;
+		}
+		std::vector<unsigned int> lines;
+		decode(*postings[shortest], lines);
+		for (size_t i = 0; i < postings.size() && !lines.empty(); i++)
+		{
+			if (i == shortest)
+			{
+				continue;
+			}
+			std::vector<unsigned int> other;
+			std::vector<unsigned int> both;
+			decode(*postings[i], other);
+			std::set_intersection(lines.begin(), lines.end(), other.begin(), other.end(),
+								  std::back_inserter(both));
+			lines.swap(both);
+		}
+		for (size_t i = lines.size(); i > 0 && out.size() < limit; i--)
+		{
+			Hit hit;
+			hit.segment = dir + "/" + it->first;
+			hit.offset = part.offsets[lines[i - 1]];
+			hit.time = part.times[lines[i - 1]];
+			out.push_back(hit);
+		}
+	}
+}
+
+size_t SearchIndex::bytes()
+{
+	ScopedLock lock(_lock);
+	return (_bytes);
+}
+
+// Runs of ASCII letters and digits, lowercased, and of UTF-8 bytes taken
+// as they are
+void SearchIndex::tokenize(const std::string& text, std::vector<std::string>& out)
+{
+	std::string word;
+	for (size_t i = 0; i <= text.size(); i++)
+	{
+		unsigned char c = i < text.size() ? text[i] : ' ';
+		if (isalnum(c) || c >= 0x80)
+		{
+			if (word.size() < MAX_WORD)
+			{
+				word += static_cast<char>(tolower(c));
+			}
+			continue;
+		}
+		if (!word.empty())
+		{
+			out.push_back(word);
+		}
+		word.clear();
+	}
+}
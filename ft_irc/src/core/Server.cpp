@@ -1,6 +1,9 @@
 #include <cctype>
+#include <fcntl.h>
+#include <sys/resource.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <cstring>
 #include <iostream>
@@ -8,16 +11,51 @@
 #include <vector>
 
 #include "Channel.hpp"
+#include "ChannelWorker.hpp"
+#include "CommandPool.hpp"
+#include "FanoutPool.hpp"
+#include "MessageLog.hpp"
+#include "SessionStore.hpp"
 #include "Client.hpp"
 #include "Config.hpp"
 #include "CommandFactory.hpp"
+#include "Epoch.hpp"
 #include "General.hpp"
+#include "HistoryRing.hpp"
 #include "Message.hpp"
 #include "Server.hpp"
+#include "Shard.hpp"
 #include "Socket.hpp"
 #include "UtilsFun.hpp"
 
-Server::Server() : _running(false), _botConnected(false)
+Server::Server()
+	: _running(false),
+	  _listening(true),
+	  _botConnected(false),
+	  _stateLock(true),
+	  _workers(Sched::WORKERS),
+	  _pipelined(false),
+	  _logicSleeping(0),
+	  _fanoutPool(NULL),
+	  _commandPool(NULL),
+	  _messageLog(NULL),
+	  _sessions(NULL),
+	  _maxConnections(0),
+	  _connectionCount(0),
+	  _reserveFd(-1),
+	  _floodBurst(Flood::BURST),
+	  _floodRate(Flood::RATE),
+	  _floodMaxStrikes(Flood::MAX_STRIKES),
+	  _broadcastSeq(0),
+	  _broadcastBatch(Sched::BROADCAST_BATCH),
+	  _migrateVotes(0),
+	  _clientsInTransit(0),
+	  _network(this),
+	  _journal(this),
+	  _upgrade(this),
+	  _snapshot(this),
+	  _welcome("motd.txt"),
+	  _historyJoin(History::JOIN_LINES)
 {
 	std::time_t now = std::time(0);
 	std::tm* timeinfo = std::localtime(&now);
@@ -44,43 +82,288 @@ Server::~Server() { stop(); }
 bool Server::setupServer(int port, const std::string& password)
 {
 	_password = password;
+	_floodBurst = Config::getConfigInt("flood_burst", Flood::BURST);
+	_floodRate = Config::getConfigInt("flood_rate", Flood::RATE);
+	_floodMaxStrikes = Config::getConfigInt("flood_strikes", Flood::MAX_STRIKES);
+	_quantumLines = Config::getConfigInt("quantum_lines", Sched::QUANTUM_LINES);
+	_maxSendq = Config::getConfigInt("sendq_bytes", Sched::SENDQ_BYTES);
+	_broadcastBatch = Config::getConfigInt("broadcast_batch", Sched::BROADCAST_BATCH);
+	_workers = Config::getConfigInt("workers", Sched::WORKERS);
+	int ioThreads = Config::getConfigInt("io_threads", 0);
+	int channelThreads = Config::getConfigInt("channel_threads", 0);
+	int fanoutThreads = Config::getConfigInt("fanout_threads", 0);
+	int commandThreads = Config::getConfigInt("command_threads", 0);
+	_migrateVotes = Config::getConfigInt("migrate_votes", 0);
+	int historyLines = Config::getConfigInt("history_lines", History::LINES);
+	int historyBytes = Config::getConfigInt("history_bytes", History::BYTES);
+	HistoryRing::setLimits(historyLines > 0 ? historyLines : 0,
+						   historyBytes > 0 ? historyBytes : 0);
+	_historyJoin = Config::getConfigInt("history_join", History::JOIN_LINES);
+	if (_historyJoin > historyLines)
+	{
+		_historyJoin = historyLines;
+	}
 	Print::Do("SetupServer...");
+	if (!setupConnectionLimits())
+	{
+		return (false);
+	}
+	// Restart without disconnects: the previous process's sockets come first
+	if (!_upgrade.setup())
+	{
+		return (false);
+	}
+	CommandFactory::initializeCommands();
+
+	// Pipelined mode: the shards only do I/O and the calling thread runs
+	// every command, so the state needs no lock
+	if (ioThreads > 0)
+	{
+		if (_workers > 1)
+		{
+			Print::Warn("io_threads is set, ignoring workers=" + toString(_workers));
+		}
+		_workers = ioThreads;
+		_pipelined = true;
+		if (pipe2(_logicWake, O_NONBLOCK | O_CLOEXEC) != 0)
+		{
+			Print::Fail("Error creating wake pipe: " + toString(strerror(errno)));
+			return (false);
+		}
+		for (int i = 0; i < channelThreads; i++)
+		{
+			_channelWorkers.push_back(new ChannelWorker(this, i));
+		}
+	}
+	else if (channelThreads > 0)
+	{
+		Print::Warn("channel_threads needs io_threads, ignoring it");
+	}
+
+	// One event loop per worker, each with its own listener on the port. A
+	// standby opens them once it takes over from its primary.
+	_listening = Config::getConfig("standby_of").empty();
+	for (int i = 0; i < _workers; i++)
+	{
+		Shard* shard = new Shard(this, i);
+		_shards.push_back(shard);
+		if (!shard->setup(port, _workers > 1))
+		{
+			return (false);
+		}
+	}
+
+	Print::Ok("IRC Server started on port " + toString(port) + " with " +
+			  toString(_workers) + (_pipelined ? " I/O thread(s)" : " worker(s)"));
+	if (!_channelWorkers.empty())
+	{
+		Print::Ok("Channels split between " + toString(_channelWorkers.size()) +
+				  " channel worker(s)");
+	}
+
+	// Channels from this size on are fanned out by a thread pool
+	if (fanoutThreads > 0)
+	{
+		int threshold = Config::getConfigInt("fanout_threshold", Sched::FANOUT_THRESHOLD);
+		int chunk = Config::getConfigInt("fanout_chunk", Sched::FANOUT_CHUNK);
+		_fanoutPool = new FanoutPool(threshold, chunk);
+		if (!_fanoutPool->start(fanoutThreads))
+		{
+			return (false);
+		}
+		FanoutPool::install(_fanoutPool);
+		Print::Ok("Parallel fan-out with " + toString(fanoutThreads) +
+				  " thread(s) for channels of " + toString(threshold) + "+ members");
+	}
+
+	// LIST, WHO on a channel and MOTD are rendered off the event loops
+	if (commandThreads > 0 && _pipelined)
+	{
+		Print::Warn("command_threads needs workers, ignoring it");
+	}
+	else if (commandThreads > 0)
+	{
+		_commandPool = new CommandPool();
+		if (!_commandPool->start(commandThreads))
+		{
+			return (false);
+		}
+		CommandPool::install(_commandPool);
+		Print::Ok("Read-only commands run on " + toString(commandThreads) + " command thread(s)");
+	}
+
+	// Channel traffic appended to disk by a write-behind thread
+	std::string logDir = Config::getConfig("log_dir");
+	if (!logDir.empty())
+	{
+		int segmentBytes = Config::getConfigInt("log_segment_bytes", History::LOG_SEGMENT_BYTES);
+		int indexBytes = Config::getConfigInt("log_index_bytes", History::LOG_INDEX_BYTES);
+		int searchBytes = Config::getConfigInt("search_index_bytes", History::SEARCH_BYTES);
+		_messageLog = new MessageLog(logDir, segmentBytes > 0 ? segmentBytes : 1,
+									 indexBytes > 0 ? indexBytes : 1,
+									 searchBytes > 0 ? searchBytes : 0);
+		if (!_messageLog->start())
+		{
+			return (false);
+		}
+		MessageLog::install(_messageLog);
+		Print::Ok("Channel messages logged to " + logDir + "/" +
+				  (searchBytes > 0 ? ", searchable" : ""));
+	}
+
+	// Lost connections wait for a RESUME this long, see SessionStore
+	int resumeGrace = Config::getConfigInt("resume_grace", Net::RESUME_GRACE);
+	if (resumeGrace > 0)
+	{
+		_sessions = new SessionStore(resumeGrace, _maxSendq);
+		SessionStore::install(_sessions);
+	}
+
+	// 001 to 005 and the MOTD, rendered once for every registration
+	_welcome.setup(_startupTime,
+				   "CHANTYPES=#& CHANMODES=itkol PREFIX=(o)@" +
+					   (HistoryRing::isEnabled() ? " CHATHISTORY=" + toString(HistoryRing::maxLines())
+												 : ""));
+	if (!_welcome.start())
+	{
+		return (false);
+	}
+
+	// Clients follow their channels to the shard those live on
+	if (_migrateVotes > 0 && (_pipelined || _workers < 2))
+	{
+		Print::Warn("migrate_votes needs several workers, ignoring it");
+		_migrateVotes = 0;
+	}
+	else if (_migrateVotes > 0)
+	{
+		Print::Ok("Clients migrate to their channels' shard after " +
+				  toString(_migrateVotes) + " votes");
+	}
+
+	// Hot standby: follow the primary, or let standbys follow us
+	_journal.setup();
+
+	// Channels of the last run: handed over by the previous process, or
+	// from the snapshot file. A standby gets them from its primary.
+	if (!_upgrade.restore())
+	{
+		return (false);
+	}
+	_snapshot.setup();
+	if (!_upgrade.isResuming() && !_journal.isStandby())
+	{
+		_snapshot.load();
+	}
+
+	// Other servers: outgoing links go on the first shard. A standby links
+	// up when it takes over.
+	if (!_journal.isStandby())
+	{
+		_network.setup();
+	}
+
+	return (true);
+}
+
+// Create a non-blocking listening socket on the port. With several workers
+// every shard binds its own, and SO_REUSEPORT has the kernel spread the
+// incoming connections between them.
+bool Server::openListener(Socket& listener, int port, bool reusePort)
+{
 	// Create the server socket
-	if (!_serverSocket.create(AF_INET, SOCK_STREAM, 0))
+	if (!listener.create(AF_INET, SOCK_STREAM, 0))
 	{
-		Print::Fail("Error creating socket: " + toString(_serverSocket.getLastError()));
+		Print::Fail("Error creating socket: " + toString(listener.getLastError()));
 		return (false);
 	}
 	// Configure socket options
 	int opt = 1;
-	if (!_serverSocket.setOption(SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)))
+	if (!listener.setOption(SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) ||
+		(reusePort && !listener.setOption(SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))))
 	{
-		Print::Fail("Error setting socket options: " +
-					toString(_serverSocket.getLastError()));
+		Print::Fail("Error setting socket options: " + toString(listener.getLastError()));
 		return (false);
 	}
 	// Set as non-blocking
-	if (!_serverSocket.setNonBlocking())
+	if (!listener.setNonBlocking())
 	{
 		Print::Fail("Error setting socket to non-blocking: " +
-					toString(_serverSocket.getLastError()));
+					toString(listener.getLastError()));
 		return (false);
 	}
 	// Bind the socket to the port
-	if (!_serverSocket.bind(port))
+	if (!listener.bind(port))
 	{
-		Print::Fail("Error binding: " + toString(_serverSocket.getLastError()));
+		Print::Fail("Error binding: " + toString(listener.getLastError()));
 		return (false);
 	}
 	// Listen for connections
-	if (!_serverSocket.listen(10))
+	if (!listener.listen(Config::getConfigInt("listen_backlog", Net::LISTEN_BACKLOG)))
 	{
-		Print::Fail("Error listening: " + toString(_serverSocket.getLastError()));
+		Print::Fail("Error listening: " + toString(listener.getLastError()));
 		return (false);
 	}
+	return (true);
+}
+
+// Size the process for max_connections clients: raise the soft fd limit as
+// far as the hard limit allows and keep one fd in reserve, so that running
+// out of fds ends in a polite rejection instead of a busy loop on accept().
+bool Server::setupConnectionLimits()
+{
+	struct rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+	{
+		Print::Fail("Error reading RLIMIT_NOFILE: " + toString(strerror(errno)));
+		return (false);
+	}
+
+	int wanted = Config::getConfigInt("max_connections", 0);
+	rlim_t needed = static_cast<rlim_t>(wanted) + Net::FD_HEADROOM;
+	if (wanted > 0 && needed > limit.rlim_cur)
+	{
+		struct rlimit raised = limit;
+		raised.rlim_cur = needed;
+		if (limit.rlim_max != RLIM_INFINITY && limit.rlim_max < needed)
+		{
+			Print::Warn("max_connections=" + toString(wanted) +
+						" is above the RLIMIT_NOFILE hard limit (" +
+						toString(limit.rlim_max) + "), clamping");
+			raised.rlim_cur = limit.rlim_max;
+		}
+		if (setrlimit(RLIMIT_NOFILE, &raised) != 0)
+		{
+			Print::Warn("Could not raise RLIMIT_NOFILE: " + toString(strerror(errno)));
+		}
+		getrlimit(RLIMIT_NOFILE, &limit);
+	}
 
-	Print::Ok("IRC Server started on port " + toString(port));
+	rlim_t usable = limit.rlim_cur;
+	if (usable == RLIM_INFINITY || usable > static_cast<rlim_t>(Net::MAX_FDS))
+	{
+		usable = Net::MAX_FDS;
+	}
+	_maxConnections = usable > static_cast<rlim_t>(Net::FD_HEADROOM)
+						  ? static_cast<size_t>(usable - Net::FD_HEADROOM)
+						  : 1;
+	if (wanted > 0 && static_cast<size_t>(wanted) < _maxConnections)
+	{
+		_maxConnections = wanted;
+	}
 
+	_reserveFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+	if (_reserveFd < 0)
+	{
+		Print::Warn("Could not open reserve fd: " + toString(strerror(errno)));
+	}
+
+	// Rough resident cost of one idle client, kernel socket buffers excluded
+	size_t perClient = sizeof(Client) + sizeof(pollfd) + sizeof(int) +
+					   sizeof(std::pair<const int, Client*>) + 4 * sizeof(void*);
+	Print::Ok("Accepting up to " + toString(_maxConnections) + " clients (fd limit " +
+			  toString(limit.rlim_cur) + ", ~" + toString(perClient) +
+			  " bytes per idle client)");
 	return (true);
 }
 
@@ -92,282 +375,425 @@ bool Server::start(int port, const std::string& password)
 		return (false);
 	}
 
-	pollfd serverPollFd;
-	memset(&serverPollFd, 0, sizeof(serverPollFd));
-	serverPollFd.fd = _serverSocket.getFd();
-	serverPollFd.events = POLLIN;
-	serverPollFd.revents = 0;
-
-	_pollFds.push_back(serverPollFd);
 	_running = true;
 
 	return (true);
 }
 
-// Main server loop - handles events using poll()
+// Run the shards: extra workers on threads of their own, the first one on
+// the calling thread, which also receives the shutdown signals.
+// In pipelined mode every shard gets a thread and the calling thread runs
+// the logic loop instead.
 void Server::run()
 {
-	extern volatile bool g_shutdown_requested;
 	Print::Debug("Server entering main event loop");
 
-	while (_running && !g_shutdown_requested)
+	bool pinThreads = Config::getConfigInt("pin_threads", 0) > 0;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t firstThread = _pipelined ? 0 : 1;
+	for (size_t i = 0; i < _shards.size(); i++)
 	{
-		int ready = poll(_pollFds.data(), _pollFds.size(), 1000);
-		// Execute poll() to check for events
-		if (g_shutdown_requested)
+		if (pinThreads && cpus > 0)
+		{
+			_shards[i]->setCpu((i + firstThread) % cpus);
+		}
+		if (i >= firstThread && !_shards[i]->startThread())
 		{
-			Print::Log("Gracefully shutting down from signal...");
 			_running = false;
 		}
-		Print::Debug("Calling poll() with " + toString(_pollFds.size()) +
-					" file descriptors");
+	}
+	for (size_t i = 0; i < _channelWorkers.size(); i++)
+	{
+		if (!_channelWorkers[i]->start())
+		{
+			_running = false;
+		}
+	}
 
-		Print::Debug("poll() returned with " + toString(ready) + " events");
+	if (_running && _pipelined)
+	{
+		runLogic();
+	}
+	else if (_running)
+	{
+		_shards[0]->run();
+	}
 
-		if (ready < 0)
+	// The main loop is done: bring the others down too
+	_running = false;
+	for (size_t i = firstThread; i < _shards.size(); i++)
+	{
+		_shards[i]->wake();
+		_shards[i]->join();
+	}
+	if (_pipelined)
+	{
+		// Settle what the I/O threads handed over last, so nothing leaks,
+		// along with the lines kept for log reads nobody answers anymore.
+		// Lines behind channel commands go as the workers finish those.
+		processLogicEvents();
+		std::map<Client*, std::deque<LogicEvent> > held;
+		held.swap(_heldEvents);
+		for (std::map<Client*, std::deque<LogicEvent> >::iterator it = held.begin();
+			 it != held.end(); ++it)
 		{
-			Print::StdErr("Error in Poll(): " + toString(strerror(errno)) +
-						" (errno: " + toString(errno));
-			if (errno == EINTR)
+			for (size_t i = 0; i < it->second.size(); i++)
 			{
-				Print::Debug("poll() interrupted by signal, continuing");
-				continue;
+				while (!runLogicEvent(it->second[i]))
+				{
+					waitLogicEvents();
+					processLogicEvents();
+				}
 			}
-			break;
 		}
-
-		// Process all fds with events
-		for (size_t i = 0; i < _pollFds.size() && ready > 0; ++i)
+		for (size_t i = 0; i < _channelWorkers.size(); i++)
 		{
-			std::stringstream ss;
-			ss << "Checking FD: " << _pollFds[i].fd
-				<< " events: " << (_pollFds[i].revents & POLLIN ? "POLLIN " : "")
-				<< (_pollFds[i].revents & POLLOUT ? "POLLOUT " : "")
-				<< (_pollFds[i].revents & POLLHUP ? "POLLHUP " : "")
-				<< (_pollFds[i].revents & POLLERR ? "POLLERR " : "")
-				<< (_pollFds[i].revents & POLLNVAL ? "POLLNVAL " : "");
-			Print::Debug(ss.str());
-			if (_pollFds[i].revents == 0)
-			{
-				Print::Debug("No events for FD: " + toString(_pollFds[i].fd) +
-							", skipping");
-				continue;
-			}
-
-			ready--;
-
-			// Check if we have a new connection on the server socket
-			if (_pollFds[i].fd == _serverSocket.getFd() && (_pollFds[i].revents & POLLIN))
-			{
-				Print::Debug("New connection event on server socket");
-				processNewConnection();
-			}
-			// Process messages from existing clients
-			else if (_pollFds[i].revents & POLLIN)
-			{
-				Print::Debug("Data available on client FD: " + toString(_pollFds[i].fd));
-				processClientMessage(_pollFds[i].fd);
-			}
-			// Handle errors
-			else if (_pollFds[i].revents & (POLLERR | POLLNVAL))
-			{
-				Print::StdErr("ERROR condition on FD: " + toString(_pollFds[i].fd));
-				removeClient(_pollFds[i].fd);
-			}
-			// Handle hangup WITH data available
-			else if ((_pollFds[i].revents & POLLHUP) && (_pollFds[i].revents & POLLIN))
-			{
-				Print::Debug("POLLHUP+POLLIN received for FD: " +
-							toString(_pollFds[i].fd) + " - processing remaining data");
-				processClientMessage(_pollFds[i].fd);
-			}
-			// Handle hangup WITHOUT data available - DON'T disconnect yet
-			else if (_pollFds[i].revents & POLLHUP)
-			{
-				Print::Debug("POLLHUP (only) received for FD: " +
-							toString(_pollFds[i].fd) + " - keeping connection");
-			}
+			_channelWorkers[i]->stop();
 		}
-		addBotToAllChannels(getClientByNick("IRCBot"));
-		print_clients();
 	}
-
 	Print::Debug("Exiting server main event loop");
 }
 
-// Stop the server and clean up resources
-void Server::stop()
+// Logic loop of the pipelined mode: runs the commands parsed by the I/O
+// threads, in the order each thread submitted them
+void Server::runLogic()
 {
-	Print::Do("Starting server shutdown process...\t\t\n");
-	_running = false;
-
-	// Clearn client buffer
-	Print::Do("Cleaning up " + toString(_clientBuffers.size()) + " client buffers...");
-	_clientBuffers.clear();
-	Print::Ok("client buffers cleared!");
+	extern volatile bool g_shutdown_requested;
 
-	// Close client sockets
-	Print::Do("Cleaning up " + toString(_clientSockets.size()) +
-				" client sockets...\t\t\n");
-	for (std::map<int, Socket*>::iterator it = _clientSockets.begin();
-		it != _clientSockets.end(); ++it)
+	while (_running && !g_shutdown_requested)
 	{
-		int fd = it->first;
-		Print::Debug("Explicitly closing client socket FD: " + toString(fd));
-		if (it->second && it->second->isValid())
+		waitLogicEvents();
+		if (g_shutdown_requested)
 		{
-			it->second->close();
+			Print::Log("Gracefully shutting down from signal...");
+			_running = false;
 		}
-		delete it->second;
+
+		Epoch::enter();
+		processLogicEvents();
+		expireSessions();
+		lockChannelWorkers();
+		if (_snapshot.isDue())
+		{
+			_snapshot.save();
+		}
+		if (_botConnected)
+		{
+			addBotToAllChannels(getBot());
+		}
+		if (DEBUG)
+		{
+			print_clients();
+		}
+		unlockChannelWorkers();
+		Epoch::leave();
+		Epoch::collect();
 	}
-	_clientSockets.clear();
-	Print::Ok("Sockets cleared!");
+}
 
-	// Close channels
-	Print::Do("Cleaning up " + toString(_channels.size()) + " channels...");
-	for (std::map<std::string, Channel*>::iterator it = _channels.begin();
-		it != _channels.end(); ++it)
+// Sleep until an event is submitted, for a second at most
+void Server::waitLogicEvents()
+{
+	pollfd wake;
+	wake.fd = _logicWake[0];
+	wake.events = POLLIN;
+
+	// Announce the nap before the last look at the queue, so a producer
+	// either sees the flag or its event is seen here
+	__atomic_store_n(&_logicSleeping, 1, __ATOMIC_SEQ_CST);
+	if (_logicQueue.empty())
 	{
-		delete it->second;
+		poll(&wake, 1, 1000);
 	}
-	_channels.clear();
-	Print::Ok("channels cleared!");
+	__atomic_store_n(&_logicSleeping, 0, __ATOMIC_SEQ_CST);
 
-	// Close Clients
-	Print::Do("Cleaning up " + toString(_clients.size()) + " clients...");
-	for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end();
-		++it)
+	char buffer[256];
+	while (read(_logicWake[0], buffer, sizeof(buffer)) > 0)
 	{
-		delete it->second;
 	}
-	_clients.clear();
-	Print::Ok("clients clear!");
+}
 
-	// Clear poll
-	Print::Do("Freeing poll file descriptors data...");
+// Hand an event to the logic thread. Called by the I/O threads and the
+// channel workers.
+void Server::submit(LogicEvent::Type type, Client* client, Message* message)
+{
+	LogicEvent event;
+	event.type = type;
+	event.client = client;
+	event.message = message;
+	_logicQueue.push(event);
+
+	if (__atomic_exchange_n(&_logicSleeping, 0, __ATOMIC_SEQ_CST))
 	{
-		std::vector<pollfd>().swap(_pollFds);
-		Print::Ok("");
+		char byte = 0;
+		if (write(_logicWake[1], &byte, 1) < 0 && errno != EAGAIN)
+		{
+			Print::Debug("Could not wake the logic thread");
+		}
 	}
+}
 
-	// Close server socket
-	Print::Do("Closing server socket...");
-	_serverSocket.close();
+void Server::processLogicEvents()
+{
+	LogicEvent event;
 
-	Print::Ok("IRC Server shutdown complete.");
+	while (_logicQueue.pop(event))
+	{
+		dispatchLogicEvent(event);
+	}
 }
 
-// Process a new client connection
-void Server::processNewConnection()
+// A client waiting for a message log read keeps its later lines here until
+// the reply is queued, the shard tells with RESUMED. One whose channel
+// commands still run waits the same way for CHANNEL_DONE, sent by the worker
+// ending the last of them. Lines it sent before losing its connection still
+// run first.
+void Server::dispatchLogicEvent(const LogicEvent& event)
 {
-	Print::Do("ProcessNewConnection");
-	Socket* clientSocket = new Socket(_serverSocket.accept());
-	if (!clientSocket->isValid())
+	std::map<Client*, std::deque<LogicEvent> >::iterator held = _heldEvents.find(event.client);
+	if (event.type == LogicEvent::RESUMED || event.type == LogicEvent::CHANNEL_DONE)
 	{
-		Print::Fail("Error accepting connection: " + _serverSocket.getLastError());
+		// A late CHANNEL_DONE is no answer to a log read still going
+		if (held == _heldEvents.end() ||
+			(event.type == LogicEvent::CHANNEL_DONE && event.client->isOffloaded()))
+		{
+			return;
+		}
+		std::deque<LogicEvent> events;
+		events.swap(held->second);
+		_heldEvents.erase(held);
+		for (size_t i = 0; i < events.size(); i++)
+		{
+			dispatchLogicEvent(events[i]);
+		}
 		return;
 	}
+	// No RESUMED comes for a lost connection, what waits for channel
+	// commands still does
+	if (held != _heldEvents.end() && event.type == LogicEvent::DISCONNECT &&
+		!event.client->hasChannelTasks())
+	{
+		std::deque<LogicEvent> events;
+		events.swap(held->second);
+		_heldEvents.erase(held);
+		events.push_back(event);
+		for (size_t i = 0; i < events.size(); i++)
+		{
+			dispatchLogicEvent(events[i]);
+		}
+		return;
+	}
+	if (held != _heldEvents.end())
+	{
+		held->second.push_back(event);
+		return;
+	}
+	if (!runLogicEvent(event))
+	{
+		_heldEvents[event.client].push_back(event);
+		return;
+	}
+	if (event.type == LogicEvent::LINE && event.client->isOffloaded())
+	{
+		_heldEvents[event.client];
+	}
+}
 
-	Print::Ok("Socket accepted successfully");
-
-	// Set client socket as non-blocking
-	clientSocket->setNonBlocking();
-	int clientFd = clientSocket->getFd();
-
-	_clientSockets[clientFd] = clientSocket;
-
-	// Add to poll
-	pollfd clientPollFd;
-	memset(&clientPollFd, 0, sizeof(clientPollFd));
-	clientPollFd.fd = clientFd;
-	clientPollFd.events = POLLIN;  // Monitor for read
-	clientPollFd.revents = 0;
-	_pollFds.push_back(clientPollFd);
-
-	// Create Client object and add to map
-	Client* client = new Client(clientFd);
-	_clients[clientFd] = client;
+// False if the event has to wait for the client's channel commands
+bool Server::runLogicEvent(const LogicEvent& event)
+{
+	ChannelWorker* owner = NULL;
+	if (event.type == LogicEvent::LINE)
+	{
+		owner = channelOwner(*event.message);
+	}
+	if (owner)
+	{
+		owner->post(event.client, event.message);
+		return (true);
+	}
 
-	Print::Ok("New connection accepted. FD: " + toString(clientFd));
+	// Anything else runs with the channel workers held off, and only once
+	// the client's earlier channel commands are done so its order holds
+	if (event.client->waitChannelTasks())
+	{
+		return (false);
+	}
+	lockChannelWorkers();
+	if (event.type == LogicEvent::CONNECT)
+	{
+		_clients[event.client->getFd()] = event.client;
+	}
+	else if (event.type == LogicEvent::LINE)
+	{
+		Print::Debug("Processing command: " + event.message->getCommand());
+		CommandFactory::executeCommand(event.client, this, *event.message);
+		delete event.message;
+	}
+	else
+	{
+		removeClient(event.client);
+		event.client->closeSocket();
+		Epoch::retire(event.client);
+	}
+	unlockChannelWorkers();
+	return (true);
 }
 
-void Server::processClientMessage(int clientFd)
+// Channel names compare case-insensitively, so hash them that way
+static unsigned long hashChannelName(const std::string& name)
 {
-	extern volatile bool g_shutdown_requested;
+	unsigned long hash = 5381;
+	for (size_t i = 0; i < name.size(); i++)
+	{
+		hash = hash * 33 + tolower(name[i]);
+	}
+	return (hash);
+}
 
-	if (g_shutdown_requested)
+// Channel worker owning the target of a PRIVMSG/NOTICE/TOPIC/MODE naming a
+// single channel, or NULL when the logic thread runs the command itself
+ChannelWorker* Server::channelOwner(const Message& message)
+{
+	if (_channelWorkers.empty() || message.getSize() < 1)
 	{
-		Print::Debug("Shutdown requested, skipping message processing");
-		return;
+		return (NULL);
+	}
+	std::string command = message.getCommand();
+	for (size_t i = 0; i < command.size(); i++)
+	{
+		command[i] = toupper(command[i]);
+	}
+	if (command != "PRIVMSG" && command != "NOTICE" && command != "TOPIC" &&
+		command != "MODE")
+	{
+		return (NULL);
+	}
+	std::string target = message.getParams(0);
+	if (target.empty() || (target[0] != '#' && target[0] != '&') ||
+		target.find(',') != std::string::npos)
+	{
+		return (NULL);
 	}
 
-	Print::Debug("Processing message from client FD: " + toString(clientFd));
+	return (_channelWorkers[hashChannelName(target) % _channelWorkers.size()]);
+}
 
-	Client* client = getClient(clientFd);
-	if (!client)
+// Shard the members of a channel gather on, -1 when clients don't migrate
+int Server::channelHome(const std::string& name) const
+{
+	if (_migrateVotes <= 0)
 	{
-		Print::StdErr("Error: Client not found for FD: " + toString(clientFd));
-		return;
+		return (-1);
 	}
+	return (static_cast<int>(hashChannelName(name) % _shards.size()));
+}
 
-	// Buffer for receiving data
+void Server::lockChannelWorkers()
+{
+	for (size_t i = 0; i < _channelWorkers.size(); i++)
+	{
+		_channelWorkers[i]->lock();
+	}
+}
 
-	char buffer[1024] = {0};
-	ssize_t bytesRead = recv(clientFd, buffer, sizeof(buffer) - 1, 0);
+void Server::unlockChannelWorkers()
+{
+	for (size_t i = _channelWorkers.size(); i > 0; i--)
+	{
+		_channelWorkers[i - 1]->unlock();
+	}
+}
 
-	Print::Debug("Received " + toString(bytesRead) +
-				" bytes from client FD: " + toString(clientFd));
+// Stop the server and clean up resources
+void Server::stop()
+{
+	Print::Do("Starting server shutdown process...\t\t\n");
+	_running = false;
 
-	if (bytesRead < 0)
+	// Channel workers go first, they run commands against the state below
+	for (size_t i = 0; i < _channelWorkers.size(); i++)
 	{
-		if (errno == EAGAIN || errno == EWOULDBLOCK)
-		{
-			Print::Debug("No data available, but connection is still open");
-			return;
-		}
-
-		Print::StdErr("Error receiving data: " + toString(strerror(errno)));
-		removeClient(clientFd);
-		return;
+		delete _channelWorkers[i];
+	}
+	_channelWorkers.clear();
+	FanoutPool::install(NULL);
+	delete _fanoutPool;
+	_fanoutPool = NULL;
+	// Queued replies still go out through the shards' mailboxes
+	CommandPool::install(NULL);
+	delete _commandPool;
+	_commandPool = NULL;
+	// Nothing records lines anymore, the writer empties its queue and goes
+	MessageLog::install(NULL);
+	delete _messageLog;
+	_messageLog = NULL;
+	_welcome.stop();
+	// Detached sessions end, there is no connection to hand them over with
+	expireSessions(true);
+	// An upgrade takes the state as it is now, before it is torn down
+	if (_upgrade.isRequested())
+	{
+		_upgrade.handOver();
 	}
+	_snapshot.saveNow();
 
-	if (bytesRead == 0)
+	// Close channels
+	Print::Do("Cleaning up " + toString(_channels.size()) + " channels...");
+	for (std::map<std::string, Channel*>::iterator it = _channels.begin();
+		it != _channels.end(); ++it)
 	{
-		Print::Debug("Client closed connection gracefully");
-		removeClient(clientFd);
-		return;
+		delete it->second;
 	}
-	Print::Debug("Buffer map size BEFORE: " + toString(_clientBuffers.size()));
-	// Append to client buffer
-	_clientBuffers[clientFd] += buffer;
-	Print::Debug("Buffer map size AFTER: " + toString(_clientBuffers.size()));
-	// Process complete messages (ending with \r\n)
-	std::string& clientBuffer = _clientBuffers[clientFd];
-	size_t pos;
+	_channels.clear();
+	Print::Ok("channels cleared!");
 
-	while ((pos = clientBuffer.find("\r\n")) != std::string::npos)
+	// Close Clients, each one closes its own socket
+	Print::Do("Cleaning up " + toString(_clients.size()) + " clients...");
+	for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end();
+		++it)
 	{
-		// Extract a complete message
-		std::string rawMessage = clientBuffer.substr(0, pos);
-		// Remove the processed message from the buffer
-		clientBuffer.erase(0, pos + 2);
+		delete it->second;
+	}
+	_clients.clear();
+	Print::Ok("clients clear!");
+	SessionStore::install(NULL);
+	delete _sessions;
+	_sessions = NULL;
 
-		// Parse and execute the message
-		Message message = Message(rawMessage);
-		Print::Debug("Processing command: " + message.getCommand());
-		CommandFactory::executeCommand(client, this, message);
+	if (_reserveFd >= 0)
+	{
+		::close(_reserveFd);
+		_reserveFd = -1;
+	}
+	if (_pipelined)
+	{
+		::close(_logicWake[0]);
+		::close(_logicWake[1]);
+		_pipelined = false;
 	}
 
-	// If buffer gets too large without complete messages, clear it (prevent DoS)
-	if (clientBuffer.size() > 4096)
+	// Close the event loops with their poll data and listening sockets
+	Print::Do("Closing " + toString(_shards.size()) + " server socket(s)...");
+	for (size_t i = 0; i < _shards.size(); i++)
 	{
-		clientBuffer.clear();
-		Print::StdErr("Warning: Client buffer overflow, clearing buffer");
+		_shards[i]->join();
+		delete _shards[i];
 	}
+	_shards.clear();
+	Print::Ok("");
+
+	// Every thread is gone, so nothing retired can still be in use
+	Epoch::drain();
+
+	Print::Ok("IRC Server shutdown complete.");
 }
 
 // Get server password
 const std::string& Server::getPassword() const { return (_password); }
+Network& Server::getNetwork() { return (_network); }
+Journal& Server::getJournal() { return (_journal); }
+int Server::getHistoryJoin() const { return (HistoryRing::isEnabled() ? _historyJoin : 0); }
 const std::string& Server::getBotPassword() const 
 { 
 	static std::string botpass = Config::getConfig("botpass");
@@ -413,6 +839,12 @@ void Server::addBotToAllChannels(Client* bot)
 // Get all channels
 std::map<std::string, Channel*>& Server::getChannels() { return (_channels); }
 
+// Consistent read-only view of every channel, see ChannelDirectory
+const ChannelDirectory::Snapshot* Server::getDirectory() { return (_directory.snapshot()); }
+
+// Same, for readers that outlive the command, see ChannelDirectory::release
+const ChannelDirectory::Snapshot* Server::acquireDirectory() { return (_directory.acquire()); }
+
 // Get channel by name
 Channel* Server::getChannel(const std::string& name)
 {
@@ -439,18 +871,41 @@ Client* Server::getClient(int fd)
 	return (NULL);
 }
 
-// Get client by nickname
+// Get client by nickname, safe without the state lock
 Client* Server::getClientByNick(const std::string& nickname)
 {
-	for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end();
-		++it)
+	return (_nicks.find(nickname));
+}
+
+// Move a client to a new nickname. Fails if another client holds it; the
+// old nickname is given up only once the new one is taken.
+bool Server::changeNick(Client* client, const std::string& nickname)
+{
+	std::string oldNick = client->getNickname();
+	if (NickRegistry::fold(oldNick) != NickRegistry::fold(nickname))
 	{
-		if (caseInsensitiveCompare(it->second->getNickname(), nickname))
+		if (!_nicks.claim(nickname, client))
+		{
+			return (false);
+		}
+		if (!oldNick.empty())
 		{
-			return it->second;
+			_nicks.release(oldNick, client);
 		}
 	}
-	return NULL;
+	client->setNickname(nickname);
+	client->setNickTs(time(NULL));
+
+	// Its channels list members by nick
+	for (std::map<std::string, Channel*>::iterator it = _channels.begin();
+		it != _channels.end(); ++it)
+	{
+		if (it->second->hasClient(client))
+		{
+			_directory.markDirty(it->second);
+		}
+	}
+	return (true);
 }
 
 // Remove channel by name
@@ -459,64 +914,228 @@ void Server::removeChannel(const std::string& name)
 	std::map<std::string, Channel*>::iterator it = _channels.find(name);
 	if (it != _channels.end())
 	{
-		delete it->second;
+		Channel* channel = it->second;
 		_channels.erase(it);
+		_directory.markRemoved(channel);
+		Epoch::retire(channel);
 	}
 }
 
-// Remove client and cleanup associated resources
-void Server::removeClient(int clientFd)
+// Register a connection accepted by a shard. Returns NULL when the server
+// is full; the fd is left to the caller then.
+Client* Server::addClient(int clientFd, Shard* shard)
 {
-	Print::Debug("Removing client FD: " + toString(clientFd));
+	if (__sync_add_and_fetch(&_connectionCount, 1) > static_cast<long>(_maxConnections))
+	{
+		__sync_sub_and_fetch(&_connectionCount, 1);
+		return (NULL);
+	}
+	Client* client = new Client(clientFd, _floodBurst, _floodRate);
+	client->setShard(shard);
+	client->setBroadcastSeq(getBroadcastSeq());  // earlier ones are not for it
+	if (_pipelined)
+	{
+		submit(LogicEvent::CONNECT, client, NULL);
+		return (client);
+	}
+	ScopedLock state(_stateLock);
+	_clients[clientFd] = client;
+	return (client);
+}
+
+// Forget a client that is about to be deleted
+void Server::removeClient(Client* client)
+{
+	ScopedLock state(_stateLock);
 
-	Client* client = getClient(clientFd);
-	if (client)
+	__sync_sub_and_fetch(&_connectionCount, 1);
+	if (client->isJournalStream())
+	{
+		_journal.dropStream(client);
+	}
+	else if (client->isLink())
 	{
-		removeClientFromChannels(client);
+		_network.dropLink(client);
 	}
+	_network.userQuit(client, "Connection closed");
+	removeClientFromChannels(client);
+	_journal.userQuit(client);
+	SessionStore::forget(client);
+	if (!client->getNickname().empty())
+	{
+		_nicks.release(client->getNickname(), client);
+	}
+	if (client->isBot())
+	{
+		setBot(false);
+	}
+	_clients.erase(client->getFd());
+}
 
-	// Remove from poll
-	for (std::vector<pollfd>::iterator it = _pollFds.begin(); it != _pollFds.end(); ++it)
+// Sessions nobody resumed in time end like the lost connections they are.
+// Their channel commands still queued run first, as for a disconnect.
+void Server::expireSessions(bool all)
+{
+	std::vector<Client*> expired;
+	SessionStore::expire(expired, all);
+	for (size_t i = 0; i < expired.size(); i++)
 	{
-		if (it->fd == clientFd)
+		Client* client = expired[i];
+		Print::Warn("Session of " + client->getNickname() + " not resumed, dropping FD: " +
+					toString(client->getFd()));
+		if (client->hasChannelTasks())
 		{
-			_pollFds.erase(it);
-			break;
+			LogicEvent event;
+			event.type = LogicEvent::DISCONNECT;
+			event.client = client;
+			event.message = NULL;
+			dispatchLogicEvent(event);
+			continue;
 		}
+		lockChannelWorkers();
+		removeClient(client);
+		unlockChannelWorkers();
+		client->closeSocket();
+		Epoch::retire(client);
 	}
+}
 
-	// Clear buffer
-	_clientBuffers.erase(clientFd);
-	Print::Debug("Buffer map size AFTER remove: " + toString(_clientBuffers.size()));
-
-	// Remove client object
-	if (_clients.find(clientFd) != _clients.end())
+// RESUME: the detached client of `token` takes the connection of `client`
+// over, in the shard that has it. That shard drops `client` at the end of
+// its iteration, its fd only: the socket stays open under the other one.
+Client* Server::resumeSession(Client* client, const std::string& token, std::string& held)
+{
+	Shard* shard = client->getShard();
+	if (!shard)
 	{
-		if (_clients.find(clientFd)->second->isBot()) setBot(false);
-		delete _clients[clientFd];
-		_clients.erase(clientFd);
+		return (NULL);
 	}
-	// Remove and delete socket
-	if (_clientSockets.find(clientFd) != _clientSockets.end())
+	__atomic_add_fetch(&_clientsInTransit, 1, __ATOMIC_SEQ_CST);
+	Client* resumed = SessionStore::resume(token, client->getFd(), shard, held);
+	if (!resumed)
 	{
-		delete _clientSockets[clientFd];
-		_clientSockets.erase(clientFd);
+		__atomic_sub_fetch(&_clientsInTransit, 1, __ATOMIC_SEQ_CST);
+		return (NULL);
 	}
+	client->requestDisconnect();
+	return (resumed);
+}
 
-	Print::Debug("Client disconnected. FD: " + toString(clientFd));
+// Close a freshly accepted connection with an ERROR line
+void Server::rejectConnection(int clientFd, const std::string& reason)
+{
+	Socket rejected(clientFd, false);
+	rejected.send("ERROR :Closing Link: localhost (" + reason + ")\r\n",
+				  MSG_NOSIGNAL | MSG_DONTWAIT);
+	Print::Warn("Rejected connection FD: " + toString(clientFd) + " (" + reason + ")");
 }
 
-// Broadcast message to all clients except excludeFd
+// Out of fds: spend the reserve fd on accepting and turning away one client.
+// Returns false when there is no reserve left to spend.
+bool Server::rejectWithReserveFd(Socket& listener)
+{
+	ScopedLock state(_stateLock);
+
+	if (_reserveFd < 0)
+	{
+		return (false);
+	}
+	::close(_reserveFd);
+	int clientFd = listener.accept();
+	if (clientFd >= 0)
+	{
+		rejectConnection(clientFd, "Server full");
+	}
+	_reserveFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+	return (true);
+}
+
+// Broadcast message to all clients except excludeFd. Nothing is sent here:
+// the message is logged and every shard delivers it to its own clients a
+// batch per loop iteration, or earlier to a client getting other output.
 void Server::broadcast(const std::string& message, int excludeFd)
 {
-	for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end();
-		++it)
+	Broadcast entry;
+	entry.message = SharedBuffer(message);
+	entry.excludedId = 0;
+	Client* excluded = getClient(excludeFd);
+	if (excluded)
+	{
+		entry.excludedId = excluded->getId();
+	}
+	{
+		ScopedLock guard(_broadcastLock);
+		entry.seq = _broadcastSeq + 1;
+		_broadcasts.push_back(entry);
+		__atomic_store_n(&_broadcastSeq, entry.seq, __ATOMIC_RELEASE);
+		SessionStore::holdBroadcast(message, entry.excludedId, entry.seq);
+	}
+
+	for (size_t i = 0; i < _shards.size(); i++)
+	{
+		if (_shards[i] != Shard::current())
+		{
+			_shards[i]->wake();
+		}
+	}
+}
+
+unsigned long Server::getBroadcastSeq() const
+{
+	return (__atomic_load_n(&_broadcastSeq, __ATOMIC_ACQUIRE));
+}
+
+// Append the broadcasts after the client's last one, up to upTo, to its
+// output. Called by the shard owning the client.
+bool Server::catchUpBroadcasts(Client* client, unsigned long upTo)
+{
+	ScopedLock guard(_broadcastLock);
+
+	if (_broadcasts.empty())
+	{
+		return (false);
+	}
+	upTo = std::min(upTo, _broadcastSeq);
+	unsigned long first = _broadcasts.front().seq;
+	unsigned long seq = std::max(client->getBroadcastSeq() + 1, first);
+	bool woken = false;
+	for (; seq <= upTo; seq++)
 	{
-		if (it->first != excludeFd)
+		const Broadcast& entry = _broadcasts[seq - first];
+		// Links hear of QUITs as link lines, see Network
+		if (entry.excludedId != client->getId() && !client->isLink())
 		{
-			it->second->sendMessage(message);
+			// No broadcasts argument: this is the catching up. QUITs change
+			// state, they go ahead of queued chatter like the replies do.
+			woken |= client->appendOutput(entry.message.str(), Client::LANE_CONTROL, 0);
 		}
 	}
+	if (upTo > client->getBroadcastSeq())
+	{
+		client->setBroadcastSeq(upTo);
+	}
+	return (woken);
+}
+
+// Drop the broadcasts every shard is done with
+void Server::trimBroadcasts()
+{
+	unsigned long done = getBroadcastSeq();
+	for (size_t i = 0; i < _shards.size(); i++)
+	{
+		done = std::min(done, _shards[i]->getBroadcastsDone());
+	}
+	// A client between two shards is in neither's pass
+	if (__atomic_load_n(&_clientsInTransit, __ATOMIC_SEQ_CST) > 0)
+	{
+		return;
+	}
+
+	ScopedLock guard(_broadcastLock);
+	while (!_broadcasts.empty() && _broadcasts.front().seq <= done)
+	{
+		_broadcasts.pop_front();
+	}
 }
 
 Channel* Server::createChannel(const std::string& name, Client* creator)
@@ -532,7 +1151,8 @@ Channel* Server::createChannel(const std::string& name, Client* creator)
 	}
 
 	// Create new channel
-	Channel* newChannel = new Channel(name);
+	Channel* newChannel = new Channel(name, &_directory);
+	newChannel->setHomeShard(channelHome(name));
 	_channels[name] = newChannel;
 
 	Print::Ok("Channel " + name + " created successfully");
@@ -631,19 +1251,12 @@ void Server::cleanupEmptyChannels()
 }
 
 void Server::broadcastChannel(const std::string& message, const std::string& chName,
-								int excludeFd)
+								int excludeFd, Client::Lane lane)
 {
 	Channel* channel = getChannel(chName);
 	if (!channel) return;
 
-	const std::map<int, Client*>& clients = channel->getClients();
-
-	std::map<int, Client*>::const_iterator it = clients.begin();
-	std::map<int, Client*>::const_iterator ite = clients.end();
-	for (; it != ite; it++)
-	{
-		if (it->first != excludeFd) it->second->sendMessage(message);
-	}
+	channel->broadcast(message, excludeFd, lane);
 }
 
 std::string Server::formatStr(const std::string& str)
@@ -685,6 +1298,8 @@ void    Server::removeClientFromChannels(Client* client)
 				client->getUsername() + "@" + "localhost" +
 				" PART " + channelNames[i] + "\r\n";
 			Server::broadcastChannel(partMsg, channelNames[i]);
+			_network.userEvent(client, partMsg);
+			_journal.channelPart(channel, client, false);
 			channel->removeClient(client);
 		}
 	}
@@ -705,3 +1320,5 @@ bool Server::caseInsensitiveCompare(const std::string& str1, const std::string&
 }
 
 const std::string& Server::getStartupTime() const { return (_startupTime); }
+
+Welcome& Server::getWelcome() { return (_welcome); }
@@ -0,0 +1,211 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Client.hpp"
+#include "SessionStore.hpp"
+#include "Shard.hpp"
+
+SessionStore* SessionStore::s_installed = NULL;
+
+SessionStore::SessionStore(int grace, size_t maxHeld)
+	: _grace(grace), _maxHeld(maxHeld), _detached(0)
+{
+}
+
+SessionStore::~SessionStore() {}
+
+void SessionStore::install(SessionStore* store) { s_installed = store; }
+
+bool SessionStore::isEnabled() { return (s_installed != NULL); }
+
+// 128 random bits, hex; empty if the system has none to give
+std::string SessionStore::newToken()
+{
+	static const char hex[] = "0123456789abcdef";
+	unsigned char bytes[16];
+	int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+	ssize_t n = fd >= 0 ? read(fd, bytes, sizeof(bytes)) : -1;
+	if (fd >= 0)
+	{
+		close(fd);
+	}
+	if (n != static_cast<ssize_t>(sizeof(bytes)))
+	{
+		return ("");
+	}
+	std::string token;
+	for (size_t i = 0; i < sizeof(bytes); i++)
+	{
+		token += hex[bytes[i] >> 4];
+		token += hex[bytes[i] & 0xf];
+	}
+	return (token);
+}
+
+std::string SessionStore::issue(Client* client)
+{
+	SessionStore* store = s_installed;
+	std::string token = store ? newToken() : "";
+	if (token.empty())
+	{
+		return (token);
+	}
+	ScopedLock lock(store->_lock);
+	std::map<Client*, std::string>::iterator previous = store->_tokens.find(client);
+	if (previous != store->_tokens.end())
+	{
+		store->_sessions.erase(previous->second);
+	}
+	store->_tokens[client] = token;
+	Session& session = store->_sessions[token];
+	session.client = client;
+	session.detachedAt = 0;
+	return (token);
+}
+
+bool SessionStore::detach(Client* client)
+{
+	SessionStore* store = s_installed;
+	if (!store)
+	{
+		return (false);
+	}
+	ScopedLock lock(store->_lock);
+	std::map<Client*, std::string>::iterator token = store->_tokens.find(client);
+	if (token == store->_tokens.end())
+	{
+		return (false);
+	}
+	Session& session = store->_sessions[token->second];
+	session.detachedAt = time(NULL);
+	session.held = client->takePendingOutput(true);
+	session.seq = client->getBroadcastSeq();
+	client->setDetached(true);
+	__atomic_add_fetch(&store->_detached, 1, __ATOMIC_RELAXED);
+	return (true);
+}
+
+// Any thread sending to a detached client. False once it is taken back,
+// the line then goes the usual way.
+bool SessionStore::hold(Client* client, const std::string& message)
+{
+	SessionStore* store = s_installed;
+	if (!store)
+	{
+		return (false);
+	}
+	ScopedLock lock(store->_lock);
+	std::map<Client*, std::string>::iterator token = store->_tokens.find(client);
+	if (token == store->_tokens.end() || !client->isDetached())
+	{
+		return (false);
+	}
+	store->_sessions[token->second].held += message;
+	return (true);
+}
+
+// Server-wide broadcasts only reach clients in a shard. Held in sequence:
+// after a gap the shard that takes the client back catches it up instead.
+void SessionStore::holdBroadcast(const std::string& message, unsigned long excludedId,
+								 unsigned long seq)
+{
+	SessionStore* store = s_installed;
+	if (!store || __atomic_load_n(&store->_detached, __ATOMIC_RELAXED) == 0)
+	{
+		return;
+	}
+	ScopedLock lock(store->_lock);
+	for (std::map<std::string, Session>::iterator it = store->_sessions.begin();
+		 it != store->_sessions.end(); ++it)
+	{
+		Session& session = it->second;
+		if (session.detachedAt == 0 || seq != session.seq + 1)
+		{
+			continue;
+		}
+		if (session.client->getId() != excludedId)
+		{
+			session.held += message;
+		}
+		session.seq = seq;
+	}
+}
+
+// Under the lock, so no line falls between the held ones and the new
+// socket: the ones sent from now on are posted behind the hand-over
+Client* SessionStore::resume(const std::string& token, int fd, Shard* shard, std::string& held)
+{
+	SessionStore* store = s_installed;
+	if (!store)
+	{
+		return (NULL);
+	}
+	ScopedLock lock(store->_lock);
+	std::map<std::string, Session>::iterator it = store->_sessions.find(token);
+	if (it == store->_sessions.end() || it->second.detachedAt == 0)
+	{
+		return (NULL);
+	}
+	Client* client = it->second.client;
+	if (!client->reattach(fd, shard))
+	{
+		return (NULL);
+	}
+	client->setBroadcastSeq(it->second.seq);
+	held.swap(it->second.held);
+	store->_tokens.erase(client);
+	store->_sessions.erase(it);
+	__atomic_sub_fetch(&store->_detached, 1, __ATOMIC_RELAXED);
+	shard->handOver(client);
+	client->setDetached(false);
+	return (client);
+}
+
+void SessionStore::forget(Client* client)
+{
+	SessionStore* store = s_installed;
+	if (!store)
+	{
+		return;
+	}
+	ScopedLock lock(store->_lock);
+	std::map<Client*, std::string>::iterator token = store->_tokens.find(client);
+	if (token == store->_tokens.end())
+	{
+		return;
+	}
+	if (store->_sessions[token->second].detachedAt != 0)
+	{
+		__atomic_sub_fetch(&store->_detached, 1, __ATOMIC_RELAXED);
+	}
+	store->_sessions.erase(token->second);
+	store->_tokens.erase(token);
+}
+
+// The clients stay detached: whoever removes them still sends to nobody
+void SessionStore::expire(std::vector<Client*>& out, bool all)
+{
+	SessionStore* store = s_installed;
+	if (!store || __atomic_load_n(&store->_detached, __ATOMIC_RELAXED) == 0)
+	{
+		return;
+	}
+	time_t now = time(NULL);
+	ScopedLock lock(store->_lock);
+	std::map<std::string, Session>::iterator it = store->_sessions.begin();
+	while (it != store->_sessions.end())
+	{
+		const Session& session = it->second;
+		if (session.detachedAt == 0 ||
+			(!all && now - session.detachedAt < store->_grace &&
+			 session.held.size() <= store->_maxHeld))
+		{
+			++it;
+			continue;
+		}
+		out.push_back(session.client);
+		store->_tokens.erase(session.client);
+		store->_sessions.erase(it++);
+		__atomic_sub_fetch(&store->_detached, 1, __ATOMIC_RELAXED);
+	}
+}
@@ -0,0 +1,1108 @@
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+#include "Channel.hpp"
+#include "Client.hpp"
+#include "CommandFactory.hpp"
+#include "Epoch.hpp"
+#include "General.hpp"
+#include "Message.hpp"
+#include "Server.hpp"
+#include "SessionStore.hpp"
+#include "Shard.hpp"
+#include "UtilsFun.hpp"
+
+// Shard whose event loop runs on the current thread
+static __thread Shard* t_currentShard = NULL;
+
+Shard::Shard(Server* server, int id)
+	: _server(server),
+	  _id(id),
+	  _cpu(-1),
+	  _threaded(false),
+	  _port(0),
+	  _reusePort(false),
+	  _broadcastPass(false),
+	  _broadcastCursor(-1),
+	  _broadcastTarget(0),
+	  _broadcastDone(0),
+	  _rebalancePass(false),
+	  _rebalanceCursor(-1),
+	  _nextRebalance(0)
+{
+	_wakePipe[0] = -1;
+	_wakePipe[1] = -1;
+}
+
+Shard::~Shard()
+{
+	drainClosingFds(true);
+	if (_wakePipe[0] >= 0)
+	{
+		::close(_wakePipe[0]);
+		::close(_wakePipe[1]);
+	}
+}
+
+// Open the listener and the wake pipe, and watch both
+bool Shard::setup(int port, bool reusePort)
+{
+	_port = port;
+	_reusePort = reusePort;
+	if (_server->_listening && !startListening())
+	{
+		return (false);
+	}
+	if (pipe2(_wakePipe, O_NONBLOCK | O_CLOEXEC) != 0)
+	{
+		Print::Fail("Error creating wake pipe: " + toString(strerror(errno)));
+		return (false);
+	}
+	addPollFd(_wakePipe[0], POLLIN);
+	// The next process asks the first shard for an upgrade
+	if (_id == 0 && _server->_upgrade.getFd() >= 0)
+	{
+		addPollFd(_server->_upgrade.getFd(), POLLIN);
+	}
+	return (true);
+}
+
+// Open the listener, at setup or once a standby takes over. After an
+// upgrade it is the previous process's.
+bool Shard::startListening()
+{
+	int inherited = _server->_upgrade.takeListener(_id);
+	if (inherited >= 0)
+	{
+		_listener.adopt(inherited);
+	}
+	else if (!_server->openListener(_listener, _port, _reusePort))
+	{
+		_listener.close();
+		return (false);
+	}
+	addPollFd(_listener.getFd(), POLLIN);
+	return (true);
+}
+
+int Shard::getId() const { return (_id); }
+
+size_t Shard::getClientCount() const { return (_clients.size()); }
+
+void Shard::setCpu(int cpu) { _cpu = cpu; }
+
+Shard* Shard::current() { return (t_currentShard); }
+
+// Event loop of the shard - handles events using poll()
+void Shard::run()
+{
+	extern volatile bool g_shutdown_requested;
+	Print::Debug("Shard " + toString(_id) + " entering event loop");
+
+	t_currentShard = this;
+	if (_cpu >= 0)
+	{
+		pinToCpu();
+	}
+	while (_server->_running && !g_shutdown_requested)
+	{
+		// A standby that took over starts accepting, until the port is free
+		if (!_listener.isValid() && _server->_listening)
+		{
+			startListening();
+		}
+		// Don't sleep while lines are queued, wake up sooner while someone is
+		// throttled so their bucket gets serviced
+		int timeout = 1000;
+		if (!_backloggedFds.empty() || _broadcastPass || _rebalancePass ||
+			_server->getBroadcastSeq() != _broadcastDone)
+			timeout = 0;
+		else if (!_throttledFds.empty() || !_closingFds.empty())
+			timeout = Flood::THROTTLED_POLL_MS;
+		int ready = poll(_pollFds.data(), _pollFds.size(), timeout);
+		// Execute poll() to check for events
+		if (g_shutdown_requested)
+		{
+			Print::Log("Gracefully shutting down from signal...");
+			_server->_running = false;
+		}
+		Print::Debug("poll() returned with " + toString(ready) + " events");
+
+		if (ready < 0)
+		{
+			if (errno == EINTR)
+			{
+				Print::Debug("poll() interrupted by signal, continuing");
+				continue;
+			}
+			Print::StdErr("Error in Poll(): " + toString(strerror(errno)) +
+						" (errno: " + toString(errno));
+			break;
+		}
+
+		// Shared clients and channels are only dereferenced inside the guard
+		Epoch::enter();
+
+		advanceBroadcasts();
+		// Clients with queued lines, served once the poll results are used:
+		// a client dropped meanwhile moves entries of _pollFds around
+		std::vector<int> pending(_backloggedFds.begin(), _backloggedFds.end());
+		pending.insert(pending.end(), _throttledFds.begin(), _throttledFds.end());
+
+		// Process all fds with events
+		for (size_t i = 0; i < _pollFds.size() && ready > 0; ++i)
+		{
+			if (_pollFds[i].revents == 0)
+			{
+				continue;
+			}
+			if (DEBUG)
+			{
+				std::stringstream ss;
+				ss << "Checking FD: " << _pollFds[i].fd
+					<< " events: " << (_pollFds[i].revents & POLLIN ? "POLLIN " : "")
+					<< (_pollFds[i].revents & POLLOUT ? "POLLOUT " : "")
+					<< (_pollFds[i].revents & POLLHUP ? "POLLHUP " : "")
+					<< (_pollFds[i].revents & POLLERR ? "POLLERR " : "")
+					<< (_pollFds[i].revents & POLLNVAL ? "POLLNVAL " : "");
+				Print::Debug(ss.str());
+			}
+
+			ready--;
+			int fd = _pollFds[i].fd;
+
+			// Messages posted by other shards
+			if (fd == _wakePipe[0])
+			{
+				drainMailbox();
+				continue;
+			}
+			if (fd == _server->_upgrade.getFd())
+			{
+				_server->_upgrade.accept();
+				continue;
+			}
+
+			// Drain queued output first, write errors are handled by syncClientOutput
+			if ((_pollFds[i].revents & POLLOUT) && fd != _listener.getFd())
+			{
+				Client* client = getClient(fd);
+				if (client)
+				{
+					client->flush();
+				}
+			}
+
+			// Check if we have a new connection on the listener
+			if (fd == _listener.getFd() && (_pollFds[i].revents & POLLIN))
+			{
+				Print::Debug("New connection event on server socket");
+				processNewConnection();
+			}
+			// Process messages from existing clients
+			else if (_pollFds[i].revents & POLLIN)
+			{
+				Print::Debug("Data available on client FD: " + toString(fd));
+				processClientMessage(fd);
+			}
+			// Handle errors
+			else if (_pollFds[i].revents & (POLLERR | POLLNVAL))
+			{
+				Print::StdErr("ERROR condition on FD: " + toString(fd));
+				removeClient(fd, true);
+			}
+			// Handle hangup WITHOUT data available - DON'T disconnect yet
+			else if (_pollFds[i].revents & POLLHUP)
+			{
+				Print::Debug("POLLHUP (only) received for FD: " + toString(fd) +
+							" - keeping connection");
+			}
+		}
+		// Only those that were waiting already, the others had their quantum
+		servicePendingClients(pending);
+		if (_server->_botConnected && !_server->_pipelined)
+		{
+			ScopedLock state(_server->_stateLock);
+			_server->addBotToAllChannels(_server->getBot());
+		}
+		if (_server->_migrateVotes > 0)
+		{
+			rebalanceClients();
+		}
+		if (_id == 0 && !_server->_pipelined)
+		{
+			_server->expireSessions();
+		}
+		// The channels are only forked to disk while no command runs
+		if (_id == 0 && !_server->_pipelined && _server->_snapshot.isDue())
+		{
+			ScopedLock state(_server->_stateLock);
+			_server->_snapshot.save();
+		}
+		flushDirtyClients();
+		syncClientOutput();
+		drainClosingFds(false);
+		if (DEBUG && !_server->_pipelined)
+		{
+			ScopedLock state(_server->_stateLock);
+			_server->print_clients();
+		}
+		Epoch::leave();
+		Epoch::collect();
+	}
+	t_currentShard = NULL;
+	Print::Debug("Shard " + toString(_id) + " leaving event loop");
+}
+
+// Run the event loop on a thread of its own. Shutdown signals stay with
+// the main thread, so the new thread starts with them blocked.
+bool Shard::startThread()
+{
+	sigset_t blocked;
+	sigset_t previous;
+	sigemptyset(&blocked);
+	sigaddset(&blocked, SIGINT);
+	sigaddset(&blocked, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+	int error = pthread_create(&_thread, NULL, &Shard::threadMain, this);
+	pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+	if (error != 0)
+	{
+		Print::Fail("Error starting shard " + toString(_id) + ": " +
+					toString(strerror(error)));
+		return (false);
+	}
+	_threaded = true;
+	return (true);
+}
+
+void* Shard::threadMain(void* arg)
+{
+	static_cast<Shard*>(arg)->run();
+	return (NULL);
+}
+
+void Shard::join()
+{
+	if (_threaded)
+	{
+		pthread_join(_thread, NULL);
+		_threaded = false;
+	}
+}
+
+// Interrupt poll() so the loop notices the mailbox or a shutdown
+void Shard::wake()
+{
+	char byte = 0;
+	if (write(_wakePipe[1], &byte, 1) < 0 && errno != EAGAIN)
+	{
+		Print::Debug("Could not wake shard " + toString(_id));
+	}
+}
+
+void Shard::pinToCpu()
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(_cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set) != 0)
+	{
+		Print::Warn("Could not pin shard " + toString(_id) + " to CPU " +
+					toString(_cpu) + ": " + toString(strerror(errno)));
+	}
+}
+
+// Hand a message to this shard for one of its clients. Called from other
+// shards; only the first message of a batch needs to wake the loop.
+void Shard::post(int fd, unsigned long clientId, const std::string& message,
+				 Client::Lane lane, bool resumes)
+{
+	Delivery delivery;
+	delivery.to.fd = fd;
+	delivery.to.clientId = clientId;
+	delivery.message = SharedBuffer(message);
+	delivery.lane = lane;
+	delivery.broadcasts = _server->getBroadcastSeq();
+	delivery.resumes = resumes;
+	delivery.adopted = NULL;
+
+	bool wasEmpty;
+	{
+		ScopedLock guard(_mailboxLock);
+		wasEmpty = _mailbox.empty();
+		_mailbox.push_back(delivery);
+	}
+	if (wasEmpty)
+	{
+		wake();
+	}
+}
+
+// Same for a batch of clients getting one message, as a fan-out does. The
+// rendered buffer is shared, not copied per recipient.
+void Shard::post(const std::vector<Recipient>& recipients, const SharedBuffer& message,
+				 Client::Lane lane)
+{
+	Delivery delivery;
+	delivery.message = message;
+	delivery.lane = lane;
+	delivery.broadcasts = _server->getBroadcastSeq();
+	delivery.resumes = false;
+	delivery.adopted = NULL;
+
+	bool wasEmpty;
+	{
+		ScopedLock guard(_mailboxLock);
+		wasEmpty = _mailbox.empty();
+		for (size_t i = 0; i < recipients.size(); i++)
+		{
+			delivery.to = recipients[i];
+			_mailbox.push_back(delivery);
+		}
+	}
+	if (wasEmpty)
+	{
+		wake();
+	}
+}
+
+// Queue everything other shards posted since the last wake up
+void Shard::drainMailbox()
+{
+	char buffer[256];
+	while (read(_wakePipe[0], buffer, sizeof(buffer)) > 0)
+	{
+	}
+
+	std::vector<Delivery> batch;
+	{
+		ScopedLock guard(_mailboxLock);
+		batch.swap(_mailbox);
+	}
+	for (size_t i = 0; i < batch.size(); i++)
+	{
+		if (batch[i].adopted)
+		{
+			adoptClient(batch[i].adopted);
+			continue;
+		}
+		Client* client = getClient(batch[i].to.fd);
+		if (!client || client->getId() != batch[i].to.clientId)
+		{
+			continue;
+		}
+		if (!batch[i].message.str().empty())
+		{
+			client->queueOutput(batch[i].message.str(), batch[i].lane,
+								batch[i].broadcasts);
+		}
+		// Its pooled command is answered: the lines it sent since get their turn,
+		// and in pipelined mode those the logic thread kept
+		if (batch[i].resumes)
+		{
+			client->setOffloaded(false);
+			_backloggedFds.insert(batch[i].to.fd);
+			if (_server->_pipelined)
+			{
+				_server->submit(Server::LogicEvent::RESUMED, client, NULL);
+			}
+		}
+	}
+}
+
+// Hand a client over to this shard, ahead of anything posted for it from
+// now on. Called by its current owner under the state lock.
+void Shard::handOver(Client* client)
+{
+	Delivery delivery;
+	delivery.to.fd = client->getFd();
+	delivery.to.clientId = client->getId();
+	delivery.lane = Client::LANE_CONTROL;
+	delivery.broadcasts = 0;
+	delivery.resumes = false;
+	delivery.adopted = client;
+
+	bool wasEmpty;
+	{
+		ScopedLock guard(_mailboxLock);
+		wasEmpty = _mailbox.empty();
+		_mailbox.push_back(delivery);
+	}
+	if (wasEmpty)
+	{
+		wake();
+	}
+}
+
+// Move the clients whose channel traffic mostly belongs to another shard
+// there. A bounded batch per loop iteration, like the broadcasts.
+void Shard::rebalanceClients()
+{
+	if (!_rebalancePass)
+	{
+		time_t now = time(NULL);
+		if (now < _nextRebalance)
+		{
+			return;
+		}
+		_rebalancePass = true;
+		_rebalanceCursor = -1;
+		_nextRebalance = now + 1;
+	}
+
+	// Commands run under the state lock, so nobody posts to these clients
+	// while they change hands
+	ScopedLock state(_server->_stateLock);
+	std::vector<Client*> leaving;
+	std::map<int, Client*>::iterator it = _clients.upper_bound(_rebalanceCursor);
+	for (int n = 0; it != _clients.end() && n < Sched::MIGRATE_BATCH; ++it, ++n)
+	{
+		Client* client = it->second;
+		int target = client->getAffinityShard();
+		if (target >= 0 && target != _id && client->getAffinityVotes() >= _server->_migrateVotes)
+		{
+			leaving.push_back(client);
+		}
+		_rebalanceCursor = it->first;
+	}
+	if (it == _clients.end())
+	{
+		_rebalancePass = false;
+	}
+	if (leaving.empty())
+	{
+		return;
+	}
+
+	// What was posted for them so far is queued here and travels with them
+	drainMailbox();
+	int moved = 0;
+	for (size_t i = 0; i < leaving.size(); i++)
+	{
+		if (canMigrate(leaving[i]))
+		{
+			migrateClient(leaving[i], _server->_shards[leaving[i]->getAffinityShard()]);
+			moved++;
+		}
+	}
+	if (moved > 0)
+	{
+		Print::Ok("Shard " + toString(_id) + " handed " + toString(moved) +
+				  " client(s) to their channels' shards");
+	}
+}
+
+// Clients in the middle of something stay until the next pass
+bool Shard::canMigrate(Client* client) const
+{
+	return (!client->isBot() && !client->isOffloaded() && !client->isThrottled() &&
+			!client->hasWriteError() && !_backloggedFds.count(client->getFd()));
+}
+
+// Give a client to another shard: its input and output buffers go along,
+// and everything posted for it from now on goes to the new owner
+void Shard::migrateClient(Client* client, Shard* target)
+{
+	int fd = client->getFd();
+	Print::Debug("Migrating FD: " + toString(fd) + " to shard " + toString(target->getId()));
+
+	removePollFd(fd);
+	_clients.erase(fd);
+	client->resetAffinity();
+
+	// Keep the broadcast log until the new owner has it
+	__atomic_add_fetch(&_server->_clientsInTransit, 1, __ATOMIC_SEQ_CST);
+	catchUpBroadcasts(client, Client::ALL_BROADCASTS);
+	client->setShard(target);
+	target->handOver(client);
+}
+
+// Take over a client handed over by another shard
+void Shard::adoptClient(Client* client)
+{
+	int fd = client->getFd();
+	_clients[fd] = client;
+	addPollFd(fd, POLLIN);
+
+	// Broadcasts issued while it was on its way
+	catchUpBroadcasts(client, Client::ALL_BROADCASTS);
+	__atomic_sub_fetch(&_server->_clientsInTransit, 1, __ATOMIC_SEQ_CST);
+	if (client->hasPendingOutput())
+	{
+		markDirty(fd);
+	}
+	Print::Debug("Adopted FD: " + toString(fd) + " on shard " + toString(_id));
+}
+
+// Catch up a bounded number of clients on the server-wide broadcasts, so a
+// broadcast to everyone never stalls the loop. Clients that get any other
+// output first are caught up right then (see Client::appendOutput).
+void Shard::advanceBroadcasts()
+{
+	if (!_broadcastPass)
+	{
+		unsigned long latest = _server->getBroadcastSeq();
+		if (latest == _broadcastDone)
+		{
+			return;
+		}
+		_broadcastPass = true;
+		_broadcastTarget = latest;
+		_broadcastCursor = -1;
+	}
+
+	std::map<int, Client*>::iterator it = _clients.upper_bound(_broadcastCursor);
+	for (int n = 0; it != _clients.end() && n < _server->_broadcastBatch; ++it, ++n)
+	{
+		if (catchUpBroadcasts(it->second, _broadcastTarget))
+		{
+			it->second->scheduleFlush();
+		}
+		_broadcastCursor = it->first;
+	}
+	if (it == _clients.end())
+	{
+		_broadcastPass = false;
+		__atomic_store_n(&_broadcastDone, _broadcastTarget, __ATOMIC_RELEASE);
+		_server->trimBroadcasts();
+	}
+}
+
+// Queue the broadcasts a client has not seen yet, up to upTo. Returns true
+// when the client went from idle to having output.
+bool Shard::catchUpBroadcasts(Client* client, unsigned long upTo)
+{
+	if (client->getBroadcastSeq() >= upTo ||
+		client->getBroadcastSeq() >= _server->getBroadcastSeq())
+	{
+		return (false);
+	}
+	return (_server->catchUpBroadcasts(client, upTo));
+}
+
+unsigned long Shard::getBroadcastsDone() const
+{
+	return (__atomic_load_n(&_broadcastDone, __ATOMIC_ACQUIRE));
+}
+
+// Remember a client that went from idle to having output queued
+void Shard::markDirty(int fd) { _dirtyFds.push_back(fd); }
+
+// A client came with complete lines already buffered
+void Shard::markBacklogged(int fd) { _backloggedFds.insert(fd); }
+
+int Shard::getListenerFd() const { return (_listener.getFd()); }
+
+// The loop stopped for good: queue what was posted and the broadcasts
+// every client is still owed
+void Shard::settle()
+{
+	drainMailbox();
+	for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it)
+	{
+		catchUpBroadcasts(it->second, Client::ALL_BROADCASTS);
+	}
+}
+
+// Write the output produced during this iteration, outside the state lock
+void Shard::flushDirtyClients()
+{
+	for (size_t i = 0; i < _dirtyFds.size(); i++)
+	{
+		Client* client = getClient(_dirtyFds[i]);
+		if (client)
+		{
+			client->flush();
+		}
+	}
+	_dirtyFds.clear();
+}
+
+// Accept every pending connection. Accepted sockets come back non-blocking
+// and close-on-exec from accept4(), so each client costs a single syscall.
+void Shard::processNewConnection()
+{
+	Print::Do("ProcessNewConnection");
+	int accepted = 0;
+
+	while (accepted < Net::ACCEPT_BATCH)
+	{
+		int clientFd = _listener.accept();
+		if (clientFd < 0)
+		{
+			int error = _listener.getLastErrno();
+			if (error == EINTR || error == ECONNABORTED)
+			{
+				continue;
+			}
+			if (error == EMFILE || error == ENFILE)
+			{
+				// Out of fds: spend the reserve on turning one client away
+				if (!_server->rejectWithReserveFd(_listener))
+				{
+					Print::Fail("Out of file descriptors, no reserve left");
+					return;
+				}
+				continue;
+			}
+			if (error != EAGAIN && error != EWOULDBLOCK)
+			{
+				Print::Fail("Error accepting connection: " + _listener.getLastError());
+				return;
+			}
+			break;
+		}
+
+		// The client owns the fd from now on
+		if (!attachConnection(clientFd))
+		{
+			_server->rejectConnection(clientFd, "Server full");
+			continue;
+		}
+		accepted++;
+	}
+	Print::Ok(toString(accepted) + " connection(s) accepted");
+}
+
+// Make a connected socket one of this shard's clients, accepted or dialed
+// out to another server. Returns NULL when the server is full.
+Client* Shard::attachConnection(int fd)
+{
+	Client* client = _server->addClient(fd, this);
+	if (!client)
+	{
+		return (NULL);
+	}
+	_clients[fd] = client;
+	addPollFd(fd, POLLIN);
+
+	Print::Debug("New connection accepted. FD: " + toString(fd));
+	return (client);
+}
+
+void Shard::processClientMessage(int clientFd)
+{
+	extern volatile bool g_shutdown_requested;
+
+	if (g_shutdown_requested)
+	{
+		Print::Debug("Shutdown requested, skipping message processing");
+		return;
+	}
+
+	Print::Debug("Processing message from client FD: " + toString(clientFd));
+
+	Client* client = getClient(clientFd);
+	if (!client)
+	{
+		Print::StdErr("Error: Client not found for FD: " + toString(clientFd));
+		return;
+	}
+
+	// Buffer for receiving data, a link takes a burst in big reads
+	char buffer[65536];
+	size_t readSize = (client->isLink() ? sizeof(buffer) : 1024);
+	ssize_t bytesRead = recv(clientFd, buffer, readSize, 0);
+
+	Print::Debug("Received " + toString(bytesRead) +
+				" bytes from client FD: " + toString(clientFd));
+
+	if (bytesRead < 0)
+	{
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+		{
+			Print::Debug("No data available, but connection is still open");
+			return;
+		}
+
+		Print::StdErr("Error receiving data: " + toString(strerror(errno)));
+		removeClient(clientFd, true);
+		return;
+	}
+
+	if (bytesRead == 0)
+	{
+		Print::Debug("Client closed connection gracefully");
+		removeClient(clientFd, true);
+		return;
+	}
+	// Append to client buffer, a link's frames are inflated on the way
+	if (!client->isLink())
+	{
+		client->getInputBuffer().append(buffer, bytesRead);
+	}
+	else if (!client->receiveLink(buffer, bytesRead))
+	{
+		Print::StdErr("Corrupt frame from server link FD: " + toString(clientFd));
+		removeClient(clientFd);
+		return;
+	}
+	// Process complete messages (ending with \r\n)
+	if (!processClientBuffer(client))
+	{
+		return;
+	}
+
+	// If buffer gets too large without complete messages, clear it (prevent DoS)
+	std::string& clientBuffer = client->getInputBuffer();
+	if (clientBuffer.size() > 4096 && !client->isLink())
+	{
+		clientBuffer.clear();
+		Print::StdErr("Warning: Client buffer overflow, clearing buffer");
+	}
+	// Idle clients keep no input buffer around
+	client->releaseInputBuffer();
+}
+
+// Execute the complete lines buffered for a client, at most one quantum per
+// loop iteration and only while its token bucket allows it.
+// Returns false if the client got disconnected for flooding.
+bool Shard::processClientBuffer(Client* client)
+{
+	int clientFd = client->getFd();
+	std::string& clientBuffer = client->getInputBuffer();
+	TokenBucket& bucket = client->getFloodBucket();
+	int budget = _server->_quantumLines;
+	size_t pos;
+
+	// A client that let its bucket fill up again is forgiven
+	bucket.refill();
+	if (bucket.isFull())
+	{
+		client->resetFloodStrikes();
+	}
+
+	_backloggedFds.erase(clientFd);
+	while ((pos = clientBuffer.find("\r\n")) != std::string::npos)
+	{
+		// Waiting for a pooled command: reading resumes with its last reply
+		if (client->isOffloaded())
+		{
+			setReadInterest(clientFd, false);
+			return (true);
+		}
+
+		// Quantum used up: the rest waits for the next loop iteration.
+		// A server link carries a whole network's traffic and isn't limited.
+		if (budget-- == 0 && !client->isLink())
+		{
+			Print::Debug("Quantum used by FD: " + toString(clientFd) + ", rescheduling");
+			_backloggedFds.insert(clientFd);
+			setReadInterest(clientFd, false);
+			return (true);
+		}
+
+		// Extract a complete message
+		std::string rawMessage = clientBuffer.substr(0, pos);
+
+		// A client's :prefix is ignored, only links speak for others: the
+		// command charged and the one run are both the word after it
+		if (!client->isLink() && !client->isJournalStream())
+		{
+			size_t start = rawMessage.find_first_not_of(' ');
+			if (start != std::string::npos && rawMessage[start] == ':')
+			{
+				size_t end = rawMessage.find(' ', start);
+				rawMessage.erase(0, end == std::string::npos
+										? end
+										: rawMessage.find_first_not_of(' ', end));
+			}
+		}
+
+		// Charge the command before running it, the bot and links are trusted
+		if (!client->isBot() && !client->isLink())
+		{
+			size_t start = rawMessage.find_first_not_of(' ');
+			std::string commandName =
+				start == std::string::npos
+					? ""
+					: rawMessage.substr(start, rawMessage.find(' ', start) - start);
+			if (!bucket.consume(CommandFactory::getCommandCost(commandName)))
+			{
+				// Out of tokens: the line stays queued for later
+				return (throttleClient(client));
+			}
+		}
+		// Remove the processed message from the buffer
+		clientBuffer.erase(0, pos + 2);
+
+		runLine(client, rawMessage);
+	}
+	return (true);
+}
+
+// Parse a line and execute it under the state lock, or hand it to the
+// logic thread in pipelined mode
+void Shard::runLine(Client* client, const std::string& rawMessage)
+{
+	if (_server->_pipelined)
+	{
+		_server->submit(Server::LogicEvent::LINE, client, new Message(rawMessage));
+		return;
+	}
+
+	ScopedLock state(_server->_stateLock);
+	Message message = Message(rawMessage);
+	Print::Debug("Processing command: " + message.getCommand());
+	CommandFactory::executeCommand(client, _server, message);
+}
+
+// Stop reading from a client that ran out of tokens. Its unread input stays
+// in the kernel until the bucket refills; repeat offenders are disconnected.
+bool Shard::throttleClient(Client* client)
+{
+	int clientFd = client->getFd();
+	int strikes = client->addFloodStrike();
+
+	if (strikes > _server->_floodMaxStrikes)
+	{
+		Print::Warn("Excess Flood from FD: " + toString(clientFd) + ", disconnecting");
+		client->sendMessage("ERROR :Closing Link: localhost (Excess Flood)\r\n");
+		// Closing with the flood still unread would reset the connection and
+		// the ERROR with it: a copy of the fd keeps it open a while longer
+		int lingering = dup(clientFd);
+		removeClient(clientFd);
+		if (lingering >= 0)
+		{
+			lingerClose(lingering);
+		}
+		return (false);
+	}
+
+	Print::Warn("Throttling FD: " + toString(clientFd) + " (strike " +
+				toString(strikes) + "/" + toString(_server->_floodMaxStrikes) + ")");
+	client->setThrottled(true);
+	_throttledFds.insert(clientFd);
+	setReadInterest(clientFd, false);
+	return (true);
+}
+
+// The ERROR is flushed: send the FIN after it and read whatever the client
+// still sends, until it closes or LINGER_SECONDS pass
+void Shard::lingerClose(int fd)
+{
+	shutdown(fd, SHUT_WR);
+	_closingFds[fd] = time(NULL) + Flood::LINGER_SECONDS;
+}
+
+void Shard::drainClosingFds(bool all)
+{
+	char discard[65536];
+	time_t now = time(NULL);
+	std::map<int, time_t>::iterator it = _closingFds.begin();
+	while (it != _closingFds.end())
+	{
+		// One read a turn: a client still flooding must not hold the loop
+		ssize_t n = recv(it->first, discard, sizeof(discard), MSG_DONTWAIT);
+		if (all || n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) ||
+			now >= it->second)
+		{
+			::close(it->first);
+			_closingFds.erase(it++);
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+// Give queued clients their next turn: backlogged ones get another quantum,
+// throttled ones resume once their bucket is at least half full again.
+// Clients that drained their queue go back to reading from the socket.
+void Shard::servicePendingClients(const std::vector<int>& fds)
+{
+	for (size_t i = 0; i < fds.size(); i++)
+	{
+		Client* client = getClient(fds[i]);
+		if (!client)
+		{
+			_backloggedFds.erase(fds[i]);
+			_throttledFds.erase(fds[i]);
+			continue;
+		}
+
+		if (client->isThrottled())
+		{
+			TokenBucket& bucket = client->getFloodBucket();
+			bucket.refill();
+			if (bucket.getTokens() < bucket.getCapacity() / 2)
+			{
+				continue;
+			}
+			_throttledFds.erase(fds[i]);
+			client->setThrottled(false);
+			Print::Debug("Resuming throttled FD: " + toString(fds[i]));
+		}
+
+		// Drain what was already read before going back to the socket
+		if (!processClientBuffer(client) || client->isThrottled()
+			|| client->isOffloaded() || _backloggedFds.count(fds[i]))
+		{
+			continue;
+		}
+		setReadInterest(fds[i], true);
+	}
+}
+
+// Keep POLLOUT in sync with each client's outbound queue, and drop clients
+// whose socket failed or whose queue outgrew the sendq limit
+void Shard::syncClientOutput()
+{
+	std::vector<int> deadFds;
+
+	for (size_t i = 0; i < _pollFds.size(); i++)
+	{
+		Client* client = getClient(_pollFds[i].fd);
+		if (!client)
+		{
+			continue;
+		}
+		if (client->hasWriteError() || client->isDisconnectRequested() ||
+			(client->getQueuedBytes() > _server->_maxSendq && !client->isLink()))
+		{
+			deadFds.push_back(_pollFds[i].fd);
+		}
+		else if (client->hasPendingOutput())
+		{
+			_pollFds[i].events |= POLLOUT;
+		}
+		else
+		{
+			_pollFds[i].events &= ~POLLOUT;
+		}
+	}
+
+	for (size_t i = 0; i < deadFds.size(); i++)
+	{
+		Client* client = getClient(deadFds[i]);
+		Print::Warn("Dropping FD: " + toString(deadFds[i]) +
+					(client->hasWriteError()            ? " (write error)"
+					 : client->isDisconnectRequested() ? " (disconnected)"
+													   : " (Max SendQ exceeded)"));
+		removeClient(deadFds[i], client->hasWriteError());
+	}
+}
+
+// Remove client and cleanup associated resources
+void Shard::removeClient(int clientFd, bool lost)
+{
+	Print::Debug("Removing client FD: " + toString(clientFd));
+
+	// Remove from poll
+	removePollFd(clientFd);
+	_throttledFds.erase(clientFd);
+	_backloggedFds.erase(clientFd);
+
+	Client* client = getClient(clientFd);
+	if (!client)
+	{
+		return;
+	}
+	_clients.erase(clientFd);
+
+	// A user that lost its connection without QUIT can take its session
+	// back for a while: it stays everywhere but here, socket still open
+	if (lost && !client->isDisconnectRequested() && !client->isLink() &&
+		SessionStore::detach(client))
+	{
+		Print::Ok("Client FD: " + toString(clientFd) + " detached, session kept for RESUME");
+		return;
+	}
+
+	// Last chance for a final ERROR line, then the socket is closed
+	client->flush();
+	if (_server->_pipelined)
+	{
+		// Lines already submitted run first, then the logic thread deletes it
+		_server->submit(Server::LogicEvent::DISCONNECT, client, NULL);
+	}
+	else
+	{
+		_server->removeClient(client);
+		client->closeSocket();
+		Epoch::retire(client);  // other threads may still hold it
+	}
+
+	Print::Debug("Client disconnected. FD: " + toString(clientFd));
+}
+
+// Get one of this shard's clients by file descriptor
+Client* Shard::getClient(int fd)
+{
+	std::map<int, Client*>::iterator it = _clients.find(fd);
+	if (it != _clients.end())
+	{
+		return (it->second);
+	}
+	return (NULL);
+}
+
+// Turn POLLIN on or off for a file descriptor
+void Shard::setReadInterest(int fd, bool enabled)
+{
+	pollfd* pfd = findPollFd(fd);
+	if (!pfd)
+	{
+		return;
+	}
+	if (enabled)
+	{
+		pfd->events |= POLLIN;
+	}
+	else
+	{
+		pfd->events &= ~POLLIN;
+	}
+}
+
+// Watch a new file descriptor, remembering where its entry lives
+void Shard::addPollFd(int fd, short events)
+{
+	pollfd pfd;
+	memset(&pfd, 0, sizeof(pfd));
+	pfd.fd = fd;
+	pfd.events = events;
+	pfd.revents = 0;
+
+	if (static_cast<size_t>(fd) >= _pollIndex.size())
+	{
+		_pollIndex.resize(fd + 1, -1);
+	}
+	_pollIndex[fd] = _pollFds.size();
+	_pollFds.push_back(pfd);
+}
+
+// Stop watching a file descriptor. The last entry takes its slot, so the
+// caller's loop may see that entry one iteration late (poll() reports it again)
+void Shard::removePollFd(int fd)
+{
+	if (fd < 0 || static_cast<size_t>(fd) >= _pollIndex.size() || _pollIndex[fd] < 0)
+	{
+		return;
+	}
+	size_t pos = _pollIndex[fd];
+	_pollFds[pos] = _pollFds.back();
+	_pollIndex[_pollFds[pos].fd] = pos;
+	_pollFds.pop_back();
+	_pollIndex[fd] = -1;
+}
+
+// Find the poll entry of a file descriptor
+pollfd* Shard::findPollFd(int fd)
+{
+	if (fd < 0 || static_cast<size_t>(fd) >= _pollIndex.size() || _pollIndex[fd] < 0)
+	{
+		return (NULL);
+	}
+	return (&_pollFds[_pollIndex[fd]]);
+}
@@ -0,0 +1,354 @@
+#include "Snapshot.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <set>
+
+#include "Channel.hpp"
+#include "Config.hpp"
+#include "Server.hpp"
+#include "UtilsFun.hpp"
+
+static const char MAGIC[] = "IRCSNAP";
+static const unsigned char VERSION = 1;
+static const int SAVE_INTERVAL = 60;
+static const size_t HEADER_SIZE = sizeof(MAGIC) + 4 + 8;  // magic and version, count, time
+static const unsigned char MODE_INVITE = 1;
+static const unsigned char MODE_TOPIC = 2;
+static const unsigned char MODE_KEY = 4;
+static const unsigned char MODE_LIMIT = 8;
+
+static void putInt(std::string& out, unsigned long value, int bytes)
+{
+	for (int i = 0; i < bytes; i++)
+	{
+		out += static_cast<char>((value >> (8 * i)) & 0xff);
+	}
+}
+
+static void putString(std::string& out, const std::string& value)
+{
+	size_t length = value.length() < 0xffff ? value.length() : 0xffff;
+	putInt(out, length, 2);
+	out.append(value, 0, length);
+}
+
+// Reading stops at the end of the mapping: pos is set past it and every
+// later read fails too
+static unsigned long getInt(const unsigned char*& pos, const unsigned char* end, int bytes)
+{
+	unsigned long value = 0;
+	if (end - pos < bytes)
+	{
+		pos = end + 1;
+		return (0);
+	}
+	for (int i = 0; i < bytes; i++)
+	{
+		value |= static_cast<unsigned long>(pos[i]) << (8 * i);
+	}
+	pos += bytes;
+	return (value);
+}
+
+static std::string getString(const unsigned char*& pos, const unsigned char* end)
+{
+	size_t length = getInt(pos, end, 2);
+	if (pos > end || static_cast<size_t>(end - pos) < length)
+	{
+		pos = end + 1;
+		return ("");
+	}
+	std::string value(reinterpret_cast<const char*>(pos), length);
+	pos += length;
+	return (value);
+}
+
+static double elapsedMs(const timespec& since)
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((now.tv_sec - since.tv_sec) * 1000.0 + (now.tv_nsec - since.tv_nsec) / 1e6);
+}
+
+Snapshot::Snapshot(Server* server)
+	: _server(server), _interval(SAVE_INTERVAL), _nextSave(0), _writer(0)
+{
+}
+
+Snapshot::~Snapshot() { reap(true); }
+
+void Snapshot::setup()
+{
+	_path = Config::getConfig("snapshot_file");
+	_interval = Config::getConfigInt("snapshot_interval", SAVE_INTERVAL);
+	if (_interval < 1)
+	{
+		_interval = 1;
+	}
+	_nextSave = time(NULL) + _interval;
+	if (!_path.empty())
+	{
+		Print::Ok("Channels saved to " + _path + " every " + toString(_interval) + "s");
+	}
+}
+
+// Bring the channels of the last snapshot back, held. A missing file is a
+// first start; a damaged one is moved aside, where the next snapshot
+// doesn't overwrite it.
+bool Snapshot::load()
+{
+	if (_path.empty())
+	{
+		return (true);
+	}
+	timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	int fd = open(_path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		if (errno != ENOENT)
+		{
+			Print::Warn("Snapshot " + _path + ": " + toString(strerror(errno)));
+		}
+		return (errno == ENOENT);
+	}
+	struct stat info;
+	void* map = MAP_FAILED;
+	if (fstat(fd, &info) == 0 && info.st_size > 0)
+	{
+		map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	::close(fd);
+	if (map == MAP_FAILED)
+	{
+		return (setAside("empty or unreadable"));
+	}
+	madvise(map, info.st_size, MADV_SEQUENTIAL);
+
+	const unsigned char* data = static_cast<const unsigned char*>(map);
+	size_t size = info.st_size;
+	bool valid = size >= HEADER_SIZE + 4 && std::memcmp(data, MAGIC, sizeof(MAGIC) - 1) == 0 &&
+				 data[sizeof(MAGIC) - 1] == VERSION;
+	const unsigned char* end = data + size - (valid ? 4 : 0);
+	const unsigned char* trailer = end;
+	if (!valid || crc32(crc32(0L, Z_NULL, 0), data, size - 4) != getInt(trailer, data + size, 4))
+	{
+		munmap(map, size);
+		return (setAside("not a snapshot, or damaged"));
+	}
+	const unsigned char* pos = data + HEADER_SIZE;
+	const unsigned char* header = data + sizeof(MAGIC);
+	size_t count = getInt(header, end, 4);
+	time_t saved = getInt(header, end, 8);
+
+	// Names come sorted, each channel goes in right after the last one
+	std::map<std::string, Channel*>& channels = _server->_channels;
+	std::map<std::string, Channel*>::iterator hint = channels.end();
+	size_t loaded = 0;
+	for (size_t i = 0; i < count && pos <= end; i++)
+	{
+		std::string name = getString(pos, end);
+		std::string topic = getString(pos, end);
+		std::string key = getString(pos, end);
+		unsigned char modes = getInt(pos, end, 1);
+		size_t limit = getInt(pos, end, 4);
+		size_t invited = getInt(pos, end, 2);
+		if (pos > end || name.empty())
+		{
+			break;
+		}
+		Channel* channel = new Channel(name, &_server->_directory);
+		hint = channels.insert(hint, std::make_pair(name, channel));
+		if (hint->second != channel)
+		{
+			delete channel;
+			channel = hint->second;
+		}
+		channel->setHomeShard(_server->channelHome(name));
+		channel->setTopic(topic);
+		channel->setInviteOnly(modes & MODE_INVITE);
+		channel->setTopicRestricted(modes & MODE_TOPIC);
+		if (modes & MODE_KEY)
+		{
+			channel->setKey(key);
+		}
+		if (modes & MODE_LIMIT)
+		{
+			channel->setUserLimit(limit);
+		}
+		for (size_t j = 0; j < invited && pos <= end; j++)
+		{
+			channel->addInvitedUser(getString(pos, end));
+		}
+		channel->setHeld(true);
+		loaded++;
+	}
+	munmap(map, size);
+	if (loaded != count)
+	{
+		Print::Warn("Snapshot " + _path + ": " + toString(count - loaded) +
+					" channel(s) could not be read");
+	}
+	Print::Ok("Loaded " + toString(loaded) + " channel(s) saved " +
+			  toString(time(NULL) - saved) + "s ago, in " + toString(elapsedMs(start)) + " ms");
+	return (true);
+}
+
+bool Snapshot::setAside(const std::string& reason) const
+{
+	std::string aside = _path + ".bad";
+	Print::Warn("Snapshot " + _path + ": " + reason + ", starting without it");
+	if (rename(_path.c_str(), aside.c_str()) == 0)
+	{
+		Print::Warn("It was moved to " + aside);
+	}
+	return (false);
+}
+
+// Every channel, in name order, with the checksum at the end
+std::string Snapshot::encode() const
+{
+	const std::map<std::string, Channel*>& channels = _server->_channels;
+	std::string out(MAGIC, sizeof(MAGIC) - 1);
+	out += static_cast<char>(VERSION);
+	putInt(out, channels.size(), 4);
+	putInt(out, time(NULL), 8);
+	for (std::map<std::string, Channel*>::const_iterator it = channels.begin();
+		 it != channels.end(); ++it)
+	{
+		Channel* channel = it->second;
+		unsigned char modes = 0;
+		modes |= channel->isInviteOnly() ? MODE_INVITE : 0;
+		modes |= channel->isTopicRestricted() ? MODE_TOPIC : 0;
+		modes |= channel->hasKey() ? MODE_KEY : 0;
+		modes |= channel->hasUserLimit() ? MODE_LIMIT : 0;
+		putString(out, it->first);
+		putString(out, channel->getTopic());
+		putString(out, channel->hasKey() ? channel->getKey() : "");
+		putInt(out, modes, 1);
+		putInt(out, channel->hasUserLimit() ? channel->getUserLimit() : 0, 4);
+		const std::set<std::string>& invited = channel->getInvitedUsers();
+		size_t names = invited.size() < 0xffff ? invited.size() : 0xffff;
+		putInt(out, names, 2);
+		std::set<std::string>::const_iterator name = invited.begin();
+		for (size_t i = 0; i < names; i++, ++name)
+		{
+			putString(out, *name);
+		}
+	}
+	putInt(out, crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(out.data()),
+					   out.length()), 4);
+	return (out);
+}
+
+// Write aside, sync, rename over the last snapshot, sync the directory.
+// Runs in the forked writer: no locks, no logging.
+bool Snapshot::writeFile(const std::string& data) const
+{
+	std::string temp = _path + ".tmp";
+	int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0)
+	{
+		return (false);
+	}
+	size_t written = 0;
+	while (written < data.length())
+	{
+		ssize_t n = write(fd, data.data() + written, data.length() - written);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n <= 0)
+		{
+			break;
+		}
+		written += n;
+	}
+	bool ok = written == data.length() && fsync(fd) == 0;
+	ok = (::close(fd) == 0) && ok;
+	if (!ok || rename(temp.c_str(), _path.c_str()) != 0)
+	{
+		unlink(temp.c_str());
+		return (false);
+	}
+	size_t slash = _path.rfind('/');
+	std::string dir = (slash == std::string::npos ? "." : _path.substr(0, slash + 1));
+	int dirFd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dirFd >= 0)
+	{
+		fsync(dirFd);
+		::close(dirFd);
+	}
+	return (true);
+}
+
+// Collect the writer's exit, waiting for it or not
+void Snapshot::reap(bool wait)
+{
+	int status = 0;
+	if (_writer <= 0 || waitpid(_writer, &status, wait ? 0 : WNOHANG) == 0)
+	{
+		return;
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	{
+		Print::Warn("Snapshot to " + _path + " failed, the previous one stays");
+	}
+	_writer = 0;
+}
+
+bool Snapshot::isDue()
+{
+	if (_path.empty())
+	{
+		return (false);
+	}
+	reap(false);
+	return (_writer == 0 && time(NULL) >= _nextSave && !_server->_journal.isStandby());
+}
+
+// The child gets a copy-on-write image of the state as it is under the
+// caller's lock, and encodes it while the loops go on
+void Snapshot::save()
+{
+	_nextSave = time(NULL) + _interval;
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		_exit(writeFile(encode()) ? 0 : 1);
+	}
+	if (pid < 0)
+	{
+		Print::Warn("Snapshot: fork failed: " + toString(strerror(errno)));
+		return;
+	}
+	_writer = pid;
+}
+
+void Snapshot::saveNow()
+{
+	if (_path.empty() || _server->_journal.isStandby())
+	{
+		return;
+	}
+	reap(true);
+	if (!writeFile(encode()))
+	{
+		Print::Warn("Snapshot to " + _path + " failed, the previous one stays");
+	}
+	else
+	{
+		Print::Ok("Saved " + toString(_server->_channels.size()) + " channel(s) to " + _path);
+	}
+	_path.clear();  // the channels are torn down next, nothing to save after this
+}
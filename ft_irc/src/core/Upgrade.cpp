@@ -0,0 +1,609 @@
+#include "Upgrade.hpp"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <sstream>
+
+#include "Channel.hpp"
+#include "Client.hpp"
+#include "Config.hpp"
+#include "Journal.hpp"
+#include "Server.hpp"
+#include "Shard.hpp"
+#include "UtilsFun.hpp"
+
+static const char* STATE_VERSION = "ircserv-upgrade 2";
+static const char* STATE_VERSION_1 = "ircserv-upgrade 1";  // no history, no caps
+static const int HANDOVER_TIMEOUT_SEC = 30;
+
+// The state is a run of netstrings, "<length>:<bytes>,", so buffered input
+// and output go through whatever bytes they hold
+static void put(std::string& out, const std::string& field)
+{
+	out += toString(field.length()) + ":" + field + ",";
+}
+
+static bool take(const std::string& in, size_t& pos, std::string& field)
+{
+	size_t colon = in.find(':', pos);
+	if (colon == std::string::npos)
+	{
+		return (false);
+	}
+	size_t length = std::strtoul(in.c_str() + pos, NULL, 10);
+	if (in.length() - colon - 1 < length + 1 || in[colon + 1 + length] != ',')
+	{
+		return (false);
+	}
+	field = in.substr(colon + 1, length);
+	pos = colon + length + 2;
+	return (true);
+}
+
+static bool takeNumber(const std::string& in, size_t& pos, long& number)
+{
+	std::string field;
+	if (!take(in, pos, field))
+	{
+		return (false);
+	}
+	number = std::atol(field.c_str());
+	return (true);
+}
+
+static bool readAll(int fd, char* buffer, size_t length)
+{
+	while (length > 0)
+	{
+		ssize_t n = recv(fd, buffer, length, 0);
+		if (n <= 0)
+		{
+			return (false);
+		}
+		buffer += n;
+		length -= n;
+	}
+	return (true);
+}
+
+static bool writeAll(int fd, const std::string& data)
+{
+	size_t sent = 0;
+	while (sent < data.length())
+	{
+		ssize_t n = send(fd, data.data() + sent, data.length() - sent, MSG_NOSIGNAL);
+		if (n <= 0)
+		{
+			return (false);
+		}
+		sent += n;
+	}
+	return (true);
+}
+
+static bool unixAddress(const std::string& path, sockaddr_un& addr)
+{
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (path.length() >= sizeof(addr.sun_path))
+	{
+		return (false);
+	}
+	std::strcpy(addr.sun_path, path.c_str());
+	return (true);
+}
+
+Upgrade::Upgrade(Server* server) : _server(server), _listeners(0), _handedOver(false) {}
+
+// Sockets received but never taken over are closed. A server that exits
+// normally removes its socket file, one that handed over leaves it to the
+// next process, which bound it again.
+Upgrade::~Upgrade()
+{
+	for (size_t i = 0; i < _fds.size(); i++)
+	{
+		if (_fds[i] >= 0)
+		{
+			::close(_fds[i]);
+		}
+	}
+	if (_listener.isValid() && !_handedOver)
+	{
+		unlink(_path.c_str());
+	}
+}
+
+// Before any socket is opened: take over from the server running on
+// upgrade_socket if there is one, then wait for the next one there
+bool Upgrade::setup()
+{
+	_path = Config::getConfig("upgrade_socket");
+	if (_path.empty())
+	{
+		return (true);
+	}
+	if (!Config::getConfig("standby_of").empty())
+	{
+		Print::Warn("upgrade_socket is not used by a standby");
+		_path.clear();
+		return (true);
+	}
+	sockaddr_un addr;
+	if (!unixAddress(_path, addr))
+	{
+		Print::Fail("upgrade_socket: path too long");
+		return (false);
+	}
+	if (!receive())
+	{
+		return (false);
+	}
+	return (listen());
+}
+
+// Ask the server on the socket for its state, "<length> <fds> <listeners>"
+// then the state, then its sockets a batch per message. Nobody there means
+// a fresh start.
+bool Upgrade::receive()
+{
+	sockaddr_un addr;
+	unixAddress(_path, addr);
+	Socket conn;
+	if (!conn.create(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0) ||
+		::connect(conn.getFd(), (sockaddr*)&addr, sizeof(addr)) != 0)
+	{
+		return (true);
+	}
+	Print::Do("Taking over from the server on " + _path + "...");
+	struct timeval timeout;
+	timeout.tv_sec = HANDOVER_TIMEOUT_SEC;
+	timeout.tv_usec = 0;
+	conn.setOption(SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	std::string header;
+	char c;
+	while (readAll(conn.getFd(), &c, 1) && c != '\n')
+	{
+		header += c;
+	}
+	std::istringstream fields(header);
+	size_t length = 0;
+	size_t count = 0;
+	fields >> length >> count >> _listeners;
+	_state.resize(length);
+	if (c != '\n' || !fields || (length && !readAll(conn.getFd(), &_state[0], length)))
+	{
+		Print::Fail("Upgrade: the running server sent no state");
+		return (false);
+	}
+
+	while (_fds.size() < count)
+	{
+		char byte;
+		struct iovec iov;
+		iov.iov_base = &byte;
+		iov.iov_len = 1;
+		std::vector<char> control(CMSG_SPACE(FDS_PER_MESSAGE * sizeof(int)));
+		struct msghdr msg;
+		std::memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = &control[0];
+		msg.msg_controllen = control.size();
+		if (recvmsg(conn.getFd(), &msg, MSG_CMSG_CLOEXEC) != 1)
+		{
+			Print::Fail("Upgrade: got " + toString(_fds.size()) + " of " + toString(count) +
+						" sockets");
+			return (false);
+		}
+		for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+		{
+			if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			{
+				continue;
+			}
+			size_t fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			const int* data = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+			_fds.insert(_fds.end(), data, data + fds);
+		}
+	}
+	// Everything is here, the old process may go
+	writeAll(conn.getFd(), "1");
+	Print::Ok("Upgrade: got the state and " + toString(count) + " socket(s)");
+	return (true);
+}
+
+// Listen for the next process. The old server's socket file is replaced,
+// its listener stays behind without a name.
+bool Upgrade::listen()
+{
+	sockaddr_un addr;
+	unixAddress(_path, addr);
+	unlink(_path.c_str());
+	if (!_listener.create(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0) ||
+		::bind(_listener.getFd(), (sockaddr*)&addr, sizeof(addr)) != 0 ||
+		!_listener.listen(1) || !_listener.setNonBlocking())
+	{
+		Print::Fail("upgrade_socket " + _path + ": " + _listener.getLastError());
+		return (false);
+	}
+	Print::Ok("Upgrades are taken on " + _path);
+	return (true);
+}
+
+bool Upgrade::isResuming() const { return (_listeners > 0); }
+
+// Shards share the inherited listeners when there are more of them now
+int Upgrade::takeListener(size_t shard)
+{
+	if (_listeners == 0)
+	{
+		return (-1);
+	}
+	return (fcntl(_fds[shard % _listeners], F_DUPFD_CLOEXEC, 0));
+}
+
+// Rebuild the clients and channels of the previous process around the
+// sockets it passed, spreading the clients over the shards
+bool Upgrade::restore()
+{
+	if (!isResuming())
+	{
+		return (true);
+	}
+	size_t pos = 0;
+	std::string version;
+	long seq = 0;
+	long count = 0;
+	if (!take(_state, pos, version) || (version != STATE_VERSION && version != STATE_VERSION_1) ||
+		!takeNumber(_state, pos, seq) || !takeNumber(_state, pos, count) ||
+		_listeners + count != _fds.size())
+	{
+		Print::Fail("Upgrade: state of another version, or damaged");
+		return (false);
+	}
+
+	std::vector<Client*> clients;
+	for (long i = 0; i < count; i++)
+	{
+		std::string kind, nick, user, flags, input, output;
+		long ts = 0;
+		if (!take(_state, pos, kind) || !take(_state, pos, nick) || !take(_state, pos, user) ||
+			!take(_state, pos, flags) || !takeNumber(_state, pos, ts) ||
+			!take(_state, pos, input) || !take(_state, pos, output))
+		{
+			Print::Fail("Upgrade: client " + toString(i) + " damaged");
+			return (false);
+		}
+		int fd = _fds[_listeners + i];
+		Shard* shard = _server->_shards[i % _server->_shards.size()];
+		Client* client = shard->attachConnection(fd);
+		clients.push_back(client);
+		if (!client)
+		{
+			continue;  // closed with the rest of _fds
+		}
+		_fds[_listeners + i] = -1;
+		if (kind == "standby")
+		{
+			client->setLink(true);
+			client->setJournalStream(true);
+			_server->_journal.resumeStandby(client);
+		}
+		if (!nick.empty())
+		{
+			_server->changeNick(client, nick);
+			client->setNickTs(ts);
+		}
+		client->setUsername(user);
+		client->setAuthenticated(flags.find('A') != std::string::npos);
+		client->setAnnounced(flags.find('N') != std::string::npos);
+		if (flags.find('B') != std::string::npos)
+		{
+			client->setBot(true);
+			_server->setBot(true);
+		}
+		client->getInputBuffer() = input;
+		if (input.find('\n') != std::string::npos)
+		{
+			shard->markBacklogged(client->getFd());
+		}
+		if (!output.empty())
+		{
+			client->queueOutput(output, Client::LANE_CONTROL);
+		}
+		if (flags.find('D') != std::string::npos)
+		{
+			client->requestDisconnect();
+		}
+		int caps = 0;
+		caps |= flags.find('b') != std::string::npos ? Client::CAP_BATCH : 0;
+		caps |= flags.find('s') != std::string::npos ? Client::CAP_SERVER_TIME : 0;
+		caps |= flags.find('h') != std::string::npos ? Client::CAP_CHATHISTORY : 0;
+		caps |= flags.find('r') != std::string::npos ? Client::CAP_RESUME : 0;
+		client->setCaps(caps);
+	}
+	_server->_journal.resumeSeq(seq);
+
+	long channels = 0;
+	takeNumber(_state, pos, channels);
+	for (long i = 0; i < channels; i++)
+	{
+		std::string name, topic, modes, key, invited;
+		long limit = 0;
+		long members = 0;
+		if (!take(_state, pos, name) || !take(_state, pos, topic) ||
+			!take(_state, pos, modes) || !take(_state, pos, key) ||
+			!takeNumber(_state, pos, limit))
+		{
+			Print::Fail("Upgrade: channel " + toString(i) + " damaged");
+			return (false);
+		}
+		Channel* channel = _server->createChannel(name, NULL);
+		channel->setTopic(topic);
+		channel->setInviteOnly(modes.find('i') != std::string::npos);
+		channel->setTopicRestricted(modes.find('t') != std::string::npos);
+		channel->setHeld(modes.find('h') != std::string::npos);
+		if (modes.find('k') != std::string::npos)
+		{
+			channel->setKey(key);
+		}
+		if (modes.find('l') != std::string::npos)
+		{
+			channel->setUserLimit(limit);
+		}
+		long names = 0;
+		takeNumber(_state, pos, names);
+		for (long j = 0; j < names && take(_state, pos, invited); j++)
+		{
+			channel->addInvitedUser(invited);
+		}
+		takeNumber(_state, pos, members);
+		for (long j = 0; j < members; j++)
+		{
+			long index = -1;
+			std::string op;
+			if (!takeNumber(_state, pos, index) || !take(_state, pos, op) || index < 0 ||
+				index >= count || !clients[index])
+			{
+				continue;
+			}
+			channel->addClient(clients[index]);
+			if (op == "@")
+			{
+				channel->addOperator(clients[index]);
+			}
+		}
+		long lines = 0;
+		if (version == STATE_VERSION)
+		{
+			takeNumber(_state, pos, lines);
+		}
+		for (long j = 0; j < lines; j++)
+		{
+			long time = 0;
+			std::string text;
+			if (takeNumber(_state, pos, time) && take(_state, pos, text))
+			{
+				channel->getHistory().push(text, time);
+			}
+		}
+		if (channel->isEmpty())
+		{
+			_server->removeChannel(name);
+		}
+	}
+
+	// The shards hold duplicates of the listeners now
+	for (size_t i = 0; i < _listeners; i++)
+	{
+		::close(_fds[i]);
+		_fds[i] = -1;
+	}
+	Print::Ok("Upgrade: resumed " + toString(count) + " client(s) and " +
+			  toString(channels) + " channel(s)");
+	std::string().swap(_state);
+	return (true);
+}
+
+int Upgrade::getFd() const { return (_listener.getFd()); }
+
+// The next process asks for the state: the event loops stop and the
+// handover happens on the way out (see Server::stop)
+void Upgrade::accept()
+{
+	int fd = ::accept4(_listener.getFd(), NULL, NULL, SOCK_CLOEXEC);
+	if (fd < 0)
+	{
+		return;
+	}
+	if (_next.isValid())
+	{
+		::close(fd);
+		return;
+	}
+	_next.adopt(fd);
+	Print::Ok("Upgrade requested, handing over");
+	_server->_running = false;
+	for (size_t i = 0; i < _server->_shards.size(); i++)
+	{
+		_server->_shards[i]->wake();
+	}
+	if (_server->_pipelined)
+	{
+		char byte = 0;
+		if (write(_server->_logicWake[1], &byte, 1) < 0 && errno != EAGAIN)
+		{
+			Print::Debug("Could not wake the logic thread");
+		}
+	}
+}
+
+bool Upgrade::isRequested() const { return (_next.isValid()); }
+
+// The clients and channels, with the listeners and client sockets in fds
+// in the order the state names them. Server links are left out, and users
+// of other servers with them; standby journal streams are kept.
+std::string Upgrade::writeState(std::vector<int>& fds)
+{
+	std::map<Client*, long> index;
+	std::string clients;
+	for (std::map<int, Client*>::iterator it = _server->_clients.begin();
+		 it != _server->_clients.end(); ++it)
+	{
+		Client* client = it->second;
+		if (client->getFd() < 0 || client->hasWriteError() ||
+			(client->isLink() && !client->isJournalStream()))
+		{
+			continue;
+		}
+		std::string flags;
+		flags += client->isAuthenticated() ? "A" : "";
+		flags += client->isBot() ? "B" : "";
+		flags += client->isAnnounced() ? "N" : "";
+		flags += client->isDisconnectRequested() ? "D" : "";
+		flags += client->hasCap(Client::CAP_BATCH) ? "b" : "";
+		flags += client->hasCap(Client::CAP_SERVER_TIME) ? "s" : "";
+		flags += client->hasCap(Client::CAP_CHATHISTORY) ? "h" : "";
+		flags += client->hasCap(Client::CAP_RESUME) ? "r" : "";
+		put(clients, client->isJournalStream() ? "standby" : "user");
+		put(clients, client->getNickname());
+		put(clients, client->getUsername());
+		put(clients, flags);
+		put(clients, toString(client->getNickTs()));
+		put(clients, client->getInputBuffer());
+		put(clients, client->takePendingOutput());
+		long position = index.size();
+		index[client] = position;
+		fds.push_back(client->getFd());
+	}
+
+	std::string channels;
+	put(channels, toString(_server->_channels.size()));
+	for (std::map<std::string, Channel*>::iterator it = _server->_channels.begin();
+		 it != _server->_channels.end(); ++it)
+	{
+		Channel* channel = it->second;
+		std::string modes;
+		modes += channel->isInviteOnly() ? "i" : "";
+		modes += channel->isTopicRestricted() ? "t" : "";
+		modes += channel->hasKey() ? "k" : "";
+		modes += channel->hasUserLimit() ? "l" : "";
+		modes += channel->isHeld() ? "h" : "";
+		put(channels, it->first);
+		put(channels, channel->getTopic());
+		put(channels, modes);
+		put(channels, channel->getKey());
+		put(channels, toString(channel->getUserLimit()));
+		const std::set<std::string>& invited = channel->getInvitedUsers();
+		put(channels, toString(invited.size()));
+		for (std::set<std::string>::const_iterator name = invited.begin();
+			 name != invited.end(); ++name)
+		{
+			put(channels, *name);
+		}
+		std::string members;
+		long count = 0;
+		const std::map<int, Client*>& clients = channel->getClients();
+		for (std::map<int, Client*>::const_iterator member = clients.begin();
+			 member != clients.end(); ++member)
+		{
+			std::map<Client*, long>::iterator found = index.find(member->second);
+			if (found == index.end())
+			{
+				continue;
+			}
+			put(members, toString(found->second));
+			put(members, channel->isOperator(member->second) ? "@" : "");
+			count++;
+		}
+		put(channels, toString(count));
+		channels += members;
+		std::vector<HistoryRing::Line> lines;
+		channel->getHistory().find(0, 0, channel->getHistory().size(), false, lines);
+		put(channels, toString(lines.size()));
+		for (size_t i = 0; i < lines.size(); i++)
+		{
+			put(channels, toString(lines[i].time));
+			put(channels, lines[i].text);
+		}
+	}
+
+	std::string state;
+	put(state, STATE_VERSION);
+	put(state, toString(_server->_journal.getSeq()));
+	put(state, toString(index.size()));
+	return (state + clients + channels);
+}
+
+// A batch of sockets per message, each with a single byte to carry it
+bool Upgrade::sendFds(const std::vector<int>& fds)
+{
+	for (size_t i = 0; i < fds.size(); i += FDS_PER_MESSAGE)
+	{
+		size_t batch = fds.size() - i;
+		if (batch > FDS_PER_MESSAGE)
+		{
+			batch = FDS_PER_MESSAGE;
+		}
+		char byte = 0;
+		struct iovec iov;
+		iov.iov_base = &byte;
+		iov.iov_len = 1;
+		std::vector<char> control(CMSG_SPACE(batch * sizeof(int)));
+		struct msghdr msg;
+		std::memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = &control[0];
+		msg.msg_controllen = control.size();
+		struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(batch * sizeof(int));
+		std::memcpy(CMSG_DATA(cmsg), &fds[i], batch * sizeof(int));
+		if (sendmsg(_next.getFd(), &msg, MSG_NOSIGNAL) != 1)
+		{
+			return (false);
+		}
+	}
+	return (true);
+}
+
+// Every loop is stopped: what was posted between them is queued first, so
+// the state holds all the output still owed
+void Upgrade::handOver()
+{
+	for (size_t i = 0; i < _server->_shards.size(); i++)
+	{
+		_server->_shards[i]->settle();
+	}
+	std::vector<int> fds;
+	for (size_t i = 0; i < _server->_shards.size(); i++)
+	{
+		fds.push_back(_server->_shards[i]->getListenerFd());
+	}
+	std::string state = writeState(fds);
+
+	int fd = _next.getFd();
+	char ack = 0;
+	bool sent = writeAll(fd, toString(state.length()) + " " + toString(fds.size()) + " " +
+								 toString(_server->_shards.size()) + "\n" + state) &&
+				sendFds(fds) && readAll(fd, &ack, 1);
+	_next.close();
+	if (!sent)
+	{
+		Print::Fail("Upgrade: the new process did not take over, clients are lost");
+		return;
+	}
+	_handedOver = true;
+	Print::Ok("Upgrade: handed over " + toString(fds.size() - _server->_shards.size()) +
+			  " client(s), exiting");
+}
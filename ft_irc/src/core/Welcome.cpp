@@ -0,0 +1,233 @@
+#include <signal.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "General.hpp"
+#include "UtilsFun.hpp"
+#include "Welcome.hpp"
+
+static const char NICK_MARK = '\x01';
+static const char USER_MARK = '\x02';
+static const size_t MOTD_LINES = 500;
+static const size_t MOTD_WIDTH = 79;
+
+volatile sig_atomic_t Welcome::s_reloadRequested = 0;
+
+Welcome::Welcome(const std::string& motdFile) : _motdFile(motdFile), _started(false), _stopping(false)
+{
+	_motdStamp.seconds = 0;
+	_motdStamp.nanos = 0;
+	_motdStamp.size = 0;
+}
+
+Welcome::~Welcome() { stop(); }
+
+// Same format as ACommand::sendNumericReply, for the nick marker
+std::string Welcome::numeric(int code, const std::string& message)
+{
+	std::ostringstream oss;
+	oss << ":server " << code << " " << NICK_MARK << " " << message << "\r\n";
+	return (oss.str());
+}
+
+void Welcome::setup(const std::string& created, const std::string& isupport)
+{
+	_header = numeric(IRC::RPL_WELCOME, ":Welcome to the IRC Network " + std::string(1, NICK_MARK) +
+											"!" + USER_MARK + "@localhost");
+	_header += numeric(IRC::RPL_YOURHOST, ":Host is server, running version 1.0");
+	_header += numeric(IRC::RPL_CREATED, ":This server was created " + created);
+	_header += numeric(IRC::RPL_MYINFO, "server ft_irc-1.0 o itkol");
+	_header += numeric(IRC::RPL_ISUPPORT, isupport + " :are supported by this server");
+
+	load(stampOf(_motdFile));
+}
+
+// Start the watcher thread. Shutdown signals stay with the main thread.
+bool Welcome::start()
+{
+	sigset_t blocked;
+	sigset_t previous;
+	sigemptyset(&blocked);
+	sigaddset(&blocked, SIGINT);
+	sigaddset(&blocked, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+	int error = pthread_create(&_thread, NULL, &Welcome::threadMain, this);
+	pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+	if (error != 0)
+	{
+		Print::Fail("Error starting MOTD thread: " + toString(strerror(error)));
+		return (false);
+	}
+	_started = true;
+	return (true);
+}
+
+void Welcome::stop()
+{
+	_watchLock.lock();
+	_stopping = true;
+	_wakeup.signal();
+	_watchLock.unlock();
+
+	if (_started)
+	{
+		pthread_join(_thread, NULL);
+		_started = false;
+	}
+}
+
+void Welcome::requestReload() { s_reloadRequested = 1; }
+
+void* Welcome::threadMain(void* arg)
+{
+	static_cast<Welcome*>(arg)->watch();
+	return (NULL);
+}
+
+// Seconds alone miss a second edit within the same second, the size and
+// the nanoseconds catch it
+Welcome::Stamp Welcome::stampOf(const std::string& path)
+{
+	Stamp stamp;
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0)
+	{
+		info.st_mtim.tv_sec = 0;
+		info.st_mtim.tv_nsec = 0;
+		info.st_size = 0;
+	}
+	stamp.seconds = info.st_mtim.tv_sec;
+	stamp.nanos = info.st_mtim.tv_nsec;
+	stamp.size = info.st_size;
+	return (stamp);
+}
+
+// Watcher thread: looks at the file once a second
+void Welcome::watch()
+{
+	_watchLock.lock();
+	while (!_stopping)
+	{
+		_wakeup.wait(_watchLock, 1000);
+		if (_stopping)
+		{
+			break;
+		}
+		_watchLock.unlock();
+		Stamp stamp = stampOf(_motdFile);
+		if (s_reloadRequested || stamp.seconds != _motdStamp.seconds ||
+			stamp.nanos != _motdStamp.nanos || stamp.size != _motdStamp.size)
+		{
+			s_reloadRequested = 0;
+			load(stamp);
+		}
+		_watchLock.lock();
+	}
+	_watchLock.unlock();
+}
+
+// Lines of the file cut to 79 characters, 500 of them at most, without the
+// bytes used as markers
+void Welcome::load(const Stamp& stamp)
+{
+	std::ifstream file(_motdFile.c_str());
+	std::string motd;
+	_motdStamp = stamp;
+	if (!file.is_open())
+	{
+		motd = defaultMotd();
+		_motdStamp.seconds = 0;
+		Print::Warn("missing file \"" + _motdFile + "\", default motd used");
+	}
+	else
+	{
+		motd = numeric(IRC::RPL_MOTDSTART, ":- server Message of the day -");
+		std::string line;
+		for (size_t i = 0; i < MOTD_LINES && std::getline(file, line); i++)
+		{
+			line = line.substr(0, MOTD_WIDTH);
+			line.erase(std::remove(line.begin(), line.end(), NICK_MARK), line.end());
+			line.erase(std::remove(line.begin(), line.end(), USER_MARK), line.end());
+			motd += numeric(IRC::RPL_MOTD, ":" + line);
+		}
+		motd += numeric(IRC::RPL_ENDOFMOTD, ":End of MOTD command.");
+		Print::Ok(_motdFile + " loaded");
+	}
+	SharedBuffer rendered(motd);
+	ScopedLock lock(_lock);
+	_motd = rendered;
+}
+
+void Welcome::splice(const std::string& text, const std::string& nick, const std::string& user,
+					 std::string& out)
+{
+	size_t start = 0;
+	size_t mark;
+	while ((mark = text.find_first_of("\x01\x02", start)) != std::string::npos)
+	{
+		out.append(text, start, mark - start);
+		out += (text[mark] == NICK_MARK) ? nick : user;
+		start = mark + 1;
+	}
+	out.append(text, start, std::string::npos);
+}
+
+std::string Welcome::burst(const std::string& nick, const std::string& user,
+						   const std::string& extra)
+{
+	SharedBuffer motd;
+	{
+		ScopedLock lock(_lock);
+		motd = _motd;
+	}
+	std::string out;
+	out.reserve(_header.size() + extra.size() + motd.str().size() + 64 * nick.size());
+	splice(_header, nick, user, out);
+	out += extra;
+	splice(motd.str(), nick, user, out);
+	return (out);
+}
+
+std::string Welcome::motd(const std::string& nick)
+{
+	SharedBuffer motd;
+	{
+		ScopedLock lock(_lock);
+		motd = _motd;
+	}
+	std::string out;
+	splice(motd.str(), nick, "", out);
+	return (out);
+}
+
+std::string Welcome::defaultMotd()
+{
+	static const char* lines[] = {
+		"+==============================================================+",
+		"|                   Welcome to ft_irc!                         |",
+		"|                                                              |",
+		"| ESSENTIAL COMMANDS                                           |",
+		"| /join #channel          - Join a channel                     |",
+		"| /msg nickname message   - Send private message               |",
+		"| /list                   - Show available channels            |",
+		"|                                                              |",
+		"| CHANNEL OPERATORS                                            |",
+		"| /topic #channel [topic] - View/set channel topic             |",
+		"| /mode #chan +/-o nick   - Give/take operator privilege       |",
+		"| /kick #chan nick [msg]  - Remove user from channel           |",
+		"| /invite nick #channel   - Invite user to channel             |",
+		"|                                                              |",
+		"+============ Created by hluiz, isilva-t & joao-pol ===========+",
+	};
+	std::string motd = numeric(IRC::RPL_MOTDSTART, ":- server Message of the day -");
+	for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++)
+	{
+		motd += numeric(IRC::RPL_MOTD, ":" + std::string(lines[i]));
+	}
+	motd += numeric(IRC::RPL_ENDOFMOTD, ":End of MOTD command.");
+	return (motd);
+}
@@ -6,6 +6,7 @@
 
 #include "Server.hpp"
 #include "UtilsFun.hpp"
+#include "Welcome.hpp"
 
 // Global server instance for signal handling
 Server* g_server = NULL;
@@ -18,6 +19,13 @@ void sigHandler(int signum)
 	g_shutdown_requested = true;
 }
 
+// SIGHUP: read motd.txt again
+void reloadHandler(int signum)
+{
+	(void)signum;
+	Welcome::requestReload();
+}
+
 int main(int argc, char* argv[])
 {
 	// Check command-line arguments
@@ -41,6 +49,7 @@ int main(int argc, char* argv[])
 	// Setup signal handlers for clean shutdown
 	signal(SIGINT, sigHandler);   // Ctrl+C
 	signal(SIGTERM, sigHandler);  // kill command
+	signal(SIGHUP, reloadHandler);
 
 	// Create and start server
 	Server server;
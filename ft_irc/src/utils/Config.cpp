@@ -62,4 +62,17 @@ std::string Config::getConfig(const std::string& wanted)
     return("");
 }
 
+// Numeric config value; fallback when missing or not a positive number
+int Config::getConfigInt(const std::string& wanted, int fallback)
+{
+	std::string value = getConfig(wanted);
+	if (value.empty() || value.length() > 9
+		|| value.find_first_not_of("0123456789") != std::string::npos)
+	{
+		return (fallback);
+	}
+	int result = toInt(value);
+	return (result > 0 ? result : fallback);
+}
+
 Config::Config() {}
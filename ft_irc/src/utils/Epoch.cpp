@@ -0,0 +1,208 @@
+#include <cstddef>
+
+#include "Epoch.hpp"
+
+// Retires between two reclamation attempts of a busy thread
+static const int COLLECT_EVERY = 64;
+
+unsigned long Epoch::s_epoch = 0;
+Epoch::Participant* Epoch::s_participants = NULL;
+Epoch::Retired* Epoch::s_orphans = NULL;
+__thread Epoch::Participant* Epoch::s_self = NULL;
+pthread_key_t Epoch::s_exitKey;
+pthread_once_t Epoch::s_keyOnce = PTHREAD_ONCE_INIT;
+
+Epoch::Guard::Guard() { Epoch::enter(); }
+
+Epoch::Guard::~Guard() { Epoch::leave(); }
+
+void Epoch::createKey() { pthread_key_create(&s_exitKey, &Epoch::threadExit); }
+
+// Record of the calling thread, taken from an exited thread when possible
+Epoch::Participant* Epoch::self()
+{
+	if (s_self)
+	{
+		return (s_self);
+	}
+	pthread_once(&s_keyOnce, &Epoch::createKey);
+
+	Participant* participant = __atomic_load_n(&s_participants, __ATOMIC_ACQUIRE);
+	for (; participant; participant = participant->next)
+	{
+		int free = 0;
+		if (__atomic_compare_exchange_n(&participant->inUse, &free, 1, false,
+										__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		{
+			break;
+		}
+	}
+	if (!participant)
+	{
+		participant = new Participant();
+		participant->state = 0;
+		participant->depth = 0;
+		participant->inUse = 1;
+		participant->limbo = NULL;
+		participant->limboCount = 0;
+		participant->next = __atomic_load_n(&s_participants, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&s_participants, &participant->next, participant,
+											false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		{
+		}
+	}
+	pthread_setspecific(s_exitKey, participant);
+	s_self = participant;
+	return (participant);
+}
+
+// A thread is going away: whatever it retired is left to the others
+void Epoch::threadExit(void* arg)
+{
+	Participant* participant = static_cast<Participant*>(arg);
+
+	if (participant->limbo)
+	{
+		Retired* tail = participant->limbo;
+		while (tail->next)
+		{
+			tail = tail->next;
+		}
+		tail->next = __atomic_load_n(&s_orphans, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&s_orphans, &tail->next, participant->limbo, false,
+											__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		{
+		}
+	}
+	participant->limbo = NULL;
+	participant->limboCount = 0;
+	participant->depth = 0;
+	__atomic_store_n(&participant->state, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&participant->inUse, 0, __ATOMIC_RELEASE);
+}
+
+// The epoch read here is announced before any shared pointer is loaded. If
+// the epoch moved in between, the stale announcement holds it back anyway.
+void Epoch::enter()
+{
+	Participant* participant = self();
+	if (participant->depth++ == 0)
+	{
+		unsigned long epoch = __atomic_load_n(&s_epoch, __ATOMIC_SEQ_CST);
+		__atomic_store_n(&participant->state, (epoch << 1) | 1, __ATOMIC_SEQ_CST);
+	}
+}
+
+void Epoch::leave()
+{
+	Participant* participant = s_self;
+	if (--participant->depth == 0)
+	{
+		__atomic_store_n(&participant->state, 0, __ATOMIC_RELEASE);
+	}
+}
+
+// Move the epoch on if every thread inside a guard has seen the current one
+void Epoch::tryAdvance()
+{
+	unsigned long epoch = __atomic_load_n(&s_epoch, __ATOMIC_SEQ_CST);
+	Participant* participant = __atomic_load_n(&s_participants, __ATOMIC_ACQUIRE);
+	for (; participant; participant = participant->next)
+	{
+		unsigned long state = __atomic_load_n(&participant->state, __ATOMIC_SEQ_CST);
+		if ((state & 1) && (state >> 1) != epoch)
+		{
+			return;
+		}
+	}
+	__atomic_compare_exchange_n(&s_epoch, &epoch, epoch + 1, false, __ATOMIC_SEQ_CST,
+								__ATOMIC_RELAXED);
+}
+
+// Free an object once no guard that could have seen it is left. The object
+// must already be unreachable from shared state.
+void Epoch::retire(void* object, void (*destroy)(void*))
+{
+	Participant* participant = self();
+	Retired* retired = new Retired();
+	retired->object = object;
+	retired->destroy = destroy;
+	// The unlink must be visible before the epoch is read
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	retired->epoch = __atomic_load_n(&s_epoch, __ATOMIC_SEQ_CST);
+	retired->next = participant->limbo;
+	participant->limbo = retired;
+	if (++participant->limboCount >= COLLECT_EVERY)
+	{
+		collect();
+	}
+}
+
+void Epoch::collect()
+{
+	Participant* participant = self();
+
+	if (__atomic_load_n(&s_orphans, __ATOMIC_RELAXED))
+	{
+		Retired* orphans = __atomic_exchange_n(&s_orphans, (Retired*)NULL, __ATOMIC_ACQUIRE);
+		while (orphans)
+		{
+			Retired* next = orphans->next;
+			orphans->next = participant->limbo;
+			participant->limbo = orphans;
+			participant->limboCount++;
+			orphans = next;
+		}
+	}
+	if (!participant->limbo)
+	{
+		return;
+	}
+
+	tryAdvance();
+	unsigned long epoch = __atomic_load_n(&s_epoch, __ATOMIC_SEQ_CST);
+	// Unlink first: a destructor may retire more objects
+	Retired* expired = NULL;
+	Retired** link = &participant->limbo;
+	while (*link)
+	{
+		Retired* retired = *link;
+		if (retired->epoch + 2 <= epoch)
+		{
+			*link = retired->next;
+			retired->next = expired;
+			expired = retired;
+			participant->limboCount--;
+		}
+		else
+		{
+			link = &retired->next;
+		}
+	}
+	destroyAll(expired);
+}
+
+void Epoch::destroyAll(Retired* list)
+{
+	while (list)
+	{
+		Retired* next = list->next;
+		list->destroy(list->object);
+		delete list;
+		list = next;
+	}
+}
+
+// Shutdown: the calling thread must be the last one using epochs
+void Epoch::drain()
+{
+	Participant* participant = __atomic_load_n(&s_participants, __ATOMIC_ACQUIRE);
+	for (; participant; participant = participant->next)
+	{
+		Retired* limbo = participant->limbo;
+		participant->limbo = NULL;
+		participant->limboCount = 0;
+		destroyAll(limbo);
+	}
+	destroyAll(__atomic_exchange_n(&s_orphans, (Retired*)NULL, __ATOMIC_ACQUIRE));
+}
@@ -27,7 +27,8 @@ HTTPClient::~HTTPClient()
 }
 
 // Private copy constructor and assignment operator
-HTTPClient::HTTPClient(const HTTPClient& other) : _socket(other._socket), _success(false), _timeout(5)
+HTTPClient::HTTPClient(const HTTPClient& other)
+	: _socket(), _success(false), _timeout(other._timeout)
 {
 	_lastError.clear();
 }
@@ -36,8 +37,8 @@ HTTPClient& HTTPClient::operator=(const HTTPClient& other)
 {
 	if (this != &other)
 	{
+		// Sockets are not copyable, the copy opens its own connection
 		cleanup();
-		_socket = other._socket;
 		_success = false;
 		_timeout = other._timeout;
 		_lastError.clear();
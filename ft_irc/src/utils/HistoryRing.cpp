@@ -0,0 +1,153 @@
+#include <sys/time.h>
+
+#include "HistoryRing.hpp"
+
+static const size_t FIRST_ARENA = 512;
+
+size_t HistoryRing::s_maxLines = 50;
+size_t HistoryRing::s_maxBytes = 8192;
+
+HistoryRing::HistoryRing() : _first(0), _count(0), _head(0) {}
+
+HistoryRing::HistoryRing(const HistoryRing& other)
+	: _arena(other._arena),
+	  _slots(other._slots),
+	  _first(other._first),
+	  _count(other._count),
+	  _head(other._head)
+{
+}
+
+HistoryRing& HistoryRing::operator=(const HistoryRing& other)
+{
+	if (this != &other)
+	{
+		_arena = other._arena;
+		_slots = other._slots;
+		_first = other._first;
+		_count = other._count;
+		_head = other._head;
+	}
+	return (*this);
+}
+
+HistoryRing::~HistoryRing() {}
+
+const HistoryRing::Slot& HistoryRing::slot(size_t i) const
+{
+	return (_slots[(_first + i) % _slots.size()]);
+}
+
+void HistoryRing::evictFront()
+{
+	_first = (_first + 1) % _slots.size();
+	if (--_count == 0)
+	{
+		_head = 0;
+	}
+}
+
+// Lines longer than the whole arena are not kept
+void HistoryRing::push(const std::string& text, unsigned long time)
+{
+	size_t length = text.length();
+	if (s_maxLines == 0 || length == 0 || length > s_maxBytes)
+	{
+		return;
+	}
+	if (_slots.empty())
+	{
+		_slots.resize(s_maxLines);
+	}
+	if (_head + length > _arena.size())
+	{
+		if (_arena.size() < s_maxBytes)
+		{
+			// Grow while nothing has wrapped yet: every offset stays valid
+			size_t grown = _arena.empty() ? FIRST_ARENA : _arena.size() * 2;
+			if (grown < _head + length)
+			{
+				grown = _head + length;
+			}
+			_arena.resize(grown < s_maxBytes ? grown : s_maxBytes);
+		}
+		if (_head + length > _arena.size())
+		{
+			// Wrap: the lines left at the end are the oldest, they go first
+			while (_count > 0 && slot(0).offset >= _head)
+			{
+				evictFront();
+			}
+			_head = 0;
+		}
+	}
+	while (_count > 0 && (_count == _slots.size() ||
+						  (slot(0).offset < _head + length &&
+						   slot(0).offset + slot(0).length > _head)))
+	{
+		evictFront();
+	}
+	text.copy(&_arena[_head], length);
+	Slot& last = _slots[(_first + _count) % _slots.size()];
+	last.offset = _head;
+	last.length = length;
+	last.time = time;
+	_count++;
+	_head += length;
+}
+
+void HistoryRing::find(unsigned long after, unsigned long before, size_t limit, bool newest,
+					   std::vector<Line>& out) const
+{
+	size_t first = 0;
+	size_t last = _count;
+	while (first < last && slot(first).time <= after)
+	{
+		first++;
+	}
+	while (last > first && before != 0 && slot(last - 1).time >= before)
+	{
+		last--;
+	}
+	if (last - first > limit)
+	{
+		if (newest)
+		{
+			first = last - limit;
+		}
+		else
+		{
+			last = first + limit;
+		}
+	}
+	for (size_t i = first; i < last; i++)
+	{
+		Line line;
+		line.time = slot(i).time;
+		line.text.assign(&_arena[slot(i).offset], slot(i).length);
+		out.push_back(line);
+	}
+}
+
+size_t HistoryRing::size() const { return (_count); }
+
+unsigned long HistoryRing::oldest() const { return (_count > 0 ? slot(0).time : 0); }
+
+size_t HistoryRing::bytes() const { return (_arena.size()); }
+
+void HistoryRing::setLimits(size_t lines, size_t bytes)
+{
+	s_maxLines = lines;
+	s_maxBytes = bytes;
+}
+
+size_t HistoryRing::maxLines() { return (s_maxLines); }
+
+bool HistoryRing::isEnabled() { return (s_maxLines > 0 && s_maxBytes > 0); }
+
+unsigned long HistoryRing::now()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (static_cast<unsigned long>(tv.tv_sec) * 1000 + tv.tv_usec / 1000);
+}
@@ -0,0 +1,47 @@
+#include <sys/time.h>
+
+#include "Mutex.hpp"
+
+Mutex::Mutex(bool recursive)
+{
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	if (recursive)
+	{
+		pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	}
+	pthread_mutex_init(&_mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+Mutex::~Mutex() { pthread_mutex_destroy(&_mutex); }
+
+void Mutex::lock() { pthread_mutex_lock(&_mutex); }
+
+void Mutex::unlock() { pthread_mutex_unlock(&_mutex); }
+
+ScopedLock::ScopedLock(Mutex& mutex) : _mutex(mutex) { _mutex.lock(); }
+
+ScopedLock::~ScopedLock() { _mutex.unlock(); }
+
+Condition::Condition() { pthread_cond_init(&_cond, NULL); }
+
+Condition::~Condition() { pthread_cond_destroy(&_cond); }
+
+void Condition::wait(Mutex& mutex) { pthread_cond_wait(&_cond, &mutex._mutex); }
+
+void Condition::wait(Mutex& mutex, int ms)
+{
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	long nanos = now.tv_usec * 1000L + (ms % 1000) * 1000000L;
+	struct timespec until;
+	until.tv_sec = now.tv_sec + ms / 1000 + nanos / 1000000000L;
+	until.tv_nsec = nanos % 1000000000L;
+	pthread_cond_timedwait(&_cond, &mutex._mutex, &until);
+}
+
+void Condition::signal() { pthread_cond_signal(&_cond); }
+
+void Condition::broadcast() { pthread_cond_broadcast(&_cond); }
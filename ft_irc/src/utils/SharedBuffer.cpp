@@ -0,0 +1,47 @@
+#include "SharedBuffer.hpp"
+
+static const std::string g_empty;
+
+SharedBuffer::SharedBuffer() : _block(NULL) {}
+
+SharedBuffer::SharedBuffer(const std::string& data) : _block(new Block())
+{
+	_block->refs = 1;
+	_block->data = data;
+}
+
+SharedBuffer::SharedBuffer(const SharedBuffer& other) : _block(other._block)
+{
+	if (_block)
+	{
+		__atomic_add_fetch(&_block->refs, 1, __ATOMIC_RELAXED);
+	}
+}
+
+SharedBuffer& SharedBuffer::operator=(const SharedBuffer& other)
+{
+	if (_block != other._block)
+	{
+		if (other._block)
+		{
+			__atomic_add_fetch(&other._block->refs, 1, __ATOMIC_RELAXED);
+		}
+		release();
+		_block = other._block;
+	}
+	return (*this);
+}
+
+SharedBuffer::~SharedBuffer() { release(); }
+
+// The last owner frees the block, after every other owner is done reading
+void SharedBuffer::release()
+{
+	if (_block && __atomic_sub_fetch(&_block->refs, 1, __ATOMIC_ACQ_REL) == 0)
+	{
+		delete _block;
+	}
+	_block = NULL;
+}
+
+const std::string& SharedBuffer::str() const { return (_block ? _block->data : g_empty); }
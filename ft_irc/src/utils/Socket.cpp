@@ -10,39 +10,10 @@ Socket::Socket(int domain, int type, int protocol)
 	create(domain, type, protocol);
 }
 
-Socket::Socket(const Socket& other) : _fd(-1), _lastError(0), _blocking(true), _addr()
+// Adopt an fd that is already open (e.g. returned by accept())
+Socket::Socket(int fd, bool blocking)
+	: _fd(fd), _lastError(0), _blocking(blocking), _addr()
 {
-	*this = other;
-}
-
-Socket& Socket::operator=(const Socket& other)
-{
-	if (this != &other)
-	{
-		if (isValid())
-		{
-			::close(_fd);
-		}
-		// Only copy the socket if its invalid, otherwise create a new one
-		if (other.isValid())
-		{
-			_blocking = other._blocking;
-			_addr = other._addr;
-			create(AF_INET, SOCK_STREAM, 0);
-			if (!_blocking)
-			{
-				setNonBlocking();
-			}
-		}
-		else
-		{
-			_fd = -1;
-			_blocking = other._blocking;
-			_addr = other._addr;
-		}
-		_lastError = other._lastError;
-	}
-	return (*this);
 }
 
 Socket::~Socket()
@@ -173,30 +144,33 @@ bool Socket::listen(int backlog)
 	return (result != -1);
 }
 
-// Accept a connection
-Socket Socket::accept()
+// Accept a connection. The new fd inherits the listener's blocking mode and
+// is close-on-exec, set atomically by accept4() where it is available.
+int Socket::accept()
 {
-	Socket newSocket;
-
 	if (!isValid())
 	{
-		return (newSocket);
+		_lastError = EBADF;
+		return (-1);
 	}
-	sockaddr_in clientAddr;
-	socklen_t clientAddrLen = sizeof(clientAddr);
 
-	int clientFd = ::accept(_fd, (struct sockaddr*)&clientAddr, &clientAddrLen);
+#ifdef SOCK_NONBLOCK
+	int flags = SOCK_CLOEXEC | (_blocking ? 0 : SOCK_NONBLOCK);
+	int clientFd = ::accept4(_fd, NULL, NULL, flags);
+	_lastError = errno;
+#else
+	int clientFd = ::accept(_fd, NULL, NULL);
 	_lastError = errno;
 	if (clientFd >= 0)
 	{
-		newSocket._fd = clientFd;
-		newSocket._addr = clientAddr;
+		fcntl(clientFd, F_SETFD, FD_CLOEXEC);
 		if (!_blocking)
 		{
-			newSocket.setNonBlocking();
+			fcntl(clientFd, F_SETFL, fcntl(clientFd, F_GETFL, 0) | O_NONBLOCK);
 		}
 	}
-	return (newSocket);
+#endif
+	return (clientFd);
 }
 
 // Connect to a remote host
@@ -276,5 +250,23 @@ void Socket::close()
 	}
 }
 
+// Give up ownership of the fd, the caller becomes responsible for closing it
+int Socket::release()
+{
+	int fd = _fd;
+	_fd = -1;
+	return (fd);
+}
+
+// Take ownership of an fd opened elsewhere (e.g. received from another process)
+void Socket::adopt(int fd)
+{
+	close();
+	_fd = fd;
+	_blocking = (fcntl(fd, F_GETFL) & O_NONBLOCK) == 0;
+}
+
 // Get last error message
 std::string Socket::getLastError() const { return (std::string(strerror(_lastError))); }
+
+int Socket::getLastErrno() const { return (_lastError); }
@@ -0,0 +1,86 @@
+#include <time.h>
+
+#include "TokenBucket.hpp"
+
+TokenBucket::TokenBucket(double capacity, double refillRate)
+	: _capacity(capacity),
+	  _refillRate(refillRate),
+	  _tokens(capacity),
+	  _lastRefill(now())
+{
+}
+
+TokenBucket::TokenBucket(const TokenBucket& other)
+	: _capacity(other._capacity),
+	  _refillRate(other._refillRate),
+	  _tokens(other._tokens),
+	  _lastRefill(other._lastRefill)
+{
+}
+
+TokenBucket& TokenBucket::operator=(const TokenBucket& other)
+{
+	if (this != &other)
+	{
+		_capacity = other._capacity;
+		_refillRate = other._refillRate;
+		_tokens = other._tokens;
+		_lastRefill = other._lastRefill;
+	}
+	return (*this);
+}
+
+TokenBucket::~TokenBucket() {}
+
+// Add the tokens earned since the last refill, capped at capacity
+void TokenBucket::refill()
+{
+	double current = now();
+	double elapsed = current - _lastRefill;
+
+	_lastRefill = current;
+	if (elapsed <= 0)
+	{
+		return;
+	}
+	_tokens += elapsed * _refillRate;
+	if (_tokens > _capacity)
+	{
+		_tokens = _capacity;
+	}
+}
+
+// Take `cost` tokens if available; leaves the bucket untouched otherwise
+bool TokenBucket::consume(double cost)
+{
+	refill();
+	if (_tokens < cost)
+	{
+		return (false);
+	}
+	_tokens -= cost;
+	return (true);
+}
+
+double TokenBucket::getTokens() const { return (_tokens); }
+
+double TokenBucket::getCapacity() const { return (_capacity); }
+
+bool TokenBucket::isFull() const { return (_tokens >= _capacity); }
+
+double TokenBucket::secondsUntil(double wanted) const
+{
+	if (_tokens >= wanted || _refillRate <= 0)
+	{
+		return (0);
+	}
+	return ((wanted - _tokens) / _refillRate);
+}
+
+double TokenBucket::now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
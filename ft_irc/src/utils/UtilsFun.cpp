@@ -32,7 +32,8 @@ void Print::Stream(std::ofstream& os, const std::string& str) { os << str << std
 void    Print::Timestamp(const std::string& color)
 {
 	std::time_t	current_time_in_seconds = std::time(NULL);
-	std::tm		*time_struct = std::localtime(&current_time_in_seconds);
+	std::tm		time_buffer;
+	std::tm		*time_struct = localtime_r(&current_time_in_seconds, &time_buffer);
 	char originalFill = std::cout.fill();
 	std::cout << color
 		<< "[" 
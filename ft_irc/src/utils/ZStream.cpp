@@ -0,0 +1,65 @@
+#include "ZStream.hpp"
+
+#include <cstring>
+
+ZStream::ZStream(Mode mode, int level) : _mode(mode), _ok(false)
+{
+	std::memset(&_stream, 0, sizeof(_stream));
+	if (_mode == DEFLATE)
+	{
+		_ok = (deflateInit(&_stream, level) == Z_OK);
+	}
+	else
+	{
+		_ok = (inflateInit(&_stream) == Z_OK);
+	}
+}
+
+ZStream::~ZStream()
+{
+	if (!_ok)
+	{
+		return;
+	}
+	if (_mode == DEFLATE)
+	{
+		deflateEnd(&_stream);
+	}
+	else
+	{
+		inflateEnd(&_stream);
+	}
+}
+
+// Run all of data through the stream. The output goes through a fixed
+// chunk, so a small frame that inflates to a whole burst needs no guess of
+// its size.
+bool ZStream::process(const char* data, size_t length, std::string& out)
+{
+	char chunk[16384];
+
+	if (!_ok)
+	{
+		return (false);
+	}
+	_stream.next_in = (Bytef*)data;
+	_stream.avail_in = length;
+	do
+	{
+		_stream.next_out = (Bytef*)chunk;
+		_stream.avail_out = sizeof(chunk);
+		int status = (_mode == DEFLATE ? deflate(&_stream, Z_SYNC_FLUSH)
+									   : inflate(&_stream, Z_SYNC_FLUSH));
+		if (status == Z_BUF_ERROR)
+		{
+			break;  // no progress left to make, everything is out
+		}
+		if (status != Z_OK)
+		{
+			_ok = false;
+			return (false);
+		}
+		out.append(chunk, sizeof(chunk) - _stream.avail_out);
+	} while (_stream.avail_out == 0 || _stream.avail_in > 0);
+	return (true);
+}
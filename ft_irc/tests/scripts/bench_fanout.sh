@@ -0,0 +1,107 @@
+#!/bin/bash
+
+# Colors
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+IRC_PORT=6673
+IRC_PASSWORD="testpass123"
+SERVER_PID=""
+TEST_DIR="tests/load_logs"
+FANOUTBENCH="${FANOUTBENCH:-obj/fanoutbench}"
+FANOUT_SIZES="${FANOUT_SIZES:-128 256 512 1024 2048}"   # channel sizes to compare
+FANOUT_MESSAGES="${FANOUT_MESSAGES:-200}"               # lines sent per run
+FANOUT_THREADS="${FANOUT_THREADS:-$(nproc)}"
+
+log_info() { echo -e "${BLUE}[INFO]${NC} $1"; }
+log_success() { echo -e "${GREEN}[PASS]${NC} $1"; }
+log_error() { echo -e "${RED}[FAIL]${NC} $1"; }
+log_warning() { echo -e "${YELLOW}[WARN]${NC} $1"; }
+
+# The server runs from TEST_DIR with the fan-out settings of the run.
+# threshold 1 sends every channel through the pool, 0 threads keeps it inline.
+start_server() {
+    local threads=$1
+    {
+        echo "flood_burst=1000000"
+        echo "flood_rate=1000000"
+        echo "sendq_bytes=67108864"
+        echo "fanout_threads=$threads"
+        echo "fanout_threshold=1"
+    } > "$TEST_DIR/config.txt"
+    (
+        cd "$TEST_DIR" && exec ../../ircserv $IRC_PORT $IRC_PASSWORD > server.log 2>&1
+    ) &
+    SERVER_PID=$!
+    sleep 1
+    kill -0 $SERVER_PID 2>/dev/null
+}
+
+stop_server() {
+    if [ ! -z "$SERVER_PID" ]; then
+        kill -TERM $SERVER_PID 2>/dev/null
+        sleep 1
+        if kill -0 $SERVER_PID 2>/dev/null; then
+            kill -KILL $SERVER_PID 2>/dev/null
+        fi
+        wait $SERVER_PID 2>/dev/null
+        SERVER_PID=""
+    fi
+}
+
+# Prints the elapsed milliseconds of one run
+run_once() {
+    local threads=$1
+    local members=$2
+    if ! start_server $threads; then
+        log_error "Failed to start server"
+        return 1
+    fi
+    "$FANOUTBENCH" $IRC_PORT $IRC_PASSWORD $members $FANOUT_MESSAGES \
+        >> "$TEST_DIR/fanoutbench.log" 2>&1
+    local status=$?
+    stop_server
+    if [ $status -ne 0 ]; then
+        return 1
+    fi
+    tail -n 1 "$TEST_DIR/fanoutbench.log" | sed 's/.* in \([0-9.]*\) ms.*/\1/'
+}
+
+main() {
+    log_info "Fan-out benchmark: $FANOUT_MESSAGES lines, pool of $FANOUT_THREADS thread(s)"
+    if [ ! -x "$FANOUTBENCH" ]; then
+        log_error "Benchmark not found at $FANOUTBENCH (run make bench-fanout)"
+        exit 1
+    fi
+    mkdir -p "$TEST_DIR"
+    rm -f "$TEST_DIR/fanoutbench.log"
+    trap 'stop_server' EXIT
+
+    local crossover=""
+    printf "%10s %12s %12s %8s\n" "members" "inline ms" "pool ms" "speedup"
+    for members in $FANOUT_SIZES; do
+        local inline=$(run_once 0 $members)
+        local pooled=$(run_once $FANOUT_THREADS $members)
+        if [ -z "$inline" ] || [ -z "$pooled" ]; then
+            log_error "Run with $members members failed, see $TEST_DIR/fanoutbench.log"
+            exit 1
+        fi
+        local speedup=$(awk "BEGIN { printf \"%.2f\", $inline / $pooled }")
+        printf "%10s %12s %12s %8s\n" $members $inline $pooled $speedup
+        if [ -z "$crossover" ] && awk "BEGIN { exit !($pooled < $inline) }"; then
+            crossover=$members
+        fi
+    done
+
+    if [ -n "$crossover" ]; then
+        log_success "Parallel fan-out wins from $crossover members on (set fanout_threshold near it)"
+    else
+        log_warning "Parallel fan-out did not win at these sizes on this machine"
+    fi
+    exit 0
+}
+
+main "$@"
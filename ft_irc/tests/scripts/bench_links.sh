@@ -0,0 +1,106 @@
+#!/bin/bash
+
+# Colors
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+IRC_PORT=6673
+IRC_PASSWORD="testpass123"
+LINK_PASSWORD="linkpass"
+SERVER_PID=""
+TEST_DIR="tests/link_logs"
+LINKBENCH="${LINKBENCH:-obj/linkbench}"
+LINK_USERS="${LINK_USERS:-250 500 1000 2000 4000}"   # users on the server per run
+LINK_CHANNELS_PER="${LINK_CHANNELS_PER:-10}"         # users per channel
+LINK_LEVEL="${LINK_LEVEL:-6}"                        # link_compress of the compressed runs
+
+log_info() { echo -e "${BLUE}[INFO]${NC} $1"; }
+log_success() { echo -e "${GREEN}[PASS]${NC} $1"; }
+log_error() { echo -e "${RED}[FAIL]${NC} $1"; }
+log_warning() { echo -e "${YELLOW}[WARN]${NC} $1"; }
+
+# The server runs from TEST_DIR/bench, compressing its links at the level
+# of the run (0 sends plain lines)
+start_server() {
+    local level=$1
+    mkdir -p "$TEST_DIR/bench"
+    {
+        echo "server_name=alpha"
+        echo "link_password=$LINK_PASSWORD"
+        echo "link_compress=$level"
+        echo "flood_burst=1000000"
+        echo "flood_rate=1000000"
+    } > "$TEST_DIR/bench/config.txt"
+    (
+        cd "$TEST_DIR/bench" && exec ../../../ircserv $IRC_PORT $IRC_PASSWORD > server.log 2>&1
+    ) &
+    SERVER_PID=$!
+    sleep 1
+    kill -0 $SERVER_PID 2>/dev/null
+}
+
+stop_server() {
+    if [ ! -z "$SERVER_PID" ]; then
+        kill -TERM $SERVER_PID 2>/dev/null
+        sleep 1
+        if kill -0 $SERVER_PID 2>/dev/null; then
+            kill -KILL $SERVER_PID 2>/dev/null
+        fi
+        wait $SERVER_PID 2>/dev/null
+        SERVER_PID=""
+    fi
+}
+
+# Prints "<ms> <bytes> <frames> <reads>" of one burst
+run_once() {
+    local level=$1
+    local users=$2
+    local channels=$(( (users + LINK_CHANNELS_PER - 1) / LINK_CHANNELS_PER ))
+    if ! start_server $level; then
+        log_error "Failed to start server"
+        return 1
+    fi
+    "$LINKBENCH" $IRC_PORT $IRC_PASSWORD $LINK_PASSWORD $users $channels \
+        >> "$TEST_DIR/linkbench.log" 2>&1
+    local status=$?
+    stop_server
+    if [ $status -ne 0 ]; then
+        return 1
+    fi
+    tail -n 1 "$TEST_DIR/linkbench.log" |
+        sed 's/.*, \([0-9]*\) bytes in \([0-9]*\) frame(s) and \([0-9]*\) read(s) in \([0-9.]*\) ms.*/\4 \1 \2 \3/'
+}
+
+main() {
+    log_info "Link burst benchmark: $LINK_CHANNELS_PER users per channel, zlib level $LINK_LEVEL"
+    if [ ! -x "$LINKBENCH" ]; then
+        log_error "Benchmark not found at $LINKBENCH (run make bench-links)"
+        exit 1
+    fi
+    mkdir -p "$TEST_DIR"
+    rm -f "$TEST_DIR/linkbench.log"
+    trap 'stop_server' EXIT
+
+    printf "%8s %10s %10s %7s %10s %10s %7s %7s %7s\n" "users" "plain ms" "plain KB" "reads" \
+        "zlib ms" "zlib KB" "frames" "reads" "ratio"
+    for users in $LINK_USERS; do
+        local plain=($(run_once 0 $users))
+        local zlib=($(run_once $LINK_LEVEL $users))
+        if [ ${#plain[@]} -ne 4 ] || [ ${#zlib[@]} -ne 4 ]; then
+            log_error "Run with $users users failed, see $TEST_DIR/linkbench.log"
+            exit 1
+        fi
+        local ratio=$(awk "BEGIN { printf \"%.1f\", ${plain[1]} / ${zlib[1]} }")
+        printf "%8s %10s %10s %7s %10s %10s %7s %7s %7s\n" $users ${plain[0]} \
+            $(( plain[1] / 1024 )) ${plain[3]} ${zlib[0]} $(( zlib[1] / 1024 )) ${zlib[2]} \
+            ${zlib[3]} "${ratio}x"
+    done
+
+    log_success "Link burst benchmark completed"
+    exit 0
+}
+
+main "$@"
@@ -0,0 +1,95 @@
+#!/bin/bash
+
+# Fixture shared by the server test scripts. Source it after setting
+# TEST_DIR and IRC_PASSWORD, and IRC_PORT for the scripts talking to a
+# single server: the helpers use it when no port is given.
+
+# Colors
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+TESTS_PASSED=0
+TESTS_FAILED=0
+
+log_info() { echo -e "${BLUE}[INFO]${NC} $1"; }
+log_success() { echo -e "${GREEN}[PASS]${NC} $1"; ((TESTS_PASSED++)); }
+log_error() { echo -e "${RED}[FAIL]${NC} $1"; ((TESTS_FAILED++)); }
+log_warning() { echo -e "${YELLOW}[WARN]${NC} $1"; }
+
+# Open a connection on fd $1, everything it receives goes to the log $2.
+# The reader keeps no other connection open, so closing one closes it.
+open_connection() {
+    local fd="$1" log="$2" port="${3:-$IRC_PORT}"
+    eval "exec $fd<>/dev/tcp/127.0.0.1/$port" || return 1
+    cat <&$fd 3>&- 4>&- 5>&- 6>&- 7>&- 8>&- 9>&- > "$TEST_DIR/$log.log" &
+    READER_PID=$!
+}
+
+# Open a registered client on fd $1, logged under its nick
+open_client() {
+    local fd="$1" nick="$2" port="${3:-$IRC_PORT}"
+    open_connection $fd $nick $port || return 1
+    printf "PASS %s\r\nNICK %s\r\nUSER %s 0 * :%s\r\n" $IRC_PASSWORD $nick $nick $nick >&$fd
+}
+
+# Drop the connection on fd $1, read by $2, without a QUIT
+drop_connection() {
+    kill $2 2>/dev/null
+    eval "exec $1>&-"
+    sleep 0.5
+}
+
+send_line() {
+    printf "%s\r\n" "$2" >&$1
+    sleep 0.3
+}
+
+# A client that only lives for one exchange: registers as $3 on port $2,
+# sends the other arguments and logs everything it gets as $1
+one_shot_logged() {
+    local log="$1" port="$2" nick="$3"
+    shift 3
+    (
+        printf "PASS %s\r\nNICK %s\r\nUSER %s 0 * :%s\r\n" $IRC_PASSWORD $nick $nick $nick
+        for cmd in "$@"; do
+            printf "%s\r\n" "$cmd"
+            sleep 0.3
+        done
+        sleep 1
+    ) | timeout ${ONE_SHOT_TIMEOUT:-3} bash -c "exec 5<>/dev/tcp/127.0.0.1/$port; cat <&6 >&5 & exec cat <&5" 6<&0 \
+        > "$TEST_DIR/$log.log" 2>&1
+}
+
+one_shot() {
+    local nick="$1"
+    shift
+    one_shot_logged $nick $IRC_PORT $nick "$@"
+}
+
+# Same on the server of port $1, logged as <nick>-<port>
+one_shot_on() {
+    local port="$1" nick="$2"
+    shift 2
+    one_shot_logged $nick-$port $port $nick "$@"
+}
+
+expect_log() {
+    local log="$1" pattern="$2" what="$3"
+    if grep -q -- "$pattern" "$TEST_DIR/$log.log"; then
+        log_success "$what"
+    else
+        log_error "$what (no '$pattern' in $log.log)"
+    fi
+}
+
+reject_log() {
+    local log="$1" pattern="$2" what="$3"
+    if grep -q -- "$pattern" "$TEST_DIR/$log.log"; then
+        log_error "$what ('$pattern' in $log.log)"
+    else
+        log_success "$what"
+    fi
+}
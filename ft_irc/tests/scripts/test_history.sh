@@ -0,0 +1,152 @@
+#!/bin/bash
+
+IRC_PORT=6678
+IRC_PASSWORD="testpass123"
+TEST_DIR="tests/history_logs"
+SERVER_PID=""
+
+. "$(dirname "$0")/lib_irc.sh"
+
+# Five lines kept per channel, the last three played on JOIN, everything in
+# small log segments. The upgrade socket lets a second generation take the
+# history over.
+start_generation() {
+    local n="$1"
+    mkdir -p "$TEST_DIR/server"
+    printf "history_lines=5\nhistory_join=3\nupgrade_socket=upgrade.sock\n" > "$TEST_DIR/server/config.txt"
+    printf "log_dir=log\nlog_segment_bytes=256\nlog_index_bytes=64\n" >> "$TEST_DIR/server/config.txt"
+    cp motd.txt "$TEST_DIR/server/" 2>/dev/null
+    (cd "$TEST_DIR/server" && exec ../../../ircserv $IRC_PORT $IRC_PASSWORD > server$n.log 2>&1) &
+    local pid=$!
+    sleep 1.5
+
+    if kill -0 $pid 2>/dev/null; then
+        log_success "Server generation $n started (PID: $pid)"
+        SERVER_PID=$pid
+        return 0
+    fi
+    log_error "Failed to start server generation $n"
+    return 1
+}
+
+stop_server() {
+    log_info "Stopping server..."
+    kill -TERM $SERVER_PID 2>/dev/null
+    sleep 1
+    kill -KILL $SERVER_PID 2>/dev/null
+    wait $SERVER_PID 2>/dev/null
+    exec 3>&- 4>&- 5>&- 6>&- 2>/dev/null
+}
+
+test_join_playback() {
+    log_info ">>> Playback on JOIN"
+    open_client 3 alice
+    sleep 0.5
+    send_line 3 "JOIN #talk"
+    for i in 1 2 3 4 5 6; do
+        printf "PRIVMSG #talk :message %s\r\n" $i >&3
+    done
+    send_line 3 "NOTICE #talk :a notice"
+
+    open_client 4 bob
+    sleep 0.5
+    send_line 4 "JOIN #talk"
+    expect_log bob "PRIVMSG #talk :message 5" "Recent messages played on JOIN"
+    expect_log bob "NOTICE #talk :a notice" "Notices kept too"
+    reject_log bob "message 4" "Only history_join lines played"
+}
+
+test_chathistory() {
+    log_info ">>> CHATHISTORY"
+    open_client 5 carol
+    sleep 0.5
+    send_line 5 "CAP LS"
+    expect_log carol "CAP \* LS :batch server-time draft/chathistory" "Capabilities offered"
+    send_line 5 "CAP REQ :batch server-time"
+    expect_log carol "CAP \* ACK :batch server-time" "Capabilities taken"
+    send_line 5 "CHATHISTORY LATEST #talk * 10"
+    expect_log carol "FAIL CHATHISTORY INVALID_TARGET" "No history of a channel not joined"
+    send_line 5 "JOIN #talk"
+    send_line 5 "CHATHISTORY LATEST #talk * 10"
+    expect_log carol "BATCH +[^ ]* chathistory #talk" "History sent as a batch"
+    expect_log carol "@batch=[^;]*;time=[0-9-]*T[0-9:.]*Z :alice![^ ]* PRIVMSG #talk :message 3" \
+        "Lines tagged with the batch and their time"
+    reject_log carol "message 2" "Ring bounded to history_lines"
+    send_line 5 "CHATHISTORY BEFORE #talk timestamp=2000-01-01T00:00:00.000Z 10"
+    if [ "$(grep -c 'PRIVMSG #talk :message 3' "$TEST_DIR/carol.log")" -eq 1 ]; then
+        log_success "BEFORE bounded by the timestamp"
+    else
+        log_error "BEFORE bounded by the timestamp"
+    fi
+}
+
+test_message_log() {
+    log_info ">>> Message log"
+    send_line 5 "CHATHISTORY AFTER #talk timestamp=2000-01-01T00:00:00.000Z 2"
+    expect_log carol "time=.*PRIVMSG #talk :message 1" "Lines older than the ring read from the log"
+    local segments
+    segments=$(ls "$TEST_DIR/server/log/%23talk/" 2>/dev/null | grep -c '\.log$')
+    if [ "$segments" -ge 2 ]; then
+        log_success "Log split into $segments segments"
+    else
+        log_error "Log split into segments ($segments found)"
+    fi
+    send_line 5 "SEARCH #talk :MESSAGE 2"
+    expect_log carol "NOTICE carol :#talk [0-9-]*T[0-9:.]*Z <alice> message 2" "SEARCH finds the line with its time"
+    expect_log carol "End of SEARCH #talk, 1 line" "SEARCH needs every word"
+}
+
+test_upgrade_keeps_history() {
+    log_info ">>> History across an upgrade"
+    local old=$SERVER_PID
+    send_line 3 "PRIVMSG #talk :said before the upgrade"
+    start_generation 2 || return
+    sleep 0.5
+    wait $old 2>/dev/null
+    send_line 5 "CHATHISTORY LATEST #talk * 1"
+    expect_log carol "time=.*PRIVMSG #talk :said before the upgrade" \
+        "History and capabilities kept by the upgrade"
+}
+
+test_restart_reads_log() {
+    log_info ">>> History across a restart"
+    stop_server
+    start_generation 3 || return
+    open_client 6 dave
+    sleep 0.5
+    send_line 6 "JOIN #talk"
+    send_line 6 "CHATHISTORY LATEST #talk * 2"
+    expect_log dave "PRIVMSG #talk :said before the upgrade" "History read back from the log after a restart"
+    send_line 6 "SEARCH #talk upgrade"
+    expect_log dave "<alice> said before the upgrade" "Search index rebuilt from the log"
+}
+
+main() {
+    log_info "Starting Channel History Tests"
+    log_info "=============================="
+
+    rm -rf "$TEST_DIR"
+    mkdir -p "$TEST_DIR"
+    if ! start_generation 1; then
+        exit 1
+    fi
+    trap 'stop_server' EXIT
+
+    test_join_playback
+    test_chathistory
+    test_message_log
+    test_upgrade_keeps_history
+    test_restart_reads_log
+
+    log_info "=============================="
+    log_success "Passed: $TESTS_PASSED"
+    if [ $TESTS_FAILED -gt 0 ]; then
+        log_error "Failed: $TESTS_FAILED"
+        log_info "Logs available in: $TEST_DIR/"
+        exit 1
+    fi
+    log_success "All channel history tests completed! 🎉"
+    exit 0
+}
+
+main "$@"
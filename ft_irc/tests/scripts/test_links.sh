@@ -0,0 +1,119 @@
+#!/bin/bash
+
+IRC_PASSWORD="testpass123"
+LINK_PASSWORD="linkpass"
+TEST_DIR="tests/link_logs"
+ALPHA_PORT=6673
+BETA_PORT=6674
+GAMMA_PORT=6675
+SERVER_PIDS=()
+
+. "$(dirname "$0")/lib_irc.sh"
+
+# Three servers in a chain, alpha <- beta <- gamma: each one runs from its
+# own directory with a config.txt naming it and the server it dials.
+# beta compresses what it sends, the others send plain lines.
+start_node() {
+    local name="$1" port="$2" peer="$3" compress="$4"
+    mkdir -p "$TEST_DIR/$name"
+    printf "server_name=%s\nlink_password=%s\n" $name $LINK_PASSWORD > "$TEST_DIR/$name/config.txt"
+    if [ ! -z "$peer" ]; then
+        printf "link_connect=127.0.0.1:%d\n" $peer >> "$TEST_DIR/$name/config.txt"
+    fi
+    if [ ! -z "$compress" ]; then
+        printf "link_compress=%d\n" $compress >> "$TEST_DIR/$name/config.txt"
+    fi
+    cp motd.txt "$TEST_DIR/$name/" 2>/dev/null
+    (cd "$TEST_DIR/$name" && exec ../../../ircserv $port $IRC_PASSWORD > server.log 2>&1) &
+    SERVER_PIDS+=($!)
+    sleep 1
+
+    if kill -0 $! 2>/dev/null; then
+        log_success "Server $name started (PID: $!)"
+        return 0
+    fi
+    log_error "Failed to start server $name"
+    return 1
+}
+
+stop_servers() {
+    log_info "Stopping servers..."
+    for pid in "${SERVER_PIDS[@]}"; do
+        kill -TERM $pid 2>/dev/null
+    done
+    sleep 1
+    for pid in "${SERVER_PIDS[@]}"; do
+        kill -KILL $pid 2>/dev/null
+        wait $pid 2>/dev/null
+    done
+    exec 3>&- 4>&- 2>/dev/null
+}
+
+test_burst() {
+    log_info ">>> Burst: a channel made before the other servers linked"
+    open_client 3 alice $ALPHA_PORT
+    send_line 3 "JOIN #net"
+    send_line 3 "TOPIC #net :linked topic"
+    start_node beta $BETA_PORT $ALPHA_PORT 6 || return
+    start_node gamma $GAMMA_PORT $BETA_PORT || return
+    one_shot_on $GAMMA_PORT carol "JOIN #net" "PRIVMSG #net :hello from gamma"
+    expect_log carol-$GAMMA_PORT "linked topic" "Topic reached gamma in the burst"
+    expect_log carol-$GAMMA_PORT "@alice" "Channel members reached gamma in the burst"
+    expect_log alice "carol JOIN" "Join on gamma seen on alpha"
+    expect_log alice "hello from gamma" "Channel message crossed two links"
+}
+
+test_private_and_nicks() {
+    log_info ">>> Private messages and nicks across servers"
+    open_client 4 gina $GAMMA_PORT
+    sleep 0.5
+    send_line 3 "PRIVMSG gina :hi gina"
+    sleep 0.5
+    expect_log gina "alice!alice@localhost PRIVMSG gina :hi gina" "Private message routed to gamma"
+    one_shot_on $BETA_PORT alice
+    expect_log alice-$BETA_PORT " 433 " "Nick of another server refused"
+}
+
+test_netsplit() {
+    log_info ">>> Netsplit: gamma goes away"
+    send_line 4 "JOIN #net"
+    sleep 0.5
+    kill -KILL ${SERVER_PIDS[2]} 2>/dev/null
+    wait ${SERVER_PIDS[2]} 2>/dev/null
+    sleep 1
+    expect_log alice "gina!gina@localhost QUIT :beta gamma" "Users of gamma quit on alpha"
+    one_shot_on $BETA_PORT gina
+    if grep -q " 433 " "$TEST_DIR/gina-$BETA_PORT.log"; then
+        log_error "Nick of a split server still taken"
+    else
+        log_success "Nicks of gamma released after the split"
+    fi
+}
+
+main() {
+    log_info "Starting Server Link Tests"
+    log_info "=========================="
+
+    rm -rf "$TEST_DIR"
+    mkdir -p "$TEST_DIR"
+    if ! start_node alpha $ALPHA_PORT; then
+        exit 1
+    fi
+    trap 'stop_servers' EXIT
+
+    test_burst
+    test_private_and_nicks
+    test_netsplit
+
+    log_info "=========================="
+    log_success "Passed: $TESTS_PASSED"
+    if [ $TESTS_FAILED -gt 0 ]; then
+        log_error "Failed: $TESTS_FAILED"
+        log_info "Logs available in: $TEST_DIR/"
+        exit 1
+    fi
+    log_success "All server link tests completed! 🎉"
+    exit 0
+}
+
+main "$@"
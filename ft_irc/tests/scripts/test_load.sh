@@ -0,0 +1,131 @@
+#!/bin/bash
+
+# Colors
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+IRC_PORT=6672
+IRC_PASSWORD="testpass123"
+SERVER_PID=""
+TEST_DIR="tests/load_logs"
+LOADGEN="${LOADGEN:-obj/loadgen}"
+LOAD_CLIENTS="${LOAD_CLIENTS:-100000}"    # target number of idle clients
+LOAD_BUDGET="${LOAD_BUDGET:-1024}"        # max server RSS bytes per idle client
+TESTS_PASSED=0
+TESTS_FAILED=0
+
+log_info() { echo -e "${BLUE}[INFO]${NC} $1"; }
+log_success() { echo -e "${GREEN}[PASS]${NC} $1"; ((TESTS_PASSED++)); }
+log_error() { echo -e "${RED}[FAIL]${NC} $1"; ((TESTS_FAILED++)); }
+log_warning() { echo -e "${YELLOW}[WARN]${NC} $1"; }
+
+# Both the server and the generator need one fd per client
+clamp_clients() {
+    local hard=$(ulimit -Hn)
+    if [ "$hard" != "unlimited" ] && [ $LOAD_CLIENTS -gt $(($hard - 100)) ]; then
+        log_warning "RLIMIT_NOFILE hard limit is $hard, testing $(($hard - 100)) clients instead of $LOAD_CLIENTS"
+        LOAD_CLIENTS=$(($hard - 100))
+    fi
+}
+
+# The server runs from TEST_DIR with its own config.txt, starting from a low
+# soft fd limit so the raise to max_connections is exercised too
+start_server() {
+    log_info "Starting IRC server with max_connections=$LOAD_CLIENTS..."
+    printf "max_connections=%d\n" $LOAD_CLIENTS > "$TEST_DIR/config.txt"
+    cp motd.txt "$TEST_DIR/" 2>/dev/null
+    (
+        ulimit -Sn 1024
+        cd "$TEST_DIR" && exec ../../ircserv $IRC_PORT $IRC_PASSWORD > server.log 2>&1
+    ) &
+    SERVER_PID=$!
+    sleep 2
+
+    if kill -0 $SERVER_PID 2>/dev/null; then
+        log_success "Server started (PID: $SERVER_PID)"
+        return 0
+    else
+        log_error "Failed to start server"
+        return 1
+    fi
+}
+
+stop_server() {
+    if [ ! -z "$SERVER_PID" ]; then
+        log_info "Stopping server..."
+        kill -TERM $SERVER_PID 2>/dev/null
+        sleep 2
+        if kill -0 $SERVER_PID 2>/dev/null; then
+            kill -KILL $SERVER_PID 2>/dev/null
+        fi
+        wait $SERVER_PID 2>/dev/null
+    fi
+}
+
+test_fd_limit() {
+    log_info "Checking the fd limit was raised..."
+    if grep -q "Accepting up to $LOAD_CLIENTS clients" "$TEST_DIR/server.log"; then
+        log_success "Server sized for $LOAD_CLIENTS clients"
+    else
+        log_error "Server did not reach max_connections=$LOAD_CLIENTS"
+        grep "Accepting up to\|RLIMIT" "$TEST_DIR/server.log"
+    fi
+}
+
+test_idle_clients() {
+    log_info ">>> Opening $LOAD_CLIENTS idle clients (budget $LOAD_BUDGET bytes each)"
+    if "$LOADGEN" $IRC_PORT $IRC_PASSWORD $LOAD_CLIENTS $SERVER_PID $LOAD_BUDGET \
+        > "$TEST_DIR/loadgen.log" 2>&1; then
+        log_success "$(grep "server RSS" "$TEST_DIR/loadgen.log")"
+    else
+        log_error "Load target missed:"
+        sed 's/^/        /' "$TEST_DIR/loadgen.log"
+    fi
+}
+
+# loadgen knocks once more while all its clients are still connected
+test_server_full() {
+    log_info "Checking the connection past max_connections..."
+    if grep -q "extra client: rejected" "$TEST_DIR/loadgen.log"; then
+        log_success "Extra client rejected with ERROR (Server full)"
+    else
+        log_error "Extra client was not rejected cleanly"
+    fi
+}
+
+main() {
+    log_info "Starting Load Tests"
+    log_info "==================="
+
+    if [ ! -x "$LOADGEN" ]; then
+        log_error "Load generator not found at $LOADGEN (run make test-load)"
+        exit 1
+    fi
+    mkdir -p "$TEST_DIR"
+    rm -f "$TEST_DIR"/*.log 2>/dev/null
+    clamp_clients
+
+    if ! start_server; then
+        exit 1
+    fi
+    trap 'stop_server' EXIT
+
+    test_fd_limit
+    test_idle_clients
+    test_server_full
+
+    log_info "==================="
+    log_success "Passed: $TESTS_PASSED"
+    if [ $TESTS_FAILED -gt 0 ]; then
+        log_error "Failed: $TESTS_FAILED"
+        log_info "Logs available in: $TEST_DIR/"
+        exit 1
+    fi
+    log_success "All load tests completed! 🎉"
+    exit 0
+}
+
+main "$@"
@@ -0,0 +1,43 @@
+#!/bin/bash
+
+# Colors
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+TEST_DIR="tests/load_logs"
+NICKSTRESS="${NICKSTRESS:-obj/nickstress}"
+NICK_THREADS="${NICK_THREADS:-16}"        # renaming threads
+NICK_RENAMES="${NICK_RENAMES:-200000}"    # renames per thread
+NICK_POOL="${NICK_POOL:-48}"              # nicks they fight over
+NICK_RACES="${NICK_RACES:-2000}"          # rounds of one nick claimed by all
+
+log_info() { echo -e "${BLUE}[INFO]${NC} $1"; }
+log_success() { echo -e "${GREEN}[PASS]${NC} $1"; }
+log_error() { echo -e "${RED}[FAIL]${NC} $1"; }
+
+main() {
+    log_info "Starting Nick Registry Stress Test"
+    log_info "=================================="
+
+    if [ ! -x "$NICKSTRESS" ]; then
+        log_error "Stress tool not found at $NICKSTRESS (run make test-nicks)"
+        exit 1
+    fi
+    mkdir -p "$TEST_DIR"
+
+    log_info ">>> $NICK_THREADS threads x $NICK_RENAMES renames over $NICK_POOL nicks"
+    if "$NICKSTRESS" $NICK_THREADS $NICK_RENAMES $NICK_POOL $NICK_RACES \
+        > "$TEST_DIR/nickstress.log" 2>&1; then
+        sed 's/^/        /' "$TEST_DIR/nickstress.log"
+        log_success "No nick ever had two owners"
+        exit 0
+    fi
+    sed 's/^/        /' "$TEST_DIR/nickstress.log"
+    log_error "Nick registry invariants broken"
+    exit 1
+}
+
+main "$@"
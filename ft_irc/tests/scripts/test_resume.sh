@@ -0,0 +1,163 @@
+#!/bin/bash
+
+IRC_PORT=6679
+IRC_PASSWORD="testpass123"
+TEST_DIR="tests/resume_logs"
+SERVER_PID=""
+
+. "$(dirname "$0")/lib_irc.sh"
+
+# Lost sessions wait three seconds for their RESUME
+start_server() {
+    mkdir -p "$TEST_DIR/server"
+    printf "resume_grace=3\n" > "$TEST_DIR/server/config.txt"
+    cp motd.txt "$TEST_DIR/server/" 2>/dev/null
+    (cd "$TEST_DIR/server" && exec ../../../ircserv $IRC_PORT $IRC_PASSWORD > server.log 2>&1) &
+    local pid=$!
+    sleep 1.5
+
+    if kill -0 $pid 2>/dev/null; then
+        log_success "Server started (PID: $pid)"
+        SERVER_PID=$pid
+        return 0
+    fi
+    log_error "Failed to start server"
+    return 1
+}
+
+stop_server() {
+    log_info "Stopping server..."
+    kill -TERM $SERVER_PID 2>/dev/null
+    sleep 1
+    kill -KILL $SERVER_PID 2>/dev/null
+    wait $SERVER_PID 2>/dev/null
+    kill $(jobs -p) 2>/dev/null
+    exec 3>&- 4>&- 5>&- 2>/dev/null
+}
+
+token_of() {
+    grep -o 'RESUME TOKEN [0-9a-f]*' "$TEST_DIR/$1.log" | tail -1 | cut -d' ' -f3
+}
+
+test_token() {
+    log_info ">>> Token at registration"
+    open_connection 3 alice1
+    ALICE_READER=$READER_PID
+    send_line 3 "CAP LS"
+    expect_log alice1 "CAP \* LS :.*draft/resume-0.5" "Capability offered"
+    printf "CAP REQ :draft/resume-0.5\r\nPASS %s\r\nNICK alice\r\nUSER alice 0 * :alice\r\nCAP END\r\n" \
+        $IRC_PASSWORD >&3
+    sleep 0.5
+    send_line 3 "JOIN #resume"
+    expect_log alice1 "RESUME TOKEN [0-9a-f]\{32\}" "Token sent with the welcome"
+
+    open_connection 4 bob
+    printf "PASS %s\r\nNICK bob\r\nUSER bob 0 * :bob\r\n" $IRC_PASSWORD >&4
+    sleep 0.5
+    send_line 4 "JOIN #resume"
+    reject_log bob "RESUME TOKEN" "No token without the capability"
+}
+
+test_resume() {
+    log_info ">>> Resume after a lost connection"
+    local token
+    token=$(token_of alice1)
+    drop_connection 3 $ALICE_READER
+    send_line 4 "PRIVMSG #resume :said while alice was away"
+    send_line 4 "NICK alice"
+    expect_log bob "433 bob alice" "Nick kept while detached"
+    reject_log bob "PART #resume" "Nobody saw alice leave"
+
+    open_connection 3 alice2
+    ALICE_READER=$READER_PID
+    printf "CAP REQ :draft/resume-0.5\r\nPASS %s\r\nRESUME %s\r\n" $IRC_PASSWORD "$token" >&3
+    sleep 0.5
+    expect_log alice2 "RESUME SUCCESS alice" "Session resumed"
+    expect_log alice2 "PRIVMSG #resume :said while alice was away" "Lines held meanwhile played"
+    reject_log alice2 " 001 " "No welcome burst"
+    reject_log alice2 "353" "No NAMES"
+    if [ "$(token_of alice2)" != "" ] && [ "$(token_of alice2)" != "$token" ]; then
+        log_success "New token after a resume"
+    else
+        log_error "New token after a resume"
+    fi
+    send_line 3 "PRIVMSG #resume :back again"
+    expect_log bob "alice!alice@localhost PRIVMSG #resume :back again" "Resumed client still in its channel"
+
+    open_connection 5 mallory
+    printf "PASS %s\r\nRESUME %s\r\n" $IRC_PASSWORD "$token" >&5
+    sleep 0.5
+    expect_log mallory "FAIL RESUME INVALID_TOKEN" "Used token refused"
+}
+
+test_expiry() {
+    log_info ">>> Session expiry"
+    local token
+    token=$(token_of alice2)
+    drop_connection 3 $ALICE_READER
+    sleep 4
+    expect_log bob "alice!alice@localhost PART #resume" "Session ended after resume_grace"
+    open_connection 3 alice3
+    printf "PASS %s\r\nRESUME %s\r\n" $IRC_PASSWORD "$token" >&3
+    sleep 0.5
+    expect_log alice3 "FAIL RESUME INVALID_TOKEN" "Expired token refused"
+}
+
+test_quit() {
+    log_info ">>> QUIT ends the session"
+    local token
+    drop_connection 3 $READER_PID
+    open_connection 3 alice4
+    ALICE_READER=$READER_PID
+    printf "CAP REQ :draft/resume-0.5\r\nPASS %s\r\nNICK alice\r\nUSER alice 0 * :alice\r\nCAP END\r\n" \
+        $IRC_PASSWORD >&3
+    sleep 0.5
+    send_line 3 "JOIN #resume"
+    token=$(token_of alice4)
+    send_line 3 "QUIT :gone for good"
+    expect_log alice4 "ERROR :Closing Link" "QUIT answered"
+    drop_connection 3 $ALICE_READER
+    expect_log bob "alice!alice@localhost QUIT :gone for good" "Channel saw alice quit"
+    send_line 4 "NICK alice"
+    expect_log bob "NICK :\?alice" "Nick free right after QUIT"
+    send_line 4 "WHO #resume"
+    if [ "$(grep -c " 352 alice #resume " "$TEST_DIR/bob.log")" = "1" ]; then
+        log_success "No ghost left in the channel"
+    else
+        log_error "No ghost left in the channel"
+    fi
+
+    open_connection 3 alice5
+    printf "PASS %s\r\nRESUME %s\r\n" $IRC_PASSWORD "$token" >&3
+    sleep 0.5
+    expect_log alice5 "FAIL RESUME INVALID_TOKEN" "Token of a QUIT refused"
+}
+
+main() {
+    log_info "Starting Session Resumption Tests"
+    log_info "================================="
+
+    rm -rf "$TEST_DIR"
+    mkdir -p "$TEST_DIR"
+    if ! start_server; then
+        exit 1
+    fi
+    trap 'stop_server' EXIT
+
+    test_token
+    test_resume
+    test_expiry
+    test_quit
+
+    log_info "================================="
+    log_success "Passed: $TESTS_PASSED"
+    if [ $TESTS_FAILED -gt 0 ]; then
+        log_error "Failed: $TESTS_FAILED"
+        log_info "Logs available in: $TEST_DIR/"
+        exit 1
+    fi
+    log_success "All session resumption tests completed! 🎉"
+    exit 0
+}
+
+main "$@"
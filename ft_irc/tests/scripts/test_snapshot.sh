@@ -0,0 +1,120 @@
+#!/bin/bash
+
+IRC_PORT=6678
+IRC_PASSWORD="testpass123"
+TEST_DIR="tests/snapshot_logs"
+SERVER_PID=""
+ONE_SHOT_TIMEOUT=4
+
+. "$(dirname "$0")/lib_irc.sh"
+
+# Every run uses the same directory, so the same snapshot file
+start_server() {
+    local n="$1"
+    mkdir -p "$TEST_DIR/server"
+    printf "snapshot_file=channels.snap\nsnapshot_interval=1\n" > "$TEST_DIR/server/config.txt"
+    cp motd.txt "$TEST_DIR/server/" 2>/dev/null
+    (cd "$TEST_DIR/server" && exec ../../../ircserv $IRC_PORT $IRC_PASSWORD > server$n.log 2>&1) &
+    SERVER_PID=$!
+    sleep 1
+
+    if kill -0 $SERVER_PID 2>/dev/null; then
+        log_success "Server run $n started (PID: $SERVER_PID)"
+        return 0
+    fi
+    log_error "Failed to start server run $n"
+    return 1
+}
+
+stop_server() {
+    local signal="${1:-TERM}"
+    kill -$signal $SERVER_PID 2>/dev/null
+    sleep 1
+    kill -KILL $SERVER_PID 2>/dev/null
+    wait $SERVER_PID 2>/dev/null
+    SERVER_PID=""
+    exec 3>&- 2>/dev/null
+}
+
+test_crash() {
+    log_info ">>> A crash keeps the last periodic snapshot"
+    # Only channels that exist are saved: alice stays in #kept
+    open_client 3 alice
+    send_line 3 "JOIN #kept"
+    send_line 3 "TOPIC #kept :from the snapshot"
+    send_line 3 "MODE #kept +kl sekret 7"
+    send_line 3 "JOIN #gone"
+    send_line 3 "PART #gone"
+    sleep 2
+    stop_server KILL
+    if [ -f "$TEST_DIR/server/channels.snap" ]; then
+        log_success "Snapshot written while running"
+    else
+        log_error "No snapshot written while running"
+    fi
+
+    start_server 2 || return
+    expect_log server/server2 "Loaded 1 channel" "Snapshot loaded at startup"
+    one_shot bob "LIST" "JOIN #kept sekret" "MODE #kept"
+    expect_log bob "#kept 0 :from the snapshot" "Channel and topic back"
+    expect_log bob "@bob" "First one in a restored channel is operator"
+    expect_log bob "#kept +tkl sekret 7" "Channel modes back"
+    if grep -q "#gone" "$TEST_DIR/bob.log"; then
+        log_error "Channel parted before the crash still listed"
+    else
+        log_success "Channel parted before the crash gone"
+    fi
+}
+
+test_shutdown() {
+    log_info ">>> A clean stop saves the latest state"
+    open_client 3 carol
+    send_line 3 "JOIN #kept sekret"
+    send_line 3 "TOPIC #kept :changed before the stop"
+    stop_server TERM
+    expect_log server/server2 "Saved 1 channel" "Snapshot written at shutdown"
+
+    start_server 3 || return
+    one_shot dave "LIST"
+    expect_log dave "#kept .*:changed before the stop" "Latest topic back"
+}
+
+test_damaged() {
+    log_info ">>> A damaged snapshot is set aside"
+    stop_server TERM
+    printf "not a snapshot" > "$TEST_DIR/server/channels.snap"
+    start_server 4 || return
+    if [ -f "$TEST_DIR/server/channels.snap.bad" ]; then
+        log_success "Damaged snapshot moved aside"
+    else
+        log_error "Damaged snapshot not moved aside"
+    fi
+}
+
+main() {
+    log_info "Starting Snapshot Tests"
+    log_info "======================="
+
+    rm -rf "$TEST_DIR"
+    mkdir -p "$TEST_DIR"
+    if ! start_server 1; then
+        exit 1
+    fi
+    trap 'stop_server' EXIT
+
+    test_crash
+    test_shutdown
+    test_damaged
+
+    log_info "======================="
+    log_success "Passed: $TESTS_PASSED"
+    if [ $TESTS_FAILED -gt 0 ]; then
+        log_error "Failed: $TESTS_FAILED"
+        log_info "Logs available in: $TEST_DIR/"
+        exit 1
+    fi
+    log_success "All snapshot tests completed! 🎉"
+    exit 0
+}
+
+main "$@"
@@ -0,0 +1,113 @@
+#!/bin/bash
+
+IRC_PORT=6676
+IRC_PASSWORD="testpass123"
+JOURNAL_PASSWORD="journalpass"
+TEST_DIR="tests/standby_logs"
+PRIMARY_PID=""
+STANDBY_PID=""
+
+. "$(dirname "$0")/lib_irc.sh"
+
+# Both servers run on the same port from their own directory: the standby
+# only listens once it took over
+start_node() {
+    local name="$1" primary="$2"
+    mkdir -p "$TEST_DIR/$name"
+    printf "journal_password=%s\n" $JOURNAL_PASSWORD > "$TEST_DIR/$name/config.txt"
+    if [ ! -z "$primary" ]; then
+        printf "standby_of=127.0.0.1:%d\n" $primary >> "$TEST_DIR/$name/config.txt"
+    fi
+    cp motd.txt "$TEST_DIR/$name/" 2>/dev/null
+    (cd "$TEST_DIR/$name" && exec ../../../ircserv $IRC_PORT $IRC_PASSWORD > server.log 2>&1) &
+    local pid=$!
+    sleep 1
+
+    if kill -0 $pid 2>/dev/null; then
+        log_success "Server $name started (PID: $pid)"
+        if [ -z "$primary" ]; then PRIMARY_PID=$pid; else STANDBY_PID=$pid; fi
+        return 0
+    fi
+    log_error "Failed to start server $name"
+    return 1
+}
+
+stop_servers() {
+    log_info "Stopping servers..."
+    for pid in $PRIMARY_PID $STANDBY_PID; do
+        kill -TERM $pid 2>/dev/null
+    done
+    sleep 1
+    for pid in $PRIMARY_PID $STANDBY_PID; do
+        kill -KILL $pid 2>/dev/null
+        wait $pid 2>/dev/null
+    done
+    exec 3>&- 4>&- 2>/dev/null
+}
+
+test_journal() {
+    log_info ">>> State before and after the standby started"
+    open_client 3 alice
+    send_line 3 "JOIN #early"
+    send_line 3 "TOPIC #early :from the snapshot"
+    start_node standby $IRC_PORT || return
+    expect_log standby/server "Standby in sync" "Standby got the snapshot"
+    open_client 4 bob
+    send_line 4 "JOIN #late"
+    send_line 4 "TOPIC #late :from the journal"
+    send_line 4 "MODE #late +k sekret"
+    send_line 3 "JOIN #gone"
+    send_line 3 "PART #gone"
+}
+
+test_takeover() {
+    log_info ">>> Failover: the primary goes away"
+    kill -KILL $PRIMARY_PID 2>/dev/null
+    wait $PRIMARY_PID 2>/dev/null
+    PRIMARY_PID=""
+    sleep 2
+    expect_log standby/server "Taking over" "Standby took over"
+    one_shot carol "LIST" "JOIN #late sekret" "MODE #late"
+    expect_log carol "#early 0 :from the snapshot" "Channel of the snapshot kept"
+    expect_log carol "#late 0 :from the journal" "Channel of the journal kept"
+    expect_log carol "@carol" "First one in a kept channel is operator"
+    expect_log carol "#late +tk sekret" "Channel modes kept"
+    if grep -q "#gone" "$TEST_DIR/carol.log"; then
+        log_error "Channel parted before the failover still listed"
+    else
+        log_success "Channel parted before the failover gone"
+    fi
+    one_shot alice
+    if grep -q " 433 " "$TEST_DIR/alice.log"; then
+        log_error "Nick of the primary still taken"
+    else
+        log_success "Nicks of the primary released"
+    fi
+}
+
+main() {
+    log_info "Starting Hot Standby Tests"
+    log_info "=========================="
+
+    rm -rf "$TEST_DIR"
+    mkdir -p "$TEST_DIR"
+    if ! start_node primary; then
+        exit 1
+    fi
+    trap 'stop_servers' EXIT
+
+    test_journal
+    test_takeover
+
+    log_info "=========================="
+    log_success "Passed: $TESTS_PASSED"
+    if [ $TESTS_FAILED -gt 0 ]; then
+        log_error "Failed: $TESTS_FAILED"
+        log_info "Logs available in: $TEST_DIR/"
+        exit 1
+    fi
+    log_success "All hot standby tests completed! 🎉"
+    exit 0
+}
+
+main "$@"
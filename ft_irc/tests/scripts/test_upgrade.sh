@@ -0,0 +1,107 @@
+#!/bin/bash
+
+IRC_PORT=6677
+IRC_PASSWORD="testpass123"
+TEST_DIR="tests/upgrade_logs"
+SERVER_PID=""
+
+. "$(dirname "$0")/lib_irc.sh"
+
+# Every generation runs from the same directory, with the same upgrade
+# socket: the one started last takes over from the one running
+start_generation() {
+    local n="$1"
+    mkdir -p "$TEST_DIR/server"
+    printf "upgrade_socket=upgrade.sock\n" > "$TEST_DIR/server/config.txt"
+    cp motd.txt "$TEST_DIR/server/" 2>/dev/null
+    (cd "$TEST_DIR/server" && exec ../../../ircserv $IRC_PORT $IRC_PASSWORD > server$n.log 2>&1) &
+    local pid=$!
+    sleep 1.5
+
+    if kill -0 $pid 2>/dev/null; then
+        log_success "Server generation $n started (PID: $pid)"
+        SERVER_PID=$pid
+        return 0
+    fi
+    log_error "Failed to start server generation $n"
+    return 1
+}
+
+stop_server() {
+    log_info "Stopping server..."
+    kill -TERM $SERVER_PID 2>/dev/null
+    sleep 1
+    kill -KILL $SERVER_PID 2>/dev/null
+    wait $SERVER_PID 2>/dev/null
+    exec 3>&- 4>&- 2>/dev/null
+}
+
+# Replace the running server, the old one has to exit by itself
+upgrade() {
+    local n="$1" old=$SERVER_PID
+    start_generation $n || return 1
+    sleep 0.5
+    if kill -0 $old 2>/dev/null; then
+        log_error "Generation $((n - 1)) still running after the upgrade"
+        kill -KILL $old 2>/dev/null
+    else
+        log_success "Generation $((n - 1)) handed over and exited"
+    fi
+    wait $old 2>/dev/null
+}
+
+test_upgrade() {
+    log_info ">>> Clients across two upgrades"
+    open_client 3 alice
+    open_client 4 bob
+    sleep 0.5
+    send_line 3 "JOIN #stay"
+    send_line 4 "JOIN #stay"
+    send_line 3 "TOPIC #stay :survives upgrades"
+    send_line 3 "MODE #stay +k sekret"
+    # Half a line is waiting in the old process when the upgrade comes
+    printf "PRIVMSG #stay :half" >&4
+    sleep 0.3
+
+    upgrade 2 || return
+    send_line 4 " a line"
+    expect_log alice "PRIVMSG #stay :half a line" "Line split by the upgrade delivered"
+    send_line 3 "PRIVMSG #stay :after the first upgrade"
+    expect_log bob "after the first upgrade" "Channel messages after the upgrade"
+
+    upgrade 3 || return
+    send_line 4 "TOPIC #stay"
+    send_line 4 "MODE #stay"
+    expect_log bob "survives upgrades" "Topic kept"
+    expect_log bob "#stay +tk sekret" "Channel modes kept"
+    send_line 4 "NICK alice"
+    expect_log bob " 433 " "Nicks of the clients still taken"
+    send_line 4 "PRIVMSG alice :still there"
+    expect_log alice "still there" "Private messages after two upgrades"
+}
+
+main() {
+    log_info "Starting Upgrade Tests"
+    log_info "======================"
+
+    rm -rf "$TEST_DIR"
+    mkdir -p "$TEST_DIR"
+    if ! start_generation 1; then
+        exit 1
+    fi
+    trap 'stop_server' EXIT
+
+    test_upgrade
+
+    log_info "======================"
+    log_success "Passed: $TESTS_PASSED"
+    if [ $TESTS_FAILED -gt 0 ]; then
+        log_error "Failed: $TESTS_FAILED"
+        log_info "Logs available in: $TEST_DIR/"
+        exit 1
+    fi
+    log_success "All upgrade tests completed! 🎉"
+    exit 0
+}
+
+main "$@"
@@ -0,0 +1,235 @@
+// Channel fan-out benchmark.
+// Puts <members> registered clients in one channel, has one of them send
+// <messages> lines to it and measures how long the server takes until every
+// other member has received all of them.
+//
+// usage: fanoutbench <port> <password> <members> <messages>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static const char* CHANNEL = "#bench";
+static const int TIMEOUT_SEC = 300;
+
+struct Conn
+{
+	int fd;
+	bool joined;
+	int received;  // benchmark lines seen
+	std::string inbox;
+};
+
+static double nowMs()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0);
+}
+
+static int openConnection(int port, int index, const std::string& password)
+{
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+	{
+		return (-1);
+	}
+
+	sockaddr_in server;
+	std::memset(&server, 0, sizeof(server));
+	server.sin_family = AF_INET;
+	server.sin_port = htons(port);
+	server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(fd, (sockaddr*)&server, sizeof(server)) < 0)
+	{
+		close(fd);
+		return (-1);
+	}
+
+	std::ostringstream hello;
+	hello << "PASS " << password << "\r\n"
+		  << "NICK fan" << index << "\r\n"
+		  << "USER fan" << index << " 0 * :fan\r\n"
+		  << "JOIN " << CHANNEL << "\r\n";
+	std::string data = hello.str();
+	if (send(fd, data.c_str(), data.size(), MSG_NOSIGNAL) != (ssize_t)data.size())
+	{
+		close(fd);
+		return (-1);
+	}
+	return (fd);
+}
+
+// Read whatever is pending, count JOIN confirmations and benchmark lines
+static void pump(std::vector<Conn>& conns, int timeoutMs)
+{
+	std::vector<pollfd> pfds(conns.size());
+	for (size_t i = 0; i < conns.size(); i++)
+	{
+		pfds[i].fd = conns[i].fd;
+		pfds[i].events = POLLIN;
+		pfds[i].revents = 0;
+	}
+	if (poll(pfds.data(), pfds.size(), timeoutMs) <= 0)
+	{
+		return;
+	}
+
+	char buffer[65536];
+	for (size_t i = 0; i < conns.size(); i++)
+	{
+		if (!pfds[i].revents)
+		{
+			continue;
+		}
+		ssize_t n = recv(conns[i].fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+		if (n <= 0)
+		{
+			continue;
+		}
+		conns[i].inbox.append(buffer, n);
+		size_t pos;
+		while ((pos = conns[i].inbox.find("\r\n")) != std::string::npos)
+		{
+			std::string line = conns[i].inbox.substr(0, pos);
+			conns[i].inbox.erase(0, pos + 2);
+			if (line.find(" :b ") != std::string::npos)
+			{
+				conns[i].received++;
+			}
+			else if (!conns[i].joined && line.find(" 366 ") != std::string::npos)
+			{
+				conns[i].joined = true;
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc != 5)
+	{
+		std::fprintf(stderr, "usage: %s <port> <password> <members> <messages>\n", argv[0]);
+		return (2);
+	}
+	int port = std::atoi(argv[1]);
+	std::string password = argv[2];
+	int members = std::atoi(argv[3]);
+	int messages = std::atoi(argv[4]);
+
+	struct rlimit limit;
+	getrlimit(RLIMIT_NOFILE, &limit);
+	limit.rlim_cur = limit.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &limit);
+
+	std::vector<Conn> conns;
+	for (int i = 0; i < members; i++)
+	{
+		Conn conn;
+		conn.fd = openConnection(port, i, password);
+		conn.joined = false;
+		conn.received = 0;
+		if (conn.fd < 0)
+		{
+			std::fprintf(stderr, "connection %d failed: %s\n", i, strerror(errno));
+			return (1);
+		}
+		conns.push_back(conn);
+		pump(conns, 0);
+	}
+
+	// Everyone in, and the JOIN burst drained
+	time_t deadline = time(NULL) + TIMEOUT_SEC;
+	size_t joined = 0;
+	while (joined < conns.size() && time(NULL) < deadline)
+	{
+		pump(conns, 100);
+		joined = 0;
+		for (size_t i = 0; i < conns.size(); i++)
+		{
+			joined += conns[i].joined;
+		}
+	}
+	while (time(NULL) < deadline)
+	{
+		size_t before = 0;
+		for (size_t i = 0; i < conns.size(); i++)
+		{
+			before += conns[i].inbox.size();
+		}
+		pump(conns, 500);
+		size_t after = 0;
+		for (size_t i = 0; i < conns.size(); i++)
+		{
+			after += conns[i].inbox.size();
+		}
+		if (before == after)
+		{
+			break;
+		}
+	}
+	if (joined < conns.size())
+	{
+		std::fprintf(stderr, "only %lu of %d members joined\n", (unsigned long)joined, members);
+		return (1);
+	}
+
+	// One sender, every other member has to see every line
+	std::ostringstream burst;
+	for (int i = 0; i < messages; i++)
+	{
+		burst << "PRIVMSG " << CHANNEL << " :b " << i << "\r\n";
+	}
+	std::string data = burst.str();
+	double start = nowMs();
+	size_t sent = 0;
+	while (sent < data.size())
+	{
+		ssize_t n = send(conns[0].fd, data.c_str() + sent, data.size() - sent, MSG_NOSIGNAL);
+		if (n < 0 && errno != EAGAIN)
+		{
+			std::fprintf(stderr, "send failed: %s\n", strerror(errno));
+			return (1);
+		}
+		if (n > 0)
+		{
+			sent += n;
+		}
+		pump(conns, 0);
+	}
+
+	long expected = (long)(members - 1) * messages;
+	long delivered = 0;
+	while (delivered < expected && time(NULL) < deadline)
+	{
+		pump(conns, 100);
+		delivered = 0;
+		for (size_t i = 1; i < conns.size(); i++)
+		{
+			delivered += conns[i].received;
+		}
+	}
+	double elapsed = nowMs() - start;
+
+	std::printf("members %d messages %d delivered %ld/%ld in %.1f ms (%.0f deliveries/s)\n",
+				members, messages, delivered, expected, elapsed,
+				delivered / (elapsed / 1000.0));
+	for (size_t i = 0; i < conns.size(); i++)
+	{
+		close(conns[i].fd);
+	}
+	return (delivered == expected ? 0 : 1);
+}
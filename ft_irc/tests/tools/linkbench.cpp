@@ -0,0 +1,295 @@
+// Server link burst benchmark.
+// Registers <users> clients spread over <channels> channels, then links to
+// the server as a new peer and measures how long the burst takes until
+// every user and channel arrived, with what it cost on the wire.
+//
+// usage: linkbench <port> <password> <link_password> <users> <channels>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ZStream.hpp"
+
+static const int TIMEOUT_SEC = 300;
+
+struct Conn
+{
+	int fd;
+	bool joined;
+	std::string inbox;
+};
+
+// What the benchmark link received
+struct Burst
+{
+	long users;     // UNICK lines
+	long channels;  // SJOIN lines
+	unsigned long bytes;
+	unsigned long frames;
+	unsigned long reads;
+	std::string raw;    // not decoded yet
+	std::string lines;  // decoded, not split yet
+};
+
+static double nowMs()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0);
+}
+
+static int openSocket(int port)
+{
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+	{
+		return (-1);
+	}
+
+	sockaddr_in server;
+	std::memset(&server, 0, sizeof(server));
+	server.sin_family = AF_INET;
+	server.sin_port = htons(port);
+	server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(fd, (sockaddr*)&server, sizeof(server)) < 0)
+	{
+		close(fd);
+		return (-1);
+	}
+	return (fd);
+}
+
+static bool sendAll(int fd, const std::string& data)
+{
+	return (send(fd, data.c_str(), data.size(), MSG_NOSIGNAL) == (ssize_t)data.size());
+}
+
+static int openUser(int port, int index, int channels, const std::string& password)
+{
+	int fd = openSocket(port);
+	if (fd < 0)
+	{
+		return (-1);
+	}
+
+	std::ostringstream hello;
+	hello << "PASS " << password << "\r\n"
+		  << "NICK lb" << index << "\r\n"
+		  << "USER lb" << index << " 0 * :link bench\r\n"
+		  << "JOIN #lb" << index % channels << "\r\n";
+	if (!sendAll(fd, hello.str()))
+	{
+		close(fd);
+		return (-1);
+	}
+	return (fd);
+}
+
+// Read whatever is pending for the users, count JOIN confirmations
+static void pump(std::vector<Conn>& conns, int timeoutMs)
+{
+	std::vector<pollfd> pfds(conns.size());
+	for (size_t i = 0; i < conns.size(); i++)
+	{
+		pfds[i].fd = conns[i].fd;
+		pfds[i].events = POLLIN;
+		pfds[i].revents = 0;
+	}
+	if (poll(pfds.data(), pfds.size(), timeoutMs) <= 0)
+	{
+		return;
+	}
+
+	char buffer[65536];
+	for (size_t i = 0; i < conns.size(); i++)
+	{
+		if (!pfds[i].revents)
+		{
+			continue;
+		}
+		ssize_t n = recv(conns[i].fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+		if (n <= 0)
+		{
+			continue;
+		}
+		conns[i].inbox.append(buffer, n);
+		size_t pos;
+		while ((pos = conns[i].inbox.find("\r\n")) != std::string::npos)
+		{
+			std::string line = conns[i].inbox.substr(0, pos);
+			conns[i].inbox.erase(0, pos + 2);
+			if (!conns[i].joined && line.find(" 366 ") != std::string::npos)
+			{
+				conns[i].joined = true;
+			}
+		}
+	}
+}
+
+// Split the link input into lines, inflating "Z <length>" frames the way
+// the server does, and count the burst lines
+static bool decode(Burst& burst, ZStream& inflater)
+{
+	size_t pos = 0;
+	size_t eol;
+
+	while ((eol = burst.raw.find("\r\n", pos)) != std::string::npos)
+	{
+		if (burst.raw.compare(pos, 2, "Z ") != 0)
+		{
+			burst.lines.append(burst.raw, pos, eol + 2 - pos);
+			pos = eol + 2;
+			continue;
+		}
+		size_t length = std::strtoul(burst.raw.c_str() + pos + 2, NULL, 10);
+		if (burst.raw.length() - (eol + 2) < length)
+		{
+			break;
+		}
+		if (!inflater.process(burst.raw.data() + eol + 2, length, burst.lines))
+		{
+			return (false);
+		}
+		burst.frames++;
+		pos = eol + 2 + length;
+	}
+	burst.raw.erase(0, pos);
+
+	pos = 0;
+	while ((eol = burst.lines.find("\r\n", pos)) != std::string::npos)
+	{
+		if (burst.lines.compare(pos, 6, "UNICK ") == 0)
+		{
+			burst.users++;
+		}
+		else if (burst.lines.compare(pos, 6, "SJOIN ") == 0)
+		{
+			burst.channels++;
+		}
+		else if (burst.lines.compare(pos, 6, "ERROR ") == 0)
+		{
+			std::fprintf(stderr, "link refused: %s\n",
+						 burst.lines.substr(pos, eol - pos).c_str());
+			return (false);
+		}
+		pos = eol + 2;
+	}
+	burst.lines.erase(0, pos);
+	return (true);
+}
+
+int main(int argc, char** argv)
+{
+	if (argc != 6)
+	{
+		std::fprintf(stderr, "usage: %s <port> <password> <link_password> <users> <channels>\n",
+					 argv[0]);
+		return (2);
+	}
+	int port = std::atoi(argv[1]);
+	std::string password = argv[2];
+	std::string linkPassword = argv[3];
+	int users = std::atoi(argv[4]);
+	int channels = std::atoi(argv[5]);
+	if (users < 1 || channels < 1 || channels > users)
+	{
+		std::fprintf(stderr, "need 1 <= channels <= users\n");
+		return (2);
+	}
+
+	struct rlimit limit;
+	getrlimit(RLIMIT_NOFILE, &limit);
+	limit.rlim_cur = limit.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &limit);
+
+	std::vector<Conn> conns;
+	for (int i = 0; i < users; i++)
+	{
+		Conn conn;
+		conn.fd = openUser(port, i, channels, password);
+		conn.joined = false;
+		if (conn.fd < 0)
+		{
+			std::fprintf(stderr, "connection %d failed: %s\n", i, strerror(errno));
+			return (1);
+		}
+		conns.push_back(conn);
+		pump(conns, 0);
+	}
+
+	time_t deadline = time(NULL) + TIMEOUT_SEC;
+	size_t joined = 0;
+	while (joined < conns.size() && time(NULL) < deadline)
+	{
+		pump(conns, 100);
+		joined = 0;
+		for (size_t i = 0; i < conns.size(); i++)
+		{
+			joined += conns[i].joined;
+		}
+	}
+	if (joined < conns.size())
+	{
+		std::fprintf(stderr, "only %lu of %d users joined\n", (unsigned long)joined, users);
+		return (1);
+	}
+
+	// Link in as a new server and take the burst
+	int link = openSocket(port);
+	if (link < 0 || !sendAll(link, "SERVER linkbench " + linkPassword + "\r\n"))
+	{
+		std::fprintf(stderr, "link failed: %s\n", strerror(errno));
+		return (1);
+	}
+	double start = nowMs();
+	Burst burst;
+	burst.users = 0;
+	burst.channels = 0;
+	burst.bytes = 0;
+	burst.frames = 0;
+	burst.reads = 0;
+	ZStream inflater(ZStream::INFLATE);
+	char buffer[65536];
+	while ((burst.users < users || burst.channels < channels) && time(NULL) < deadline)
+	{
+		ssize_t n = recv(link, buffer, sizeof(buffer), 0);
+		if (n <= 0)
+		{
+			std::fprintf(stderr, "link closed during the burst\n");
+			return (1);
+		}
+		burst.bytes += n;
+		burst.reads++;
+		burst.raw.append(buffer, n);
+		if (!decode(burst, inflater))
+		{
+			return (1);
+		}
+	}
+	double elapsed = nowMs() - start;
+
+	std::printf("users %d channels %d burst %ld/%d users %ld/%d channels, %lu bytes in %lu "
+				"frame(s) and %lu read(s) in %.1f ms\n",
+				users, channels, burst.users, users, burst.channels, channels, burst.bytes,
+				burst.frames, burst.reads, elapsed);
+	close(link);
+	for (size_t i = 0; i < conns.size(); i++)
+	{
+		close(conns[i].fd);
+	}
+	return (burst.users >= users && burst.channels >= channels ? 0 : 1);
+}
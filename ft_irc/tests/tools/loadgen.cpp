@@ -0,0 +1,252 @@
+// Connection load generator for the high-connection mode.
+// Opens <count> connections to the server, registers every one of them and
+// keeps them idle, then checks the server's resident memory per client.
+// One more connection is attempted at the end to see how a full server
+// turns it away.
+//
+// usage: loadgen <port> <password> <count> <server_pid> <bytes_per_client>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Each source address gets its own ephemeral port range
+static const int CLIENTS_PER_SOURCE = 25000;
+static const int CONNECT_BATCH = 500;
+static const int TIMEOUT_SEC = 120;
+
+struct Conn
+{
+	int fd;
+	bool registered;
+	std::string inbox;
+};
+
+static long readRssKb(int pid)
+{
+	std::ostringstream path;
+	path << "/proc/" << pid << "/status";
+	std::ifstream status(path.str().c_str());
+	std::string line;
+
+	while (std::getline(status, line))
+	{
+		if (line.compare(0, 6, "VmRSS:") == 0)
+		{
+			return (std::atol(line.c_str() + 6));
+		}
+	}
+	return (-1);
+}
+
+static int openConnection(int port, int index, const std::string& password)
+{
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+	{
+		return (-1);
+	}
+
+	sockaddr_in local;
+	std::memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = htonl(0x7f000001 + 1 + (index + 1) / CLIENTS_PER_SOURCE);
+	sockaddr_in server;
+	std::memset(&server, 0, sizeof(server));
+	server.sin_family = AF_INET;
+	server.sin_port = htons(port);
+	server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(fd, (sockaddr*)&local, sizeof(local)) < 0 ||
+		connect(fd, (sockaddr*)&server, sizeof(server)) < 0)
+	{
+		close(fd);
+		return (-1);
+	}
+
+	std::ostringstream hello;
+	hello << "PASS " << password << "\r\n"
+		  << "NICK load" << index << "\r\n"
+		  << "USER load" << index << " 0 * :load\r\n";
+	std::string data = hello.str();
+	if (send(fd, data.c_str(), data.size(), MSG_NOSIGNAL) != (ssize_t)data.size())
+	{
+		close(fd);
+		return (-1);
+	}
+	return (fd);
+}
+
+// Read whatever is pending on every connection, flag the registered ones
+static int pump(std::vector<Conn>& conns, int timeoutMs)
+{
+	std::vector<pollfd> pfds(conns.size());
+	for (size_t i = 0; i < conns.size(); i++)
+	{
+		pfds[i].fd = conns[i].fd;
+		pfds[i].events = POLLIN;
+		pfds[i].revents = 0;
+	}
+	if (poll(pfds.data(), pfds.size(), timeoutMs) <= 0)
+	{
+		return (0);
+	}
+
+	int closed = 0;
+	char buffer[4096];
+	for (size_t i = 0; i < conns.size(); i++)
+	{
+		if (!pfds[i].revents)
+		{
+			continue;
+		}
+		ssize_t n = recv(conns[i].fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+		if (n == 0 || (n < 0 && errno != EAGAIN))
+		{
+			close(conns[i].fd);
+			conns[i].fd = -1;  // poll() skips it from now on
+			closed++;
+			continue;
+		}
+		if (n > 0 && !conns[i].registered)
+		{
+			conns[i].inbox.append(buffer, n);
+			if (conns[i].inbox.find("Welcome") != std::string::npos)
+			{
+				conns[i].registered = true;
+				std::string().swap(conns[i].inbox);
+			}
+		}
+	}
+	return (closed);
+}
+
+// Knock once more while every client is still connected
+static bool probeServerFull(int port, const std::string& password)
+{
+	int fd = openConnection(port, -1, password);
+	if (fd < 0)
+	{
+		return (false);
+	}
+
+	std::string reply;
+	char buffer[512];
+	pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while (poll(&pfd, 1, 3000) > 0)
+	{
+		ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+		if (n <= 0)
+		{
+			break;
+		}
+		reply.append(buffer, n);
+	}
+	close(fd);
+	return (reply.find("Server full") != std::string::npos);
+}
+
+int main(int argc, char** argv)
+{
+	if (argc != 6)
+	{
+		std::fprintf(stderr,
+					 "usage: %s <port> <password> <count> <server_pid> <bytes_per_client>\n",
+					 argv[0]);
+		return (2);
+	}
+	int port = std::atoi(argv[1]);
+	std::string password = argv[2];
+	int count = std::atoi(argv[3]);
+	int serverPid = std::atoi(argv[4]);
+	long budget = std::atol(argv[5]);
+
+	struct rlimit limit;
+	getrlimit(RLIMIT_NOFILE, &limit);
+	limit.rlim_cur = limit.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &limit);
+
+	long rssBefore = readRssKb(serverPid);
+	if (rssBefore < 0)
+	{
+		std::fprintf(stderr, "cannot read RSS of pid %d\n", serverPid);
+		return (2);
+	}
+
+	std::vector<Conn> conns;
+	conns.reserve(count);
+	time_t deadline = time(NULL) + TIMEOUT_SEC;
+	int failed = 0;
+	for (int i = 0; i < count; i++)
+	{
+		Conn conn;
+		conn.fd = openConnection(port, i, password);
+		conn.registered = false;
+		if (conn.fd < 0)
+		{
+			failed++;
+			continue;
+		}
+		conns.push_back(conn);
+		if (i % CONNECT_BATCH == 0)
+		{
+			pump(conns, 0);
+		}
+	}
+
+	size_t registered = 0;
+	int closed = 0;
+	while (time(NULL) < deadline)
+	{
+		closed += pump(conns, 100);
+		registered = 0;
+		for (size_t i = 0; i < conns.size(); i++)
+		{
+			registered += conns[i].registered;
+		}
+		if (registered + closed >= conns.size())
+		{
+			break;
+		}
+	}
+
+	// Let the server settle before sampling its memory
+	sleep(1);
+	long rssAfter = readRssKb(serverPid);
+	long perClient = registered ? (rssAfter - rssBefore) * 1024 / (long)registered : 0;
+	bool rejected = probeServerFull(port, password);
+
+	std::printf("connections: %d requested, %d failed, %d closed, %lu registered\n",
+				count, failed, closed, (unsigned long)registered);
+	std::printf("server RSS: %ld kB -> %ld kB, %ld bytes per client (budget %ld)\n",
+				rssBefore, rssAfter, perClient, budget);
+	std::printf("extra client: %s\n", rejected ? "rejected (Server full)" : "not rejected");
+
+	for (size_t i = 0; i < conns.size(); i++)
+	{
+		if (conns[i].fd >= 0)
+		{
+			close(conns[i].fd);
+		}
+	}
+	if ((int)registered != count || perClient > budget)
+	{
+		return (1);
+	}
+	return (0);
+}
@@ -0,0 +1,283 @@
+// Stress test for the lock-free nick registry.
+// Every thread owns a few fake clients and renames them at random over a
+// small pool of nicks, so most claims collide, while reader threads look
+// nicks up the whole time. A per-nick holder count catches two owners at
+// once; at the end every nick must map to the client its thread believes
+// holds it. Then all threads race for the same fresh nick, round after
+// round, and exactly one may win each.
+//
+// usage: nickstress <threads> <renames_per_thread> <nick_pool> <races>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/time.h>
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Epoch.hpp"
+#include "NickRegistry.hpp"
+
+static const int CLIENTS_PER_THREAD = 4;
+static const int READERS = 2;
+
+static NickRegistry* g_registry;
+static std::vector<std::string> g_pool;
+static int* g_holders;  // per pool nick: clients that currently hold it
+static long g_violations = 0;
+static long g_lookups = 0;
+static volatile int g_writersLeft;
+static int g_renames;
+
+// Race phase
+static pthread_barrier_t g_barrier;
+static int g_races;
+static int* g_winners;  // per round
+
+struct Worker
+{
+	pthread_t thread;
+	int id;
+	int held[CLIENTS_PER_THREAD];  // pool index per client, -1 for none
+	long claims;
+	long failed;
+};
+
+// A fake client: the registry never dereferences its owners
+static Client* fakeClient(int thread, int slot)
+{
+	return (reinterpret_cast<Client*>((thread * CLIENTS_PER_THREAD + slot + 1) * 16L));
+}
+
+static std::string mixCase(const std::string& nick, unsigned int& seed)
+{
+	std::string mixed = nick;
+	for (size_t i = 0; i < mixed.size(); i++)
+	{
+		if (rand_r(&seed) & 1)
+		{
+			mixed[i] = std::tolower(mixed[i]);
+		}
+	}
+	return (mixed);
+}
+
+static void* renameLoop(void* arg)
+{
+	Worker* worker = static_cast<Worker*>(arg);
+	unsigned int seed = worker->id * 7919 + 1;
+
+	for (int i = 0; i < g_renames; i++)
+	{
+		int slot = rand_r(&seed) % CLIENTS_PER_THREAD;
+		int target = rand_r(&seed) % g_pool.size();
+		Client* client = fakeClient(worker->id, slot);
+		int old = worker->held[slot];
+
+		if (old == target)
+		{
+			continue;
+		}
+		worker->claims++;
+		if (!g_registry->claim(mixCase(g_pool[target], seed), client))
+		{
+			worker->failed++;
+			continue;
+		}
+		if (__atomic_add_fetch(&g_holders[target], 1, __ATOMIC_SEQ_CST) != 1)
+		{
+			__atomic_add_fetch(&g_violations, 1, __ATOMIC_RELAXED);
+		}
+		if (old >= 0)
+		{
+			__atomic_sub_fetch(&g_holders[old], 1, __ATOMIC_SEQ_CST);
+			g_registry->release(g_pool[old], client);
+		}
+		worker->held[slot] = target;
+
+		// Now and then a client disconnects
+		if (rand_r(&seed) % 16 == 0)
+		{
+			__atomic_sub_fetch(&g_holders[target], 1, __ATOMIC_SEQ_CST);
+			g_registry->release(g_pool[target], client);
+			worker->held[slot] = -1;
+		}
+	}
+	__atomic_sub_fetch(&g_writersLeft, 1, __ATOMIC_RELEASE);
+	return (NULL);
+}
+
+static void* lookupLoop(void* arg)
+{
+	unsigned int seed = *static_cast<int*>(arg);
+	long lookups = 0;
+
+	while (__atomic_load_n(&g_writersLeft, __ATOMIC_ACQUIRE) > 0)
+	{
+		Client* owner = g_registry->find(g_pool[rand_r(&seed) % g_pool.size()]);
+		// Owners are fake pointers: only the range is checked
+		long value = reinterpret_cast<long>(owner);
+		if (value % 16 != 0)
+		{
+			__atomic_add_fetch(&g_violations, 1, __ATOMIC_RELAXED);
+		}
+		lookups++;
+	}
+	__atomic_add_fetch(&g_lookups, lookups, __ATOMIC_RELAXED);
+	return (NULL);
+}
+
+static void* raceLoop(void* arg)
+{
+	Worker* worker = static_cast<Worker*>(arg);
+	Client* client = fakeClient(worker->id, 0);
+
+	for (int round = 0; round < g_races; round++)
+	{
+		std::ostringstream nick;
+		nick << "race" << round;
+		pthread_barrier_wait(&g_barrier);
+		if (g_registry->claim(nick.str(), client))
+		{
+			__atomic_add_fetch(&g_winners[round], 1, __ATOMIC_RELAXED);
+		}
+	}
+	return (NULL);
+}
+
+static double now()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec + tv.tv_usec / 1e6);
+}
+
+int main(int argc, char** argv)
+{
+	if (argc != 5)
+	{
+		std::fprintf(stderr, "usage: %s <threads> <renames_per_thread> <nick_pool> <races>\n",
+					 argv[0]);
+		return (2);
+	}
+	int threads = std::atoi(argv[1]);
+	g_renames = std::atoi(argv[2]);
+	int poolSize = std::atoi(argv[3]);
+	g_races = std::atoi(argv[4]);
+	if (threads < 2 || g_renames < 1 || poolSize < 1 || g_races < 1)
+	{
+		std::fprintf(stderr, "invalid arguments\n");
+		return (2);
+	}
+
+	NickRegistry registry;
+	g_registry = &registry;
+	for (int i = 0; i < poolSize; i++)
+	{
+		std::ostringstream nick;
+		nick << "NICK" << i;
+		g_pool.push_back(nick.str());
+	}
+	g_holders = new int[poolSize]();
+
+	// Renames against lookups
+	std::vector<Worker> workers(threads);
+	g_writersLeft = threads;
+	double start = now();
+	for (int t = 0; t < threads; t++)
+	{
+		workers[t].id = t;
+		workers[t].claims = 0;
+		workers[t].failed = 0;
+		for (int c = 0; c < CLIENTS_PER_THREAD; c++)
+		{
+			workers[t].held[c] = -1;
+		}
+		pthread_create(&workers[t].thread, NULL, renameLoop, &workers[t]);
+	}
+	pthread_t readers[READERS];
+	int seeds[READERS];
+	for (int r = 0; r < READERS; r++)
+	{
+		seeds[r] = r + 1;
+		pthread_create(&readers[r], NULL, lookupLoop, &seeds[r]);
+	}
+	for (int t = 0; t < threads; t++)
+	{
+		pthread_join(workers[t].thread, NULL);
+	}
+	for (int r = 0; r < READERS; r++)
+	{
+		pthread_join(readers[r], NULL);
+	}
+	double elapsed = now() - start;
+
+	// Everything the threads hold must be what the registry says
+	long claims = 0;
+	long failed = 0;
+	size_t held = 0;
+	long mismatches = 0;
+	std::vector<Client*> expected(poolSize, (Client*)NULL);
+	for (int t = 0; t < threads; t++)
+	{
+		claims += workers[t].claims;
+		failed += workers[t].failed;
+		for (int c = 0; c < CLIENTS_PER_THREAD; c++)
+		{
+			if (workers[t].held[c] >= 0)
+			{
+				expected[workers[t].held[c]] = fakeClient(t, c);
+				held++;
+			}
+		}
+	}
+	for (int i = 0; i < poolSize; i++)
+	{
+		if (registry.find(g_pool[i]) != expected[i])
+		{
+			mismatches++;
+		}
+	}
+	if (registry.size() != held)
+	{
+		mismatches++;
+	}
+
+	// Simultaneous claims of one nick
+	g_winners = new int[g_races]();
+	pthread_barrier_init(&g_barrier, NULL, threads);
+	for (int t = 0; t < threads; t++)
+	{
+		pthread_create(&workers[t].thread, NULL, raceLoop, &workers[t]);
+	}
+	for (int t = 0; t < threads; t++)
+	{
+		pthread_join(workers[t].thread, NULL);
+	}
+	pthread_barrier_destroy(&g_barrier);
+	int badRaces = 0;
+	for (int round = 0; round < g_races; round++)
+	{
+		badRaces += (g_winners[round] != 1);
+	}
+
+	std::printf("renames: %ld claims, %ld refused, %.0f claims/s with %d threads\n", claims,
+				failed, claims / elapsed, threads);
+	std::printf("lookups: %ld during the run\n", g_lookups);
+	std::printf("owners: %ld double claims, %ld mismatches, %lu nicks held\n", g_violations,
+				mismatches, (unsigned long)held);
+	std::printf("races: %d rounds, %d without exactly one winner\n", g_races, badRaces);
+
+	delete[] g_holders;
+	delete[] g_winners;
+	Epoch::drain();
+	if (g_violations || mismatches || badRaces)
+	{
+		return (1);
+	}
+	return (0);
+}